@@ -2103,6 +2103,10 @@ int virDomainDetachDevice(virDomainPtr domain, const char *xml);
 
 int virDomainAttachDeviceFlags(virDomainPtr domain,
                                const char *xml, unsigned int flags);
+int virDomainAttachDevices(virDomainPtr domain,
+                           const char **xmls,
+                           unsigned int nxmls,
+                           unsigned int flags);
 int virDomainDetachDeviceFlags(virDomainPtr domain,
                                const char *xml, unsigned int flags);
 int virDomainUpdateDeviceFlags(virDomainPtr domain,
@@ -2160,6 +2164,62 @@ int virDomainListGetStats(virDomainPtr *doms,
 
 void virDomainStatsRecordListFree(virDomainStatsRecordPtr *stats);
 
+/**
+ * virConnectDomainStatsRecordCallback:
+ * @conn: connection object
+ * @record: statistics of a single domain
+ * @opaque: application specific data
+ *
+ * Callback invoked by virConnectGetAllDomainStatsChunked() for every
+ * domain record as soon as the chunk containing it was collected. The
+ * callback must not free @record (it will be freed once the callback
+ * finishes); it may take a reference to @record->dom with virDomainRef().
+ *
+ * Returns 0 to continue the iteration, -1 to stop it.
+ */
+typedef int (*virConnectDomainStatsRecordCallback)(virConnectPtr conn,
+                                                   virDomainStatsRecordPtr record,
+                                                   void *opaque);
+
+int virConnectGetAllDomainStatsChunked(virConnectPtr conn,
+                                       unsigned int stats,
+                                       unsigned int chunk,
+                                       virConnectDomainStatsRecordCallback cb,
+                                       void *opaque,
+                                       unsigned int flags);
+
+/**
+ * virConnectDomainStatsCallback:
+ * @conn: connection object
+ * @dom: domain the statistics were sampled from
+ * @params: statistics stored as an array of virTypedParameter
+ * @nparams: size of the params array
+ * @opaque: application specific data
+ *
+ * This callback occurs each time the statistics of a subscription made
+ * with virConnectDomainStatsRegister() are sampled. The params array uses
+ * the same field names as virConnectGetAllDomainStats() and contains only
+ * the groups requested by the subscription. The callback must not free
+ * @params (the array will be freed once the callback finishes).
+ */
+typedef void (*virConnectDomainStatsCallback)(virConnectPtr conn,
+                                              virDomainPtr dom,
+                                              virTypedParameterPtr params,
+                                              int nparams,
+                                              void *opaque);
+
+int virConnectDomainStatsRegister(virConnectPtr conn,
+                                  virDomainPtr dom,
+                                  unsigned int stats,
+                                  unsigned int interval,
+                                  virConnectDomainStatsCallback cb,
+                                  void *opaque,
+                                  virFreeCallback freecb,
+                                  unsigned int flags);
+
+int virConnectDomainStatsDeregister(virConnectPtr conn,
+                                    int callbackID);
+
 /*
  * Perf Event API
  */
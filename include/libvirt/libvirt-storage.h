@@ -86,6 +86,12 @@ typedef enum {
     VIR_STORAGE_POOL_CREATE_WITH_BUILD_NO_OVERWRITE = 1 << 2,
 } virStoragePoolCreateFlags;
 
+typedef enum {
+    /* Discard the cached volume list and re-probe every volume, instead
+     * of only re-probing volumes which changed since the last refresh */
+    VIR_STORAGE_POOL_REFRESH_FULL = 1 << 0,
+} virStoragePoolRefreshFlags;
+
 typedef struct _virStoragePoolInfo virStoragePoolInfo;
 
 struct _virStoragePoolInfo {
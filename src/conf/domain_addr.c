@@ -21,6 +21,8 @@
 
 #include <config.h>
 
+#include <strings.h>
+
 #include "viralloc.h"
 #include "virlog.h"
 #include "virstring.h"
@@ -500,10 +502,34 @@ virDomainPCIAddressValidate(virDomainPCIAddressSetPtr addrs,
 }
 
 
+verify(VIR_PCI_ADDRESS_SLOT_LAST < 32);
+
+/* Recompute the freeSlots and aggregateSlots bits for @slot on @bus */
+static void
+virDomainPCIAddressBusUpdateSlot(virDomainPCIAddressBusPtr bus,
+                                 size_t slot)
+{
+    uint32_t bit = 1U << slot;
+
+    bus->freeSlots &= ~bit;
+    bus->aggregateSlots &= ~bit;
+
+    if (slot < bus->minSlot || slot > bus->maxSlot)
+        return;
+
+    if (!bus->slot[slot].functions)
+        bus->freeSlots |= bit;
+    if (bus->slot[slot].aggregate && bus->slot[slot].functions != 0xff)
+        bus->aggregateSlots |= bit;
+}
+
+
 int
 virDomainPCIAddressBusSetModel(virDomainPCIAddressBusPtr bus,
                                virDomainControllerModelPCI model)
 {
+    size_t i;
+
     /* set flags for what can be connected *downstream* from each
      * bus.
      */
@@ -599,6 +625,10 @@ virDomainPCIAddressBusSetModel(virDomainPCIAddressBusPtr bus,
     }
 
     bus->model = model;
+
+    for (i = 0; i <= VIR_PCI_ADDRESS_SLOT_LAST; i++)
+        virDomainPCIAddressBusUpdateSlot(bus, i);
+
     return 0;
 }
 
@@ -606,28 +636,17 @@ virDomainPCIAddressBusSetModel(virDomainPCIAddressBusPtr bus,
 bool
 virDomainPCIAddressBusIsFullyReserved(virDomainPCIAddressBusPtr bus)
 {
-    size_t i;
-
-    for (i = bus->minSlot; i <= bus->maxSlot; i++) {
-        if (!bus->slot[i].functions)
-            return false;
-    }
-
-    return true;
+    return !bus->freeSlots;
 }
 
 
 static bool ATTRIBUTE_NONNULL(1)
 virDomainPCIAddressBusIsEmpty(virDomainPCIAddressBusPtr bus)
 {
-    size_t i;
-
-    for (i = bus->minSlot; i <= bus->maxSlot; i++) {
-        if (bus->slot[i].functions)
-            return false;
-    }
+    uint32_t range = (UINT32_MAX >> (VIR_PCI_ADDRESS_SLOT_LAST - bus->maxSlot)) &
+                     ~((1U << bus->minSlot) - 1);
 
-    return true;
+    return bus->freeSlots == range;
 }
 
 
@@ -886,6 +905,7 @@ virDomainPCIAddressReserveAddrInternal(virDomainPCIAddressSetPtr addrs,
 
     /* mark the requested function as reserved */
     bus->slot[addr->slot].functions |= (1 << addr->function);
+    virDomainPCIAddressBusUpdateSlot(bus, addr->slot);
     VIR_DEBUG("Reserving PCI address %s (aggregate='%s')", addrStr,
               bus->slot[addr->slot].aggregate ? "true" : "false");
 
@@ -973,7 +993,10 @@ void
 virDomainPCIAddressReleaseAddr(virDomainPCIAddressSetPtr addrs,
                                virPCIDeviceAddressPtr addr)
 {
-    addrs->buses[addr->bus].slot[addr->slot].functions &= ~(1 << addr->function);
+    virDomainPCIAddressBusPtr bus = &addrs->buses[addr->bus];
+
+    bus->slot[addr->slot].functions &= ~(1 << addr->function);
+    virDomainPCIAddressBusUpdateSlot(bus, addr->slot);
 }
 
 
@@ -1097,70 +1120,65 @@ virDomainPCIAddressSetFree(virDomainPCIAddressSetPtr addrs)
 }
 
 
-static int
+/*
+ * Look for a slot on @bus, starting from @searchAddr->slot, that a
+ * device with connection @flags can use: either a completely unused
+ * one or, if the device can aggregate, an aggregate slot with a free
+ * function (@searchAddr->function, or any if @function is -1).
+ * Returns true and updates @searchAddr if one was found.
+ */
+static bool
 virDomainPCIAddressFindUnusedFunctionOnBus(virDomainPCIAddressBusPtr bus,
                                            virPCIDeviceAddressPtr searchAddr,
                                            int function,
-                                           virDomainPCIConnectFlags flags,
-                                           bool *found)
+                                           virDomainPCIConnectFlags flags)
 {
-    int ret = -1;
-    char *addrStr = NULL;
+    uint32_t candidates = bus->freeSlots;
 
-    *found = false;
+    if (flags & VIR_PCI_CONNECT_AGGREGATE_SLOT)
+        candidates |= bus->aggregateSlots;
 
-    if (!(addrStr = virPCIDeviceAddressAsString(searchAddr)))
-        goto cleanup;
+    candidates &= ~((1U << searchAddr->slot) - 1);
+
+    if (!candidates)
+        return false;
 
-    if (!virDomainPCIAddressFlagsCompatible(searchAddr, addrStr, bus->flags,
+    if (!virDomainPCIAddressFlagsCompatible(searchAddr, NULL, bus->flags,
                                             flags, false, false)) {
         VIR_DEBUG("PCI bus %.4x:%.2x is not compatible with the device",
                   searchAddr->domain, searchAddr->bus);
-    } else {
-        while (searchAddr->slot <= bus->maxSlot) {
-            if (bus->slot[searchAddr->slot].functions == 0) {
-                *found = true;
-                break;
-            }
+        return false;
+    }
 
-            if (flags & VIR_PCI_CONNECT_AGGREGATE_SLOT &&
-                bus->slot[searchAddr->slot].aggregate) {
-                /* slot and device are okay with aggregating devices */
-                if ((bus->slot[searchAddr->slot].functions &
-                     (1 << searchAddr->function)) == 0) {
-                    *found = true;
-                    break;
-                }
+    while (candidates) {
+        unsigned int slot = ffs(candidates) - 1;
+        uint8_t functions = bus->slot[slot].functions;
 
-                /* also check for *any* unused function if caller
-                 * sent function = -1
-                 */
-                if (function == -1) {
-                    while (searchAddr->function < 8) {
-                        if ((bus->slot[searchAddr->slot].functions &
-                             (1 << searchAddr->function)) == 0) {
-                            *found = true;
-                            break; /* out of inner while */
-                        }
-                        searchAddr->function++;
-                    }
-                    if (*found)
-                       break; /* out of outer while */
-                    searchAddr->function = 0; /* reset for next try */
-                }
-            }
+        candidates &= ~(1U << slot);
 
-            VIR_DEBUG("PCI slot %.4x:%.2x:%.2x already in use",
-                      searchAddr->domain, searchAddr->bus, searchAddr->slot);
-            searchAddr->slot++;
+        if (!functions) {
+            searchAddr->slot = slot;
+            return true;
         }
-    }
 
-    ret = 0;
+        /* slot and device are okay with aggregating devices; if the
+         * caller sent function = -1, take the lowest unused one */
+        if (function == -1) {
+            searchAddr->slot = slot;
+            searchAddr->function = ffs(~functions & 0xff) - 1;
+            return true;
+        }
 
- cleanup:
-    VIR_FREE(addrStr);
-    return ret;
+        if (!(functions & (1 << searchAddr->function))) {
+            searchAddr->slot = slot;
+            return true;
+        }
+
+        VIR_DEBUG("PCI slot %.4x:%.2x:%.2x already in use",
+                  searchAddr->domain, searchAddr->bus, slot);
+    }
+
+    return false;
 }
 
 
@@ -1190,7 +1208,6 @@ virDomainPCIAddressGetNextAddr(virDomainPCIAddressSetPtr addrs,
      * group will end up on the same bus */
     for (a.bus = 0; a.bus < addrs->nbuses; a.bus++) {
         virDomainPCIAddressBusPtr bus = &addrs->buses[a.bus];
-        bool found = false;
 
         if (bus->isolationGroup != isolationGroup)
             continue;
@@ -1198,11 +1215,7 @@ virDomainPCIAddressGetNextAddr(virDomainPCIAddressSetPtr addrs,
         a.slot = bus->minSlot;
 
         if (virDomainPCIAddressFindUnusedFunctionOnBus(bus, &a, function,
-                                                       flags, &found) < 0) {
-            goto error;
-        }
-
-        if (found)
+                                                       flags))
             goto success;
     }
 
@@ -1211,7 +1224,6 @@ virDomainPCIAddressGetNextAddr(virDomainPCIAddressSetPtr addrs,
      * group for a bus that's currently empty. So let's try that */
     for (a.bus = 0; a.bus < addrs->nbuses; a.bus++) {
         virDomainPCIAddressBusPtr bus = &addrs->buses[a.bus];
-        bool found = false;
 
         /* We can only change the isolation group for a bus when
          * plugging in the first device; moreover, some buses are
@@ -1221,14 +1233,10 @@ virDomainPCIAddressGetNextAddr(virDomainPCIAddressSetPtr addrs,
 
         a.slot = bus->minSlot;
 
-        if (virDomainPCIAddressFindUnusedFunctionOnBus(bus, &a, function,
-                                                       flags, &found) < 0) {
-            goto error;
-        }
-
         /* The isolation group for the bus will actually be changed
          * later, in virDomainPCIAddressReserveAddrInternal() */
-        if (found)
+        if (virDomainPCIAddressFindUnusedFunctionOnBus(bus, &a, function,
+                                                       flags))
             goto success;
     }
 
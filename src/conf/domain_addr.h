@@ -106,6 +106,16 @@ typedef struct {
      */
     virDomainPCIAddressSlot slot[VIR_PCI_ADDRESS_SLOT_LAST + 1];
 
+    /* Bit N of freeSlots is set if slot N is within minSlot..maxSlot
+     * and none of its functions are in use. Bit N of aggregateSlots
+     * is set if slot N is within range, is an aggregate slot and
+     * still has at least one unused function. Both are kept up to
+     * date whenever a function is reserved or released, so that
+     * searching for a free slot doesn't need to look at each one.
+     */
+    uint32_t freeSlots;
+    uint32_t aggregateSlots;
+
     /* See virDomainDeviceInfo::isolationGroup */
     unsigned int isolationGroup;
 
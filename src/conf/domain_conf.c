@@ -2519,6 +2519,8 @@ virDomainChrSourceDefCopy(virDomainChrSourceDefPtr dest,
         if (VIR_STRDUP(dest->data.tcp.service, src->data.tcp.service) < 0)
             return -1;
 
+        dest->data.tcp.listen = src->data.tcp.listen;
+        dest->data.tcp.protocol = src->data.tcp.protocol;
         dest->data.tcp.haveTLS = src->data.tcp.haveTLS;
         dest->data.tcp.tlsFromConfig = src->data.tcp.tlsFromConfig;
 
@@ -2530,6 +2532,7 @@ virDomainChrSourceDefCopy(virDomainChrSourceDefPtr dest,
         if (VIR_STRDUP(dest->data.nix.path, src->data.nix.path) < 0)
             return -1;
 
+        dest->data.nix.listen = src->data.nix.listen;
         dest->data.nix.reconnect.enabled = src->data.nix.reconnect.enabled;
         dest->data.nix.reconnect.timeout = src->data.nix.reconnect.timeout;
         break;
@@ -2541,8 +2544,22 @@ virDomainChrSourceDefCopy(virDomainChrSourceDefPtr dest,
             return -1;
 
         break;
+
+    case VIR_DOMAIN_CHR_TYPE_SPICEVMC:
+        dest->data.spicevmc = src->data.spicevmc;
+        break;
+
+    case VIR_DOMAIN_CHR_TYPE_SPICEPORT:
+        if (VIR_STRDUP(dest->data.spiceport.channel,
+                       src->data.spiceport.channel) < 0)
+            return -1;
+        break;
     }
 
+    if (VIR_STRDUP(dest->logfile, src->logfile) < 0)
+        return -1;
+    dest->logappend = src->logappend;
+
     dest->type = src->type;
 
     return 0;
@@ -29122,30 +29139,1213 @@ virDomainDiskDefForeachPath(virDomainDiskDefPtr disk,
 }
 
 
-/* Copy src into a new definition; with the quality of the copy
- * depending on the migratable flag (false for transitions between
- * persistent and active, true for transitions across save files or
- * snapshots).  */
-virDomainDefPtr
-virDomainDefCopy(virDomainDefPtr src,
-                 virCapsPtr caps,
-                 virDomainXMLOptionPtr xmlopt,
-                 void *parseOpaque,
-                 bool migratable)
+/*
+ * Native copies of domain definitions.
+ *
+ * Formatting a definition to XML and parsing it back is the easiest way
+ * to clone it, but it is also by far the most expensive one and it is done
+ * every time a domain is started.  The helpers below copy inactive
+ * definitions structurally instead.  They only handle the devices and
+ * settings most domains are made of and they reset the same runtime-only
+ * state an inactive parse would drop; definitions using anything else are
+ * rejected by virDomainDefCopyNativeSupported() and go through XML.
+ */
+static bool
+virDomainDefCopyNativeSupported(const virDomainDef *def)
 {
-    unsigned int format_flags = VIR_DOMAIN_DEF_FORMAT_SECURE;
-    unsigned int parse_flags = VIR_DOMAIN_DEF_PARSE_INACTIVE |
-                               VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE;
-    VIR_AUTOFREE(char *) xml = NULL;
+    size_t i;
 
-    if (migratable)
-        format_flags |= VIR_DOMAIN_DEF_FORMAT_INACTIVE | VIR_DOMAIN_DEF_FORMAT_MIGRATABLE;
+    if (def->id != -1 || def->postParseFailed || def->namespaceData)
+        return false;
 
-    /* Easiest to clone via a round-trip through XML.  */
-    if (!(xml = virDomainDefFormat(src, caps, format_flags)))
+    if (def->nresctrls || def->nfss || def->nhostdevs || def->nredirdevs ||
+        def->nsmartcards || def->nleases || def->nhubs || def->nshmems ||
+        def->nmems || def->nseclabels)
+        return false;
+
+    if (def->sysinfo || def->tpm || def->nvram || def->redirfilter ||
+        def->vsock)
+        return false;
+
+    for (i = 0; i < def->ndisks; i++) {
+        if (def->disks[i]->mirror || def->disks[i]->src->backingStore)
+            return false;
+    }
+
+    for (i = 0; i < def->nnets; i++) {
+        virDomainNetDefPtr net = def->nets[i];
+
+        if (net->type == VIR_DOMAIN_NET_TYPE_NETWORK) {
+            if (net->data.network.actual)
+                return false;
+        } else if (net->type != VIR_DOMAIN_NET_TYPE_BRIDGE &&
+                   net->type != VIR_DOMAIN_NET_TYPE_DIRECT &&
+                   net->type != VIR_DOMAIN_NET_TYPE_ETHERNET &&
+                   net->type != VIR_DOMAIN_NET_TYPE_USER) {
+            return false;
+        }
+
+        if (net->hostIP.nips || net->hostIP.nroutes ||
+            net->guestIP.nips || net->guestIP.nroutes)
+            return false;
+    }
+
+    return true;
+}
+
+
+static int
+virDomainVirtioOptionsCopy(virDomainVirtioOptionsPtr *dst,
+                           const virDomainVirtioOptions *src)
+{
+    if (!src)
+        return 0;
+
+    if (VIR_ALLOC(*dst) < 0)
+        return -1;
+
+    **dst = *src;
+    return 0;
+}
+
+
+static int
+virDomainDeviceInfoCopyInactive(virDomainDeviceInfoPtr dst,
+                                virDomainDeviceInfoPtr src,
+                                virDomainXMLOptionPtr xmlopt)
+{
+    if (virDomainDeviceInfoCopy(dst, src) < 0)
+        return -1;
+
+    /* only user aliases survive parsing an inactive definition */
+    if (dst->alias &&
+        !(xmlopt->config.features & VIR_DOMAIN_DEF_FEATURE_USER_ALIAS &&
+          virDomainDeviceAliasIsUserAlias(dst->alias) &&
+          strspn(dst->alias, USER_ALIAS_CHARS) == strlen(dst->alias)))
+        VIR_FREE(dst->alias);
+
+    dst->pciConnectFlags = 0;
+    dst->pciAddrExtFlags = 0;
+    dst->isolationGroup = 0;
+    dst->isolationGroupLocked = false;
+
+    return 0;
+}
+
+
+static int
+virDomainChrSourceDefCopyInactive(virDomainChrSourceDefPtr dst,
+                                  virDomainChrSourceDefPtr src)
+{
+    size_t i;
+
+    if (virDomainChrSourceDefCopy(dst, src) < 0)
+        return -1;
+
+    /* PTY paths are allocated when the domain starts */
+    if (dst->type == VIR_DOMAIN_CHR_TYPE_PTY)
+        VIR_FREE(dst->data.file.path);
+    else if (dst->type == VIR_DOMAIN_CHR_TYPE_TCP)
+        dst->data.tcp.tlsFromConfig = false;
+
+    if (src->nseclabels) {
+        if (VIR_ALLOC_N(dst->seclabels, src->nseclabels) < 0)
+            return -1;
+
+        for (i = 0; i < src->nseclabels; i++) {
+            if (!(dst->seclabels[i] =
+                  virSecurityDeviceLabelDefCopy(src->seclabels[i])))
+                return -1;
+            dst->seclabels[i]->labelskip = false;
+            dst->nseclabels++;
+        }
+    }
+
+    return 0;
+}
+
+
+static virDomainDiskDefPtr
+virDomainDiskDefCopyInactive(virDomainDiskDefPtr src,
+                             virDomainXMLOptionPtr xmlopt)
+{
+    virDomainDiskDefPtr def;
+    virStorageSourcePtr disksrc;
+    size_t i;
+
+    if (!(def = virDomainDiskDefNew(xmlopt)))
         return NULL;
 
-    return virDomainDefParseString(xml, caps, xmlopt, parseOpaque, parse_flags);
+    virObjectUnref(def->src);
+    if (!(def->src = virStorageSourceCopy(src->src, false)))
+        goto error;
+
+    /* runtime data of the source are not part of the inactive XML */
+    disksrc = def->src;
+    disksrc->id = 0;
+    disksrc->capacity = 0;
+    disksrc->allocation = 0;
+    disksrc->has_allocation = false;
+    disksrc->physical = 0;
+    disksrc->detected = false;
+    disksrc->tlsFromConfig = false;
+    VIR_FREE(disksrc->nodeformat);
+    VIR_FREE(disksrc->nodestorage);
+    VIR_FREE(disksrc->tlsAlias);
+    for (i = 0; i < disksrc->nseclabels; i++)
+        disksrc->seclabels[i]->labelskip = false;
+
+    def->device = src->device;
+    def->bus = src->bus;
+    def->tray_status = src->tray_status;
+    def->removable = src->removable;
+    def->geometry = src->geometry;
+    def->blockio = src->blockio;
+    def->blkdeviotune = src->blkdeviotune;
+    def->blkdeviotune.group_name = NULL;
+    def->cachemode = src->cachemode;
+    def->error_policy = src->error_policy;
+    def->rerror_policy = src->rerror_policy;
+    def->iomode = src->iomode;
+    def->ioeventfd = src->ioeventfd;
+    def->event_idx = src->event_idx;
+    def->copy_on_read = src->copy_on_read;
+    def->snapshot = src->snapshot;
+    def->startupPolicy = src->startupPolicy;
+    def->transient = src->transient;
+    def->rawio = src->rawio;
+    def->sgio = src->sgio;
+    def->discard = src->discard;
+    def->iothread = src->iothread;
+    def->detect_zeroes = src->detect_zeroes;
+    def->queues = src->queues;
+    def->model = src->model;
+
+    if (VIR_STRDUP(def->dst, src->dst) < 0 ||
+        VIR_STRDUP(def->blkdeviotune.group_name,
+                   src->blkdeviotune.group_name) < 0 ||
+        VIR_STRDUP(def->driverName, src->driverName) < 0 ||
+        VIR_STRDUP(def->serial, src->serial) < 0 ||
+        VIR_STRDUP(def->wwn, src->wwn) < 0 ||
+        VIR_STRDUP(def->vendor, src->vendor) < 0 ||
+        VIR_STRDUP(def->product, src->product) < 0 ||
+        VIR_STRDUP(def->domain_name, src->domain_name) < 0)
+        goto error;
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info, xmlopt) < 0 ||
+        virDomainVirtioOptionsCopy(&def->virtio, src->virtio) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainDiskDefFree(def);
+    return NULL;
+}
+
+
+static virDomainControllerDefPtr
+virDomainControllerDefCopyInactive(virDomainControllerDefPtr src,
+                                   virDomainXMLOptionPtr xmlopt)
+{
+    virDomainControllerDefPtr def;
+
+    if (!(def = virDomainControllerDefNew(src->type)))
+        return NULL;
+
+    def->idx = src->idx;
+    def->model = src->model;
+    def->queues = src->queues;
+    def->cmd_per_lun = src->cmd_per_lun;
+    def->max_sectors = src->max_sectors;
+    def->ioeventfd = src->ioeventfd;
+    def->iothread = src->iothread;
+    def->opts = src->opts;
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info, xmlopt) < 0 ||
+        virDomainVirtioOptionsCopy(&def->virtio, src->virtio) < 0) {
+        virDomainControllerDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainNetDefPtr
+virDomainNetDefCopyInactive(virDomainNetDefPtr src,
+                            const char *netprefix,
+                            virDomainXMLOptionPtr xmlopt)
+{
+    virDomainNetDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->type = src->type;
+    def->mac = src->mac;
+    def->driver = src->driver;
+    def->tune = src->tune;
+    def->trustGuestRxFilters = src->trustGuestRxFilters;
+    def->linkstate = src->linkstate;
+    def->mtu = src->mtu;
+
+    if (VIR_STRDUP(def->model, src->model) < 0 ||
+        VIR_STRDUP(def->backend.tap, src->backend.tap) < 0 ||
+        VIR_STRDUP(def->backend.vhost, src->backend.vhost) < 0 ||
+        VIR_STRDUP(def->script, src->script) < 0 ||
+        VIR_STRDUP(def->domain_name, src->domain_name) < 0 ||
+        VIR_STRDUP(def->ifname_guest, src->ifname_guest) < 0 ||
+        VIR_STRDUP(def->ifname_guest_actual, src->ifname_guest_actual) < 0 ||
+        VIR_STRDUP(def->filter, src->filter) < 0)
+        goto error;
+
+    switch (src->type) {
+    case VIR_DOMAIN_NET_TYPE_NETWORK:
+        if (VIR_STRDUP(def->data.network.name, src->data.network.name) < 0 ||
+            VIR_STRDUP(def->data.network.portgroup,
+                       src->data.network.portgroup) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_BRIDGE:
+        if (VIR_STRDUP(def->data.bridge.brname, src->data.bridge.brname) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_DIRECT:
+        if (VIR_STRDUP(def->data.direct.linkdev, src->data.direct.linkdev) < 0)
+            goto error;
+        def->data.direct.mode = src->data.direct.mode;
+        break;
+
+    default:
+        break;
+    }
+
+    /* auto-generated target names are blanked out by the inactive parser */
+    if (src->ifname &&
+        !STRPREFIX(src->ifname, VIR_NET_GENERATED_TAP_PREFIX) &&
+        !(netprefix && STRPREFIX(src->ifname, netprefix)) &&
+        !(src->type == VIR_DOMAIN_NET_TYPE_DIRECT &&
+          (STRPREFIX(src->ifname, VIR_NET_GENERATED_MACVTAP_PREFIX) ||
+           STRPREFIX(src->ifname, VIR_NET_GENERATED_MACVLAN_PREFIX))) &&
+        VIR_STRDUP(def->ifname, src->ifname) < 0)
+        goto error;
+
+    if (src->virtPortProfile) {
+        if (VIR_ALLOC(def->virtPortProfile) < 0)
+            goto error;
+        *def->virtPortProfile = *src->virtPortProfile;
+    }
+
+    if (src->coalesce) {
+        if (VIR_ALLOC(def->coalesce) < 0)
+            goto error;
+        *def->coalesce = *src->coalesce;
+    }
+
+    if (src->filterparams) {
+        if (!(def->filterparams = virNWFilterHashTableCreate(0)) ||
+            virNWFilterHashTablePutAll(src->filterparams,
+                                       def->filterparams) < 0)
+            goto error;
+    }
+
+    if (virNetDevBandwidthCopy(&def->bandwidth, src->bandwidth) < 0 ||
+        virNetDevVlanCopy(&def->vlan, &src->vlan) < 0)
+        goto error;
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info, xmlopt) < 0 ||
+        virDomainVirtioOptionsCopy(&def->virtio, src->virtio) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainNetDefFree(def);
+    return NULL;
+}
+
+
+static virDomainInputDefPtr
+virDomainInputDefCopyInactive(virDomainInputDefPtr src,
+                              virDomainXMLOptionPtr xmlopt)
+{
+    virDomainInputDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->type = src->type;
+    def->bus = src->bus;
+    def->model = src->model;
+
+    if (VIR_STRDUP(def->source.evdev, src->source.evdev) < 0 ||
+        virDomainDeviceInfoCopyInactive(&def->info, &src->info, xmlopt) < 0 ||
+        virDomainVirtioOptionsCopy(&def->virtio, src->virtio) < 0) {
+        virDomainInputDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainSoundDefPtr
+virDomainSoundDefCopyInactive(virDomainSoundDefPtr src,
+                              virDomainXMLOptionPtr xmlopt)
+{
+    virDomainSoundDefPtr def;
+    size_t i;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->model = src->model;
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info, xmlopt) < 0)
+        goto error;
+
+    if (src->ncodecs) {
+        if (VIR_ALLOC_N(def->codecs, src->ncodecs) < 0)
+            goto error;
+
+        for (i = 0; i < src->ncodecs; i++) {
+            if (VIR_ALLOC(def->codecs[i]) < 0)
+                goto error;
+            *def->codecs[i] = *src->codecs[i];
+            def->ncodecs++;
+        }
+    }
+
+    return def;
+
+ error:
+    virDomainSoundDefFree(def);
+    return NULL;
+}
+
+
+static virDomainVideoDefPtr
+virDomainVideoDefCopyInactive(virDomainVideoDefPtr src,
+                              virDomainXMLOptionPtr xmlopt)
+{
+    virDomainVideoDefPtr def;
+
+    if (!(def = virDomainVideoDefNew()))
+        return NULL;
+
+    def->type = src->type;
+    def->ram = src->ram;
+    def->vram = src->vram;
+    def->vram64 = src->vram64;
+    def->vgamem = src->vgamem;
+    def->heads = src->heads;
+    def->primary = src->primary;
+
+    if (src->accel) {
+        if (VIR_ALLOC(def->accel) < 0)
+            goto error;
+        *def->accel = *src->accel;
+    }
+
+    if (src->driver) {
+        if (VIR_ALLOC(def->driver) < 0)
+            goto error;
+        *def->driver = *src->driver;
+    }
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info, xmlopt) < 0 ||
+        virDomainVirtioOptionsCopy(&def->virtio, src->virtio) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainVideoDefFree(def);
+    return NULL;
+}
+
+
+static virDomainChrDefPtr
+virDomainChrDefCopyInactive(virDomainChrDefPtr src,
+                            virDomainXMLOptionPtr xmlopt)
+{
+    virDomainChrDefPtr def;
+
+    if (!(def = virDomainChrDefNew(xmlopt)))
+        return NULL;
+
+    def->deviceType = src->deviceType;
+    def->targetType = src->targetType;
+    def->targetModel = src->targetModel;
+
+    if (src->deviceType == VIR_DOMAIN_CHR_DEVICE_TYPE_CHANNEL) {
+        memset(&def->target, 0, sizeof(def->target));
+
+        switch (src->targetType) {
+        case VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_GUESTFWD:
+            if (src->target.addr) {
+                if (VIR_ALLOC(def->target.addr) < 0)
+                    goto error;
+                *def->target.addr = *src->target.addr;
+            }
+            break;
+
+        case VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_XEN:
+        case VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_VIRTIO:
+            if (VIR_STRDUP(def->target.name, src->target.name) < 0)
+                goto error;
+            break;
+        }
+    } else {
+        def->target.port = src->target.port;
+    }
+
+    if (virDomainChrSourceDefCopyInactive(def->source, src->source) < 0 ||
+        virDomainDeviceInfoCopyInactive(&def->info, &src->info, xmlopt) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainChrDefFree(def);
+    return NULL;
+}
+
+
+static virDomainMemballoonDefPtr
+virDomainMemballoonDefCopyInactive(virDomainMemballoonDefPtr src,
+                                   virDomainXMLOptionPtr xmlopt)
+{
+    virDomainMemballoonDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->model = src->model;
+    def->period = src->period;
+    def->autodeflate = src->autodeflate;
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info, xmlopt) < 0 ||
+        virDomainVirtioOptionsCopy(&def->virtio, src->virtio) < 0) {
+        virDomainMemballoonDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainWatchdogDefPtr
+virDomainWatchdogDefCopyInactive(virDomainWatchdogDefPtr src,
+                                 virDomainXMLOptionPtr xmlopt)
+{
+    virDomainWatchdogDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->model = src->model;
+    def->action = src->action;
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info, xmlopt) < 0) {
+        virDomainWatchdogDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainPanicDefPtr
+virDomainPanicDefCopyInactive(virDomainPanicDefPtr src,
+                              virDomainXMLOptionPtr xmlopt)
+{
+    virDomainPanicDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->model = src->model;
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info, xmlopt) < 0) {
+        virDomainPanicDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainRNGDefPtr
+virDomainRNGDefCopyInactive(virDomainRNGDefPtr src,
+                            virDomainXMLOptionPtr xmlopt)
+{
+    virDomainRNGDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->model = src->model;
+    def->backend = src->backend;
+    def->rate = src->rate;
+    def->period = src->period;
+
+    switch ((virDomainRNGBackend) src->backend) {
+    case VIR_DOMAIN_RNG_BACKEND_RANDOM:
+        if (VIR_STRDUP(def->source.file, src->source.file) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_RNG_BACKEND_EGD:
+        if (!(def->source.chardev = virDomainChrSourceDefNew(xmlopt)) ||
+            virDomainChrSourceDefCopyInactive(def->source.chardev,
+                                              src->source.chardev) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_RNG_BACKEND_LAST:
+        break;
+    }
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info, xmlopt) < 0 ||
+        virDomainVirtioOptionsCopy(&def->virtio, src->virtio) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainRNGDefFree(def);
+    return NULL;
+}
+
+
+static int
+virDomainGraphicsAuthDefCopy(virDomainGraphicsAuthDefPtr dst,
+                             const virDomainGraphicsAuthDef *src)
+{
+    dst->expires = src->expires;
+    dst->validTo = src->validTo;
+    dst->connected = src->connected;
+
+    return VIR_STRDUP(dst->passwd, src->passwd);
+}
+
+
+static virDomainGraphicsDefPtr
+virDomainGraphicsDefCopyInactive(virDomainGraphicsDefPtr src,
+                                 virDomainXMLOptionPtr xmlopt)
+{
+    virDomainGraphicsDefPtr def;
+    size_t i;
+
+    if (!(def = virDomainGraphicsDefNew(xmlopt)))
+        return NULL;
+
+    def->type = src->type;
+
+    /* ports picked when the domain started are not kept, and neither are
+     * the reservations and generated values tracked in the status XML */
+    switch (src->type) {
+    case VIR_DOMAIN_GRAPHICS_TYPE_VNC:
+        def->data.vnc.port = src->data.vnc.port;
+        def->data.vnc.autoport = src->data.vnc.autoport;
+        if (def->data.vnc.port == -1 || def->data.vnc.autoport) {
+            def->data.vnc.port = 0;
+            def->data.vnc.autoport = true;
+        }
+        def->data.vnc.websocket = src->data.vnc.websocket;
+        def->data.vnc.sharePolicy = src->data.vnc.sharePolicy;
+        if (VIR_STRDUP(def->data.vnc.keymap, src->data.vnc.keymap) < 0 ||
+            virDomainGraphicsAuthDefCopy(&def->data.vnc.auth,
+                                         &src->data.vnc.auth) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_SDL:
+        def->data.sdl.fullscreen = src->data.sdl.fullscreen;
+        def->data.sdl.gl = src->data.sdl.gl;
+        if (VIR_STRDUP(def->data.sdl.display, src->data.sdl.display) < 0 ||
+            VIR_STRDUP(def->data.sdl.xauth, src->data.sdl.xauth) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_RDP:
+        def->data.rdp = src->data.rdp;
+        if (def->data.rdp.port == -1)
+            def->data.rdp.autoport = true;
+        if (def->data.rdp.autoport)
+            def->data.rdp.port = 0;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_DESKTOP:
+        def->data.desktop.fullscreen = src->data.desktop.fullscreen;
+        if (VIR_STRDUP(def->data.desktop.display,
+                       src->data.desktop.display) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_SPICE:
+        def->data.spice.port = src->data.spice.port;
+        def->data.spice.tlsPort = src->data.spice.tlsPort;
+        def->data.spice.autoport = src->data.spice.autoport;
+        if (def->data.spice.port == -1 && def->data.spice.tlsPort == -1)
+            def->data.spice.autoport = true;
+        if (def->data.spice.autoport) {
+            def->data.spice.port = 0;
+            def->data.spice.tlsPort = 0;
+        }
+        def->data.spice.mousemode = src->data.spice.mousemode;
+        memcpy(def->data.spice.channels, src->data.spice.channels,
+               sizeof(src->data.spice.channels));
+        def->data.spice.defaultMode = src->data.spice.defaultMode;
+        def->data.spice.image = src->data.spice.image;
+        def->data.spice.jpeg = src->data.spice.jpeg;
+        def->data.spice.zlib = src->data.spice.zlib;
+        def->data.spice.playback = src->data.spice.playback;
+        def->data.spice.streaming = src->data.spice.streaming;
+        def->data.spice.copypaste = src->data.spice.copypaste;
+        def->data.spice.filetransfer = src->data.spice.filetransfer;
+        def->data.spice.gl = src->data.spice.gl;
+        if (VIR_STRDUP(def->data.spice.keymap, src->data.spice.keymap) < 0 ||
+            VIR_STRDUP(def->data.spice.rendernode,
+                       src->data.spice.rendernode) < 0 ||
+            virDomainGraphicsAuthDefCopy(&def->data.spice.auth,
+                                         &src->data.spice.auth) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_EGL_HEADLESS:
+        if (VIR_STRDUP(def->data.egl_headless.rendernode,
+                       src->data.egl_headless.rendernode) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_LAST:
+        break;
+    }
+
+    if (src->nListens) {
+        if (VIR_ALLOC_N(def->listens, src->nListens) < 0)
+            goto error;
+        def->nListens = src->nListens;
+    }
+
+    for (i = 0; i < src->nListens; i++) {
+        virDomainGraphicsListenDefPtr listen = &def->listens[i];
+
+        listen->type = src->listens[i].type;
+
+        /* the address of a network listen is resolved at startup */
+        if (listen->type != VIR_DOMAIN_GRAPHICS_LISTEN_TYPE_NETWORK &&
+            VIR_STRDUP(listen->address, src->listens[i].address) < 0)
+            goto error;
+
+        if (VIR_STRDUP(listen->network, src->listens[i].network) < 0 ||
+            VIR_STRDUP(listen->socket, src->listens[i].socket) < 0)
+            goto error;
+    }
+
+    return def;
+
+ error:
+    virDomainGraphicsDefFree(def);
+    return NULL;
+}
+
+
+#define VIR_DOMAIN_DEF_COPY_DEVICES(name, count, func, ...) \
+    do { \
+        if (src->count) { \
+            if (VIR_ALLOC_N(def->name, src->count) < 0) \
+                goto error; \
+            for (i = 0; i < src->count; i++) { \
+                if (!(def->name[i] = func(src->name[i], __VA_ARGS__))) \
+                    goto error; \
+                def->count++; \
+            } \
+        } \
+    } while (0)
+
+
+static int
+virDomainDefCopyNativeOS(virDomainOSDefPtr dst,
+                         const virDomainOSDef *src)
+{
+    size_t i;
+
+    dst->type = src->type;
+    dst->firmware = src->firmware;
+    dst->arch = src->arch;
+    dst->nBootDevs = src->nBootDevs;
+    memcpy(dst->bootDevs, src->bootDevs, sizeof(src->bootDevs));
+    dst->bootmenu = src->bootmenu;
+    dst->bm_timeout = src->bm_timeout;
+    dst->bm_timeout_set = src->bm_timeout_set;
+    dst->smbios_mode = src->smbios_mode;
+    dst->bios = src->bios;
+
+    if (VIR_STRDUP(dst->machine, src->machine) < 0 ||
+        VIR_STRDUP(dst->init, src->init) < 0 ||
+        VIR_STRDUP(dst->initdir, src->initdir) < 0 ||
+        VIR_STRDUP(dst->inituser, src->inituser) < 0 ||
+        VIR_STRDUP(dst->initgroup, src->initgroup) < 0 ||
+        VIR_STRDUP(dst->kernel, src->kernel) < 0 ||
+        VIR_STRDUP(dst->initrd, src->initrd) < 0 ||
+        VIR_STRDUP(dst->cmdline, src->cmdline) < 0 ||
+        VIR_STRDUP(dst->dtb, src->dtb) < 0 ||
+        VIR_STRDUP(dst->root, src->root) < 0 ||
+        VIR_STRDUP(dst->slic_table, src->slic_table) < 0 ||
+        VIR_STRDUP(dst->bootloader, src->bootloader) < 0 ||
+        VIR_STRDUP(dst->bootloaderArgs, src->bootloaderArgs) < 0)
+        return -1;
+
+    if (src->initargv &&
+        virStringListCopy(&dst->initargv,
+                          (const char **) src->initargv) < 0)
+        return -1;
+
+    if (src->initenv) {
+        size_t n = 0;
+
+        while (src->initenv[n])
+            n++;
+
+        /* the array is NULL terminated */
+        if (VIR_ALLOC_N(dst->initenv, n + 1) < 0)
+            return -1;
+
+        for (i = 0; i < n; i++) {
+            if (VIR_ALLOC(dst->initenv[i]) < 0 ||
+                VIR_STRDUP(dst->initenv[i]->name, src->initenv[i]->name) < 0 ||
+                VIR_STRDUP(dst->initenv[i]->value, src->initenv[i]->value) < 0)
+                return -1;
+        }
+    }
+
+    if (src->loader) {
+        if (VIR_ALLOC(dst->loader) < 0)
+            return -1;
+
+        dst->loader->readonly = src->loader->readonly;
+        dst->loader->type = src->loader->type;
+        dst->loader->secure = src->loader->secure;
+
+        if (VIR_STRDUP(dst->loader->path, src->loader->path) < 0 ||
+            VIR_STRDUP(dst->loader->nvram, src->loader->nvram) < 0 ||
+            VIR_STRDUP(dst->loader->templt, src->loader->templt) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virDomainDefCopyNativeTuning(virDomainDefPtr def,
+                             const virDomainDef *src)
+{
+    size_t i;
+
+    def->blkio.weight = src->blkio.weight;
+    if (src->blkio.ndevices) {
+        if (VIR_ALLOC_N(def->blkio.devices, src->blkio.ndevices) < 0)
+            return -1;
+        def->blkio.ndevices = src->blkio.ndevices;
+
+        for (i = 0; i < src->blkio.ndevices; i++) {
+            virBlkioDevicePtr dev = &def->blkio.devices[i];
+
+            *dev = src->blkio.devices[i];
+            dev->path = NULL;
+            if (VIR_STRDUP(dev->path, src->blkio.devices[i].path) < 0)
+                return -1;
+        }
+    }
+
+    def->mem = src->mem;
+    def->mem.hugepages = NULL;
+    def->mem.nhugepages = 0;
+    if (src->mem.nhugepages) {
+        if (VIR_ALLOC_N(def->mem.hugepages, src->mem.nhugepages) < 0)
+            return -1;
+        def->mem.nhugepages = src->mem.nhugepages;
+
+        for (i = 0; i < src->mem.nhugepages; i++) {
+            def->mem.hugepages[i].size = src->mem.hugepages[i].size;
+            if (src->mem.hugepages[i].nodemask &&
+                !(def->mem.hugepages[i].nodemask =
+                  virBitmapNewCopy(src->mem.hugepages[i].nodemask)))
+                return -1;
+        }
+    }
+
+    def->cputune = src->cputune;
+    def->cputune.emulatorpin = NULL;
+    if (src->cputune.emulatorpin &&
+        !(def->cputune.emulatorpin = virBitmapNewCopy(src->cputune.emulatorpin)))
+        return -1;
+
+    if (src->niothreadids) {
+        bool autofill = true;
+
+        /* iothreads are only formatted if one of them is not autofilled */
+        for (i = 0; i < src->niothreadids; i++) {
+            if (!src->iothreadids[i]->autofill)
+                autofill = false;
+        }
+
+        if (VIR_ALLOC_N(def->iothreadids, src->niothreadids) < 0)
+            return -1;
+        def->niothreadids = src->niothreadids;
+
+        for (i = 0; i < src->niothreadids; i++) {
+            virDomainIOThreadIDDefPtr iothrid;
+
+            if (VIR_ALLOC(iothrid) < 0)
+                return -1;
+            def->iothreadids[i] = iothrid;
+
+            iothrid->autofill = autofill;
+            iothrid->iothread_id = src->iothreadids[i]->iothread_id;
+            iothrid->sched = src->iothreadids[i]->sched;
+            if (src->iothreadids[i]->cpumask &&
+                !(iothrid->cpumask =
+                  virBitmapNewCopy(src->iothreadids[i]->cpumask)))
+                return -1;
+        }
+    }
+
+    virDomainNumaFree(def->numa);
+    if (!(def->numa = virDomainNumaCopy(src->numa)))
+        return -1;
+
+    if (src->resource) {
+        if (VIR_ALLOC(def->resource) < 0 ||
+            VIR_STRDUP(def->resource->partition,
+                       src->resource->partition) < 0)
+            return -1;
+    }
+
+    if (src->idmap.nuidmap) {
+        if (VIR_ALLOC_N(def->idmap.uidmap, src->idmap.nuidmap) < 0)
+            return -1;
+        memcpy(def->idmap.uidmap, src->idmap.uidmap,
+               sizeof(*src->idmap.uidmap) * src->idmap.nuidmap);
+        def->idmap.nuidmap = src->idmap.nuidmap;
+    }
+
+    if (src->idmap.ngidmap) {
+        if (VIR_ALLOC_N(def->idmap.gidmap, src->idmap.ngidmap) < 0)
+            return -1;
+        memcpy(def->idmap.gidmap, src->idmap.gidmap,
+               sizeof(*src->idmap.gidmap) * src->idmap.ngidmap);
+        def->idmap.ngidmap = src->idmap.ngidmap;
+    }
+
+    return 0;
+}
+
+
+static int
+virDomainDefCopyNativeVcpus(virDomainDefPtr def,
+                            const virDomainDef *src,
+                            virDomainXMLOptionPtr xmlopt)
+{
+    size_t i;
+
+    if (virDomainDefSetVcpusMax(def, src->maxvcpus, xmlopt) < 0)
+        return -1;
+
+    def->individualvcpus = src->individualvcpus;
+    def->placement_mode = src->placement_mode;
+    if (src->cpumask &&
+        !(def->cpumask = virBitmapNewCopy(src->cpumask)))
+        return -1;
+
+    for (i = 0; i < src->maxvcpus; i++) {
+        virDomainVcpuDefPtr vcpu = def->vcpus[i];
+
+        vcpu->online = src->vcpus[i]->online;
+        vcpu->hotpluggable = src->vcpus[i]->hotpluggable;
+        vcpu->sched = src->vcpus[i]->sched;
+
+        /* the order is only formatted along with individual vcpus */
+        if (src->individualvcpus)
+            vcpu->order = src->vcpus[i]->order;
+
+        if (src->vcpus[i]->cpumask &&
+            !(vcpu->cpumask = virBitmapNewCopy(src->vcpus[i]->cpumask)))
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virDomainDefCopyNativeClock(virDomainClockDefPtr dst,
+                            const virDomainClockDef *src)
+{
+    size_t i;
+
+    dst->offset = src->offset;
+    if (src->offset == VIR_DOMAIN_CLOCK_OFFSET_TIMEZONE) {
+        if (VIR_STRDUP(dst->data.timezone, src->data.timezone) < 0)
+            return -1;
+    } else {
+        dst->data = src->data;
+        /* the start-time adjustment is only kept in the status XML */
+        if (src->offset == VIR_DOMAIN_CLOCK_OFFSET_VARIABLE)
+            dst->data.variable.adjustment0 = 0;
+    }
+
+    if (src->ntimers) {
+        if (VIR_ALLOC_N(dst->timers, src->ntimers) < 0)
+            return -1;
+
+        for (i = 0; i < src->ntimers; i++) {
+            if (VIR_ALLOC(dst->timers[i]) < 0)
+                return -1;
+            *dst->timers[i] = *src->timers[i];
+            dst->ntimers++;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * virDomainDefCopyNative:
+ * @src: definition to copy
+ * @caps: driver capabilities
+ * @xmlopt: XML parser configuration object
+ * @dst: filled with the copy
+ *
+ * Copies @src without a round-trip through XML.  The result is what
+ * parsing the XML of @src with VIR_DOMAIN_DEF_PARSE_INACTIVE would give;
+ * private data of the definition and its devices are allocated afresh.
+ *
+ * Returns 1 on success, 0 if @src uses something which can only be copied
+ * through XML (@dst is NULL then), and -1 on error.
+ */
+int
+virDomainDefCopyNative(const virDomainDef *src,
+                       virCapsPtr caps,
+                       virDomainXMLOptionPtr xmlopt,
+                       virDomainDefPtr *dst)
+{
+    virDomainDefPtr def = NULL;
+    const char *netprefix = caps ? caps->host.netprefix : NULL;
+    size_t i;
+
+    *dst = NULL;
+
+    if (!virDomainDefCopyNativeSupported(src))
+        return 0;
+
+    if (!(def = virDomainDefNew()))
+        return -1;
+
+    def->virtType = src->virtType;
+    def->id = -1;
+    memcpy(def->uuid, src->uuid, VIR_UUID_BUFLEN);
+    memcpy(def->genid, src->genid, VIR_UUID_BUFLEN);
+    def->genidRequested = src->genidRequested;
+
+    if (VIR_STRDUP(def->name, src->name) < 0 ||
+        VIR_STRDUP(def->title, src->title) < 0 ||
+        VIR_STRDUP(def->description, src->description) < 0 ||
+        VIR_STRDUP(def->emulator, src->emulator) < 0 ||
+        VIR_STRDUP(def->hyperv_vendor_id, src->hyperv_vendor_id) < 0)
+        goto error;
+
+    if (virDomainDefCopyNativeTuning(def, src) < 0 ||
+        virDomainDefCopyNativeVcpus(def, src, xmlopt) < 0 ||
+        virDomainDefCopyNativeOS(&def->os, &src->os) < 0 ||
+        virDomainDefCopyNativeClock(&def->clock, &src->clock) < 0)
+        goto error;
+
+    def->onReboot = src->onReboot;
+    def->onPoweroff = src->onPoweroff;
+    def->onCrash = src->onCrash;
+    def->onLockFailure = src->onLockFailure;
+    def->pm = src->pm;
+    def->perf = src->perf;
+
+    memcpy(def->features, src->features, sizeof(src->features));
+    memcpy(def->caps_features, src->caps_features, sizeof(src->caps_features));
+    memcpy(def->hyperv_features, src->hyperv_features,
+           sizeof(src->hyperv_features));
+    memcpy(def->kvm_features, src->kvm_features, sizeof(src->kvm_features));
+    memcpy(def->msrs_features, src->msrs_features, sizeof(src->msrs_features));
+    def->hyperv_spinlocks = src->hyperv_spinlocks;
+    def->gic_version = src->gic_version;
+    def->hpt_resizing = src->hpt_resizing;
+    def->hpt_maxpagesize = src->hpt_maxpagesize;
+    def->apic_eoi = src->apic_eoi;
+    def->tseg_specified = src->tseg_specified;
+    def->tseg_size = src->tseg_size;
+
+    VIR_DOMAIN_DEF_COPY_DEVICES(graphics, ngraphics,
+                                virDomainGraphicsDefCopyInactive, xmlopt);
+    VIR_DOMAIN_DEF_COPY_DEVICES(disks, ndisks,
+                                virDomainDiskDefCopyInactive, xmlopt);
+    VIR_DOMAIN_DEF_COPY_DEVICES(controllers, ncontrollers,
+                                virDomainControllerDefCopyInactive, xmlopt);
+    VIR_DOMAIN_DEF_COPY_DEVICES(nets, nnets,
+                                virDomainNetDefCopyInactive, netprefix, xmlopt);
+    VIR_DOMAIN_DEF_COPY_DEVICES(inputs, ninputs,
+                                virDomainInputDefCopyInactive, xmlopt);
+    VIR_DOMAIN_DEF_COPY_DEVICES(sounds, nsounds,
+                                virDomainSoundDefCopyInactive, xmlopt);
+    VIR_DOMAIN_DEF_COPY_DEVICES(videos, nvideos,
+                                virDomainVideoDefCopyInactive, xmlopt);
+    VIR_DOMAIN_DEF_COPY_DEVICES(serials, nserials,
+                                virDomainChrDefCopyInactive, xmlopt);
+    VIR_DOMAIN_DEF_COPY_DEVICES(parallels, nparallels,
+                                virDomainChrDefCopyInactive, xmlopt);
+    VIR_DOMAIN_DEF_COPY_DEVICES(channels, nchannels,
+                                virDomainChrDefCopyInactive, xmlopt);
+    VIR_DOMAIN_DEF_COPY_DEVICES(rngs, nrngs,
+                                virDomainRNGDefCopyInactive, xmlopt);
+    VIR_DOMAIN_DEF_COPY_DEVICES(panics, npanics,
+                                virDomainPanicDefCopyInactive, xmlopt);
+
+    if (src->nconsoles) {
+        if (VIR_ALLOC_N(def->consoles, src->nconsoles) < 0)
+            goto error;
+
+        for (i = 0; i < src->nconsoles; i++) {
+            virDomainChrDefPtr console = src->consoles[i];
+
+            /* A serial console of HVM guests is formatted from the serial
+             * port it aliases, so that is what it's parsed back from */
+            if (src->os.type == VIR_DOMAIN_OSTYPE_HVM &&
+                (console->targetType == VIR_DOMAIN_CHR_CONSOLE_TARGET_TYPE_SERIAL ||
+                 console->targetType == VIR_DOMAIN_CHR_CONSOLE_TARGET_TYPE_NONE) &&
+                i < src->nserials) {
+                if (!(def->consoles[i] =
+                      virDomainChrDefCopyInactive(src->serials[i], xmlopt)))
+                    goto error;
+                def->consoles[i]->deviceType = VIR_DOMAIN_CHR_DEVICE_TYPE_CONSOLE;
+                def->consoles[i]->targetType = VIR_DOMAIN_CHR_CONSOLE_TARGET_TYPE_SERIAL;
+                def->consoles[i]->targetModel = 0;
+            } else if (!(def->consoles[i] =
+                         virDomainChrDefCopyInactive(console, xmlopt))) {
+                goto error;
+            }
+            def->nconsoles++;
+        }
+    }
+
+    if ((src->watchdog &&
+         !(def->watchdog = virDomainWatchdogDefCopyInactive(src->watchdog,
+                                                            xmlopt))) ||
+        (src->memballoon &&
+         !(def->memballoon = virDomainMemballoonDefCopyInactive(src->memballoon,
+                                                                xmlopt))))
+        goto error;
+
+    if (src->iommu) {
+        if (VIR_ALLOC(def->iommu) < 0)
+            goto error;
+        *def->iommu = *src->iommu;
+    }
+
+    if (src->keywrap) {
+        if (VIR_ALLOC(def->keywrap) < 0)
+            goto error;
+        *def->keywrap = *src->keywrap;
+    }
+
+    if (src->sev) {
+        if (VIR_ALLOC(def->sev) < 0)
+            goto error;
+        def->sev->sectype = src->sev->sectype;
+        def->sev->policy = src->sev->policy;
+        def->sev->cbitpos = src->sev->cbitpos;
+        def->sev->reduced_phys_bits = src->sev->reduced_phys_bits;
+        if (VIR_STRDUP(def->sev->dh_cert, src->sev->dh_cert) < 0 ||
+            VIR_STRDUP(def->sev->session, src->sev->session) < 0)
+            goto error;
+    }
+
+    if (src->cpu &&
+        !(def->cpu = virCPUDefCopy(src->cpu)))
+        goto error;
+
+    if (src->metadata &&
+        !(def->metadata = xmlCopyNode(src->metadata, 1))) {
+        virReportOOMError();
+        goto error;
+    }
+
+    def->ns = xmlopt->ns;
+
+    *dst = def;
+    return 1;
+
+ error:
+    virDomainDefFree(def);
+    return -1;
+}
+
+#undef VIR_DOMAIN_DEF_COPY_DEVICES
+
+
+/* Copy src into a new definition through a round-trip through XML,
+ * the way virDomainDefCopy does for anything virDomainDefCopyNative
+ * can't handle.  */
+virDomainDefPtr
+virDomainDefCopyXML(virDomainDefPtr src,
+                    virCapsPtr caps,
+                    virDomainXMLOptionPtr xmlopt,
+                    void *parseOpaque,
+                    bool migratable)
+{
+    unsigned int format_flags = VIR_DOMAIN_DEF_FORMAT_SECURE;
+    unsigned int parse_flags = VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                               VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE;
+    VIR_AUTOFREE(char *) xml = NULL;
+
+    if (migratable)
+        format_flags |= VIR_DOMAIN_DEF_FORMAT_INACTIVE | VIR_DOMAIN_DEF_FORMAT_MIGRATABLE;
+
+    if (!(xml = virDomainDefFormat(src, caps, format_flags)))
+        return NULL;
+
+    return virDomainDefParseString(xml, caps, xmlopt, parseOpaque, parse_flags);
+}
+
+
+/* Copy src into a new definition; with the quality of the copy
+ * depending on the migratable flag (false for transitions between
+ * persistent and active, true for transitions across save files or
+ * snapshots).  */
+virDomainDefPtr
+virDomainDefCopy(virDomainDefPtr src,
+                 virCapsPtr caps,
+                 virDomainXMLOptionPtr xmlopt,
+                 void *parseOpaque,
+                 bool migratable)
+{
+    virDomainDefPtr ret = NULL;
+
+    if (!migratable) {
+        int rc;
+
+        if ((rc = virDomainDefCopyNative(src, caps, xmlopt, &ret)) < 0)
+            return NULL;
+        if (rc > 0)
+            return ret;
+    }
+
+    /* Anything else is cloned via a round-trip through XML.  */
+    return virDomainDefCopyXML(src, caps, xmlopt, parseOpaque, migratable);
 }
 
 virDomainDefPtr
@@ -2871,6 +2871,15 @@ virDomainDefPtr virDomainDefCopy(virDomainDefPtr src,
                                  virDomainXMLOptionPtr xmlopt,
                                  void *parseOpaque,
                                  bool migratable);
+int virDomainDefCopyNative(const virDomainDef *src,
+                           virCapsPtr caps,
+                           virDomainXMLOptionPtr xmlopt,
+                           virDomainDefPtr *dst);
+virDomainDefPtr virDomainDefCopyXML(virDomainDefPtr src,
+                                    virCapsPtr caps,
+                                    virDomainXMLOptionPtr xmlopt,
+                                    void *parseOpaque,
+                                    bool migratable);
 virDomainDefPtr virDomainObjCopyPersistentDef(virDomainObjPtr dom,
                                               virCapsPtr caps,
                                               virDomainXMLOptionPtr xmlopt);
@@ -59,6 +59,7 @@ static virClassPtr virDomainEventJobCompletedClass;
 static virClassPtr virDomainEventDeviceRemovalFailedClass;
 static virClassPtr virDomainEventMetadataChangeClass;
 static virClassPtr virDomainEventBlockThresholdClass;
+static virClassPtr virDomainStatsEventClass;
 
 static void virDomainEventDispose(void *obj);
 static void virDomainEventLifecycleDispose(void *obj);
@@ -81,6 +82,7 @@ static void virDomainEventJobCompletedDispose(void *obj);
 static void virDomainEventDeviceRemovalFailedDispose(void *obj);
 static void virDomainEventMetadataChangeDispose(void *obj);
 static void virDomainEventBlockThresholdDispose(void *obj);
+static void virDomainStatsEventDispose(void *obj);
 
 static void
 virDomainEventDispatchDefaultFunc(virConnectPtr conn,
@@ -94,6 +96,12 @@ virDomainQemuMonitorEventDispatchFunc(virConnectPtr conn,
                                       virConnectObjectEventGenericCallback cb,
                                       void *cbopaque);
 
+static void
+virDomainStatsEventDispatchFunc(virConnectPtr conn,
+                                virObjectEventPtr event,
+                                virConnectObjectEventGenericCallback cb,
+                                void *cbopaque);
+
 struct _virDomainEvent {
     virObjectEvent parent;
 
@@ -225,6 +233,18 @@ struct _virDomainQemuMonitorEvent {
 typedef struct _virDomainQemuMonitorEvent virDomainQemuMonitorEvent;
 typedef virDomainQemuMonitorEvent *virDomainQemuMonitorEventPtr;
 
+struct _virDomainStatsEvent {
+    virObjectEvent parent;
+
+    virTypedParameterPtr params;
+    int nparams;
+    unsigned int *groups; /* stats group of each of @params, may be NULL */
+    int *due; /* callbacks the sample was taken for */
+    size_t ndue;
+};
+typedef struct _virDomainStatsEvent virDomainStatsEvent;
+typedef virDomainStatsEvent *virDomainStatsEventPtr;
+
 struct _virDomainEventTunable {
     virDomainEvent parent;
 
@@ -335,6 +355,8 @@ virDomainEventsOnceInit(void)
         return -1;
     if (!VIR_CLASS_NEW(virDomainEventBlockThreshold, virDomainEventClass))
         return -1;
+    if (!VIR_CLASS_NEW(virDomainStatsEvent, virClassForObjectEvent()))
+        return -1;
     return 0;
 }
 
@@ -490,6 +512,17 @@ virDomainQemuMonitorEventDispose(void *obj)
     VIR_FREE(event->details);
 }
 
+static void
+virDomainStatsEventDispose(void *obj)
+{
+    virDomainStatsEventPtr event = obj;
+    VIR_DEBUG("obj=%p", event);
+
+    virTypedParamsFree(event->params, event->nparams);
+    VIR_FREE(event->groups);
+    VIR_FREE(event->due);
+}
+
 static void
 virDomainEventTunableDispose(void *obj)
 {
@@ -2042,6 +2075,126 @@ virDomainQemuMonitorEventDispatchFunc(virConnectPtr conn,
 }
 
 
+/**
+ * virDomainStatsEventNew:
+ * @id: domain ID
+ * @name: domain name
+ * @uuid: domain UUID
+ * @params: sampled statistics
+ * @nparams: number of items in @params
+ * @groups: stats group each of @params belongs to, or NULL
+ * @due: IDs of the callbacks the sample was taken for
+ * @ndue: number of items in @due
+ *
+ * Creates an event carrying one sample of a stats subscription.  The
+ * driver doing the sampling passes @groups and @due so that a single
+ * sampling pass can feed subscriptions with different intervals and
+ * stats groups; events rebuilt on the client side of the remote driver
+ * pass NULL and 0 as the server already did the selection.
+ *
+ * This function consumes @params and @groups, the caller must not free
+ * them even if an error occurs. @due is copied.
+ */
+virObjectEventPtr
+virDomainStatsEventNew(int id,
+                       const char *name,
+                       const unsigned char *uuid,
+                       virTypedParameterPtr params,
+                       int nparams,
+                       unsigned int *groups,
+                       const int *due,
+                       size_t ndue)
+{
+    virDomainStatsEventPtr ev;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    if (virDomainEventsInitialize() < 0)
+        goto error;
+
+    virUUIDFormat(uuid, uuidstr);
+    if (!(ev = virObjectEventNew(virDomainStatsEventClass,
+                                 virDomainStatsEventDispatchFunc,
+                                 0, id, name, uuid, uuidstr)))
+        goto error;
+
+    ev->params = params;
+    ev->nparams = nparams;
+    ev->groups = groups;
+
+    if (ndue) {
+        if (VIR_ALLOC_N(ev->due, ndue) < 0) {
+            virObjectUnref(ev);
+            return NULL;
+        }
+        memcpy(ev->due, due, ndue * sizeof(*due));
+        ev->ndue = ndue;
+    }
+
+    return (virObjectEventPtr)ev;
+
+ error:
+    virTypedParamsFree(params, nparams);
+    VIR_FREE(groups);
+    return NULL;
+}
+
+
+/* The per-callback stats groups and the callback ID used to match
+ * samples taken for the subscription are kept together with the
+ * caller's opaque data; as with qemu monitor events, wrapping the
+ * caller's freecb releases them when the callback is deregistered.  */
+struct virDomainStatsEventData {
+    int callbackID;
+    unsigned int stats;
+    void *opaque;
+    virFreeCallback freecb;
+};
+typedef struct virDomainStatsEventData virDomainStatsEventData;
+
+
+static void
+virDomainStatsEventDispatchFunc(virConnectPtr conn,
+                                virObjectEventPtr event,
+                                virConnectObjectEventGenericCallback cb,
+                                void *cbopaque)
+{
+    virDomainPtr dom;
+    virDomainStatsEventPtr statsEvent = (virDomainStatsEventPtr)event;
+    virDomainStatsEventData *data = cbopaque;
+    virTypedParameterPtr params = statsEvent->params;
+    virTypedParameterPtr selected = NULL;
+    int nparams = statsEvent->nparams;
+    size_t i;
+
+    /* The sample may contain groups requested by other subscriptions
+     * that were due at the same time; hand out only the ones this
+     * callback asked for.  The copy is shallow, the strings stay owned
+     * by the event.  */
+    if (statsEvent->groups && data->stats) {
+        if (VIR_ALLOC_N(selected, statsEvent->nparams) < 0)
+            return;
+
+        nparams = 0;
+        for (i = 0; i < statsEvent->nparams; i++) {
+            if (statsEvent->groups[i] & data->stats)
+                selected[nparams++] = statsEvent->params[i];
+        }
+        params = selected;
+    }
+
+    if (!(dom = virGetDomain(conn, event->meta.name,
+                             event->meta.uuid, event->meta.id)))
+        goto cleanup;
+
+    ((virConnectDomainStatsCallback)cb)(conn, dom, params, nparams,
+                                        data->opaque);
+    virObjectUnref(dom);
+
+ cleanup:
+    VIR_FREE(selected);
+}
+
+
 /**
  * virDomainEventStateRegister:
  * @conn: connection to associate with callback
@@ -2343,3 +2496,106 @@ virDomainQemuMonitorEventStateRegisterID(virConnectPtr conn,
                                          data, freecb,
                                          false, callbackID, false);
 }
+
+
+/**
+ * virDomainStatsEventFilter:
+ * @conn: the connection pointer
+ * @event: the event about to be dispatched
+ * @opaque: the opaque data registered with the filter
+ *
+ * Callback for filtering stats samples by the subscriptions they were
+ * taken for.  Returns true if the event should be dispatched.
+ */
+static bool
+virDomainStatsEventFilter(virConnectPtr conn ATTRIBUTE_UNUSED,
+                          virObjectEventPtr event,
+                          void *opaque)
+{
+    virDomainStatsEventData *data = opaque;
+    virDomainStatsEventPtr statsEvent = (virDomainStatsEventPtr) event;
+    size_t i;
+
+    /* Remote events are already routed by their callback ID */
+    if (statsEvent->ndue == 0)
+        return true;
+
+    for (i = 0; i < statsEvent->ndue; i++) {
+        if (statsEvent->due[i] == data->callbackID)
+            return true;
+    }
+
+    return false;
+}
+
+
+static void
+virDomainStatsEventCleanup(void *opaque)
+{
+    virDomainStatsEventData *data = opaque;
+
+    if (data->freecb)
+        (data->freecb)(data->opaque);
+    VIR_FREE(data);
+}
+
+
+/**
+ * virDomainStatsEventStateRegisterID:
+ * @conn: connection to associate with callback
+ * @state: object event state
+ * @dom: optional domain to deliver statistics for
+ * @stats: stats groups to deliver, 0 for everything sampled
+ * @cb: function to invoke when a sample is taken
+ * @opaque: data blob to pass to callback
+ * @freecb: callback to free @opaque
+ * @callbackID: filled with callback ID
+ *
+ * Register the function @cb with connection @conn, from @state, for
+ * stats samples.  Every callback is matched to exactly one sampling
+ * subscription (or one server callback), so the return value is
+ * always 1 on success.
+ *
+ * Returns: the number of callbacks now registered, or -1 on error
+ */
+int
+virDomainStatsEventStateRegisterID(virConnectPtr conn,
+                                   virObjectEventStatePtr state,
+                                   virDomainPtr dom,
+                                   unsigned int stats,
+                                   virConnectDomainStatsCallback cb,
+                                   void *opaque,
+                                   virFreeCallback freecb,
+                                   int *callbackID)
+{
+    virDomainStatsEventData *data = NULL;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    int ret;
+
+    if (virDomainEventsInitialize() < 0)
+        return -1;
+
+    if (VIR_ALLOC(data) < 0)
+        return -1;
+    data->callbackID = -1;
+    data->stats = stats;
+    data->opaque = opaque;
+    data->freecb = freecb;
+
+    if (dom)
+        virUUIDFormat(dom->uuid, uuidstr);
+    ret = virObjectEventStateRegisterID(conn, state, dom ? uuidstr : NULL,
+                                        virDomainStatsEventFilter, data,
+                                        virDomainStatsEventClass, 0,
+                                        VIR_OBJECT_EVENT_CALLBACK(cb),
+                                        data, virDomainStatsEventCleanup,
+                                        false, callbackID, false);
+    if (ret < 0) {
+        VIR_FREE(data);
+        return -1;
+    }
+
+    /* No sample can name the callback before the caller learns its ID */
+    data->callbackID = *callbackID;
+    return ret;
+}
@@ -314,6 +314,29 @@ virDomainQemuMonitorEventStateRegisterID(virConnectPtr conn,
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(5)
     ATTRIBUTE_NONNULL(9);
 
+int
+virDomainStatsEventStateRegisterID(virConnectPtr conn,
+                                   virObjectEventStatePtr state,
+                                   virDomainPtr dom,
+                                   unsigned int stats,
+                                   virConnectDomainStatsCallback cb,
+                                   void *opaque,
+                                   virFreeCallback freecb,
+                                   int *callbackID)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(5)
+    ATTRIBUTE_NONNULL(8);
+
+virObjectEventPtr
+virDomainStatsEventNew(int id,
+                       const char *name,
+                       const unsigned char *uuid,
+                       virTypedParameterPtr params,
+                       int nparams,
+                       unsigned int *groups,
+                       const int *due,
+                       size_t ndue)
+    ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
+
 virObjectEventPtr
 virDomainQemuMonitorEventNew(int id,
                              const char *name,
@@ -1090,6 +1090,68 @@ virDomainNumaNew(void)
 }
 
 
+/**
+ * virDomainNumaCopy:
+ * @src: NUMA definition to copy
+ *
+ * Returns a deep copy of @src, or NULL with an error reported.
+ */
+virDomainNumaPtr
+virDomainNumaCopy(const virDomainNuma *src)
+{
+    virDomainNumaPtr ret = NULL;
+    size_t i;
+
+    if (!(ret = virDomainNumaNew()))
+        return NULL;
+
+    ret->memory.specified = src->memory.specified;
+    ret->memory.mode = src->memory.mode;
+    ret->memory.placement = src->memory.placement;
+    if (src->memory.nodeset &&
+        !(ret->memory.nodeset = virBitmapNewCopy(src->memory.nodeset)))
+        goto error;
+
+    if (src->nmem_nodes) {
+        if (VIR_ALLOC_N(ret->mem_nodes, src->nmem_nodes) < 0)
+            goto error;
+        ret->nmem_nodes = src->nmem_nodes;
+    }
+
+    for (i = 0; i < src->nmem_nodes; i++) {
+        const struct _virDomainNumaNode *node = &src->mem_nodes[i];
+        struct _virDomainNumaNode *copy = &ret->mem_nodes[i];
+
+        copy->mem = node->mem;
+        copy->mode = node->mode;
+        copy->memAccess = node->memAccess;
+        copy->discard = node->discard;
+
+        if (node->cpumask &&
+            !(copy->cpumask = virBitmapNewCopy(node->cpumask)))
+            goto error;
+
+        if (node->nodeset &&
+            !(copy->nodeset = virBitmapNewCopy(node->nodeset)))
+            goto error;
+
+        if (node->ndistances) {
+            if (VIR_ALLOC_N(copy->distances, node->ndistances) < 0)
+                goto error;
+            memcpy(copy->distances, node->distances,
+                   sizeof(*node->distances) * node->ndistances);
+            copy->ndistances = node->ndistances;
+        }
+    }
+
+    return ret;
+
+ error:
+    virDomainNumaFree(ret);
+    return NULL;
+}
+
+
 bool
 virDomainNumaCheckABIStability(virDomainNumaPtr src,
                                virDomainNumaPtr tgt)
@@ -55,6 +55,7 @@ VIR_ENUM_DECL(virDomainMemoryAccess);
 
 
 virDomainNumaPtr virDomainNumaNew(void);
+virDomainNumaPtr virDomainNumaCopy(const virDomainNuma *src);
 void virDomainNumaFree(virDomainNumaPtr numa);
 
 /*
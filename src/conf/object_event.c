@@ -30,6 +30,8 @@
 #include "datatypes.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "virhash.h"
+#include "virhashcode.h"
 #include "virobject.h"
 #include "virstring.h"
 
@@ -56,10 +58,29 @@ struct _virObjectEventCallback {
 typedef struct _virObjectEventCallback virObjectEventCallback;
 typedef virObjectEventCallback *virObjectEventCallbackPtr;
 
+/* Index key of the callbacks interested in @eventID for the object
+ * identified by @key, or in every object if @key is NULL */
+struct _virObjectEventCallbackIndexKey {
+    int eventID;
+    char *key;
+};
+typedef struct _virObjectEventCallbackIndexKey virObjectEventCallbackIndexKey;
+typedef virObjectEventCallbackIndexKey *virObjectEventCallbackIndexKeyPtr;
+
+/* Callbacks sharing an index key, in registration order */
+struct _virObjectEventCallbackBucket {
+    size_t count;
+    virObjectEventCallbackPtr *callbacks;
+};
+typedef struct _virObjectEventCallbackBucket virObjectEventCallbackBucket;
+typedef virObjectEventCallbackBucket *virObjectEventCallbackBucketPtr;
+
 struct _virObjectEventCallbackList {
     unsigned int nextID;
     size_t count;
     virObjectEventCallbackPtr *callbacks;
+    /* Buckets of callbacks indexed by event ID and object key */
+    virHashTablePtr index;
 };
 
 struct _virObjectEventQueue {
@@ -164,10 +185,195 @@ virObjectEventCallbackListFree(virObjectEventCallbackListPtr list)
         VIR_FREE(list->callbacks[i]);
     }
     VIR_FREE(list->callbacks);
+    virHashFree(list->index);
     VIR_FREE(list);
 }
 
 
+static uint32_t
+virObjectEventCallbackIndexKeyCode(const void *name,
+                                   uint32_t seed)
+{
+    const virObjectEventCallbackIndexKey *key = name;
+    uint32_t code = virHashCodeGen(&key->eventID, sizeof(key->eventID), seed);
+
+    if (key->key)
+        code = virHashCodeGen(key->key, strlen(key->key), code);
+    return code;
+}
+
+
+static bool
+virObjectEventCallbackIndexKeyEqual(const void *namea,
+                                    const void *nameb)
+{
+    const virObjectEventCallbackIndexKey *a = namea;
+    const virObjectEventCallbackIndexKey *b = nameb;
+
+    return a->eventID == b->eventID && STREQ_NULLABLE(a->key, b->key);
+}
+
+
+static void *
+virObjectEventCallbackIndexKeyCopy(const void *name)
+{
+    const virObjectEventCallbackIndexKey *key = name;
+    virObjectEventCallbackIndexKeyPtr copy;
+
+    if (VIR_ALLOC(copy) < 0)
+        return NULL;
+
+    copy->eventID = key->eventID;
+    if (VIR_STRDUP(copy->key, key->key) < 0) {
+        VIR_FREE(copy);
+        return NULL;
+    }
+    return copy;
+}
+
+
+static void
+virObjectEventCallbackIndexKeyFree(void *name)
+{
+    virObjectEventCallbackIndexKeyPtr key = name;
+
+    if (!key)
+        return;
+
+    VIR_FREE(key->key);
+    VIR_FREE(key);
+}
+
+
+static void
+virObjectEventCallbackBucketFree(void *payload,
+                                 const void *name ATTRIBUTE_UNUSED)
+{
+    virObjectEventCallbackBucketPtr bucket = payload;
+
+    if (!bucket)
+        return;
+
+    VIR_FREE(bucket->callbacks);
+    VIR_FREE(bucket);
+}
+
+
+/**
+ * virObjectEventCallbackListNew:
+ *
+ * Allocate an empty callback list along with its index
+ */
+static virObjectEventCallbackListPtr
+virObjectEventCallbackListNew(void)
+{
+    virObjectEventCallbackListPtr list;
+
+    if (VIR_ALLOC(list) < 0)
+        return NULL;
+
+    list->index = virHashCreateFull(32,
+                                    virObjectEventCallbackBucketFree,
+                                    virObjectEventCallbackIndexKeyCode,
+                                    virObjectEventCallbackIndexKeyEqual,
+                                    virObjectEventCallbackIndexKeyCopy,
+                                    virObjectEventCallbackIndexKeyFree);
+    if (!list->index) {
+        VIR_FREE(list);
+        return NULL;
+    }
+
+    return list;
+}
+
+
+/**
+ * virObjectEventCallbackListLookupBucket:
+ * @cbList: the list
+ * @eventID: the event ID
+ * @key: the object key, or NULL for callbacks not filtering on objects
+ *
+ * Returns the bucket of callbacks registered for @eventID and @key,
+ * or NULL if there are none.
+ */
+static virObjectEventCallbackBucketPtr
+virObjectEventCallbackListLookupBucket(virObjectEventCallbackListPtr cbList,
+                                       int eventID,
+                                       const char *key)
+{
+    virObjectEventCallbackIndexKey name = { eventID, (char *)key };
+
+    return virHashLookup(cbList->index, &name);
+}
+
+
+/**
+ * virObjectEventCallbackListIndexAdd:
+ * @cbList: the list
+ * @cb: the callback to index
+ *
+ * Adds @cb to the index of @cbList.  Callbacks are given increasing
+ * IDs, so appending keeps each bucket sorted by callback ID.
+ *
+ * Returns 0 on success, -1 on failure
+ */
+static int
+virObjectEventCallbackListIndexAdd(virObjectEventCallbackListPtr cbList,
+                                   virObjectEventCallbackPtr cb)
+{
+    virObjectEventCallbackIndexKey name = { cb->eventID, cb->key };
+    virObjectEventCallbackBucketPtr bucket;
+
+    if (!(bucket = virHashLookup(cbList->index, &name))) {
+        if (VIR_ALLOC(bucket) < 0)
+            return -1;
+        if (virHashAddEntry(cbList->index, &name, bucket) < 0) {
+            VIR_FREE(bucket);
+            return -1;
+        }
+    }
+
+    if (VIR_APPEND_ELEMENT(bucket->callbacks, bucket->count, cb) < 0) {
+        if (bucket->count == 0)
+            virHashRemoveEntry(cbList->index, &name);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virObjectEventCallbackListIndexRemove:
+ * @cbList: the list
+ * @cb: the callback to drop from the index
+ *
+ * Removes @cb from the index of @cbList, dropping its bucket once it
+ * becomes empty.  Must not be used while dispatching events.
+ */
+static void
+virObjectEventCallbackListIndexRemove(virObjectEventCallbackListPtr cbList,
+                                      virObjectEventCallbackPtr cb)
+{
+    virObjectEventCallbackIndexKey name = { cb->eventID, cb->key };
+    virObjectEventCallbackBucketPtr bucket;
+    size_t i;
+
+    if (!(bucket = virHashLookup(cbList->index, &name)))
+        return;
+
+    for (i = 0; i < bucket->count; i++) {
+        if (bucket->callbacks[i] == cb) {
+            VIR_DELETE_ELEMENT(bucket->callbacks, i, bucket->count);
+            break;
+        }
+    }
+
+    if (bucket->count == 0)
+        virHashRemoveEntry(cbList->index, &name);
+}
+
+
 /**
  * virObjectEventCallbackListCount:
  * @conn: pointer to the connection
@@ -253,6 +459,7 @@ virObjectEventCallbackListRemoveID(virConnectPtr conn,
              * function won't end up with a double free error */
             if (doFreeCb && cb->freecb)
                 (*cb->freecb)(cb->opaque);
+            virObjectEventCallbackListIndexRemove(cbList, cb);
             virObjectEventCallbackFree(cb);
             VIR_DELETE_ELEMENT(cbList->callbacks, i, cbList->count);
             return ret;
@@ -302,6 +509,8 @@ virObjectEventCallbackListPurgeMarked(virObjectEventCallbackListPtr cbList)
             virFreeCallback freecb = cbList->callbacks[n]->freecb;
             if (freecb)
                 (*freecb)(cbList->callbacks[n]->opaque);
+            virObjectEventCallbackListIndexRemove(cbList,
+                                                  cbList->callbacks[n]);
             virObjectEventCallbackFree(cbList->callbacks[n]);
 
             VIR_DELETE_ELEMENT(cbList->callbacks, n, cbList->count);
@@ -340,21 +549,23 @@ virObjectEventCallbackLookup(virConnectPtr conn,
                              bool legacy,
                              int *remoteID)
 {
+    virObjectEventCallbackBucketPtr bucket;
     size_t i;
 
     if (remoteID)
         *remoteID = -1;
 
-    for (i = 0; i < cbList->count; i++) {
-        virObjectEventCallbackPtr cb = cbList->callbacks[i];
+    if (!(bucket = virObjectEventCallbackListLookupBucket(cbList,
+                                                          eventID, key)))
+        return -1;
+
+    for (i = 0; i < bucket->count; i++) {
+        virObjectEventCallbackPtr cb = bucket->callbacks[i];
 
         if (cb->deleted)
             continue;
         if (cb->klass == klass &&
-            cb->eventID == eventID &&
-            cb->conn == conn &&
-            ((key && cb->key_filter && STREQ(cb->key, key)) ||
-             (!key && !cb->key_filter))) {
+            cb->conn == conn) {
             if (remoteID)
                 *remoteID = cb->remoteID;
             if (cb->legacy == legacy &&
@@ -444,9 +655,14 @@ virObjectEventCallbackListAddID(virConnectPtr conn,
     cb->filter_opaque = filter_opaque;
     cb->legacy = legacy;
 
-    if (VIR_APPEND_ELEMENT(cbList->callbacks, cbList->count, cb) < 0)
+    if (virObjectEventCallbackListIndexAdd(cbList, cb) < 0)
         goto cleanup;
 
+    if (VIR_APPEND_ELEMENT(cbList->callbacks, cbList->count, cb) < 0) {
+        virObjectEventCallbackListIndexRemove(cbList, cb);
+        goto cleanup;
+    }
+
     /* When additional filtering is being done, every client callback
      * is matched to exactly one server callback.  */
     if (filter) {
@@ -567,7 +783,7 @@ virObjectEventStateNew(void)
     if (!(state = virObjectLockableNew(virObjectEventStateClass)))
         return NULL;
 
-    if (VIR_ALLOC(state->callbacks) < 0)
+    if (!(state->callbacks = virObjectEventCallbackListNew()))
         goto error;
 
     if (!(state->queue = virObjectEventQueueNew()))
@@ -683,19 +899,48 @@ virObjectEventDispatchMatchCallback(virObjectEventPtr event,
 }
 
 
+/*
+ * Only the callbacks registered for the event ID of @event, either for
+ * every object or for the object @event is about, can match it.  Those
+ * come from two buckets of the index which are both sorted by callback
+ * ID, so merging them preserves the registration order in which
+ * callbacks have always been invoked.
+ */
 static void
 virObjectEventStateDispatchCallbacks(virObjectEventStatePtr state,
                                      virObjectEventPtr event,
                                      virObjectEventCallbackListPtr callbacks)
 {
-    size_t i;
-    /* Cache this now, since we may be dropping the lock,
+    virObjectEventCallbackBucketPtr global;
+    virObjectEventCallbackBucketPtr keyed = NULL;
+    size_t i = 0;
+    size_t j = 0;
+    /* Cache these now, since we may be dropping the lock,
        and have more callbacks added. We're guaranteed not
-       to have any removed */
-    size_t cbCount = callbacks->count;
-
-    for (i = 0; i < cbCount; i++) {
-        virObjectEventCallbackPtr cb = callbacks->callbacks[i];
+       to have any removed, so the buckets stay around */
+    size_t globalCount = 0;
+    size_t keyedCount = 0;
+
+    if ((global = virObjectEventCallbackListLookupBucket(callbacks,
+                                                         event->eventID,
+                                                         NULL)))
+        globalCount = global->count;
+    if (event->meta.key &&
+        (keyed = virObjectEventCallbackListLookupBucket(callbacks,
+                                                        event->eventID,
+                                                        event->meta.key)))
+        keyedCount = keyed->count;
+
+    while (i < globalCount || j < keyedCount) {
+        virObjectEventCallbackPtr cb;
+
+        if (j == keyedCount ||
+            (i < globalCount &&
+             global->callbacks[i]->callbackID <
+             keyed->callbacks[j]->callbackID))
+            cb = global->callbacks[i++];
+        else
+            cb = keyed->callbacks[j++];
 
         if (!virObjectEventDispatchMatchCallback(event, cb))
             continue;
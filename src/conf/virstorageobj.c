@@ -42,6 +42,7 @@ static virClassPtr virStoragePoolObjClass;
 static virClassPtr virStoragePoolObjListClass;
 static virClassPtr virStorageVolObjClass;
 static virClassPtr virStorageVolObjListClass;
+static virClassPtr virStorageVolPathIndexClass;
 
 static void
 virStoragePoolObjDispose(void *opaque);
@@ -51,6 +52,8 @@ static void
 virStorageVolObjDispose(void *opaque);
 static void
 virStorageVolObjListDispose(void *opaque);
+static void
+virStorageVolPathIndexDispose(void *opaque);
 
 
 
@@ -80,6 +83,26 @@ struct _virStorageVolObjList {
     virHashTable *objsPath;
 };
 
+typedef struct _virStorageVolPathIndex virStorageVolPathIndex;
+typedef virStorageVolPathIndex *virStorageVolPathIndexPtr;
+struct _virStorageVolPathIndex {
+    virObjectLockable parent;
+
+    /* path string -> virStorageVolPathOwners mapping
+     * for (1) lookup-by-path across all pools */
+    virHashTable *paths;
+};
+
+/* Several pools can expose the same target path (e.g. two pools over
+ * the same directory), therefore every path keeps the list of all the
+ * pools holding a volume with it. */
+typedef struct _virStorageVolPathOwners virStorageVolPathOwners;
+typedef virStorageVolPathOwners *virStorageVolPathOwnersPtr;
+struct _virStorageVolPathOwners {
+    size_t nuuids;
+    unsigned char *uuids; /* @nuuids times VIR_UUID_BUFLEN bytes */
+};
+
 struct _virStoragePoolObj {
     virObjectLockable parent;
 
@@ -93,6 +116,10 @@ struct _virStoragePoolObj {
     virStoragePoolDefPtr newDef;
 
     virStorageVolObjListPtr volumes;
+
+    /* Index of volume paths shared with the other pools of the list
+     * holding this pool, if any */
+    virStorageVolPathIndexPtr volPaths;
 };
 
 struct _virStoragePoolObjList {
@@ -105,6 +132,9 @@ struct _virStoragePoolObjList {
     /* name string -> virStoragePoolObj mapping
      * for (1), lockless lookup-by-name */
     virHashTable *objsName;
+
+    /* volume paths of all the pools */
+    virStorageVolPathIndexPtr volPaths;
 };
 
 
@@ -117,6 +147,9 @@ virStorageVolObjOnceInit(void)
     if (!VIR_CLASS_NEW(virStorageVolObjList, virClassForObjectRWLockable()))
         return -1;
 
+    if (!VIR_CLASS_NEW(virStorageVolPathIndex, virClassForObjectLockable()))
+        return -1;
+
     return 0;
 }
 
@@ -199,6 +232,166 @@ virStorageVolObjListDispose(void *opaque)
 }
 
 
+static void
+virStorageVolPathOwnersFree(void *payload,
+                            const void *name ATTRIBUTE_UNUSED)
+{
+    virStorageVolPathOwnersPtr owners = payload;
+
+    if (!owners)
+        return;
+
+    VIR_FREE(owners->uuids);
+    VIR_FREE(owners);
+}
+
+
+static virStorageVolPathIndexPtr
+virStorageVolPathIndexNew(void)
+{
+    virStorageVolPathIndexPtr index;
+
+    if (virStorageVolObjInitialize() < 0)
+        return NULL;
+
+    if (!(index = virObjectLockableNew(virStorageVolPathIndexClass)))
+        return NULL;
+
+    if (!(index->paths = virHashCreate(100, virStorageVolPathOwnersFree))) {
+        virObjectUnref(index);
+        return NULL;
+    }
+
+    return index;
+}
+
+
+static void
+virStorageVolPathIndexDispose(void *opaque)
+{
+    virStorageVolPathIndexPtr index = opaque;
+
+    if (!index)
+        return;
+
+    virHashFree(index->paths);
+}
+
+
+/* Called with obj->volPaths locked */
+static ssize_t
+virStorageVolPathOwnersFind(virStorageVolPathOwnersPtr owners,
+                            const unsigned char *uuid)
+{
+    size_t i;
+
+    for (i = 0; i < owners->nuuids; i++) {
+        if (memcmp(owners->uuids + i * VIR_UUID_BUFLEN,
+                   uuid, VIR_UUID_BUFLEN) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+
+/*
+ * Records that the volume with target @path belongs to @obj.
+ */
+static int
+virStoragePoolObjIndexVolPath(virStoragePoolObjPtr obj,
+                              const char *path)
+{
+    virStorageVolPathOwnersPtr owners;
+    virStorageVolPathOwnersPtr newowners = NULL;
+    int ret = -1;
+
+    if (!obj->volPaths)
+        return 0;
+
+    virObjectLock(obj->volPaths);
+
+    if (!(owners = virHashLookup(obj->volPaths->paths, path))) {
+        if (VIR_ALLOC(newowners) < 0 ||
+            virHashAddEntry(obj->volPaths->paths, path, newowners) < 0)
+            goto cleanup;
+        owners = newowners;
+        newowners = NULL;
+    }
+
+    if (virStorageVolPathOwnersFind(owners, obj->def->uuid) < 0) {
+        if (VIR_REALLOC_N(owners->uuids,
+                          (owners->nuuids + 1) * VIR_UUID_BUFLEN) < 0)
+            goto cleanup;
+
+        memcpy(owners->uuids + owners->nuuids * VIR_UUID_BUFLEN,
+               obj->def->uuid, VIR_UUID_BUFLEN);
+        owners->nuuids++;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (owners && owners->nuuids == 0)
+        virHashRemoveEntry(obj->volPaths->paths, path);
+    virObjectUnlock(obj->volPaths);
+    virStorageVolPathOwnersFree(newowners, NULL);
+    return ret;
+}
+
+
+/* Called with obj->volPaths locked */
+static void
+virStoragePoolObjUnindexVolPathLocked(virStoragePoolObjPtr obj,
+                                      const char *path)
+{
+    virStorageVolPathOwnersPtr owners = virHashLookup(obj->volPaths->paths,
+                                                      path);
+    ssize_t idx;
+
+    if (!owners ||
+        (idx = virStorageVolPathOwnersFind(owners, obj->def->uuid)) < 0)
+        return;
+
+    if (owners->nuuids == 1) {
+        virHashRemoveEntry(obj->volPaths->paths, path);
+        return;
+    }
+
+    memmove(owners->uuids + idx * VIR_UUID_BUFLEN,
+            owners->uuids + (idx + 1) * VIR_UUID_BUFLEN,
+            (owners->nuuids - idx - 1) * VIR_UUID_BUFLEN);
+    owners->nuuids--;
+}
+
+
+static int
+virStoragePoolObjUnindexVolPathsCb(void *payload ATTRIBUTE_UNUSED,
+                                   const void *name,
+                                   void *opaque)
+{
+    virStoragePoolObjUnindexVolPathLocked(opaque, name);
+    return 0;
+}
+
+
+/*
+ * Drops the paths of all volumes of @obj from the index.  Called
+ * with obj->volumes locked, or while nobody else can see it.
+ */
+static void
+virStoragePoolObjUnindexVolPaths(virStoragePoolObjPtr obj)
+{
+    if (!obj->volPaths)
+        return;
+
+    virObjectLock(obj->volPaths);
+    virHashForEach(obj->volumes->objsPath,
+                   virStoragePoolObjUnindexVolPathsCb, obj);
+    virObjectUnlock(obj->volPaths);
+}
+
+
 static int
 virStoragePoolObjOnceInit(void)
 {
@@ -367,6 +560,7 @@ virStoragePoolObjDispose(void *opaque)
 
     virStoragePoolObjClearVols(obj);
     virObjectUnref(obj->volumes);
+    virObjectUnref(obj->volPaths);
 
     virStoragePoolDefFree(obj->def);
     virStoragePoolDefFree(obj->newDef);
@@ -383,6 +577,7 @@ virStoragePoolObjListDispose(void *opaque)
 
     virHashFree(pools->objs);
     virHashFree(pools->objsName);
+    virObjectUnref(pools->volPaths);
 }
 
 
@@ -398,7 +593,8 @@ virStoragePoolObjListNew(void)
         return NULL;
 
     if (!(pools->objs = virHashCreate(20, virObjectFreeHashData)) ||
-        !(pools->objsName = virHashCreate(20, virObjectFreeHashData))) {
+        !(pools->objsName = virHashCreate(20, virObjectFreeHashData)) ||
+        !(pools->volPaths = virStorageVolPathIndexNew())) {
         virObjectUnref(pools);
         return NULL;
     }
@@ -523,6 +719,11 @@ virStoragePoolObjRemove(virStoragePoolObjListPtr pools,
     virObjectLock(obj);
     virHashRemoveEntry(pools->objs, uuidstr);
     virHashRemoveEntry(pools->objsName, obj->def->name);
+    virObjectRWLockRead(obj->volumes);
+    virStoragePoolObjUnindexVolPaths(obj);
+    virObjectRWUnlock(obj->volumes);
+    virObjectUnref(obj->volPaths);
+    obj->volPaths = NULL;
     virObjectUnlock(obj);
     virObjectUnref(obj);
     virObjectRWUnlock(pools);
@@ -599,6 +800,62 @@ virStoragePoolObjFindByName(virStoragePoolObjListPtr pools,
 }
 
 
+/**
+ * virStoragePoolObjListFindByVolPath
+ * @pools: Storage pool object list pointer
+ * @path: Target path of the volume to find
+ * @voldef: Filled with the definition of the volume
+ *
+ * Lookup the active pool holding a volume with target @path in the
+ * index of volume paths kept for all pools of @pools.  Unlike
+ * searching the pools one by one, no stable path is computed, so
+ * @path must be exactly the target path of the volume.  If several
+ * active pools hold such a volume, the one indexed first wins.
+ *
+ * Returns: Locked and reffed storage pool object or NULL if not found
+ */
+virStoragePoolObjPtr
+virStoragePoolObjListFindByVolPath(virStoragePoolObjListPtr pools,
+                                   const char *path,
+                                   virStorageVolDefPtr *voldef)
+{
+    virStoragePoolObjPtr obj = NULL;
+    virStorageVolPathOwnersPtr owners;
+    unsigned char *uuids = NULL;
+    size_t nuuids = 0;
+    size_t i;
+
+    *voldef = NULL;
+
+    virObjectLock(pools->volPaths);
+    if ((owners = virHashLookup(pools->volPaths->paths, path)) &&
+        VIR_ALLOC_N_QUIET(uuids, owners->nuuids * VIR_UUID_BUFLEN) == 0) {
+        memcpy(uuids, owners->uuids, owners->nuuids * VIR_UUID_BUFLEN);
+        nuuids = owners->nuuids;
+    }
+    virObjectUnlock(pools->volPaths);
+
+    for (i = 0; i < nuuids; i++) {
+        if (!(obj = virStoragePoolObjFindByUUID(pools,
+                                                uuids + i * VIR_UUID_BUFLEN)))
+            continue;
+
+        if (virStoragePoolObjIsActive(obj) &&
+            (*voldef = virStorageVolDefFindByPath(obj, path)))
+            break;
+
+        virStoragePoolObjEndAPI(&obj);
+    }
+
+    VIR_FREE(uuids);
+
+    if (i == nuuids)
+        return NULL;
+
+    return obj;
+}
+
+
 static virStoragePoolObjPtr
 virStoragePoolSourceFindDuplicateDevices(virStoragePoolObjPtr obj,
                                          virStoragePoolDefPtr def)
@@ -619,6 +876,7 @@ virStoragePoolSourceFindDuplicateDevices(virStoragePoolObjPtr obj,
 void
 virStoragePoolObjClearVols(virStoragePoolObjPtr obj)
 {
+    virStoragePoolObjUnindexVolPaths(obj);
     virHashRemoveAll(obj->volumes->objsKey);
     virHashRemoveAll(obj->volumes->objsName);
     virHashRemoveAll(obj->volumes->objsPath);
@@ -654,6 +912,13 @@ virStoragePoolObjAddVol(virStoragePoolObjPtr obj,
     }
     virObjectRef(volobj);
 
+    if (virStoragePoolObjIndexVolPath(obj, voldef->target.path) < 0) {
+        virHashRemoveEntry(volumes->objsKey, voldef->key);
+        virHashRemoveEntry(volumes->objsName, voldef->name);
+        virHashRemoveEntry(volumes->objsPath, voldef->target.path);
+        goto error;
+    }
+
     volobj->voldef = voldef;
     virObjectRWUnlock(volumes);
     virStorageVolObjEndAPI(&volobj);
@@ -686,6 +951,11 @@ virStoragePoolObjRemoveVol(virStoragePoolObjPtr obj,
 
     virObjectRef(volobj);
     virObjectLock(volobj);
+    if (obj->volPaths) {
+        virObjectLock(obj->volPaths);
+        virStoragePoolObjUnindexVolPathLocked(obj, voldef->target.path);
+        virObjectUnlock(obj->volPaths);
+    }
     virHashRemoveEntry(volumes->objsKey, voldef->key);
     virHashRemoveEntry(volumes->objsName, voldef->name);
     virHashRemoveEntry(volumes->objsPath, voldef->target.path);
@@ -1563,6 +1833,7 @@ virStoragePoolObjAssignDef(virStoragePoolObjListPtr pools,
     }
     virObjectRef(obj);
     obj->def = def;
+    obj->volPaths = virObjectRef(pools->volPaths);
     virObjectRWUnlock(pools);
     return obj;
 
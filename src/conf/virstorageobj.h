@@ -125,6 +125,11 @@ virStoragePoolObjPtr
 virStoragePoolObjFindByName(virStoragePoolObjListPtr pools,
                             const char *name);
 
+virStoragePoolObjPtr
+virStoragePoolObjListFindByVolPath(virStoragePoolObjListPtr pools,
+                                   const char *path,
+                                   virStorageVolDefPtr *voldef);
+
 int
 virStoragePoolObjAddVol(virStoragePoolObjPtr obj,
                         virStorageVolDefPtr voldef);
@@ -1328,6 +1328,26 @@ typedef int
                                         int *nparams,
                                         unsigned int flags);
 
+typedef int
+(*virDrvConnectDomainStatsRegister)(virConnectPtr conn,
+                                    virDomainPtr dom,
+                                    unsigned int stats,
+                                    unsigned int interval,
+                                    virConnectDomainStatsCallback cb,
+                                    void *opaque,
+                                    virFreeCallback freecb,
+                                    unsigned int flags);
+
+typedef int
+(*virDrvConnectDomainStatsDeregister)(virConnectPtr conn,
+                                      int callbackID);
+
+typedef int
+(*virDrvDomainAttachDevices)(virDomainPtr domain,
+                             const char **xmls,
+                             unsigned int nxmls,
+                             unsigned int flags);
+
 
 typedef struct _virHypervisorDriver virHypervisorDriver;
 typedef virHypervisorDriver *virHypervisorDriverPtr;
@@ -1580,6 +1600,9 @@ struct _virHypervisorDriver {
     virDrvConnectBaselineHypervisorCPU connectBaselineHypervisorCPU;
     virDrvNodeGetSEVInfo nodeGetSEVInfo;
     virDrvDomainGetLaunchSecurityInfo domainGetLaunchSecurityInfo;
+    virDrvConnectDomainStatsRegister connectDomainStatsRegister;
+    virDrvConnectDomainStatsDeregister connectDomainStatsDeregister;
+    virDrvDomainAttachDevices domainAttachDevices;
 };
 
 
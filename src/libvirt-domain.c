@@ -8240,6 +8240,67 @@ virDomainAttachDeviceFlags(virDomainPtr domain,
 }
 
 
+/**
+ * virDomainAttachDevices:
+ * @domain: pointer to domain object
+ * @xmls: list of XML descriptions, one device each
+ * @nxmls: the number of devices in @xmls
+ * @flags: bitwise-OR of virDomainDeviceModifyFlags
+ *
+ * Attach several virtual devices to a domain in one go.  This is
+ * equivalent to calling virDomainAttachDeviceFlags() for each entry
+ * of @xmls in turn, except that the hypervisor driver may modify the
+ * domain in a single job and save its state and configuration only
+ * once.  The work needed to hotplug each device, such as setting up
+ * its security labels and cgroups, is still done device by device.
+ *
+ * The devices are attached in the order given.  If attaching one of
+ * them fails, the persistent configuration is left unmodified, but the
+ * devices before it may remain attached to the running domain.
+ *
+ * See virDomainAttachDeviceFlags() for the meaning of @flags.
+ *
+ * Returns 0 in case of success, -1 in case of failure.
+ */
+int
+virDomainAttachDevices(virDomainPtr domain,
+                       const char **xmls,
+                       unsigned int nxmls,
+                       unsigned int flags)
+{
+    virConnectPtr conn;
+    size_t i;
+
+    VIR_DOMAIN_DEBUG(domain, "xmls=%p, nxmls=%u, flags=0x%x",
+                     xmls, nxmls, flags);
+
+    virResetLastError();
+
+    virCheckDomainReturn(domain, -1);
+    conn = domain->conn;
+
+    virCheckNonNullArgGoto(xmls, error);
+    virCheckPositiveArgGoto(nxmls, error);
+    for (i = 0; i < nxmls; i++)
+        virCheckNonNullArgGoto(xmls[i], error);
+    virCheckReadOnlyGoto(conn->flags, error);
+
+    if (conn->driver->domainAttachDevices) {
+        int ret;
+        ret = conn->driver->domainAttachDevices(domain, xmls, nxmls, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(domain->conn);
+    return -1;
+}
+
+
 /**
  * virDomainDetachDevice:
  * @domain: pointer to domain object
@@ -11810,6 +11871,131 @@ virDomainListGetStats(virDomainPtr *doms,
 }
 
 
+/* Default number of domains per chunk of virConnectGetAllDomainStatsChunked;
+ * sized so that a chunk of domains with a few dozen disks and interfaces
+ * stays well below the RPC message limit.  */
+#define VIR_DOMAIN_STATS_CHUNK_DEFAULT 64
+
+/**
+ * virConnectGetAllDomainStatsChunked:
+ * @conn: pointer to the hypervisor connection
+ * @stats: stats to return, binary-OR of virDomainStatsTypes
+ * @chunk: maximum number of domains to collect at once, 0 for a default
+ * @cb: callback invoked for every domain record
+ * @opaque: opaque data to pass on to the callback
+ * @flags: extra flags; binary-OR of virConnectGetAllDomainStatsFlags
+ *
+ * Query statistics for all domains like virConnectGetAllDomainStats(),
+ * but collect them in chunks of at most @chunk domains and hand every
+ * record to @cb as soon as its chunk is done instead of returning one
+ * array at the end.
+ *
+ * This is a convenience wrapper implemented on top of the drivers'
+ * virConnectListAllDomains() and virConnectGetAllDomainStats() support:
+ * the list of domains is fetched in full once at the start and then
+ * the stats of each chunk of it are requested separately. There is no
+ * paging in the driver or in the RPC protocol, so it does not reduce
+ * the amount of data transferred. What it does is keep the records of
+ * at most one chunk in memory on either side of the connection, and
+ * with remote connections every chunk is a separate reply, so hosts
+ * with many domains do not run into the limits on the size of a
+ * single reply. The first records are also available earlier.
+ *
+ * The records of each chunk are sampled when the chunk is requested.
+ * Domains that vanish in between are silently skipped, domains created
+ * in between are not reported. @stats and @flags have the same meaning as for
+ * virConnectGetAllDomainStats() and are applied to every chunk.
+ *
+ * If @cb returns -1 the iteration stops and this function fails.
+ *
+ * Returns the count of records passed to @cb on success, -1 on error.
+ */
+int
+virConnectGetAllDomainStatsChunked(virConnectPtr conn,
+                                   unsigned int stats,
+                                   unsigned int chunk,
+                                   virConnectDomainStatsRecordCallback cb,
+                                   void *opaque,
+                                   unsigned int flags)
+{
+    virDomainPtr *doms = NULL;
+    virDomainPtr *batch = NULL;
+    virDomainStatsRecordPtr *records = NULL;
+    unsigned int lflags = flags & ~(VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT |
+                                    VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING |
+                                    VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS);
+    int ndoms = 0;
+    int count = 0;
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    VIR_DEBUG("conn=%p, stats=0x%x, chunk=%u, cb=%p, opaque=%p, flags=0x%x",
+              conn, stats, chunk, cb, opaque, flags);
+
+    virResetLastError();
+
+    virCheckConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(cb, cleanup);
+
+    if (!conn->driver->connectListAllDomains ||
+        !conn->driver->connectGetAllDomainStats) {
+        virReportUnsupportedError();
+        goto cleanup;
+    }
+
+    if (chunk == 0)
+        chunk = VIR_DOMAIN_STATS_CHUNK_DEFAULT;
+
+    if ((ndoms = conn->driver->connectListAllDomains(conn, &doms, lflags)) < 0)
+        goto cleanup;
+
+    if (VIR_ALLOC_N(batch, MIN(chunk, ndoms) + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ndoms; i += chunk) {
+        unsigned int nbatch = MIN(chunk, ndoms - i);
+        int nrecords;
+
+        memcpy(batch, doms + i, nbatch * sizeof(*batch));
+        batch[nbatch] = NULL;
+
+        if ((nrecords = conn->driver->connectGetAllDomainStats(conn, batch,
+                                                               nbatch, stats,
+                                                               &records,
+                                                               flags)) < 0)
+            goto cleanup;
+
+        for (j = 0; j < nrecords; j++) {
+            if (cb(conn, records[j], opaque) < 0) {
+                virReportError(VIR_ERR_OPERATION_ABORTED, "%s",
+                               _("domain stats callback aborted the query"));
+                goto cleanup;
+            }
+            count++;
+        }
+
+        virDomainStatsRecordListFree(records);
+        records = NULL;
+    }
+
+    ret = count;
+
+ cleanup:
+    virDomainStatsRecordListFree(records);
+    VIR_FREE(batch);
+    if (doms) {
+        for (i = 0; i < ndoms; i++)
+            virObjectUnref(doms[i]);
+        VIR_FREE(doms);
+    }
+    if (ret < 0)
+        virDispatchError(conn);
+
+    return ret;
+}
+
+
 /**
  * virDomainStatsRecordListFree:
  * @stats: NULL terminated array of virDomainStatsRecords to free
@@ -11835,6 +12021,130 @@ virDomainStatsRecordListFree(virDomainStatsRecordPtr *stats)
 }
 
 
+/**
+ * virConnectDomainStatsRegister:
+ * @conn: pointer to the connection
+ * @dom: pointer to the domain, or NULL
+ * @stats: stats types to sample, see virDomainStatsTypes
+ * @interval: sampling interval in seconds
+ * @cb: callback to the function handling the sampled statistics
+ * @opaque: opaque data to pass on to the callback
+ * @freecb: optional function to deallocate opaque when not used anymore
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Subscribes @cb to statistics of running domains sampled every @interval
+ * seconds. Rather than having every client poll
+ * virConnectGetAllDomainStats() on its own schedule, the driver runs a
+ * single sampling pass for all subscriptions that are due and pushes the
+ * results through the regular event loop, so the callback is only invoked
+ * while the application runs an event loop implementation.
+ *
+ * If @dom is NULL, then statistics are delivered for every running
+ * domain, otherwise only for the specific domain. Each invocation of @cb
+ * carries the record of a single domain.
+ *
+ * @stats selects the groups to sample using the same values as
+ * virConnectGetAllDomainStats(); 0 requests all groups supported by the
+ * driver. The records delivered to @cb never contain groups that other
+ * subscriptions requested.
+ *
+ * The virDomainPtr object handle passed into the callback upon delivery
+ * of an event is only valid for the duration of execution of the callback.
+ * If the callback wishes to keep the domain object after the callback returns,
+ * it shall take a reference to it, by calling virDomainRef().
+ * The reference can be released once the object is no longer required
+ * by calling virDomainFree().
+ *
+ * The return value from this method is a positive integer identifier
+ * for the callback. To unregister a callback, this callback ID should
+ * be passed to the virConnectDomainStatsDeregister() method.
+ *
+ * Returns a callback identifier on success, -1 on failure
+ */
+int
+virConnectDomainStatsRegister(virConnectPtr conn,
+                              virDomainPtr dom,
+                              unsigned int stats,
+                              unsigned int interval,
+                              virConnectDomainStatsCallback cb,
+                              void *opaque,
+                              virFreeCallback freecb,
+                              unsigned int flags)
+{
+    VIR_DOMAIN_DEBUG(dom,
+                     "conn=%p, stats=0x%x, interval=%u, cb=%p, opaque=%p, "
+                     "freecb=%p, flags=0x%x",
+                     conn, stats, interval, cb, opaque, freecb, flags);
+
+    virResetLastError();
+
+    virCheckConnectReturn(conn, -1);
+    if (dom) {
+        virCheckDomainGoto(dom, error);
+        if (dom->conn != conn) {
+            virReportInvalidArg(dom,
+                                _("domain '%s' in %s must match connection"),
+                                dom->name, __FUNCTION__);
+            goto error;
+        }
+    }
+    virCheckNonNullArgGoto(cb, error);
+    virCheckPositiveArgGoto(interval, error);
+
+    if (conn->driver && conn->driver->connectDomainStatsRegister) {
+        int ret;
+        ret = conn->driver->connectDomainStatsRegister(conn, dom, stats,
+                                                       interval, cb, opaque,
+                                                       freecb, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
+/**
+ * virConnectDomainStatsDeregister:
+ * @conn: pointer to the connection
+ * @callbackID: the callback identifier
+ *
+ * Removes a statistics subscription. The callbackID parameter should be
+ * the value obtained from a previous virConnectDomainStatsRegister()
+ * method.
+ *
+ * Returns 0 on success, -1 on failure
+ */
+int
+virConnectDomainStatsDeregister(virConnectPtr conn,
+                                int callbackID)
+{
+    VIR_DEBUG("conn=%p, callbackID=%d", conn, callbackID);
+
+    virResetLastError();
+
+    virCheckConnectReturn(conn, -1);
+    virCheckNonNegativeArgGoto(callbackID, error);
+
+    if (conn->driver && conn->driver->connectDomainStatsDeregister) {
+        int ret;
+        ret = conn->driver->connectDomainStatsDeregister(conn, callbackID);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
 /**
  * virDomainGetFSInfo:
  * @dom: a domain object
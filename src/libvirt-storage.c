@@ -882,12 +882,18 @@ virStoragePoolRef(virStoragePoolPtr pool)
 /**
  * virStoragePoolRefresh:
  * @pool: pointer to storage pool
- * @flags: extra flags; not used yet, so callers should always pass 0
+ * @flags: bitwise-OR of virStoragePoolRefreshFlags
  *
  * Request that the pool refresh its list of volumes. This may
  * involve communicating with a remote server, and/or initializing
  * new devices at the OS layer
  *
+ * For directory based pools the refresh is incremental by default:
+ * volumes whose files were not modified since the previous refresh
+ * keep their cached details and only new or changed files are probed.
+ * Passing VIR_STORAGE_POOL_REFRESH_FULL discards the cached volume list
+ * and probes every volume again.
+ *
  * Returns 0 if the volume list was refreshed, -1 on failure
  */
 int
@@ -123,6 +123,16 @@ typedef enum {
      * Support for driver close callback rpc
      */
     VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK = 15,
+
+    /*
+     * Support for bulk domain stats in packed form
+     */
+    VIR_DRV_FEATURE_REMOTE_PACKED_DOMAIN_STATS = 16,
+
+    /*
+     * Support for coalescing events into batch messages
+     */
+    VIR_DRV_FEATURE_REMOTE_EVENT_BATCH = 17,
 } virDrvFeature;
 
 
@@ -46,6 +46,7 @@
 #include "virstring.h"
 #include "virgettext.h"
 #include "virenum.h"
+#include "virhostcpu.h"
 
 #include "locking/lock_daemon_dispatch.h"
 #include "locking/lock_protocol.h"
@@ -150,6 +151,14 @@ virLockDaemonNew(virLockDaemonConfigPtr config, bool privileged)
 {
     virLockDaemonPtr lockd;
     virNetServerPtr srv = NULL;
+    size_t max_workers = config->max_workers;
+
+    if (max_workers == 0) {
+        int ncpus = virHostCPUGetCount();
+
+        max_workers = ncpus > 0 ? ncpus : 1;
+        virResetLastError();
+    }
 
     if (VIR_ALLOC(lockd) < 0)
         return NULL;
@@ -165,7 +174,7 @@ virLockDaemonNew(virLockDaemonConfigPtr config, bool privileged)
         goto error;
 
     if (!(srv = virNetServerNew("virtlockd", 1,
-                                0, 0, 0, config->max_clients,
+                                1, max_workers, 0, config->max_clients,
                                 config->max_clients, -1, 0,
                                 NULL,
                                 virLockDaemonClientNew,
@@ -1052,20 +1061,25 @@ virLockDaemonPreExecRestart(const char *state_file,
     }
 
 
+    virLockDaemonLock(lockDaemon);
     tmp = pairs = virHashGetItems(lockDaemon->lockspaces, NULL);
     while (tmp && tmp->key) {
         virLockSpacePtr lockspace = (virLockSpacePtr)tmp->value;
 
-        if (!(child = virLockSpacePreExecRestart(lockspace)))
+        if (!(child = virLockSpacePreExecRestart(lockspace))) {
+            virLockDaemonUnlock(lockDaemon);
             goto cleanup;
+        }
 
         if (virJSONValueArrayAppend(lockspaces, child) < 0) {
             virJSONValueFree(child);
+            virLockDaemonUnlock(lockDaemon);
             goto cleanup;
         }
 
         tmp++;
     }
+    virLockDaemonUnlock(lockDaemon);
 
     if (!(magic = virLockDaemonGetExecRestartMagic()))
         goto cleanup;
@@ -1465,6 +1479,11 @@ int main(int argc, char **argv) {
     virNetDaemonUpdateServices(lockDaemon->dmn, true);
     virNetDaemonRun(lockDaemon->dmn);
 
+    /* Requests may still be processed by the workers, let them
+     * finish before the lockspaces are saved or freed */
+    virNetServerShutdownWait(lockSrv);
+    virNetServerShutdownWait(adminSrv);
+
     if (execRestart &&
         virLockDaemonPreExecRestart(state_file,
                                     lockDaemon->dmn,
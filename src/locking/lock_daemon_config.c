@@ -99,6 +99,8 @@ virLockDaemonConfigLoadOptions(virLockDaemonConfigPtr data,
         return -1;
     if (virConfGetValueUInt(conf, "max_clients", &data->max_clients) < 0)
         return -1;
+    if (virConfGetValueUInt(conf, "max_workers", &data->max_workers) < 0)
+        return -1;
     if (virConfGetValueUInt(conf, "admin_max_clients", &data->admin_max_clients) < 0)
         return -1;
 
@@ -32,6 +32,7 @@ struct _virLockDaemonConfig {
     char *log_filters;
     char *log_outputs;
     unsigned int max_clients;
+    unsigned int max_workers;
     unsigned int admin_max_clients;
 };
 
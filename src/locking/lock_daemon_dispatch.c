@@ -22,6 +22,7 @@
 
 #include "rpc/virnetdaemon.h"
 #include "rpc/virnetserverclient.h"
+#include "viralloc.h"
 #include "virlog.h"
 #include "virstring.h"
 #include "lock_daemon.h"
@@ -95,6 +96,160 @@ virLockSpaceProtocolDispatchAcquireResource(virNetServerPtr server ATTRIBUTE_UNU
 }
 
 
+static int
+virLockSpaceProtocolDispatchAcquireResources(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                             virNetServerClientPtr client,
+                                             virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                             virNetMessageErrorPtr rerr,
+                                             virLockSpaceProtocolAcquireResourcesArgs *args)
+{
+    int rv = -1;
+    unsigned int flags = args->flags;
+    virLockDaemonClientPtr priv =
+        virNetServerClientGetPrivateData(client);
+    virLockSpacePtr *lockspaces = NULL;
+    virErrorPtr orig_err;
+    size_t nacquired = 0;
+    size_t i;
+
+    virMutexLock(&priv->lock);
+
+    virCheckFlagsGoto(0, cleanup);
+
+    if (priv->restricted) {
+        virReportError(VIR_ERR_OPERATION_DENIED, "%s",
+                       _("lock manager connection has been restricted"));
+        goto cleanup;
+    }
+
+    if (!priv->ownerId) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("lock owner details have not been registered"));
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(lockspaces, args->resources.resources_len) < 0)
+        goto cleanup;
+
+    for (i = 0; i < args->resources.resources_len; i++) {
+        virLockSpaceProtocolResource *res = &args->resources.resources_val[i];
+        virLockSpacePtr lockspace;
+        unsigned int newFlags;
+
+        if (res->flags & ~(VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED |
+                           VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE)) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("unsupported flags (0x%x) for resource %s"),
+                           res->flags, res->name);
+            goto rollback;
+        }
+
+        if (!(lockspace = virLockDaemonFindLockSpace(lockDaemon, res->path))) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Lockspace for path %s does not exist"),
+                           res->path);
+            goto rollback;
+        }
+
+        newFlags = 0;
+        if (res->flags & VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED)
+            newFlags |= VIR_LOCK_SPACE_ACQUIRE_SHARED;
+        if (res->flags & VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE)
+            newFlags |= VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE;
+
+        if (virLockSpaceAcquireResource(lockspace,
+                                        res->name,
+                                        priv->ownerPid,
+                                        newFlags) < 0)
+            goto rollback;
+
+        lockspaces[nacquired++] = lockspace;
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virMutexUnlock(&priv->lock);
+    VIR_FREE(lockspaces);
+    return rv;
+
+ rollback:
+    /* The set is acquired as a whole or not at all */
+    virErrorPreserveLast(&orig_err);
+    for (i = 0; i < nacquired; i++)
+        ignore_value(virLockSpaceReleaseResource(lockspaces[i],
+                                                 args->resources.resources_val[i].name,
+                                                 priv->ownerPid));
+    virErrorRestore(&orig_err);
+    goto cleanup;
+}
+
+
+static int
+virLockSpaceProtocolDispatchReleaseResources(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                             virNetServerClientPtr client,
+                                             virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                             virNetMessageErrorPtr rerr,
+                                             virLockSpaceProtocolReleaseResourcesArgs *args)
+{
+    int rv = -1;
+    unsigned int flags = args->flags;
+    virLockDaemonClientPtr priv =
+        virNetServerClientGetPrivateData(client);
+    size_t i;
+
+    virMutexLock(&priv->lock);
+
+    virCheckFlagsGoto(0, cleanup);
+
+    if (priv->restricted) {
+        virReportError(VIR_ERR_OPERATION_DENIED, "%s",
+                       _("lock manager connection has been restricted"));
+        goto cleanup;
+    }
+
+    if (!priv->ownerId) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("lock owner details have not been registered"));
+        goto cleanup;
+    }
+
+    for (i = 0; i < args->resources.resources_len; i++) {
+        virLockSpaceProtocolResource *res = &args->resources.resources_val[i];
+        virLockSpacePtr lockspace;
+
+        if (res->flags) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("unsupported flags (0x%x) for resource %s"),
+                           res->flags, res->name);
+            goto cleanup;
+        }
+
+        if (!(lockspace = virLockDaemonFindLockSpace(lockDaemon, res->path))) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Lockspace for path %s does not exist"),
+                           res->path);
+            goto cleanup;
+        }
+
+        if (virLockSpaceReleaseResource(lockspace,
+                                        res->name,
+                                        priv->ownerPid) < 0)
+            goto cleanup;
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virMutexUnlock(&priv->lock);
+    return rv;
+}
+
+
 static int
 virLockSpaceProtocolDispatchCreateResource(virNetServerPtr server ATTRIBUTE_UNUSED,
                                            virNetServerClientPtr client,
@@ -236,8 +391,13 @@ virLockSpaceProtocolDispatchNew(virNetServerPtr server ATTRIBUTE_UNUSED,
     }
     virResetLastError();
 
-    lockspace = virLockSpaceNew(args->path);
-    virLockDaemonAddLockSpace(lockDaemon, args->path, lockspace);
+    if (!(lockspace = virLockSpaceNew(args->path)))
+        goto cleanup;
+
+    if (virLockDaemonAddLockSpace(lockDaemon, args->path, lockspace) < 0) {
+        virLockSpaceFree(lockspace);
+        goto cleanup;
+    }
 
     rv = 0;
 
@@ -277,6 +437,8 @@ virLockSpaceProtocolDispatchRegister(virNetServerPtr server ATTRIBUTE_UNUSED,
         goto cleanup;
     }
 
+    /* A client may register again to act on behalf of another owner */
+    VIR_FREE(priv->ownerName);
     if (VIR_STRDUP(priv->ownerName, args->owner.name) < 0)
         goto cleanup;
     memcpy(priv->ownerUUID, args->owner.uuid, VIR_UUID_BUFLEN);
@@ -33,6 +33,7 @@
 #include "lock_protocol.h"
 #include "configmake.h"
 #include "virstring.h"
+#include "viratomic.h"
 
 #include "lock_driver_lockd.h"
 
@@ -49,6 +50,9 @@ typedef virLockManagerLockDaemonResource *virLockManagerLockDaemonResourcePtr;
 typedef struct _virLockManagerLockDaemonDriver virLockManagerLockDaemonDriver;
 typedef virLockManagerLockDaemonDriver *virLockManagerLockDaemonDriverPtr;
 
+typedef struct _virLockManagerLockDaemonConnection virLockManagerLockDaemonConnection;
+typedef virLockManagerLockDaemonConnection *virLockManagerLockDaemonConnectionPtr;
+
 struct _virLockManagerLockDaemonResource {
     char *lockspace;
     char *name;
@@ -68,6 +72,15 @@ struct _virLockManagerLockDaemonPrivate {
 };
 
 
+struct _virLockManagerLockDaemonConnection {
+    virNetClientPtr client;
+    virNetClientProgramPtr program;
+    int counter;
+};
+
+/* Max number of idle connections kept open for reuse */
+#define VIR_LOCK_MANAGER_LOCK_DAEMON_IDLE_MAX 8
+
 struct _virLockManagerLockDaemonDriver {
     bool autoDiskLease;
     bool requireLeaseForDisks;
@@ -75,6 +88,15 @@ struct _virLockManagerLockDaemonDriver {
     char *fileLockSpaceDir;
     char *lvmLockSpaceDir;
     char *scsiLockSpaceDir;
+
+    virMutex lock; /* protects the idle connections */
+    size_t nidle;
+    virLockManagerLockDaemonConnectionPtr idle[VIR_LOCK_MANAGER_LOCK_DAEMON_IDLE_MAX];
+
+    /* Set once virtlockd turns out not to know the *_RESOURCES
+     * procedures. Atomic rather than under @lock, as it is also
+     * checked in the child process between fork and exec. */
+    int noBatch;
 };
 
 static virLockManagerLockDaemonDriverPtr driver;
@@ -252,35 +274,145 @@ static virNetClientPtr virLockManagerLockDaemonConnectionNew(bool privileged,
     virNetClientClose(client);
     virObjectUnref(client);
     virObjectUnref(*prog);
+    *prog = NULL;
     return NULL;
 }
 
 
-static virNetClientPtr
+static void
+virLockManagerLockDaemonConnectionFree(virLockManagerLockDaemonConnectionPtr conn)
+{
+    if (!conn)
+        return;
+
+    virNetClientClose(conn->client);
+    virObjectUnref(conn->client);
+    virObjectUnref(conn->program);
+    VIR_FREE(conn);
+}
+
+
+/**
+ * virLockManagerLockDaemonConnect:
+ * @lock: the lock manager
+ * @pooled: whether an idle connection may be reused
+ *
+ * Get a connection to virtlockd registered for the owner of @lock. A
+ * connection which is handed over to the domain process or restricted
+ * must not be @pooled; everything else reuses an idle connection if
+ * there is one, which saves connecting and setting up the client for
+ * each acquire and release. Locks are owned by the registered owner,
+ * not by the connection, so reusing it for another owner is fine.
+ *
+ * Release the connection with virLockManagerLockDaemonDisconnect().
+ */
+static virLockManagerLockDaemonConnectionPtr
 virLockManagerLockDaemonConnect(virLockManagerPtr lock,
-                                virNetClientProgramPtr *program,
-                                int *counter)
+                                bool pooled)
 {
-    virNetClientPtr client;
+    virLockManagerLockDaemonConnectionPtr conn = NULL;
+
+    while (pooled) {
+        virMutexLock(&driver->lock);
+        if (driver->nidle)
+            conn = driver->idle[--driver->nidle];
+        virMutexUnlock(&driver->lock);
+
+        if (!conn)
+            break;
+
+        /* virtlockd may have gone away since the connection was last
+         * used, in which case throw it away and try the next one */
+        if (virNetClientIsOpen(conn->client) &&
+            virLockManagerLockDaemonConnectionRegister(lock,
+                                                       conn->client,
+                                                       conn->program,
+                                                       &conn->counter) == 0)
+            return conn;
+
+        VIR_DEBUG("Discarding stale connection %p", conn->client);
+        virResetLastError();
+        virLockManagerLockDaemonConnectionFree(conn);
+        conn = NULL;
+    }
 
-    if (!(client = virLockManagerLockDaemonConnectionNew(geteuid() == 0, program)))
+    if (VIR_ALLOC(conn) < 0)
         return NULL;
 
+    if (!(conn->client = virLockManagerLockDaemonConnectionNew(geteuid() == 0,
+                                                               &conn->program)))
+        goto error;
+
     if (virLockManagerLockDaemonConnectionRegister(lock,
-                                                   client,
-                                                   *program,
-                                                   counter) < 0)
+                                                   conn->client,
+                                                   conn->program,
+                                                   &conn->counter) < 0)
         goto error;
 
-    return client;
+    return conn;
 
  error:
-    virNetClientClose(client);
-    virObjectUnref(client);
+    virLockManagerLockDaemonConnectionFree(conn);
     return NULL;
 }
 
 
+static void
+virLockManagerLockDaemonDisconnect(virLockManagerLockDaemonConnectionPtr conn,
+                                   bool pooled)
+{
+    if (!conn)
+        return;
+
+    if (pooled && virNetClientIsOpen(conn->client)) {
+        virMutexLock(&driver->lock);
+        if (driver->nidle < VIR_LOCK_MANAGER_LOCK_DAEMON_IDLE_MAX) {
+            driver->idle[driver->nidle++] = conn;
+            conn = NULL;
+        }
+        virMutexUnlock(&driver->lock);
+    }
+
+    virLockManagerLockDaemonConnectionFree(conn);
+}
+
+
+static bool
+virLockManagerLockDaemonBatchSupported(size_t nresources)
+{
+    return nresources <= VIR_LOCK_SPACE_PROTOCOL_RESOURCES_MAX &&
+           !virAtomicIntGet(&driver->noBatch);
+}
+
+
+/**
+ * virLockManagerLockDaemonBatchFailed:
+ * @conn: the connection a batched call just failed on
+ *
+ * Check whether the failure was because virtlockd predates the batched
+ * procedures, which it reports as an RPC error while keeping the
+ * connection open. If so, the error is discarded and callers fall back
+ * to one call per resource from now on.
+ *
+ * Returns true if the caller should fall back, false otherwise.
+ */
+static bool
+virLockManagerLockDaemonBatchFailed(virLockManagerLockDaemonConnectionPtr conn)
+{
+    if (virGetLastErrorCode() != VIR_ERR_RPC ||
+        !virNetClientIsOpen(conn->client))
+        return false;
+
+    VIR_DEBUG("virtlockd does not support batched resource calls: %s",
+              virGetLastErrorMessage());
+    virResetLastError();
+
+    virAtomicIntSet(&driver->noBatch, 1);
+
+    return true;
+}
+
+
 static int virLockManagerLockDaemonSetupLockspace(const char *path)
 {
     virNetClientPtr client;
@@ -337,6 +469,12 @@ static int virLockManagerLockDaemonInit(unsigned int version,
     if (VIR_ALLOC(driver) < 0)
         return -1;
 
+    if (virMutexInit(&driver->lock) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init mutex"));
+        VIR_FREE(driver);
+        return -1;
+    }
+
     driver->requireLeaseForDisks = true;
     driver->autoDiskLease = true;
 
@@ -366,9 +504,15 @@ static int virLockManagerLockDaemonInit(unsigned int version,
 
 static int virLockManagerLockDaemonDeinit(void)
 {
+    size_t i;
+
     if (!driver)
         return 0;
 
+    for (i = 0; i < driver->nidle; i++)
+        virLockManagerLockDaemonConnectionFree(driver->idle[i]);
+    virMutexDestroy(&driver->lock);
+
     VIR_FREE(driver->scsiLockSpaceDir);
     VIR_FREE(driver->lvmLockSpaceDir);
     VIR_FREE(driver->fileLockSpaceDir);
@@ -624,15 +768,142 @@ static int virLockManagerLockDaemonAddResource(virLockManagerPtr lock,
 }
 
 
+static int
+virLockManagerLockDaemonAcquireResources(virLockManagerPtr lock,
+                                         virLockManagerLockDaemonConnectionPtr conn)
+{
+    virLockManagerLockDaemonPrivatePtr priv = lock->privateData;
+    size_t i;
+
+    if (priv->nresources == 0)
+        return 0;
+
+    if (virLockManagerLockDaemonBatchSupported(priv->nresources)) {
+        virLockSpaceProtocolAcquireResourcesArgs args;
+        int rc;
+
+        memset(&args, 0, sizeof(args));
+
+        if (VIR_ALLOC_N(args.resources.resources_val, priv->nresources) < 0)
+            return -1;
+        args.resources.resources_len = priv->nresources;
+
+        for (i = 0; i < priv->nresources; i++) {
+            args.resources.resources_val[i].path = priv->resources[i].lockspace;
+            args.resources.resources_val[i].name = priv->resources[i].name;
+            args.resources.resources_val[i].flags = priv->resources[i].flags;
+        }
+
+        rc = virNetClientProgramCall(conn->program,
+                                     conn->client,
+                                     conn->counter++,
+                                     VIR_LOCK_SPACE_PROTOCOL_PROC_ACQUIRE_RESOURCES,
+                                     0, NULL, NULL, NULL,
+                                     (xdrproc_t)xdr_virLockSpaceProtocolAcquireResourcesArgs, &args,
+                                     (xdrproc_t)xdr_void, NULL);
+        VIR_FREE(args.resources.resources_val);
+
+        if (rc == 0 || !virLockManagerLockDaemonBatchFailed(conn))
+            return rc;
+    }
+
+    for (i = 0; i < priv->nresources; i++) {
+        virLockSpaceProtocolAcquireResourceArgs args;
+
+        memset(&args, 0, sizeof(args));
+
+        args.path = priv->resources[i].lockspace;
+        args.name = priv->resources[i].name;
+        args.flags = priv->resources[i].flags;
+
+        if (virNetClientProgramCall(conn->program,
+                                    conn->client,
+                                    conn->counter++,
+                                    VIR_LOCK_SPACE_PROTOCOL_PROC_ACQUIRE_RESOURCE,
+                                    0, NULL, NULL, NULL,
+                                    (xdrproc_t)xdr_virLockSpaceProtocolAcquireResourceArgs, &args,
+                                    (xdrproc_t)xdr_void, NULL) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virLockManagerLockDaemonReleaseResources(virLockManagerPtr lock,
+                                         virLockManagerLockDaemonConnectionPtr conn)
+{
+    virLockManagerLockDaemonPrivatePtr priv = lock->privateData;
+    size_t i;
+
+    if (priv->nresources == 0)
+        return 0;
+
+    if (virLockManagerLockDaemonBatchSupported(priv->nresources)) {
+        virLockSpaceProtocolReleaseResourcesArgs args;
+        int rc;
+
+        memset(&args, 0, sizeof(args));
+
+        if (VIR_ALLOC_N(args.resources.resources_val, priv->nresources) < 0)
+            return -1;
+        args.resources.resources_len = priv->nresources;
+
+        for (i = 0; i < priv->nresources; i++) {
+            args.resources.resources_val[i].path = priv->resources[i].lockspace;
+            args.resources.resources_val[i].name = priv->resources[i].name;
+        }
+
+        rc = virNetClientProgramCall(conn->program,
+                                     conn->client,
+                                     conn->counter++,
+                                     VIR_LOCK_SPACE_PROTOCOL_PROC_RELEASE_RESOURCES,
+                                     0, NULL, NULL, NULL,
+                                     (xdrproc_t)xdr_virLockSpaceProtocolReleaseResourcesArgs, &args,
+                                     (xdrproc_t)xdr_void, NULL);
+        VIR_FREE(args.resources.resources_val);
+
+        if (rc == 0 || !virLockManagerLockDaemonBatchFailed(conn))
+            return rc;
+    }
+
+    for (i = 0; i < priv->nresources; i++) {
+        virLockSpaceProtocolReleaseResourceArgs args;
+
+        memset(&args, 0, sizeof(args));
+
+        if (priv->resources[i].lockspace)
+            args.path = priv->resources[i].lockspace;
+        args.name = priv->resources[i].name;
+        args.flags = priv->resources[i].flags;
+
+        args.flags &=
+            ~(VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED |
+              VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE);
+
+        if (virNetClientProgramCall(conn->program,
+                                    conn->client,
+                                    conn->counter++,
+                                    VIR_LOCK_SPACE_PROTOCOL_PROC_RELEASE_RESOURCE,
+                                    0, NULL, NULL, NULL,
+                                    (xdrproc_t)xdr_virLockSpaceProtocolReleaseResourceArgs, &args,
+                                    (xdrproc_t)xdr_void, NULL) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
 static int virLockManagerLockDaemonAcquire(virLockManagerPtr lock,
                                            const char *state ATTRIBUTE_UNUSED,
                                            unsigned int flags,
                                            virDomainLockFailureAction action ATTRIBUTE_UNUSED,
                                            int *fd)
 {
-    virNetClientPtr client = NULL;
-    virNetClientProgramPtr program = NULL;
-    int counter = 0;
+    virLockManagerLockDaemonConnectionPtr conn = NULL;
+    bool pooled = !fd && !(flags & VIR_LOCK_MANAGER_ACQUIRE_RESTRICT);
     int rv = -1;
     virLockManagerLockDaemonPrivatePtr priv = lock->privateData;
 
@@ -647,37 +918,21 @@ static int virLockManagerLockDaemonAcquire(virLockManagerPtr lock,
         return -1;
     }
 
-    if (!(client = virLockManagerLockDaemonConnect(lock, &program, &counter)))
+    if (!(conn = virLockManagerLockDaemonConnect(lock, pooled)))
         goto cleanup;
 
     if (fd &&
-        (*fd = virNetClientDupFD(client, false)) < 0)
+        (*fd = virNetClientDupFD(conn->client, false)) < 0)
         goto cleanup;
 
-    if (!(flags & VIR_LOCK_MANAGER_ACQUIRE_REGISTER_ONLY)) {
-        size_t i;
-        for (i = 0; i < priv->nresources; i++) {
-            virLockSpaceProtocolAcquireResourceArgs args;
-
-            memset(&args, 0, sizeof(args));
-
-            args.path = priv->resources[i].lockspace;
-            args.name = priv->resources[i].name;
-            args.flags = priv->resources[i].flags;
-
-            if (virNetClientProgramCall(program,
-                                        client,
-                                        counter++,
-                                        VIR_LOCK_SPACE_PROTOCOL_PROC_ACQUIRE_RESOURCE,
-                                        0, NULL, NULL, NULL,
-                                        (xdrproc_t)xdr_virLockSpaceProtocolAcquireResourceArgs, &args,
-                                        (xdrproc_t)xdr_void, NULL) < 0)
-                goto cleanup;
-        }
-    }
+    if (!(flags & VIR_LOCK_MANAGER_ACQUIRE_REGISTER_ONLY) &&
+        virLockManagerLockDaemonAcquireResources(lock, conn) < 0)
+        goto cleanup;
 
     if ((flags & VIR_LOCK_MANAGER_ACQUIRE_RESTRICT) &&
-        virLockManagerLockDaemonConnectionRestrict(lock, client, program, &counter) < 0)
+        virLockManagerLockDaemonConnectionRestrict(lock, conn->client,
+                                                   conn->program,
+                                                   &conn->counter) < 0)
         goto cleanup;
 
     rv = 0;
@@ -685,9 +940,7 @@ static int virLockManagerLockDaemonAcquire(virLockManagerPtr lock,
  cleanup:
     if (rv != 0 && fd)
         VIR_FORCE_CLOSE(*fd);
-    virNetClientClose(client);
-    virObjectUnref(client);
-    virObjectUnref(program);
+    virLockManagerLockDaemonDisconnect(conn, pooled);
 
     return rv;
 }
@@ -696,51 +949,24 @@ static int virLockManagerLockDaemonRelease(virLockManagerPtr lock,
                                            char **state,
                                            unsigned int flags)
 {
-    virNetClientPtr client = NULL;
-    virNetClientProgramPtr program = NULL;
-    int counter = 0;
+    virLockManagerLockDaemonConnectionPtr conn = NULL;
     int rv = -1;
-    size_t i;
-    virLockManagerLockDaemonPrivatePtr priv = lock->privateData;
 
     virCheckFlags(0, -1);
 
     if (state)
         *state = NULL;
 
-    if (!(client = virLockManagerLockDaemonConnect(lock, &program, &counter)))
+    if (!(conn = virLockManagerLockDaemonConnect(lock, true)))
         goto cleanup;
 
-    for (i = 0; i < priv->nresources; i++) {
-        virLockSpaceProtocolReleaseResourceArgs args;
-
-        memset(&args, 0, sizeof(args));
-
-        if (priv->resources[i].lockspace)
-            args.path = priv->resources[i].lockspace;
-        args.name = priv->resources[i].name;
-        args.flags = priv->resources[i].flags;
-
-        args.flags &=
-            ~(VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED |
-              VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE);
-
-        if (virNetClientProgramCall(program,
-                                    client,
-                                    counter++,
-                                    VIR_LOCK_SPACE_PROTOCOL_PROC_RELEASE_RESOURCE,
-                                    0, NULL, NULL, NULL,
-                                    (xdrproc_t)xdr_virLockSpaceProtocolReleaseResourceArgs, &args,
-                                    (xdrproc_t)xdr_void, NULL) < 0)
-            goto cleanup;
-    }
+    if (virLockManagerLockDaemonReleaseResources(lock, conn) < 0)
+        goto cleanup;
 
     rv = 0;
 
  cleanup:
-    virNetClientClose(client);
-    virObjectUnref(client);
-    virObjectUnref(program);
+    virLockManagerLockDaemonDisconnect(conn, true);
 
     return rv;
 }
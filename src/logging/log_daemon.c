@@ -45,6 +45,7 @@
 #include "virstring.h"
 #include "virgettext.h"
 #include "virenum.h"
+#include "virrotatingfile.h"
 
 #include "log_daemon_dispatch.h"
 #include "log_protocol.h"
@@ -192,6 +193,10 @@ virLogDaemonNew(virLogDaemonConfigPtr config, bool privileged)
     if (!(logd->handler = virLogHandlerNew(privileged,
                                            config->max_size,
                                            config->max_backups,
+                                           config->compress_backups,
+                                           config->max_rate,
+                                           config->max_burst,
+                                           config->drop_excess,
                                            virLogDaemonInhibitor,
                                            logd)))
         goto error;
@@ -284,6 +289,10 @@ virLogDaemonNewPostExecRestart(virJSONValuePtr object, bool privileged,
                                                           privileged,
                                                           config->max_size,
                                                           config->max_backups,
+                                                          config->compress_backups,
+                                                          config->max_rate,
+                                                          config->max_burst,
+                                                          config->drop_excess,
                                                           virLogDaemonInhibitor,
                                                           logd)))
         goto error;
@@ -1236,6 +1245,9 @@ int main(int argc, char **argv) {
     virNetDaemonUpdateServices(logDaemon->dmn, true);
     virNetDaemonRun(logDaemon->dmn);
 
+    /* Don't leave half compressed log backups behind */
+    virRotatingFileWriterCompressWait();
+
     if (execRestart &&
         virLogDaemonPreExecRestart(state_file,
                                    logDaemon->dmn,
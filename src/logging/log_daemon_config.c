@@ -74,6 +74,8 @@ virLogDaemonConfigNew(bool privileged ATTRIBUTE_UNUSED)
     data->admin_max_clients = 5000;
     data->max_size = 1024 * 1024 * 2;
     data->max_backups = 3;
+    data->max_rate = 0;
+    data->max_burst = 1024 * 1024;
 
     return data;
 }
@@ -94,6 +96,9 @@ static int
 virLogDaemonConfigLoadOptions(virLogDaemonConfigPtr data,
                               virConfPtr conf)
 {
+    char *action = NULL;
+    int ret = -1;
+
     if (virConfGetValueUInt(conf, "log_level", &data->log_level) < 0)
         return -1;
     if (virConfGetValueString(conf, "log_filters", &data->log_filters) < 0)
@@ -108,8 +113,33 @@ virLogDaemonConfigLoadOptions(virLogDaemonConfigPtr data,
         return -1;
     if (virConfGetValueSizeT(conf, "max_backups", &data->max_backups) < 0)
         return -1;
+    if (virConfGetValueBool(conf, "compress_backups", &data->compress_backups) < 0)
+        return -1;
+    if (virConfGetValueSizeT(conf, "max_rate", &data->max_rate) < 0)
+        return -1;
+    if (virConfGetValueSizeT(conf, "max_burst", &data->max_burst) < 0)
+        return -1;
+    if (virConfGetValueString(conf, "rate_limit_action", &action) < 0)
+        return -1;
 
-    return 0;
+    if (action) {
+        if (STREQ(action, "drop")) {
+            data->drop_excess = true;
+        } else if (STREQ(action, "block")) {
+            data->drop_excess = false;
+        } else {
+            virReportError(VIR_ERR_CONF_SYNTAX,
+                           _("Unknown rate_limit_action '%s', expected "
+                             "'block' or 'drop'"), action);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(action);
+    return ret;
 }
 
 
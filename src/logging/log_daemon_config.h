@@ -36,6 +36,11 @@ struct _virLogDaemonConfig {
 
     size_t max_backups;
     size_t max_size;
+    bool compress_backups;
+
+    size_t max_rate;
+    size_t max_burst;
+    bool drop_excess;
 };
 
 
@@ -105,6 +105,38 @@ virLogManagerProtocolDispatchDomainGetLogFilePosition(virNetServerPtr server ATT
 }
 
 
+static int
+virLogManagerProtocolDispatchDomainGetLogFileStats(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                                   virNetServerClientPtr client ATTRIBUTE_UNUSED,
+                                                   virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                                   virNetMessageErrorPtr rerr,
+                                                   virLogManagerProtocolDomainGetLogFileStatsArgs *args,
+                                                   virLogManagerProtocolDomainGetLogFileStatsRet *ret)
+{
+    int rv = -1;
+    virLogHandlerLogFileStats stats;
+
+    if (virLogHandlerDomainGetLogFileStats(virLogDaemonGetHandler(logDaemon),
+                                           args->path,
+                                           args->flags,
+                                           &stats) < 0)
+        goto cleanup;
+
+    ret->stats.bytes = stats.bytes;
+    ret->stats.transfers = stats.transfers;
+    ret->stats.spliced = stats.spliced;
+    ret->stats.dropped = stats.dropped;
+    ret->stats.throttled = stats.throttled;
+
+    rv = 0;
+ cleanup:
+
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    return rv;
+}
+
+
 static int
 virLogManagerProtocolDispatchDomainReadLogFile(virNetServerPtr server ATTRIBUTE_UNUSED,
                                                virNetServerClientPtr client ATTRIBUTE_UNUSED,
@@ -29,6 +29,7 @@
 #include "virlog.h"
 #include "virrotatingfile.h"
 #include "viruuid.h"
+#include "virtime.h"
 
 #include <unistd.h>
 #include <fcntl.h>
@@ -42,6 +43,25 @@ VIR_LOG_INIT("logging.log_handler");
 
 #define DEFAULT_MODE 0600
 
+/* Bounds for the amount of data moved from a log pipe in one go.
+ * The upper limit matches the default pipe capacity on Linux */
+#define VIR_LOG_HANDLER_CHUNK_MIN 4096
+#define VIR_LOG_HANDLER_CHUNK_MAX (64 * 1024)
+
+typedef struct _virLogHandlerDomainLimit virLogHandlerDomainLimit;
+typedef virLogHandlerDomainLimit *virLogHandlerDomainLimitPtr;
+
+/* Token bucket shared by all log files of a single domain */
+struct _virLogHandlerDomainLimit {
+    unsigned char domuuid[VIR_UUID_BUFLEN];
+    size_t nfiles; /* Number of log files using this bucket */
+
+    unsigned long long tokens; /* Bytes which may be written right now */
+    unsigned long long refill; /* Time tokens were last added, in ms */
+    unsigned long long dropped; /* Bytes discarded since last summary */
+    int timer; /* Resumes paused log files once tokens are available */
+};
+
 typedef struct _virLogHandlerLogFile virLogHandlerLogFile;
 typedef virLogHandlerLogFile *virLogHandlerLogFilePtr;
 
@@ -50,6 +70,11 @@ struct _virLogHandlerLogFile {
     int watch;
     int pipefd; /* Read from QEMU via this */
     bool drained;
+    bool paused; /* Not reading from pipefd due to rate limit */
+
+    size_t chunk; /* Adaptive transfer size, grows with busy pipes */
+    virLogHandlerLogFileStats stats;
+    virLogHandlerDomainLimitPtr limit; /* NULL if not rate limited */
 
     char *driver;
     unsigned char domuuid[VIR_UUID_BUFLEN];
@@ -62,10 +87,21 @@ struct _virLogHandler {
     bool privileged;
     size_t max_size;
     size_t max_backups;
+    bool compress_backups;
+
+    /* Per domain rate limit in bytes per second, 0 if unlimited */
+    size_t max_rate;
+    size_t max_burst;
+    bool drop_excess;
 
     virLogHandlerLogFilePtr *files;
     size_t nfiles;
 
+    virLogHandlerDomainLimitPtr *limits;
+    size_t nlimits;
+
+    char *buf; /* Scratch space for copying data from log pipes */
+
     virLogHandlerShutdownInhibitor inhibitor;
     void *opaque;
 };
@@ -103,6 +139,169 @@ virLogHandlerLogFileFree(virLogHandlerLogFilePtr file)
 }
 
 
+static void
+virLogHandlerDomainLimitFree(virLogHandlerDomainLimitPtr limit)
+{
+    if (!limit)
+        return;
+
+    if (limit->timer != -1)
+        virEventRemoveTimeout(limit->timer);
+
+    VIR_FREE(limit);
+}
+
+
+static void
+virLogHandlerDomainLimitResume(virLogHandlerPtr handler,
+                               virLogHandlerDomainLimitPtr limit)
+{
+    size_t i;
+
+    for (i = 0; i < handler->nfiles; i++) {
+        virLogHandlerLogFilePtr file = handler->files[i];
+
+        if (file->limit != limit || !file->paused)
+            continue;
+
+        VIR_DEBUG("Resuming log file %s",
+                  virRotatingFileWriterGetPath(file->file));
+        virEventUpdateHandle(file->watch, VIR_EVENT_HANDLE_READABLE);
+        file->paused = false;
+    }
+}
+
+
+static void
+virLogHandlerDomainLimitTimer(int timer,
+                              void *opaque)
+{
+    virLogHandlerPtr handler = opaque;
+    size_t i;
+
+    virObjectLock(handler);
+
+    virEventUpdateTimeout(timer, -1);
+
+    for (i = 0; i < handler->nlimits; i++) {
+        if (handler->limits[i]->timer == timer) {
+            virLogHandlerDomainLimitResume(handler, handler->limits[i]);
+            break;
+        }
+    }
+
+    virObjectUnlock(handler);
+}
+
+
+/*
+ * Make @file share the token bucket of its domain, creating
+ * the bucket if this is the first log file of the domain.
+ * Nothing is done if rate limiting is disabled.
+ */
+static int
+virLogHandlerDomainLimitAcquire(virLogHandlerPtr handler,
+                                virLogHandlerLogFilePtr file)
+{
+    virLogHandlerDomainLimitPtr limit = NULL;
+    size_t i;
+
+    if (!handler->max_rate)
+        return 0;
+
+    for (i = 0; i < handler->nlimits; i++) {
+        if (memcmp(handler->limits[i]->domuuid, file->domuuid,
+                   VIR_UUID_BUFLEN) == 0) {
+            limit = handler->limits[i];
+            break;
+        }
+    }
+
+    if (!limit) {
+        if (VIR_ALLOC(limit) < 0)
+            return -1;
+
+        memcpy(limit->domuuid, file->domuuid, VIR_UUID_BUFLEN);
+        limit->tokens = handler->max_burst;
+
+        if (virTimeMillisNow(&limit->refill) < 0 ||
+            (limit->timer = virEventAddTimeout(-1,
+                                               virLogHandlerDomainLimitTimer,
+                                               handler,
+                                               NULL)) < 0) {
+            VIR_FREE(limit);
+            return -1;
+        }
+
+        if (VIR_APPEND_ELEMENT_COPY(handler->limits, handler->nlimits,
+                                    limit) < 0) {
+            virLogHandlerDomainLimitFree(limit);
+            return -1;
+        }
+    }
+
+    limit->nfiles++;
+    file->limit = limit;
+
+    return 0;
+}
+
+
+static void
+virLogHandlerDomainLimitRelease(virLogHandlerPtr handler,
+                                virLogHandlerLogFilePtr file)
+{
+    virLogHandlerDomainLimitPtr limit = file->limit;
+    size_t i;
+
+    if (!limit)
+        return;
+
+    file->limit = NULL;
+    if (--limit->nfiles)
+        return;
+
+    for (i = 0; i < handler->nlimits; i++) {
+        if (handler->limits[i] == limit) {
+            VIR_DELETE_ELEMENT(handler->limits, i, handler->nlimits);
+            break;
+        }
+    }
+
+    virLogHandlerDomainLimitFree(limit);
+}
+
+
+/*
+ * Add the tokens accrued between the last refill and @now
+ * (in ms), never accumulating more than the burst size
+ */
+static void
+virLogHandlerDomainLimitRefill(virLogHandlerPtr handler,
+                               virLogHandlerDomainLimitPtr limit,
+                               unsigned long long now)
+{
+    unsigned long long elapsed;
+    unsigned long long tokens;
+
+    if (now <= limit->refill)
+        return;
+
+    elapsed = now - limit->refill;
+    if (elapsed >= (handler->max_burst * 1000ULL) / handler->max_rate) {
+        tokens = handler->max_burst;
+    } else {
+        tokens = elapsed * handler->max_rate / 1000;
+        if (tokens == 0)
+            return;
+        tokens = MIN(limit->tokens + tokens, handler->max_burst);
+    }
+
+    limit->tokens = tokens;
+    limit->refill = now;
+}
+
+
 static void
 virLogHandlerLogFileClose(virLogHandlerPtr handler,
                           virLogHandlerLogFilePtr file)
@@ -112,6 +311,7 @@ virLogHandlerLogFileClose(virLogHandlerPtr handler,
     for (i = 0; i < handler->nfiles; i++) {
         if (handler->files[i] == file) {
             VIR_DELETE_ELEMENT(handler->files, i, handler->nfiles);
+            virLogHandlerDomainLimitRelease(handler, file);
             virLogHandlerLogFileFree(file);
             break;
         }
@@ -119,6 +319,22 @@ virLogHandlerLogFileClose(virLogHandlerPtr handler,
 }
 
 
+static virLogHandlerLogFilePtr
+virLogHandlerGetLogFileFromPath(virLogHandlerPtr handler,
+                                const char *path)
+{
+    size_t i;
+
+    for (i = 0; i < handler->nfiles; i++) {
+        if (STREQ(virRotatingFileWriterGetPath(handler->files[i]->file),
+                  path))
+            return handler->files[i];
+    }
+
+    return NULL;
+}
+
+
 static virLogHandlerLogFilePtr
 virLogHandlerGetLogFileFromWatch(virLogHandlerPtr handler,
                                  int watch)
@@ -134,6 +350,143 @@ virLogHandlerGetLogFileFromWatch(virLogHandlerPtr handler,
 }
 
 
+/*
+ * Move one chunk of data from the log pipe into the log file.
+ * Data is spliced straight into the file when the rollover
+ * limits allow it, otherwise it is copied via the handler's
+ * scratch buffer. The chunk size doubles whenever a transfer
+ * fills it and shrinks again once the pipe goes quiet, so
+ * that a busy pipe is drained with few syscalls.
+ *
+ * No more than @maxlen bytes are transferred.
+ *
+ * Returns the number of bytes transferred, 0 on EOF or
+ * -1 on error
+ */
+static ssize_t
+virLogHandlerLogFileTransfer(virLogHandlerPtr handler,
+                             virLogHandlerLogFilePtr file,
+                             size_t maxlen)
+{
+    size_t want = MIN(file->chunk, maxlen);
+    ssize_t len;
+
+    len = virRotatingFileWriterAppendFD(file->file, file->pipefd, want);
+    if (len == -1)
+        return -1;
+
+    if (len >= 0) {
+        file->stats.spliced += len;
+    } else {
+ reread:
+        len = read(file->pipefd, handler->buf, want);
+        if (len < 0) {
+            if (errno == EINTR)
+                goto reread;
+
+            virReportSystemError(errno, "%s",
+                                 _("Unable to read from log pipe"));
+            return -1;
+        }
+
+        if (virRotatingFileWriterAppend(file->file, handler->buf, len) != len)
+            return -1;
+    }
+
+    file->stats.bytes += len;
+    file->stats.transfers++;
+
+    if ((size_t)len == file->chunk &&
+        file->chunk < VIR_LOG_HANDLER_CHUNK_MAX)
+        file->chunk *= 2;
+    else if ((size_t)len < file->chunk / 4 &&
+             file->chunk > VIR_LOG_HANDLER_CHUNK_MIN)
+        file->chunk /= 2;
+
+    return len;
+}
+
+
+/*
+ * Deal with data arriving on a log pipe whose domain has
+ * exceeded its rate limit. Either the data is discarded and
+ * accounted for, or we stop reading from the pipe until the
+ * token bucket has been refilled, letting the pipe fill up
+ * and push back on the writer.
+ *
+ * Returns the number of bytes discarded, 0 on EOF or when
+ * the pipe was paused, -1 on error
+ */
+static ssize_t
+virLogHandlerLogFileThrottle(virLogHandlerPtr handler,
+                             virLogHandlerLogFilePtr file)
+{
+    virLogHandlerDomainLimitPtr limit = file->limit;
+    unsigned long long wait;
+    ssize_t len;
+
+    if (handler->drop_excess) {
+ reread:
+        len = read(file->pipefd, handler->buf, file->chunk);
+        if (len < 0) {
+            if (errno == EINTR)
+                goto reread;
+
+            virReportSystemError(errno, "%s",
+                                 _("Unable to read from log pipe"));
+            return -1;
+        }
+
+        limit->dropped += len;
+        file->stats.dropped += len;
+        return len;
+    }
+
+    /* Wait until there are enough tokens for a reasonably sized
+     * write, rather than waking up for every few bytes */
+    wait = MIN(VIR_LOG_HANDLER_CHUNK_MIN, handler->max_burst) * 1000ULL /
+        handler->max_rate;
+
+    VIR_DEBUG("Pausing log file %s for %llu ms",
+              virRotatingFileWriterGetPath(file->file), wait);
+
+    virEventUpdateHandle(file->watch, 0);
+    virEventUpdateTimeout(limit->timer, MAX(wait, 1));
+    file->paused = true;
+    file->stats.throttled++;
+
+    return 0;
+}
+
+
+/*
+ * Leave a note in the log file about data discarded due to
+ * the rate limit, once the domain is allowed to write again
+ */
+static int
+virLogHandlerLogFileSummarize(virLogHandlerLogFilePtr file)
+{
+    virLogHandlerDomainLimitPtr limit = file->limit;
+    char *msg = NULL;
+    int ret = -1;
+
+    if (virAsprintf(&msg,
+                    "\nvirtlogd: %llu bytes of output dropped due to rate limit\n",
+                    limit->dropped) < 0)
+        return -1;
+
+    if (virRotatingFileWriterAppend(file->file, msg, strlen(msg)) < 0)
+        goto cleanup;
+
+    limit->dropped = 0;
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(msg);
+    return ret;
+}
+
+
 static void
 virLogHandlerDomainLogFileEvent(int watch,
                                 int fd,
@@ -142,7 +495,7 @@ virLogHandlerDomainLogFileEvent(int watch,
 {
     virLogHandlerPtr handler = opaque;
     virLogHandlerLogFilePtr logfile;
-    char buf[1024];
+    size_t maxlen = VIR_LOG_HANDLER_CHUNK_MAX;
     ssize_t len;
 
     virObjectLock(handler);
@@ -158,20 +511,39 @@ virLogHandlerDomainLogFileEvent(int watch,
         goto cleanup;
     }
 
- reread:
-    len = read(fd, buf, sizeof(buf));
-    if (len < 0) {
-        if (errno == EINTR)
-            goto reread;
+    if (logfile->paused)
+        goto cleanup;
 
-        virReportSystemError(errno, "%s",
-                             _("Unable to read from log pipe"));
-        goto error;
+    if (logfile->limit) {
+        unsigned long long now;
+
+        if (virTimeMillisNowRaw(&now) == 0)
+            virLogHandlerDomainLimitRefill(handler, logfile->limit, now);
+
+        if (logfile->limit->tokens == 0) {
+            if ((len = virLogHandlerLogFileThrottle(handler, logfile)) < 0)
+                goto error;
+
+            if (len == 0 && !logfile->paused &&
+                (events & VIR_EVENT_HANDLE_HANGUP))
+                goto error;
+
+            goto cleanup;
+        }
+
+        if (logfile->limit->dropped &&
+            virLogHandlerLogFileSummarize(logfile) < 0)
+            goto error;
+
+        maxlen = logfile->limit->tokens;
     }
 
-    if (virRotatingFileWriterAppend(logfile->file, buf, len) != len)
+    if ((len = virLogHandlerLogFileTransfer(handler, logfile, maxlen)) < 0)
         goto error;
 
+    if (logfile->limit)
+        logfile->limit->tokens -= len;
+
     if (events & VIR_EVENT_HANDLE_HANGUP)
         goto error;
 
@@ -190,6 +562,10 @@ virLogHandlerPtr
 virLogHandlerNew(bool privileged,
                  size_t max_size,
                  size_t max_backups,
+                 bool compress_backups,
+                 size_t max_rate,
+                 size_t max_burst,
+                 bool drop_excess,
                  virLogHandlerShutdownInhibitor inhibitor,
                  void *opaque)
 {
@@ -201,9 +577,18 @@ virLogHandlerNew(bool privileged,
     if (!(handler = virObjectLockableNew(virLogHandlerClass)))
         goto error;
 
+    if (VIR_ALLOC_N(handler->buf, VIR_LOG_HANDLER_CHUNK_MAX) < 0) {
+        virObjectUnref(handler);
+        goto error;
+    }
+
     handler->privileged = privileged;
     handler->max_size = max_size;
     handler->max_backups = max_backups;
+    handler->compress_backups = compress_backups;
+    handler->max_rate = max_rate;
+    handler->max_burst = max_burst ? max_burst : max_rate;
+    handler->drop_excess = drop_excess;
     handler->inhibitor = inhibitor;
     handler->opaque = opaque;
 
@@ -226,6 +611,8 @@ virLogHandlerLogFilePostExecRestart(virLogHandlerPtr handler,
     if (VIR_ALLOC(file) < 0)
         return NULL;
 
+    file->chunk = VIR_LOG_HANDLER_CHUNK_MIN;
+
     handler->inhibitor(true, handler->opaque);
 
     if ((path = virJSONValueObjectGetString(object, "path")) == NULL) {
@@ -265,7 +652,9 @@ virLogHandlerLogFilePostExecRestart(virLogHandlerPtr handler,
                                                handler->max_size,
                                                handler->max_backups,
                                                false,
-                                               DEFAULT_MODE)) == NULL)
+                                               DEFAULT_MODE)) == NULL ||
+        virRotatingFileWriterSetCompress(file->file,
+                                         handler->compress_backups) < 0)
         goto error;
 
     if (virJSONValueObjectGetNumberInt(object, "pipefd", &file->pipefd) < 0) {
@@ -293,6 +682,10 @@ virLogHandlerNewPostExecRestart(virJSONValuePtr object,
                                 bool privileged,
                                 size_t max_size,
                                 size_t max_backups,
+                                bool compress_backups,
+                                size_t max_rate,
+                                size_t max_burst,
+                                bool drop_excess,
                                 virLogHandlerShutdownInhibitor inhibitor,
                                 void *opaque)
 {
@@ -303,6 +696,10 @@ virLogHandlerNewPostExecRestart(virJSONValuePtr object,
     if (!(handler = virLogHandlerNew(privileged,
                                      max_size,
                                      max_backups,
+                                     compress_backups,
+                                     max_rate,
+                                     max_burst,
+                                     drop_excess,
                                      inhibitor,
                                      opaque)))
         return NULL;
@@ -329,11 +726,13 @@ virLogHandlerNewPostExecRestart(virJSONValuePtr object,
         if (VIR_APPEND_ELEMENT_COPY(handler->files, handler->nfiles, file) < 0)
             goto error;
 
-        if ((file->watch = virEventAddHandle(file->pipefd,
+        if (virLogHandlerDomainLimitAcquire(handler, file) < 0 ||
+            (file->watch = virEventAddHandle(file->pipefd,
                                              VIR_EVENT_HANDLE_READABLE,
                                              virLogHandlerDomainLogFileEvent,
                                              handler,
                                              NULL)) < 0) {
+            virLogHandlerDomainLimitRelease(handler, file);
             VIR_DELETE_ELEMENT(handler->files, handler->nfiles - 1, handler->nfiles);
             goto error;
         }
@@ -359,6 +758,10 @@ virLogHandlerDispose(void *obj)
         virLogHandlerLogFileFree(handler->files[i]);
     }
     VIR_FREE(handler->files);
+    for (i = 0; i < handler->nlimits; i++)
+        virLogHandlerDomainLimitFree(handler->limits[i]);
+    VIR_FREE(handler->limits);
+    VIR_FREE(handler->buf);
 }
 
 
@@ -399,6 +802,7 @@ virLogHandlerDomainOpenLogFile(virLogHandlerPtr handler,
         goto error;
 
     file->watch = -1;
+    file->chunk = VIR_LOG_HANDLER_CHUNK_MIN;
     file->pipefd = pipefd[0];
     pipefd[0] = -1;
     memcpy(file->domuuid, domuuid, VIR_UUID_BUFLEN);
@@ -410,17 +814,21 @@ virLogHandlerDomainOpenLogFile(virLogHandlerPtr handler,
                                                handler->max_size,
                                                handler->max_backups,
                                                trunc,
-                                               DEFAULT_MODE)) == NULL)
+                                               DEFAULT_MODE)) == NULL ||
+        virRotatingFileWriterSetCompress(file->file,
+                                         handler->compress_backups) < 0)
         goto error;
 
     if (VIR_APPEND_ELEMENT_COPY(handler->files, handler->nfiles, file) < 0)
         goto error;
 
-    if ((file->watch = virEventAddHandle(file->pipefd,
+    if (virLogHandlerDomainLimitAcquire(handler, file) < 0 ||
+        (file->watch = virEventAddHandle(file->pipefd,
                                          VIR_EVENT_HANDLE_READABLE,
                                          virLogHandlerDomainLogFileEvent,
                                          handler,
                                          NULL)) < 0) {
+        virLogHandlerDomainLimitRelease(handler, file);
         VIR_DELETE_ELEMENT(handler->files, handler->nfiles - 1, handler->nfiles);
         goto error;
     }
@@ -442,14 +850,31 @@ virLogHandlerDomainOpenLogFile(virLogHandlerPtr handler,
 
 
 static void
-virLogHandlerDomainLogFileDrain(virLogHandlerLogFilePtr file)
+virLogHandlerDomainLogFileDrain(virLogHandlerPtr handler,
+                                virLogHandlerLogFilePtr file)
 {
-    char buf[1024];
+    size_t maxlen = VIR_LOG_HANDLER_CHUNK_MAX;
+    unsigned long long now;
     ssize_t len;
     struct pollfd pfd;
     int ret;
 
     for (;;) {
+        /* Data beyond the domain's rate limit is left in the pipe
+         * for the event loop to throttle or drop. */
+        if (file->limit) {
+            if (file->paused)
+                return;
+
+            if (virTimeMillisNowRaw(&now) == 0)
+                virLogHandlerDomainLimitRefill(handler, file->limit, now);
+
+            if (file->limit->tokens == 0)
+                return;
+
+            maxlen = file->limit->tokens;
+        }
+
         pfd.fd = file->pipefd;
         pfd.events = POLLIN;
         pfd.revents = 0;
@@ -465,16 +890,13 @@ virLogHandlerDomainLogFileDrain(virLogHandlerLogFilePtr file)
         if (ret == 0)
             return;
 
-        len = read(file->pipefd, buf, sizeof(buf));
+        len = virLogHandlerLogFileTransfer(handler, file, maxlen);
         file->drained = true;
-        if (len < 0) {
-            if (errno == EINTR)
-                continue;
+        if (len <= 0)
             return;
-        }
 
-        if (virRotatingFileWriterAppend(file->file, buf, len) != len)
-            return;
+        if (file->limit)
+            file->limit->tokens -= len;
     }
 }
 
@@ -488,28 +910,19 @@ virLogHandlerDomainGetLogFilePosition(virLogHandlerPtr handler,
 {
     virLogHandlerLogFilePtr file = NULL;
     int ret = -1;
-    size_t i;
 
     virCheckFlags(0, -1);
 
     virObjectLock(handler);
 
-    for (i = 0; i < handler->nfiles; i++) {
-        if (STREQ(virRotatingFileWriterGetPath(handler->files[i]->file),
-                  path)) {
-            file = handler->files[i];
-            break;
-        }
-    }
-
-    if (!file) {
+    if (!(file = virLogHandlerGetLogFileFromPath(handler, path))) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("No open log file %s"),
                        path);
         goto cleanup;
     }
 
-    virLogHandlerDomainLogFileDrain(file);
+    virLogHandlerDomainLogFileDrain(handler, file);
 
     *inode = virRotatingFileWriterGetINode(file->file);
     *offset = virRotatingFileWriterGetOffset(file->file);
@@ -522,6 +935,36 @@ virLogHandlerDomainGetLogFilePosition(virLogHandlerPtr handler,
 }
 
 
+int
+virLogHandlerDomainGetLogFileStats(virLogHandlerPtr handler,
+                                   const char *path,
+                                   unsigned int flags,
+                                   virLogHandlerLogFileStatsPtr stats)
+{
+    virLogHandlerLogFilePtr file = NULL;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    virObjectLock(handler);
+
+    if (!(file = virLogHandlerGetLogFileFromPath(handler, path))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("No open log file %s"),
+                       path);
+        goto cleanup;
+    }
+
+    *stats = file->stats;
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(handler);
+    return ret;
+}
+
+
 char *
 virLogHandlerDomainReadLogFile(virLogHandlerPtr handler,
                                const char *path,
@@ -596,7 +1039,9 @@ virLogHandlerDomainAppendLogFile(virLogHandlerPtr handler,
                                                    handler->max_size,
                                                    handler->max_backups,
                                                    false,
-                                                   DEFAULT_MODE)))
+                                                   DEFAULT_MODE)) ||
+            virRotatingFileWriterSetCompress(newwriter,
+                                             handler->compress_backups) < 0)
             goto cleanup;
 
         writer = newwriter;
@@ -27,6 +27,17 @@
 typedef struct _virLogHandler virLogHandler;
 typedef virLogHandler *virLogHandlerPtr;
 
+typedef struct _virLogHandlerLogFileStats virLogHandlerLogFileStats;
+typedef virLogHandlerLogFileStats *virLogHandlerLogFileStatsPtr;
+
+struct _virLogHandlerLogFileStats {
+    unsigned long long bytes;     /* total bytes read from the pipe */
+    unsigned long long transfers; /* number of chunks moved */
+    unsigned long long spliced;   /* bytes moved without copying */
+    unsigned long long dropped;   /* bytes discarded by the rate limit */
+    unsigned long long throttled; /* times reading paused by the rate limit */
+};
+
 
 typedef void (*virLogHandlerShutdownInhibitor)(bool inhibit,
                                                void *opaque);
@@ -34,12 +45,20 @@ typedef void (*virLogHandlerShutdownInhibitor)(bool inhibit,
 virLogHandlerPtr virLogHandlerNew(bool privileged,
                                   size_t max_size,
                                   size_t max_backups,
+                                  bool compress_backups,
+                                  size_t max_rate,
+                                  size_t max_burst,
+                                  bool drop_excess,
                                   virLogHandlerShutdownInhibitor inhibitor,
                                   void *opaque);
 virLogHandlerPtr virLogHandlerNewPostExecRestart(virJSONValuePtr child,
                                                  bool privileged,
                                                  size_t max_size,
                                                  size_t max_backups,
+                                                 bool compress_backups,
+                                                 size_t max_rate,
+                                                 size_t max_burst,
+                                                 bool drop_excess,
                                                  virLogHandlerShutdownInhibitor inhibitor,
                                                  void *opaque);
 
@@ -60,6 +79,11 @@ int virLogHandlerDomainGetLogFilePosition(virLogHandlerPtr handler,
                                           ino_t *inode,
                                           off_t *offset);
 
+int virLogHandlerDomainGetLogFileStats(virLogHandlerPtr handler,
+                                       const char *path,
+                                       unsigned int flags,
+                                       virLogHandlerLogFileStatsPtr stats);
+
 char *virLogHandlerDomainReadLogFile(virLogHandlerPtr handler,
                                      const char *path,
                                      ino_t inode,
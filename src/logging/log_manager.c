@@ -246,6 +246,35 @@ virLogManagerDomainGetLogFilePosition(virLogManagerPtr mgr,
 }
 
 
+int
+virLogManagerDomainGetLogFileStats(virLogManagerPtr mgr,
+                                   const char *path,
+                                   unsigned int flags,
+                                   virLogManagerProtocolLogFileStats *stats)
+{
+    struct virLogManagerProtocolDomainGetLogFileStatsArgs args;
+    struct virLogManagerProtocolDomainGetLogFileStatsRet ret;
+
+    memset(&args, 0, sizeof(args));
+    memset(&ret, 0, sizeof(ret));
+
+    args.path = (char *)path;
+    args.flags = flags;
+
+    if (virNetClientProgramCall(mgr->program,
+                                mgr->client,
+                                mgr->serial++,
+                                VIR_LOG_MANAGER_PROTOCOL_PROC_DOMAIN_GET_LOG_FILE_STATS,
+                                0, NULL, NULL, NULL,
+                                (xdrproc_t)xdr_virLogManagerProtocolDomainGetLogFileStatsArgs, &args,
+                                (xdrproc_t)xdr_virLogManagerProtocolDomainGetLogFileStatsRet, &ret) < 0)
+        return -1;
+
+    *stats = ret.stats;
+    return 0;
+}
+
+
 char *
 virLogManagerDomainReadLogFile(virLogManagerPtr mgr,
                                const char *path,
@@ -47,6 +47,11 @@ int virLogManagerDomainGetLogFilePosition(virLogManagerPtr mgr,
                                           ino_t *inode,
                                           off_t *offset);
 
+int virLogManagerDomainGetLogFileStats(virLogManagerPtr mgr,
+                                       const char *path,
+                                       unsigned int flags,
+                                       virLogManagerProtocolLogFileStats *stats);
+
 char *virLogManagerDomainReadLogFile(virLogManagerPtr mgr,
                                      const char *path,
                                      ino_t inode,
@@ -57,6 +57,24 @@ struct virLogManagerProtocolDomainGetLogFilePositionRet {
     virLogManagerProtocolLogFilePosition pos;
 };
 
+struct virLogManagerProtocolLogFileStats {
+    unsigned hyper bytes;
+    unsigned hyper transfers;
+    unsigned hyper spliced;
+    unsigned hyper dropped;
+    unsigned hyper throttled;
+};
+typedef struct virLogManagerProtocolLogFileStats virLogManagerProtocolLogFileStats;
+
+struct virLogManagerProtocolDomainGetLogFileStatsArgs {
+    virLogManagerProtocolNonNullString path;
+    unsigned int flags;
+};
+
+struct virLogManagerProtocolDomainGetLogFileStatsRet {
+    virLogManagerProtocolLogFileStats stats;
+};
+
 struct virLogManagerProtocolDomainReadLogFileArgs {
     virLogManagerProtocolNonNullString path;
     virLogManagerProtocolLogFilePosition pos;
@@ -133,5 +151,11 @@ enum virLogManagerProtocolProcedure {
      * @generate: none
      * @acl: none
      */
-    VIR_LOG_MANAGER_PROTOCOL_PROC_DOMAIN_APPEND_LOG_FILE = 4
+    VIR_LOG_MANAGER_PROTOCOL_PROC_DOMAIN_APPEND_LOG_FILE = 4,
+
+    /**
+     * @generate: none
+     * @acl: none
+     */
+    VIR_LOG_MANAGER_PROTOCOL_PROC_DOMAIN_GET_LOG_FILE_STATS = 5
 };
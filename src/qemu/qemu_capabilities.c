@@ -54,6 +54,9 @@
 #include <sys/wait.h>
 #include <stdarg.h>
 #include <sys/utsname.h>
+#if HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+#endif
 
 #define VIR_FROM_THIS VIR_FROM_QEMU
 
@@ -567,6 +570,10 @@ struct _virQEMUCapsHostCPUData {
 struct _virQEMUCaps {
     virObject parent;
 
+    /* The object is owned by the capabilities cache and shared by all
+     * its users, it must not be modified. */
+    bool shared;
+
     bool usedQMP;
     bool kvmSupportsNesting;
 
@@ -598,6 +605,10 @@ struct _virQEMUCaps {
 
     virQEMUCapsHostCPUData kvmCPU;
     virQEMUCapsHostCPUData tcgCPU;
+
+    /* generation of the capabilities cache in which the capabilities
+     * were last fully validated, only accessed with the cache locked */
+    unsigned long long validGeneration;
 };
 
 struct virQEMUCapsSearchData {
@@ -755,27 +766,39 @@ virQEMUCapsFindBinaryForArch(virArch hostarch,
 }
 
 static int
-virQEMUCapsInitGuest(virCapsPtr caps,
-                     virFileCachePtr cache,
-                     virArch hostarch,
-                     virArch guestarch)
+virQEMUCapsFindGuestBinary(virArch hostarch,
+                           virArch guestarch,
+                           char **binary)
 {
-    char *binary = NULL;
-    virQEMUCapsPtr qemuCaps = NULL;
-    int ret = -1;
-
     /* Check for existence of base emulator, or alternate base
      * which can be used with magic cpu choice
      */
-    binary = virQEMUCapsFindBinaryForArch(hostarch, guestarch);
+    *binary = virQEMUCapsFindBinaryForArch(hostarch, guestarch);
 
     /* RHEL doesn't follow the usual naming for QEMU binaries and ships
      * a single binary named qemu-kvm outside of $PATH instead */
-    if (virQEMUCapsGuestIsNative(hostarch, guestarch) && !binary) {
-        if (VIR_STRDUP(binary, "/usr/libexec/qemu-kvm") < 0)
+    if (virQEMUCapsGuestIsNative(hostarch, guestarch) && !*binary) {
+        if (VIR_STRDUP(*binary, "/usr/libexec/qemu-kvm") < 0)
             return -1;
     }
 
+    return 0;
+}
+
+
+static int
+virQEMUCapsInitGuest(virCapsPtr caps,
+                     virFileCachePtr cache,
+                     virArch hostarch,
+                     virArch guestarch)
+{
+    char *binary = NULL;
+    virQEMUCapsPtr qemuCaps = NULL;
+    int ret = -1;
+
+    if (virQEMUCapsFindGuestBinary(hostarch, guestarch, &binary) < 0)
+        return -1;
+
     /* Ignore binary if extracting version info fails */
     if (binary) {
         if (!(qemuCaps = virQEMUCapsCacheLookup(cache, binary))) {
@@ -931,6 +954,24 @@ virQEMUCapsInit(virFileCachePtr cache)
     virCapabilitiesAddHostMigrateTransport(caps, "tcp");
     virCapabilitiesAddHostMigrateTransport(caps, "rdma");
 
+    /* Probe all emulators in parallel first, virQEMUCapsInitGuest then
+     * only waits for the one it is interested in. A failed prefetch is
+     * not fatal, the lookup will simply probe the binary itself.
+     */
+    for (i = 0; i < VIR_ARCH_LAST; i++) {
+        VIR_AUTOFREE(char *) binary = NULL;
+
+        if (virQEMUCapsFindGuestBinary(hostarch, i, &binary) < 0)
+            goto error;
+
+        if (binary && virFileIsExecutable(binary) &&
+            virFileCachePrefetch(cache, binary, NULL) < 0) {
+            VIR_WARN("Failed to start probing '%s': %s",
+                     binary, virGetLastErrorMessage());
+            virResetLastError();
+        }
+    }
+
     /* QEMU can support pretty much every arch that exists,
      * so just probe for them all - we gracefully fail
      * if a qemu-system-$ARCH binary can't be found
@@ -1677,6 +1718,39 @@ virQEMUCapsClear(virQEMUCapsPtr qemuCaps,
 }
 
 
+/**
+ * virQEMUCapsClearPrivate:
+ * @qemuCaps: pointer to capabilities
+ * @flag: capability to clear
+ *
+ * Clears @flag in @qemuCaps. If @qemuCaps points to capabilities shared
+ * with the capabilities cache (see virQEMUCapsCacheLookupCopy), it is
+ * replaced by a private copy first. Nothing is copied if @flag is not set.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virQEMUCapsClearPrivate(virQEMUCapsPtr *qemuCaps,
+                        virQEMUCapsFlags flag)
+{
+    virQEMUCapsPtr copy;
+
+    if (!virQEMUCapsGet(*qemuCaps, flag))
+        return 0;
+
+    if ((*qemuCaps)->shared) {
+        if (!(copy = virQEMUCapsNewCopy(*qemuCaps)))
+            return -1;
+
+        virObjectUnref(*qemuCaps);
+        *qemuCaps = copy;
+    }
+
+    virQEMUCapsClear(*qemuCaps, flag);
+    return 0;
+}
+
+
 char *virQEMUCapsFlagsString(virQEMUCapsPtr qemuCaps)
 {
     return virBitmapToString(qemuCaps->flags, true, false);
@@ -3330,6 +3404,12 @@ struct _virQEMUCapsCachePriv {
     /* cache whether /dev/kvm is usable as runUid:runGuid */
     virTristateBool kvmUsable;
     time_t kvmCtime;
+
+    /* inotify watching emulator binaries and /dev for changes which may
+     * make cached capabilities outdated, -1 if not available */
+    int inotifyFd;
+    /* incremented whenever a change is noticed on @inotifyFd */
+    unsigned long long generation;
 };
 typedef struct _virQEMUCapsCachePriv virQEMUCapsCachePriv;
 typedef virQEMUCapsCachePriv *virQEMUCapsCachePrivPtr;
@@ -3342,6 +3422,7 @@ virQEMUCapsCachePrivFree(void *privData)
 
     VIR_FREE(priv->libDir);
     VIR_FREE(priv->kernelVersion);
+    VIR_FORCE_CLOSE(priv->inotifyFd);
     VIR_FREE(priv);
 }
 
@@ -3997,31 +4078,100 @@ virQEMUCapsKVMUsable(virQEMUCapsCachePrivPtr priv)
 }
 
 
-static bool
-virQEMUCapsIsValid(void *data,
-                   void *privData)
+#if HAVE_SYS_INOTIFY_H
+/* Starts watching for changes which may make cached capabilities
+ * outdated. Creating or removing /dev/kvm also covers reloading KVM
+ * modules with different nesting support. */
+static void
+virQEMUCapsCacheWatchInit(virQEMUCapsCachePrivPtr priv)
 {
-    virQEMUCapsPtr qemuCaps = data;
-    virQEMUCapsCachePrivPtr priv = privData;
-    bool kvmUsable;
-    struct stat sb;
-    bool kvmSupportsNesting;
+    char ebuf[1024];
+
+    if ((priv->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0 ||
+        inotify_add_watch(priv->inotifyFd, "/dev",
+                          IN_CREATE | IN_DELETE |
+                          IN_MOVED_FROM | IN_MOVED_TO) < 0) {
+        VIR_DEBUG("Cannot watch for changes, capabilities will be fully "
+                  "validated on every lookup: %s",
+                  virStrerror(errno, ebuf, sizeof(ebuf)));
+        VIR_FORCE_CLOSE(priv->inotifyFd);
+        return;
+    }
 
-    if (!qemuCaps->binary)
-        return true;
+    priv->generation = 1;
+}
 
-    if (qemuCaps->libvirtCtime != virGetSelfLastChanged() ||
-        qemuCaps->libvirtVersion != LIBVIR_VERSION_NUMBER) {
-        VIR_DEBUG("Outdated capabilities for '%s': libvirt changed "
-                  "(%lld vs %lld, %lu vs %lu)",
-                  qemuCaps->binary,
-                  (long long)qemuCaps->libvirtCtime,
-                  (long long)virGetSelfLastChanged(),
-                  (unsigned long)qemuCaps->libvirtVersion,
-                  (unsigned long)LIBVIR_VERSION_NUMBER);
+
+/* Returns true if @path is being watched or does not exist. */
+static bool
+virQEMUCapsCacheWatch(virQEMUCapsCachePrivPtr priv,
+                      const char *path)
+{
+    if (priv->inotifyFd < 0)
+        return false;
+
+    if (inotify_add_watch(priv->inotifyFd, path,
+                          IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE |
+                          IN_MOVE_SELF | IN_DELETE_SELF) < 0 &&
+        errno != ENOENT)
         return false;
+
+    return true;
+}
+
+
+static void
+virQEMUCapsCacheCheckChanges(virQEMUCapsCachePrivPtr priv)
+{
+    char buf[4096];
+    bool changed = false;
+    ssize_t got;
+
+    if (priv->inotifyFd < 0)
+        return;
+
+    while ((got = read(priv->inotifyFd, buf, sizeof(buf))) > 0)
+        changed = true;
+
+    if (got < 0 && errno != EAGAIN && errno != EINTR) {
+        VIR_FORCE_CLOSE(priv->inotifyFd);
+        return;
     }
 
+    if (changed)
+        priv->generation++;
+}
+#else /* !HAVE_SYS_INOTIFY_H */
+static void
+virQEMUCapsCacheWatchInit(virQEMUCapsCachePrivPtr priv)
+{
+    priv->inotifyFd = -1;
+}
+
+
+static bool
+virQEMUCapsCacheWatch(virQEMUCapsCachePrivPtr priv ATTRIBUTE_UNUSED,
+                      const char *path ATTRIBUTE_UNUSED)
+{
+    return false;
+}
+
+
+static void
+virQEMUCapsCacheCheckChanges(virQEMUCapsCachePrivPtr priv ATTRIBUTE_UNUSED)
+{
+}
+#endif /* !HAVE_SYS_INOTIFY_H */
+
+
+static bool
+virQEMUCapsIsValidFull(virQEMUCapsPtr qemuCaps,
+                       virQEMUCapsCachePrivPtr priv)
+{
+    bool kvmUsable;
+    struct stat sb;
+    bool kvmSupportsNesting;
+
     if (stat(qemuCaps->binary, &sb) < 0) {
         char ebuf[1024];
         VIR_DEBUG("Failed to stat QEMU binary '%s': %s",
@@ -4096,6 +4246,52 @@ virQEMUCapsIsValid(void *data,
 }
 
 
+static bool
+virQEMUCapsIsValid(void *data,
+                   void *privData)
+{
+    virQEMUCapsPtr qemuCaps = data;
+    virQEMUCapsCachePrivPtr priv = privData;
+    unsigned long long generation;
+    bool watched;
+
+    if (!qemuCaps->binary)
+        return true;
+
+    if (qemuCaps->libvirtCtime != virGetSelfLastChanged() ||
+        qemuCaps->libvirtVersion != LIBVIR_VERSION_NUMBER) {
+        VIR_DEBUG("Outdated capabilities for '%s': libvirt changed "
+                  "(%lld vs %lld, %lu vs %lu)",
+                  qemuCaps->binary,
+                  (long long)qemuCaps->libvirtCtime,
+                  (long long)virGetSelfLastChanged(),
+                  (unsigned long)qemuCaps->libvirtVersion,
+                  (unsigned long)LIBVIR_VERSION_NUMBER);
+        return false;
+    }
+
+    /* Nothing we watch changed since the last full validation */
+    virQEMUCapsCacheCheckChanges(priv);
+    if (priv->inotifyFd >= 0 &&
+        qemuCaps->validGeneration == priv->generation)
+        return true;
+
+    /* Start watching before validating so that any change made while
+     * we are validating bumps the generation */
+    generation = priv->generation;
+    watched = virQEMUCapsCacheWatch(priv, qemuCaps->binary) &&
+              virQEMUCapsCacheWatch(priv, "/dev/kvm");
+
+    if (!virQEMUCapsIsValidFull(qemuCaps, priv))
+        return false;
+
+    if (watched)
+        qemuCaps->validGeneration = generation;
+
+    return true;
+}
+
+
 /**
  * virQEMUCapsInitQMPArch:
  * @qemuCaps: QEMU capabilities
@@ -4536,14 +4732,19 @@ virQEMUCapsNewData(const char *binary,
                    void *privData)
 {
     virQEMUCapsCachePrivPtr priv = privData;
+    virQEMUCapsPtr qemuCaps;
 
-    return virQEMUCapsNewForBinaryInternal(priv->hostArch,
-                                           binary,
-                                           priv->libDir,
-                                           priv->runUid,
-                                           priv->runGid,
-                                           priv->microcodeVersion,
-                                           priv->kernelVersion);
+    qemuCaps = virQEMUCapsNewForBinaryInternal(priv->hostArch,
+                                               binary,
+                                               priv->libDir,
+                                               priv->runUid,
+                                               priv->runGid,
+                                               priv->microcodeVersion,
+                                               priv->kernelVersion);
+    if (qemuCaps)
+        qemuCaps->shared = true;
+
+    return qemuCaps;
 }
 
 
@@ -4564,6 +4765,8 @@ virQEMUCapsLoadFile(const char *filename,
     if (virQEMUCapsLoadCache(priv->hostArch, qemuCaps, filename) < 0)
         goto error;
 
+    qemuCaps->shared = true;
+
  cleanup:
     return qemuCaps;
 
@@ -4587,6 +4790,39 @@ static const struct virQEMUCapsMachineTypeFilter virQEMUCapsMachineFilter[] = {
 };
 
 
+/**
+ * virQEMUCapsFilterByMachineTypeNeeded:
+ *
+ * Returns true if virQEMUCapsFilterByMachineType would clear any
+ * capability of @qemuCaps for @machineType.
+ */
+static bool
+virQEMUCapsFilterByMachineTypeNeeded(virQEMUCapsPtr qemuCaps,
+                                     const char *machineType)
+{
+    size_t i;
+
+    if (!machineType)
+        return false;
+
+    for (i = 0; i < ARRAY_CARDINALITY(virQEMUCapsMachineFilter); i++) {
+        const struct virQEMUCapsMachineTypeFilter *filter = &virQEMUCapsMachineFilter[i];
+        size_t j;
+
+        if (STRNEQ(filter->machineType, machineType))
+            continue;
+
+        for (j = 0; j < filter->nflags; j++) {
+            if (virQEMUCapsGet(qemuCaps, filter->flags[j]))
+                return true;
+        }
+    }
+
+    return virQEMUCapsGet(qemuCaps, QEMU_CAPS_QUERY_HOTPLUGGABLE_CPUS) &&
+           !virQEMUCapsGetMachineHotplugCpus(qemuCaps, machineType);
+}
+
+
 void
 virQEMUCapsFilterByMachineType(virQEMUCapsPtr qemuCaps,
                                const char *machineType)
@@ -4641,6 +4877,7 @@ virQEMUCapsCacheNew(const char *libDir,
 
     if (VIR_ALLOC(priv) < 0)
         goto error;
+    priv->inotifyFd = -1;
     virFileCacheSetPriv(cache, priv);
 
     if (VIR_STRDUP(priv->libDir, libDir) < 0)
@@ -4653,6 +4890,8 @@ virQEMUCapsCacheNew(const char *libDir,
     priv->microcodeVersion = microcodeVersion;
     priv->kvmUsable = VIR_TRISTATE_BOOL_ABSENT;
 
+    virQEMUCapsCacheWatchInit(priv);
+
     if (uname(&uts) == 0 &&
         virAsprintf(&priv->kernelVersion, "%s %s", uts.release, uts.version) < 0)
         goto error;
@@ -4681,6 +4920,19 @@ virQEMUCapsCacheLookup(virFileCachePtr cache,
 }
 
 
+/**
+ * virQEMUCapsCacheLookupCopy:
+ * @cache: QEMU capabilities cache
+ * @binary: emulator binary
+ * @machineType: machine type to filter capabilities for
+ *
+ * Looks up capabilities of @binary filtered for @machineType. Unless the
+ * filter actually changes anything, the returned object is shared with the
+ * cache rather than being a private copy and thus must not be modified
+ * directly. Use virQEMUCapsClearPrivate to clear capabilities in it.
+ *
+ * Returns a new reference to the capabilities or NULL on error.
+ */
 virQEMUCapsPtr
 virQEMUCapsCacheLookupCopy(virFileCachePtr cache,
                            const char *binary,
@@ -4692,6 +4944,9 @@ virQEMUCapsCacheLookupCopy(virFileCachePtr cache,
     if (!qemuCaps)
         return NULL;
 
+    if (!virQEMUCapsFilterByMachineTypeNeeded(qemuCaps, machineType))
+        return qemuCaps;
+
     ret = virQEMUCapsNewCopy(qemuCaps);
     virObjectUnref(qemuCaps);
 
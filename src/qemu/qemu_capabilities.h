@@ -525,6 +525,9 @@ void virQEMUCapsSetList(virQEMUCapsPtr qemuCaps, ...) ATTRIBUTE_NONNULL(1);
 void virQEMUCapsClear(virQEMUCapsPtr qemuCaps,
                       virQEMUCapsFlags flag) ATTRIBUTE_NONNULL(1);
 
+int virQEMUCapsClearPrivate(virQEMUCapsPtr *qemuCaps,
+                            virQEMUCapsFlags flag) ATTRIBUTE_NONNULL(1);
+
 bool virQEMUCapsGet(virQEMUCapsPtr qemuCaps,
                     virQEMUCapsFlags flag);
 
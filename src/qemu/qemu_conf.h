@@ -65,6 +65,9 @@ typedef virQEMUDriver *virQEMUDriverPtr;
 typedef struct _virQEMUDriverConfig virQEMUDriverConfig;
 typedef virQEMUDriverConfig *virQEMUDriverConfigPtr;
 
+typedef struct _qemuDomainStatsSampler qemuDomainStatsSampler;
+typedef qemuDomainStatsSampler *qemuDomainStatsSamplerPtr;
+
 /* Main driver config. The data in these object
  * instances is immutable, so can be accessed
  * without locking. Threads must, however, hold
@@ -295,6 +298,9 @@ struct _virQEMUDriver {
 
     /* Immutable pointer, self-locking APIs */
     virHashAtomicPtr migrationErrors;
+
+    /* Immutable pointer, self-locking APIs */
+    qemuDomainStatsSamplerPtr statsSampler;
 };
 
 typedef struct _qemuDomainCmdlineDef qemuDomainCmdlineDef;
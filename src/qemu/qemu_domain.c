@@ -8402,6 +8402,64 @@ qemuDomainLogAppendMessage(virQEMUDriverPtr driver,
 }
 
 
+/**
+ * qemuDomainLogReportStats:
+ * @driver: qemu driver
+ * @vm: domain object
+ *
+ * Queries virtlogd for statistics of the log file of @vm and logs
+ * them. Warns if the rate limit dropped any guest output. This is
+ * meant to be called once the domain is stopped. The stats are
+ * informative only (older virtlogd might not even provide them),
+ * therefore errors are ignored and any error already set is
+ * preserved.
+ */
+void
+qemuDomainLogReportStats(virQEMUDriverPtr driver,
+                         virDomainObjPtr vm)
+{
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    virLogManagerPtr manager = NULL;
+    virLogManagerProtocolLogFileStats stats;
+    virErrorPtr orig_err;
+    char *path = NULL;
+
+    if (!cfg->stdioLogD)
+        goto cleanup;
+
+    virErrorPreserveLast(&orig_err);
+
+    memset(&stats, 0, sizeof(stats));
+
+    if (virAsprintf(&path, "%s/%s.log", cfg->logDir, vm->def->name) < 0 ||
+        !(manager = virLogManagerNew(virQEMUDriverIsPrivileged(driver))) ||
+        virLogManagerDomainGetLogFileStats(manager, path, 0, &stats) < 0) {
+        VIR_DEBUG("Unable to get stats of log file of domain %s",
+                  vm->def->name);
+        goto restore;
+    }
+
+    VIR_DEBUG("log file %s: bytes=%llu transfers=%llu spliced=%llu "
+              "throttled=%llu dropped=%llu",
+              path,
+              (unsigned long long)stats.bytes,
+              (unsigned long long)stats.transfers,
+              (unsigned long long)stats.spliced,
+              (unsigned long long)stats.throttled,
+              (unsigned long long)stats.dropped);
+    if (stats.dropped)
+        VIR_WARN("Rate limit of %s dropped %llu bytes of guest output",
+                 path, (unsigned long long)stats.dropped);
+
+ restore:
+    virErrorRestore(&orig_err);
+ cleanup:
+    virLogManagerFree(manager);
+    VIR_FREE(path);
+    virObjectUnref(cfg);
+}
+
+
 int qemuDomainLogContextGetWriteFD(qemuDomainLogContextPtr ctxt)
 {
     return ctxt->writefd;
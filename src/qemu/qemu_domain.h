@@ -684,6 +684,9 @@ int qemuDomainLogAppendMessage(virQEMUDriverPtr driver,
                                const char *fmt,
                                ...) ATTRIBUTE_FMT_PRINTF(3, 4);
 
+void qemuDomainLogReportStats(virQEMUDriverPtr driver,
+                              virDomainObjPtr vm);
+
 const char *qemuFindQemuImgBinary(virQEMUDriverPtr driver);
 
 int qemuDomainSnapshotWriteMetadata(virDomainObjPtr vm,
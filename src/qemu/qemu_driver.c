@@ -37,6 +37,8 @@
 
 
 #include "qemu_driver.h"
+#define LIBVIRT_QEMU_DRIVERPRIV_H_ALLOW
+#include "qemu_driverpriv.h"
 #include "qemu_agent.h"
 #include "qemu_alias.h"
 #include "qemu_block.h"
@@ -132,10 +134,11 @@ VIR_LOG_INIT("qemu.qemu_driver");
 
 #define QEMU_NB_BANDWIDTH_PARAM 7
 
-static void qemuProcessEventHandler(void *data, void *opaque);
-
 static int qemuStateCleanup(void);
 
+static qemuDomainStatsSamplerPtr qemuDomainStatsSamplerNew(void);
+static void qemuDomainStatsSamplerFree(qemuDomainStatsSamplerPtr sampler);
+
 static int qemuDomainObjStart(virConnectPtr conn,
                               virQEMUDriverPtr driver,
                               virDomainObjPtr vm,
@@ -610,6 +613,9 @@ qemuStateInitialize(bool privileged,
     if (!qemu_driver->domainEventState)
         goto error;
 
+    if (!(qemu_driver->statsSampler = qemuDomainStatsSamplerNew()))
+        goto error;
+
     /* read the host sysinfo */
     if (privileged)
         qemu_driver->hostsysinfo = virSysinfoRead();
@@ -1040,6 +1046,7 @@ qemuStateCleanup(void)
     if (!qemu_driver)
         return -1;
 
+    qemuDomainStatsSamplerFree(qemu_driver->statsSampler);
     virThreadPoolFree(qemu_driver->workerPool);
     virObjectUnref(qemu_driver->config);
     virObjectUnref(qemu_driver->hostdevMgr);
@@ -1177,6 +1184,8 @@ qemuConnectSupportsFeature(virConnectPtr conn, int feature)
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_PACKED_DOMAIN_STATS:
+    case VIR_DRV_FEATURE_REMOTE_EVENT_BATCH:
     default:
         return 0;
     }
@@ -4828,7 +4837,7 @@ processRdmaGidStatusChangedEvent(virDomainObjPtr vm,
 }
 
 
-static void qemuProcessEventHandler(void *data, void *opaque)
+void qemuProcessEventHandler(void *data, void *opaque)
 {
     struct qemuProcessEvent *processEvent = data;
     virDomainObjPtr vm = processEvent->vm;
@@ -8615,10 +8624,11 @@ qemuDomainUpdateDeviceConfig(virDomainDefPtr vmdef,
     return 0;
 }
 
-static int
+int
 qemuDomainAttachDeviceLiveAndConfig(virDomainObjPtr vm,
                                     virQEMUDriverPtr driver,
-                                    const char *xml,
+                                    const char **xmls,
+                                    size_t nxmls,
                                     unsigned int flags)
 {
     virDomainDefPtr vmdef = NULL;
@@ -8629,6 +8639,7 @@ qemuDomainAttachDeviceLiveAndConfig(virDomainObjPtr vm,
     virCapsPtr caps = NULL;
     unsigned int parse_flags = VIR_DOMAIN_DEF_PARSE_INACTIVE |
                                VIR_DOMAIN_DEF_PARSE_ABI_UPDATE;
+    size_t i;
 
     virCheckFlags(VIR_DOMAIN_AFFECT_LIVE |
                   VIR_DOMAIN_AFFECT_CONFIG, -1);
@@ -8646,56 +8657,81 @@ qemuDomainAttachDeviceLiveAndConfig(virDomainObjPtr vm,
         if (!vmdef)
             goto cleanup;
 
-        if (!(devConf = virDomainDeviceDefParse(xml, vmdef, caps,
-                                                driver->xmlopt, parse_flags)))
-            goto cleanup;
+        for (i = 0; i < nxmls; i++) {
+            if (!(devConf = virDomainDeviceDefParse(xmls[i], vmdef, caps,
+                                                    driver->xmlopt,
+                                                    parse_flags)))
+                goto cleanup;
 
-        if (virDomainDefCompatibleDevice(vmdef, devConf, NULL,
-                                         VIR_DOMAIN_DEVICE_ACTION_ATTACH,
-                                         false) < 0)
-            goto cleanup;
+            if (virDomainDefCompatibleDevice(vmdef, devConf, NULL,
+                                             VIR_DOMAIN_DEVICE_ACTION_ATTACH,
+                                             false) < 0)
+                goto cleanup;
 
-        if ((ret = qemuDomainAttachDeviceConfig(vmdef, devConf, caps,
-                                                parse_flags,
-                                                driver->xmlopt)) < 0)
-            goto cleanup;
+            if (qemuDomainAttachDeviceConfig(vmdef, devConf, caps,
+                                             parse_flags,
+                                             driver->xmlopt) < 0)
+                goto cleanup;
+
+            virDomainDeviceDefFree(devConf);
+            devConf = NULL;
+        }
     }
 
     if (flags & VIR_DOMAIN_AFFECT_LIVE) {
-        if (!(devLive = virDomainDeviceDefParse(xml, vm->def, caps,
-                                                driver->xmlopt, parse_flags)))
-            goto cleanup;
+        /* XXX Only the job and the status save are shared by the devices.
+         * Each one is still hotplugged on its own: lease, /dev entry,
+         * security relabel, cgroup and finally the monitor command, with
+         * a rollback for every step. The relabel can't be one transaction
+         * for all of them as long as it has to happen after the lease
+         * and the /dev entry of the very device, but before QEMU opens
+         * it. Doing so needs the hotplug helpers split into a prepare
+         * step run for all devices first and an attach step. */
+        for (i = 0; i < nxmls; i++) {
+            if (!(devLive = virDomainDeviceDefParse(xmls[i], vm->def, caps,
+                                                    driver->xmlopt,
+                                                    parse_flags)))
+                break;
 
-        if (virDomainDeviceValidateAliasForHotplug(vm, devLive, flags) < 0)
-            goto cleanup;
+            if (virDomainDeviceValidateAliasForHotplug(vm, devLive, flags) < 0)
+                break;
 
-        if (virDomainDefCompatibleDevice(vm->def, devLive, NULL,
-                                         VIR_DOMAIN_DEVICE_ACTION_ATTACH,
-                                         true) < 0)
-            goto cleanup;
+            if (virDomainDefCompatibleDevice(vm->def, devLive, NULL,
+                                             VIR_DOMAIN_DEVICE_ACTION_ATTACH,
+                                             true) < 0)
+                break;
+
+            if (qemuDomainAttachDeviceLive(vm, devLive, driver) < 0)
+                break;
+
+            virDomainDeviceDefFree(devLive);
+            devLive = NULL;
+        }
 
-        if ((ret = qemuDomainAttachDeviceLive(vm, devLive, driver)) < 0)
-            goto cleanup;
         /*
-         * update domain status forcibly because the domain status may be
-         * changed even if we failed to attach the device. For example,
-         * a new controller may be created.
+         * update domain status once for all the devices, and do so even
+         * if one of them failed to attach, because the ones before it are
+         * already in use by the guest.
          */
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
-            ret = -1;
+        if (i > 0 &&
+            virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+            goto cleanup;
+
+        if (i < nxmls)
             goto cleanup;
-        }
     }
 
     /* Finally, if no error until here, we can save config. */
     if (flags & VIR_DOMAIN_AFFECT_CONFIG) {
-        ret = virDomainSaveConfig(cfg->configDir, driver->caps, vmdef);
-        if (!ret) {
-            virDomainObjAssignDef(vm, vmdef, false, NULL);
-            vmdef = NULL;
-        }
+        if (virDomainSaveConfig(cfg->configDir, driver->caps, vmdef) < 0)
+            goto cleanup;
+
+        virDomainObjAssignDef(vm, vmdef, false, NULL);
+        vmdef = NULL;
     }
 
+    ret = 0;
+
  cleanup:
     virDomainDefFree(vmdef);
     virDomainDeviceDefFree(devConf);
@@ -8729,7 +8765,45 @@ qemuDomainAttachDeviceFlags(virDomainPtr dom,
     if (virDomainObjUpdateModificationImpact(vm, &flags) < 0)
         goto endjob;
 
-    if (qemuDomainAttachDeviceLiveAndConfig(vm, driver, xml, flags) < 0)
+    if (qemuDomainAttachDeviceLiveAndConfig(vm, driver, &xml, 1, flags) < 0)
+        goto endjob;
+
+    ret = 0;
+
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    virNWFilterUnlockFilterUpdates();
+    return ret;
+}
+
+static int
+qemuDomainAttachDevices(virDomainPtr dom,
+                        const char **xmls,
+                        unsigned int nxmls,
+                        unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+
+    virNWFilterReadLockFilterUpdates();
+
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        goto cleanup;
+
+    if (virDomainAttachDevicesEnsureACL(dom->conn, vm->def, flags) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjUpdateModificationImpact(vm, &flags) < 0)
+        goto endjob;
+
+    if (qemuDomainAttachDeviceLiveAndConfig(vm, driver, xmls, nxmls, flags) < 0)
         goto endjob;
 
     ret = 0;
@@ -21186,6 +21260,417 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
 }
 
 
+/* Stats subscriptions are served by a single sampler thread per
+ * driver.  Whenever one or more subscriptions are due, the union of
+ * their stats groups is collected in one pass over the domains and
+ * every domain's sample is queued as one event tagged with the due
+ * callbacks, which the event filter then fans out to the subscribers.
+ * Due times are aligned to multiples of the interval so that
+ * subscriptions with the same (or a dividing) interval share passes
+ * no matter when they were registered.  Just like event callbacks,
+ * a subscription holds a reference to its connection until it is
+ * deregistered.  */
+typedef struct _qemuDomainStatsSubscription qemuDomainStatsSubscription;
+typedef qemuDomainStatsSubscription *qemuDomainStatsSubscriptionPtr;
+struct _qemuDomainStatsSubscription {
+    virConnectPtr conn;
+    int callbackID;
+    bool hasUUID;
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    unsigned int stats;
+    unsigned long long interval; /* in milliseconds */
+    unsigned long long next; /* when the next sample is due */
+};
+
+struct _qemuDomainStatsSampler {
+    virMutex lock;
+    virCond cond;
+    virThread thread;
+    bool threadRunning;
+    bool quit;
+
+    qemuDomainStatsSubscriptionPtr subs;
+    size_t nsubs;
+    size_t nsubs_max;
+};
+
+
+static qemuDomainStatsSamplerPtr
+qemuDomainStatsSamplerNew(void)
+{
+    qemuDomainStatsSamplerPtr sampler;
+
+    if (VIR_ALLOC(sampler) < 0)
+        return NULL;
+
+    if (virMutexInit(&sampler->lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot initialize mutex"));
+        VIR_FREE(sampler);
+        return NULL;
+    }
+
+    if (virCondInit(&sampler->cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition"));
+        virMutexDestroy(&sampler->lock);
+        VIR_FREE(sampler);
+        return NULL;
+    }
+
+    return sampler;
+}
+
+
+static void
+qemuDomainStatsSamplerFree(qemuDomainStatsSamplerPtr sampler)
+{
+    size_t i;
+
+    if (!sampler)
+        return;
+
+    virMutexLock(&sampler->lock);
+    sampler->quit = true;
+    virCondSignal(&sampler->cond);
+    virMutexUnlock(&sampler->lock);
+
+    if (sampler->threadRunning)
+        virThreadJoin(&sampler->thread);
+
+    for (i = 0; i < sampler->nsubs; i++)
+        virObjectUnref(sampler->subs[i].conn);
+    VIR_FREE(sampler->subs);
+    virCondDestroy(&sampler->cond);
+    virMutexDestroy(&sampler->lock);
+    VIR_FREE(sampler);
+}
+
+
+/**
+ * qemuDomainStatsSample:
+ * @driver: qemu driver
+ * @vm: locked domain object
+ * @stats: union of the stats groups of the due subscriptions
+ * @due: callback IDs of the due subscriptions
+ * @ndue: number of items in @due
+ *
+ * Collects @stats of @vm the same way virConnectGetAllDomainStats does,
+ * remembering which group each parameter belongs to.  The monitor job
+ * is never waited for, so that a single busy domain does not delay the
+ * samples of all the others; such a domain reports the groups which
+ * can be obtained without the monitor only.
+ *
+ * Returns the event to queue or NULL on error.
+ */
+static virObjectEventPtr
+qemuDomainStatsSample(virQEMUDriverPtr driver,
+                      virDomainObjPtr vm,
+                      unsigned int stats,
+                      const int *due,
+                      size_t ndue)
+{
+    virDomainStatsRecord record = { 0 };
+    unsigned int *groups = NULL;
+    size_t ngroups = 0;
+    size_t ngroups_max = 0;
+    int maxparams = 0;
+    unsigned int flags = 0;
+    virObjectEventPtr event = NULL;
+    size_t i;
+
+    if (qemuDomainGetStatsNeedMonitor(stats) &&
+        qemuDomainObjBeginJobNowait(driver, vm, QEMU_JOB_QUERY) == 0)
+        flags |= QEMU_DOMAIN_STATS_HAVE_JOB;
+
+    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
+        if (!(stats & qemuDomainGetStatsWorkers[i].stats))
+            continue;
+
+        if (qemuDomainGetStatsWorkers[i].func(driver, vm, &record,
+                                              &maxparams, flags) < 0)
+            goto cleanup;
+
+        if (VIR_RESIZE_N(groups, ngroups_max, ngroups,
+                         record.nparams - ngroups) < 0)
+            goto cleanup;
+
+        for (; ngroups < record.nparams; ngroups++)
+            groups[ngroups] = qemuDomainGetStatsWorkers[i].stats;
+    }
+
+    event = virDomainStatsEventNew(vm->def->id, vm->def->name, vm->def->uuid,
+                                   record.params, record.nparams,
+                                   groups, due, ndue);
+    record.params = NULL;
+    record.nparams = 0;
+    groups = NULL;
+
+ cleanup:
+    if (HAVE_JOB(flags))
+        qemuDomainObjEndJob(driver, vm);
+    virTypedParamsFree(record.params, record.nparams);
+    VIR_FREE(groups);
+    return event;
+}
+
+
+static void
+qemuDomainStatsSamplerRun(virQEMUDriverPtr driver,
+                          unsigned int stats,
+                          virHashTablePtr uuids,
+                          const int *due,
+                          size_t ndue)
+{
+    virDomainObjPtr *vms = NULL;
+    size_t nvms = 0;
+    size_t i;
+
+    if (virDomainObjListCollect(driver->domains, NULL, &vms, &nvms, NULL,
+                                VIR_CONNECT_LIST_DOMAINS_ACTIVE) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nvms; i++) {
+        virDomainObjPtr vm = vms[i];
+        virObjectEventPtr event = NULL;
+        char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+        virObjectLock(vm);
+
+        virUUIDFormat(vm->def->uuid, uuidstr);
+        if (virDomainObjIsActive(vm) &&
+            (!uuids || virHashLookup(uuids, uuidstr)) &&
+            !(event = qemuDomainStatsSample(driver, vm, stats, due, ndue)))
+            VIR_WARN("Unable to sample stats of domain %s: %s",
+                     vm->def->name, virGetLastErrorMessage());
+
+        virObjectUnlock(vm);
+
+        virObjectEventStateQueue(driver->domainEventState, event);
+    }
+
+ cleanup:
+    virObjectListFreeCount(vms, nvms);
+    virResetLastError();
+}
+
+
+static void
+qemuDomainStatsSamplerThread(void *opaque)
+{
+    virQEMUDriverPtr driver = opaque;
+    qemuDomainStatsSamplerPtr sampler = driver->statsSampler;
+
+    virMutexLock(&sampler->lock);
+
+    while (!sampler->quit) {
+        unsigned long long now;
+        unsigned long long wakeup = 0;
+        unsigned int stats = 0;
+        virHashTablePtr uuids = NULL;
+        bool all = false;
+        int *due = NULL;
+        size_t ndue = 0;
+        size_t i;
+
+        if (sampler->nsubs == 0) {
+            if (virCondWait(&sampler->cond, &sampler->lock) < 0)
+                break;
+            continue;
+        }
+
+        if (virTimeMillisNow(&now) < 0 ||
+            VIR_ALLOC_N(due, sampler->nsubs) < 0 ||
+            !(uuids = virHashCreate(sampler->nsubs, NULL))) {
+            VIR_FREE(due);
+            break;
+        }
+
+        for (i = 0; i < sampler->nsubs; i++) {
+            qemuDomainStatsSubscriptionPtr sub = &sampler->subs[i];
+            char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+            if (sub->next > now) {
+                if (!wakeup || sub->next < wakeup)
+                    wakeup = sub->next;
+                continue;
+            }
+
+            due[ndue++] = sub->callbackID;
+            stats |= sub->stats;
+            if (sub->hasUUID) {
+                virUUIDFormat(sub->uuid, uuidstr);
+                ignore_value(virHashUpdateEntry(uuids, uuidstr, (void *) 1));
+            } else {
+                all = true;
+            }
+
+            sub->next = (now / sub->interval + 1) * sub->interval;
+            if (!wakeup || sub->next < wakeup)
+                wakeup = sub->next;
+        }
+
+        if (ndue) {
+            virMutexUnlock(&sampler->lock);
+            VIR_DEBUG("Sampling stats 0x%x for %zu subscriptions",
+                      stats, ndue);
+            qemuDomainStatsSamplerRun(driver, stats, all ? NULL : uuids,
+                                      due, ndue);
+            virMutexLock(&sampler->lock);
+        } else if (virCondWaitUntil(&sampler->cond, &sampler->lock,
+                                    wakeup) < 0 &&
+                   errno != ETIMEDOUT) {
+            VIR_FREE(due);
+            virHashFree(uuids);
+            break;
+        }
+
+        VIR_FREE(due);
+        virHashFree(uuids);
+    }
+
+    virMutexUnlock(&sampler->lock);
+}
+
+
+static int
+qemuDomainStatsSamplerAdd(virQEMUDriverPtr driver,
+                          virConnectPtr conn,
+                          virDomainPtr dom,
+                          unsigned int stats,
+                          unsigned int interval,
+                          virConnectDomainStatsCallback cb,
+                          void *opaque,
+                          virFreeCallback freecb)
+{
+    qemuDomainStatsSamplerPtr sampler = driver->statsSampler;
+    qemuDomainStatsSubscription sub = { 0 };
+    unsigned long long now;
+    int ret = -1;
+
+    if (virTimeMillisNow(&now) < 0)
+        return -1;
+
+    if (dom) {
+        sub.hasUUID = true;
+        memcpy(sub.uuid, dom->uuid, VIR_UUID_BUFLEN);
+    }
+    sub.stats = stats;
+    sub.interval = interval * 1000ULL;
+    sub.next = (now / sub.interval + 1) * sub.interval;
+
+    virMutexLock(&sampler->lock);
+
+    if (!sampler->threadRunning) {
+        if (virThreadCreate(&sampler->thread, true,
+                            qemuDomainStatsSamplerThread, driver) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to create stats sampler thread"));
+            goto cleanup;
+        }
+        sampler->threadRunning = true;
+    }
+
+    /* Make room first, nothing may fail once the callback is registered
+     * as we would have no way to undo it without freeing the caller's
+     * opaque data.  */
+    if (VIR_RESIZE_N(sampler->subs, sampler->nsubs_max, sampler->nsubs, 1) < 0)
+        goto cleanup;
+
+    if (virDomainStatsEventStateRegisterID(conn, driver->domainEventState,
+                                           dom, stats, cb, opaque, freecb,
+                                           &sub.callbackID) < 0)
+        goto cleanup;
+
+    sub.conn = virObjectRef(conn);
+    sampler->subs[sampler->nsubs++] = sub;
+    virCondSignal(&sampler->cond);
+    ret = sub.callbackID;
+
+ cleanup:
+    virMutexUnlock(&sampler->lock);
+    return ret;
+}
+
+
+static int
+qemuDomainStatsSamplerRemove(virQEMUDriverPtr driver,
+                             virConnectPtr conn,
+                             int callbackID)
+{
+    qemuDomainStatsSamplerPtr sampler = driver->statsSampler;
+    size_t i;
+    int ret = -1;
+
+    virMutexLock(&sampler->lock);
+
+    for (i = 0; i < sampler->nsubs; i++) {
+        if (sampler->subs[i].callbackID == callbackID &&
+            sampler->subs[i].conn == conn)
+            break;
+    }
+
+    if (i == sampler->nsubs) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("no domain stats subscription %d"), callbackID);
+        goto cleanup;
+    }
+
+    virObjectUnref(sampler->subs[i].conn);
+    VIR_DELETE_ELEMENT_INPLACE(sampler->subs, i, sampler->nsubs);
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&sampler->lock);
+    return ret;
+}
+
+
+static int
+qemuConnectDomainStatsRegister(virConnectPtr conn,
+                               virDomainPtr dom,
+                               unsigned int stats,
+                               unsigned int interval,
+                               virConnectDomainStatsCallback cb,
+                               void *opaque,
+                               virFreeCallback freecb,
+                               unsigned int flags)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+
+    virCheckFlags(0, -1);
+
+    if (virConnectDomainStatsRegisterEnsureACL(conn) < 0)
+        return -1;
+
+    if (qemuDomainGetStatsCheckSupport(&stats, true) < 0)
+        return -1;
+
+    return qemuDomainStatsSamplerAdd(driver, conn, dom, stats, interval,
+                                     cb, opaque, freecb);
+}
+
+
+static int
+qemuConnectDomainStatsDeregister(virConnectPtr conn,
+                                 int callbackID)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+
+    if (virConnectDomainStatsDeregisterEnsureACL(conn) < 0)
+        return -1;
+
+    if (qemuDomainStatsSamplerRemove(driver, conn, callbackID) < 0)
+        return -1;
+
+    if (virObjectEventStateDeregisterID(conn, driver->domainEventState,
+                                        callbackID, true) < 0)
+        return -1;
+
+    return 0;
+}
+
+
 static int
 qemuNodeAllocPages(virConnectPtr conn,
                    unsigned int npages,
@@ -22506,6 +22991,9 @@ static virHypervisorDriver qemuHypervisorDriver = {
     .connectBaselineHypervisorCPU = qemuConnectBaselineHypervisorCPU, /* 4.4.0 */
     .nodeGetSEVInfo = qemuNodeGetSEVInfo, /* 4.5.0 */
     .domainGetLaunchSecurityInfo = qemuDomainGetLaunchSecurityInfo, /* 4.5.0 */
+    .connectDomainStatsRegister = qemuConnectDomainStatsRegister, /* 5.3.0 */
+    .connectDomainStatsDeregister = qemuConnectDomainStatsDeregister, /* 5.3.0 */
+    .domainAttachDevices = qemuDomainAttachDevices, /* 5.3.0 */
 };
 
 
@@ -88,6 +88,8 @@ qemuDomainResetDeviceRemoval(virDomainObjPtr vm);
  * Upon entry, @vm must be locked.
  *
  * Returns: 0 on success,
+ *          1 if QEMU no longer knows the device, so no DEVICE_DELETED
+ *            event is going to arrive for it,
  *         -1 otherwise.
  */
 static int
@@ -122,9 +124,11 @@ qemuDomainDeleteDevice(virDomainObjPtr vm,
              * exists in libvirt. Claim success to make caller
              * qemuDomainWaitForDeviceRemoval(). Otherwise if
              * domain XML is queried right after detach API the
-             * device would still be there.  */
+             * device would still be there. Callers that don't wait
+             * must finish the removal themselves, as there will be
+             * no event to do it for them.  */
             VIR_DEBUG("Detaching of device %s failed and no event arrived", alias);
-            rc = 0;
+            rc = 1;
         }
     }
 
@@ -5780,6 +5784,7 @@ qemuDomainDetachDeviceChr(virQEMUDriverPtr driver,
     virDomainDefPtr vmdef = vm->def;
     virDomainChrDefPtr tmpChr;
     bool guestfwd = false;
+    int rc;
 
     if (!(tmpChr = virDomainChrFind(vmdef, chr))) {
         virReportError(VIR_ERR_DEVICE_MISSING,
@@ -5798,7 +5803,6 @@ qemuDomainDetachDeviceChr(virQEMUDriverPtr driver,
         qemuDomainMarkDeviceForRemoval(vm, &tmpChr->info);
 
     if (guestfwd) {
-        int rc;
         qemuDomainObjEnterMonitor(driver, vm);
         rc = qemuMonitorRemoveNetdev(priv->mon, tmpChr->info.alias);
         if (qemuDomainObjExitMonitor(driver, vm) < 0)
@@ -5807,14 +5811,17 @@ qemuDomainDetachDeviceChr(virQEMUDriverPtr driver,
         if (rc < 0)
             goto cleanup;
     } else {
-        if (qemuDomainDeleteDevice(vm, tmpChr->info.alias) < 0)
+        if ((rc = qemuDomainDeleteDevice(vm, tmpChr->info.alias)) < 0)
             goto cleanup;
     }
 
     if (guestfwd) {
         ret = qemuDomainRemoveChrDevice(driver, vm, tmpChr, false);
     } else if (async) {
-        ret = 0;
+        if (rc == 1)
+            ret = qemuDomainRemoveChrDevice(driver, vm, tmpChr, true);
+        else
+            ret = 0;
     } else {
         if ((ret = qemuDomainWaitForDeviceRemoval(vm)) == 1)
             ret = qemuDomainRemoveChrDevice(driver, vm, tmpChr, true);
@@ -5959,6 +5966,7 @@ qemuDomainDetachDeviceLive(virDomainObjPtr vm,
     virDomainDeviceDef detach = { .type = match->type };
     virDomainDeviceInfoPtr info = NULL;
     int ret = -1;
+    int rc;
 
     switch ((virDomainDeviceType)match->type) {
         /*
@@ -6107,14 +6115,20 @@ qemuDomainDetachDeviceLive(virDomainObjPtr vm,
     if (!async)
         qemuDomainMarkDeviceForRemoval(vm, info);
 
-    if (qemuDomainDeleteDevice(vm, info->alias) < 0) {
+    if ((rc = qemuDomainDeleteDevice(vm, info->alias)) < 0) {
         if (virDomainObjIsActive(vm))
             qemuDomainRemoveAuditDevice(vm, &detach, false);
         goto cleanup;
     }
 
     if (async) {
-        ret = 0;
+        /* The rest of the removal is done by processDeviceDeletedEvent
+         * once the guest has released the device, unless QEMU already
+         * got rid of it */
+        if (rc == 1)
+            ret = qemuDomainRemoveDevice(driver, vm, &detach);
+        else
+            ret = 0;
     } else {
         if ((ret = qemuDomainWaitForDeviceRemoval(vm)) == 1)
             ret = qemuDomainRemoveDevice(driver, vm, &detach);
@@ -1426,7 +1426,9 @@ qemuMigrationCapsCheck(virQEMUDriverPtr driver,
         if (rc < 0) {
             virResetLastError();
             VIR_DEBUG("Cannot enable migration events; clearing capability");
-            virQEMUCapsClear(priv->qemuCaps, QEMU_CAPS_MIGRATION_EVENT);
+            if (virQEMUCapsClearPrivate(&priv->qemuCaps,
+                                        QEMU_CAPS_MIGRATION_EVENT) < 0)
+                goto cleanup;
         }
     }
 
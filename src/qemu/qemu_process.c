@@ -5399,8 +5399,10 @@ qemuProcessInit(virQEMUDriverPtr driver,
     if (qemuDomainUpdateQEMUCaps(vm, driver->qemuCapsCache) < 0)
         goto cleanup;
 
-    if (flags & VIR_QEMU_PROCESS_START_STANDALONE)
-        virQEMUCapsClear(priv->qemuCaps, QEMU_CAPS_CHARDEV_FD_PASS);
+    if ((flags & VIR_QEMU_PROCESS_START_STANDALONE) &&
+        virQEMUCapsClearPrivate(&priv->qemuCaps,
+                                QEMU_CAPS_CHARDEV_FD_PASS) < 0)
+        goto cleanup;
 
     if (qemuDomainUpdateCPU(vm, updatedCPU, &origCPU) < 0)
         goto cleanup;
@@ -6054,7 +6056,9 @@ qemuProcessPrepareDomain(virQEMUDriverPtr driver,
      * -drive or which have floppies where we can't reliably get the QOM path */
     for (i = 0; i < vm->def->ndisks; i++) {
         if (qemuDiskBusNeedsDriveArg(vm->def->disks[i]->bus)) {
-            virQEMUCapsClear(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+            if (virQEMUCapsClearPrivate(&priv->qemuCaps,
+                                        QEMU_CAPS_BLOCKDEV) < 0)
+                goto cleanup;
             break;
         }
     }
@@ -7224,6 +7228,8 @@ void qemuProcessStop(virQEMUDriverPtr driver,
                                  VIR_QEMU_PROCESS_KILL_FORCE|
                                  VIR_QEMU_PROCESS_KILL_NOCHECK));
 
+    qemuDomainLogReportStats(driver, vm);
+
     qemuDomainCleanupRun(driver, vm);
 
     qemuExtDevicesStop(driver, vm);
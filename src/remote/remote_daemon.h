@@ -30,6 +30,7 @@
 # include "lxc_protocol.h"
 # include "qemu_protocol.h"
 # include "virthread.h"
+# include "virhash.h"
 
 # if WITH_SASL
 #  include "virnetsaslcontext.h"
@@ -54,6 +55,8 @@ struct daemonClientPrivate {
     size_t nnetworkEventCallbacks;
     daemonClientEventCallbackPtr *qemuEventCallbacks;
     size_t nqemuEventCallbacks;
+    daemonClientEventCallbackPtr *statsEventCallbacks;
+    size_t nstatsEventCallbacks;
     daemonClientEventCallbackPtr *storageEventCallbacks;
     size_t nstorageEventCallbacks;
     daemonClientEventCallbackPtr *nodeDeviceEventCallbacks;
@@ -79,6 +82,20 @@ struct daemonClientPrivate {
     virConnectPtr storageConn;
 
     daemonClientStreamPtr streams;
+
+    /* Last domain stats sample sent in packed form, keyed by domain
+     * UUID, which the client may ask to use as baseline for deltas */
+    virHashTablePtr statsBaseline;
+    unsigned long long statsSample;
+
+    /* Events held back to be sent as a single batch message once
+     * the batching window, in milliseconds, elapses; a window of 0
+     * means events are sent as they come */
+    unsigned int eventBatchWindow;
+    int eventBatchTimer;
+    virNetMessagePtr eventBatch;
+    size_t neventBatch;
+    size_t eventBatchSize;
 };
 
 
@@ -293,6 +293,30 @@ remoteRelayDomainQemuMonitorEventCheckACL(virNetServerClientPtr client,
     return ret;
 }
 
+static bool
+remoteRelayDomainStatsCheckACL(virNetServerClientPtr client,
+                               virConnectPtr conn, virDomainPtr dom)
+{
+    virDomainDef def;
+    virIdentityPtr identity = NULL;
+    bool ret = false;
+
+    /* Same trick as remoteRelayDomainQemuMonitorEventCheckACL */
+    def.name = dom->name;
+    memcpy(def.uuid, dom->uuid, VIR_UUID_BUFLEN);
+
+    if (!(identity = virNetServerClientGetIdentity(client)))
+        goto cleanup;
+    if (virIdentitySetCurrent(identity) < 0)
+        goto cleanup;
+    ret = virConnectDomainStatsRegisterCheckACL(conn, &def);
+
+ cleanup:
+    ignore_value(virIdentitySetCurrent(NULL));
+    virObjectUnref(identity);
+    return ret;
+}
+
 
 static int
 remoteRelayDomainEventLifecycle(virConnectPtr conn,
@@ -1805,6 +1829,46 @@ remoteRelayDomainQemuMonitorEvent(virConnectPtr conn,
     return;
 }
 
+static void
+remoteRelayDomainStats(virConnectPtr conn,
+                       virDomainPtr dom,
+                       virTypedParameterPtr params,
+                       int nparams,
+                       void *opaque)
+{
+    daemonClientEventCallbackPtr callback = opaque;
+    remote_domain_event_stats_msg data;
+
+    if (callback->callbackID < 0 ||
+        !remoteRelayDomainStatsCheckACL(callback->client, conn, dom))
+        return;
+
+    VIR_DEBUG("Relaying domain stats %s %d, callback %d, params %p %d",
+              dom->name, dom->id, callback->callbackID, params, nparams);
+
+    /* build return data */
+    memset(&data, 0, sizeof(data));
+    data.callbackID = callback->callbackID;
+    if (make_nonnull_domain(&data.dom, dom) < 0)
+        goto error;
+
+    if (virTypedParamsSerialize(params, nparams,
+                                (virTypedParameterRemotePtr *) &data.params.params_val,
+                                &data.params.params_len,
+                                VIR_TYPED_PARAM_STRING_OKAY) < 0)
+        goto error;
+
+    remoteDispatchObjectEventSend(callback->client, remoteProgram,
+                                  REMOTE_PROC_DOMAIN_EVENT_STATS,
+                                  (xdrproc_t)xdr_remote_domain_event_stats_msg,
+                                  &data);
+    return;
+
+ error:
+    xdr_free((xdrproc_t)xdr_remote_domain_event_stats_msg,
+             (char *) &data);
+}
+
 static
 void remoteRelayConnectionClosedEvent(virConnectPtr conn ATTRIBUTE_UNUSED, int reason, void *opaque)
 {
@@ -1868,6 +1932,9 @@ remoteClientFreePrivateCallbacks(struct daemonClientPrivate *priv)
     DEREG_CB(priv->conn, priv->qemuEventCallbacks,
              priv->nqemuEventCallbacks,
              virConnectDomainQemuMonitorEventDeregister, "qemu monitor");
+    DEREG_CB(priv->conn, priv->statsEventCallbacks,
+             priv->nstatsEventCallbacks,
+             virConnectDomainStatsDeregister, "domain stats");
 
     if (priv->closeRegistered && priv->conn) {
         if (virConnectUnregisterCloseCallback(priv->conn,
@@ -1907,6 +1974,7 @@ void remoteClientFree(void *data)
     if (priv->storageConn)
         virConnectClose(priv->storageConn);
 
+    virHashFree(priv->statsBaseline);
     VIR_FREE(priv);
 }
 
@@ -1914,10 +1982,24 @@ void remoteClientFree(void *data)
 static void remoteClientCloseFunc(virNetServerClientPtr client)
 {
     struct daemonClientPrivate *priv = virNetServerClientGetPrivateData(client);
+    virNetMessagePtr msg;
 
     daemonRemoveAllClientStreams(priv->streams);
 
     remoteClientFreePrivateCallbacks(priv);
+
+    /* Nobody is left to receive the events held back */
+    virMutexLock(&priv->lock);
+    if (priv->eventBatchTimer >= 0) {
+        virEventRemoveTimeout(priv->eventBatchTimer);
+        priv->eventBatchTimer = -1;
+    }
+    priv->eventBatchWindow = 0;
+    while ((msg = virNetMessageQueueServe(&priv->eventBatch)))
+        virNetMessageFree(msg);
+    priv->neventBatch = 0;
+    priv->eventBatchSize = 0;
+    virMutexUnlock(&priv->lock);
 }
 
 
@@ -1935,6 +2017,8 @@ void *remoteClientNew(virNetServerClientPtr client,
         return NULL;
     }
 
+    priv->eventBatchTimer = -1;
+
     virNetServerClientSetCloseHook(client, remoteClientCloseFunc);
     return priv;
 }
@@ -4187,17 +4271,16 @@ remoteDispatchConnectDomainEventDeregister(virNetServerPtr server ATTRIBUTE_UNUS
     return rv;
 }
 
-static void
-remoteDispatchObjectEventSend(virNetServerClientPtr client,
-                              virNetServerProgramPtr program,
-                              int procnr,
-                              xdrproc_t proc,
-                              void *data)
+static virNetMessagePtr
+remoteDispatchObjectEventEncode(virNetServerProgramPtr program,
+                                int procnr,
+                                xdrproc_t proc,
+                                void *data)
 {
     virNetMessagePtr msg;
 
     if (!(msg = virNetMessageNew(false)))
-        goto cleanup;
+        return NULL;
 
     msg->header.prog = virNetServerProgramGetID(program);
     msg->header.vers = virNetServerProgramGetVersion(program);
@@ -4206,14 +4289,142 @@ remoteDispatchObjectEventSend(virNetServerClientPtr client,
     msg->header.serial = 1;
     msg->header.status = VIR_NET_OK;
 
-    if (virNetMessageEncodeHeader(msg) < 0)
+    if (virNetMessageEncodeHeader(msg) < 0 ||
+        virNetMessageEncodePayload(msg, proc, data) < 0) {
+        virNetMessageFree(msg);
+        return NULL;
+    }
+
+    return msg;
+}
+
+/*
+ * Sends the events held back for @client, wrapped in a single
+ * REMOTE_PROC_CONNECT_EVENT_BATCH message unless there is only one.
+ * Called with priv->lock held.
+ */
+static void
+remoteEventBatchFlushLocked(virNetServerClientPtr client,
+                            struct daemonClientPrivate *priv)
+{
+    remote_connect_event_batch_msg data;
+    virNetMessagePtr batch = NULL;
+    virNetMessagePtr msg;
+    size_t i;
+
+    memset(&data, 0, sizeof(data));
+
+    if (priv->eventBatchTimer >= 0)
+        virEventUpdateTimeout(priv->eventBatchTimer, -1);
+
+    if (priv->neventBatch == 0)
+        return;
+
+    if (priv->neventBatch == 1) {
+        batch = virNetMessageQueueServe(&priv->eventBatch);
+    } else {
+        if (VIR_ALLOC_N(data.events.events_val, priv->neventBatch) < 0)
+            goto cleanup;
+        data.events.events_len = priv->neventBatch;
+
+        /* The entries borrow the buffers of the queued messages */
+        for (i = 0, msg = priv->eventBatch; msg; i++, msg = msg->next) {
+            data.events.events_val[i].message.message_len = msg->bufferLength;
+            data.events.events_val[i].message.message_val = msg->buffer;
+        }
+
+        if (!(batch = remoteDispatchObjectEventEncode(remoteProgram,
+                                                      REMOTE_PROC_CONNECT_EVENT_BATCH,
+                                                      (xdrproc_t)xdr_remote_connect_event_batch_msg,
+                                                      &data)))
+            goto cleanup;
+    }
+
+    VIR_DEBUG("Queue batch of %zu events %zu",
+              priv->neventBatch, batch->bufferLength);
+    if (virNetServerClientSendMessage(client, batch) < 0)
         goto cleanup;
+    batch = NULL;
 
-    if (virNetMessageEncodePayload(msg, proc, data) < 0)
+ cleanup:
+    VIR_FREE(data.events.events_val);
+    virNetMessageFree(batch);
+    while ((msg = virNetMessageQueueServe(&priv->eventBatch)))
+        virNetMessageFree(msg);
+    priv->neventBatch = 0;
+    priv->eventBatchSize = 0;
+}
+
+static void
+remoteEventBatchTimer(int timer ATTRIBUTE_UNUSED,
+                      void *opaque)
+{
+    virNetServerClientPtr client = opaque;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    virMutexLock(&priv->lock);
+    remoteEventBatchFlushLocked(client, priv);
+    virMutexUnlock(&priv->lock);
+}
+
+/*
+ * Either sends @msg right away or, if @client enabled batching, holds
+ * it back until the batching window elapses or enough events piled up.
+ * Only events of the remote program can be batched; any other event
+ * flushes the pending ones first so that the client sees them in order.
+ *
+ * Returns 0 if @msg was consumed, -1 otherwise.
+ */
+static int
+remoteDispatchObjectEventQueue(virNetServerClientPtr client,
+                               virNetServerProgramPtr program,
+                               virNetMessagePtr msg)
+{
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+    int ret = -1;
+
+    virMutexLock(&priv->lock);
+
+    if (priv->eventBatchWindow == 0 ||
+        program != remoteProgram ||
+        msg->bufferLength > REMOTE_EVENT_BATCH_MESSAGE_MAX) {
+        remoteEventBatchFlushLocked(client, priv);
+        ret = virNetServerClientSendMessage(client, msg);
+        goto cleanup;
+    }
+
+    virNetMessageQueuePush(&priv->eventBatch, msg);
+    priv->neventBatch++;
+    priv->eventBatchSize += msg->bufferLength;
+    ret = 0;
+
+    if (priv->neventBatch == REMOTE_EVENT_BATCH_MAX ||
+        priv->eventBatchSize >= REMOTE_EVENT_BATCH_MESSAGE_MAX)
+        remoteEventBatchFlushLocked(client, priv);
+    else if (priv->neventBatch == 1)
+        virEventUpdateTimeout(priv->eventBatchTimer, priv->eventBatchWindow);
+
+ cleanup:
+    virMutexUnlock(&priv->lock);
+    return ret;
+}
+
+static void
+remoteDispatchObjectEventSend(virNetServerClientPtr client,
+                              virNetServerProgramPtr program,
+                              int procnr,
+                              xdrproc_t proc,
+                              void *data)
+{
+    virNetMessagePtr msg;
+
+    if (!(msg = remoteDispatchObjectEventEncode(program, procnr, proc, data)))
         goto cleanup;
 
     VIR_DEBUG("Queue event %d %zu", procnr, msg->bufferLength);
-    if (virNetServerClientSendMessage(client, msg) < 0)
+    if (remoteDispatchObjectEventQueue(client, program, msg) < 0)
         goto cleanup;
 
     xdr_free(proc, data);
@@ -4874,6 +5085,8 @@ static int remoteDispatchConnectSupportsFeature(virNetServerPtr server ATTRIBUTE
     case VIR_DRV_FEATURE_FD_PASSING:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_PACKED_DOMAIN_STATS:
+    case VIR_DRV_FEATURE_REMOTE_EVENT_BATCH:
         supported = 1;
         break;
     case VIR_DRV_FEATURE_MIGRATION_V1:
@@ -6772,45 +6985,29 @@ remoteDispatchNetworkGetDHCPLeases(virNetServerPtr server ATTRIBUTE_UNUSED,
 
 
 static int
-remoteDispatchConnectGetAllDomainStats(virNetServerPtr server ATTRIBUTE_UNUSED,
-                                       virNetServerClientPtr client,
-                                       virNetMessagePtr msg ATTRIBUTE_UNUSED,
-                                       virNetMessageErrorPtr rerr,
-                                       remote_connect_get_all_domain_stats_args *args,
-                                       remote_connect_get_all_domain_stats_ret *ret)
+remoteGetDomainStats(virConnectPtr conn,
+                     remote_nonnull_domain *domains,
+                     unsigned int ndomains,
+                     unsigned int stats,
+                     virDomainStatsRecordPtr **retStats,
+                     unsigned int flags)
 {
-    int rv = -1;
+    int nrecords = -1;
     size_t i;
-    struct daemonClientPrivate *priv = virNetServerClientGetPrivateData(client);
-    virDomainStatsRecordPtr *retStats = NULL;
-    int nrecords = 0;
     virDomainPtr *doms = NULL;
 
-    if (!priv->conn) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
-        goto cleanup;
-    }
-
-    if (args->doms.doms_len) {
-        if (VIR_ALLOC_N(doms, args->doms.doms_len + 1) < 0)
+    if (ndomains) {
+        if (VIR_ALLOC_N(doms, ndomains + 1) < 0)
             goto cleanup;
 
-        for (i = 0; i < args->doms.doms_len; i++) {
-            if (!(doms[i] = get_nonnull_domain(priv->conn, args->doms.doms_val[i])))
+        for (i = 0; i < ndomains; i++) {
+            if (!(doms[i] = get_nonnull_domain(conn, domains[i])))
                 goto cleanup;
         }
 
-        if ((nrecords = virDomainListGetStats(doms,
-                                              args->stats,
-                                              &retStats,
-                                              args->flags)) < 0)
-            goto cleanup;
+        nrecords = virDomainListGetStats(doms, stats, retStats, flags);
     } else {
-        if ((nrecords = virConnectGetAllDomainStats(priv->conn,
-                                                    args->stats,
-                                                    &retStats,
-                                                    args->flags)) < 0)
-            goto cleanup;
+        nrecords = virConnectGetAllDomainStats(conn, stats, retStats, flags);
     }
 
     if (nrecords > REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX) {
@@ -6818,9 +7015,42 @@ remoteDispatchConnectGetAllDomainStats(virNetServerPtr server ATTRIBUTE_UNUSED,
                        _("Number of domain stats records is %d, "
                          "which exceeds max limit: %d"),
                        nrecords, REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX);
+        nrecords = -1;
+    }
+
+ cleanup:
+    virObjectListFree(doms);
+    return nrecords;
+}
+
+
+static int
+remoteDispatchConnectGetAllDomainStats(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                       virNetServerClientPtr client,
+                                       virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                       virNetMessageErrorPtr rerr,
+                                       remote_connect_get_all_domain_stats_args *args,
+                                       remote_connect_get_all_domain_stats_ret *ret)
+{
+    int rv = -1;
+    size_t i;
+    struct daemonClientPrivate *priv = virNetServerClientGetPrivateData(client);
+    virDomainStatsRecordPtr *retStats = NULL;
+    int nrecords = 0;
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
         goto cleanup;
     }
 
+    if ((nrecords = remoteGetDomainStats(priv->conn,
+                                         args->doms.doms_val,
+                                         args->doms.doms_len,
+                                         args->stats,
+                                         &retStats,
+                                         args->flags)) < 0)
+        goto cleanup;
+
     if (nrecords) {
         if (VIR_ALLOC_N(ret->retStats.retStats_val, nrecords) < 0)
             goto cleanup;
@@ -6852,12 +7082,405 @@ remoteDispatchConnectGetAllDomainStats(virNetServerPtr server ATTRIBUTE_UNUSED,
         virNetMessageSaveError(rerr);
 
     virDomainStatsRecordListFree(retStats);
-    virObjectListFree(doms);
 
     return rv;
 }
 
 
+static void
+remoteStatsBaselineFree(void *payload,
+                        const void *name ATTRIBUTE_UNUSED)
+{
+    virDomainStatsRecordPtr rec = payload;
+
+    virTypedParamsFree(rec->params, rec->nparams);
+    VIR_FREE(rec);
+}
+
+
+/*
+ * Find or add the layout of @rec in @ret, adding any missing keys to
+ * the key dictionary on the way. Returns the index of the layout, or -1
+ * on error.
+ */
+static int
+remoteStatsPackLayout(virDomainStatsRecordPtr rec,
+                      virHashTablePtr keys,
+                      size_t *nkeysAlloc,
+                      virHashTablePtr layouts,
+                      size_t *nlayoutsAlloc,
+                      remote_connect_get_all_domain_stats_packed_ret *ret)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    VIR_AUTOFREE(unsigned int *) indexes = NULL;
+    VIR_AUTOFREE(char *) layoutKey = NULL;
+    char key[VIR_TYPED_PARAM_FIELD_LENGTH + INT_BUFSIZE_BOUND(int) + 1];
+    remote_domain_stats_layout *layout;
+    size_t idx;
+    size_t i;
+
+    if (VIR_ALLOC_N(indexes, rec->nparams) < 0)
+        return -1;
+
+    for (i = 0; i < rec->nparams; i++) {
+        virTypedParameterPtr param = rec->params + i;
+        remote_domain_stats_key *dst;
+
+        snprintf(key, sizeof(key), "%d:%s", param->type, param->field);
+
+        if (!(idx = (size_t) virHashLookup(keys, key))) {
+            if (ret->keys.keys_len >= REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("Number of domain stats keys exceeds max limit: %d"),
+                               REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX);
+                goto error;
+            }
+
+            if (VIR_RESIZE_N(ret->keys.keys_val, *nkeysAlloc,
+                             ret->keys.keys_len, 1) < 0)
+                goto error;
+
+            dst = ret->keys.keys_val + ret->keys.keys_len;
+            if (VIR_STRDUP(dst->field, param->field) < 0)
+                goto error;
+            dst->type = param->type;
+
+            idx = ++ret->keys.keys_len;
+            if (virHashAddEntry(keys, key, (void *) idx) < 0)
+                goto error;
+        }
+
+        indexes[i] = idx - 1;
+        virBufferAsprintf(&buf, "%zu,", idx - 1);
+    }
+
+    if (virBufferCheckError(&buf) < 0)
+        return -1;
+
+    if (!(layoutKey = virBufferContentAndReset(&buf)) &&
+        VIR_STRDUP(layoutKey, "") < 0)
+        return -1;
+
+    if ((idx = (size_t) virHashLookup(layouts, layoutKey)))
+        return idx - 1;
+
+    if (VIR_RESIZE_N(ret->layouts.layouts_val, *nlayoutsAlloc,
+                     ret->layouts.layouts_len, 1) < 0)
+        return -1;
+
+    layout = ret->layouts.layouts_val + ret->layouts.layouts_len;
+    layout->keys.keys_len = rec->nparams;
+    VIR_STEAL_PTR(layout->keys.keys_val, indexes);
+
+    idx = ++ret->layouts.layouts_len;
+    if (virHashAddEntry(layouts, layoutKey, (void *) idx) < 0)
+        return -1;
+
+    return idx - 1;
+
+ error:
+    virBufferFreeAndReset(&buf);
+    return -1;
+}
+
+
+static int
+remoteDispatchConnectGetAllDomainStatsPacked(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                             virNetServerClientPtr client,
+                                             virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                             virNetMessageErrorPtr rerr,
+                                             remote_connect_get_all_domain_stats_packed_args *args,
+                                             remote_connect_get_all_domain_stats_packed_ret *ret)
+{
+    int rv = -1;
+    size_t i;
+    struct daemonClientPrivate *priv = virNetServerClientGetPrivateData(client);
+    virDomainStatsRecordPtr *retStats = NULL;
+    int nrecords = 0;
+    virHashTablePtr keys = NULL;
+    virHashTablePtr layouts = NULL;
+    virHashTablePtr baseline = NULL;
+    virHashTablePtr prev = NULL;
+    size_t nkeysAlloc = 0;
+    size_t nlayoutsAlloc = 0;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    bool locked = false;
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    if ((nrecords = remoteGetDomainStats(priv->conn,
+                                         args->doms.doms_val,
+                                         args->doms.doms_len,
+                                         args->stats,
+                                         &retStats,
+                                         args->flags)) < 0)
+        goto cleanup;
+
+    if (!(keys = virHashCreate(256, NULL)) ||
+        !(layouts = virHashCreate(16, NULL)) ||
+        !(baseline = virHashCreate(MAX(nrecords, 16), remoteStatsBaselineFree)))
+        goto cleanup;
+
+    virMutexLock(&priv->lock);
+    locked = true;
+
+    /* Deltas are only sent against the sample the client confirms having */
+    if (args->baseline && args->baseline == priv->statsSample) {
+        prev = priv->statsBaseline;
+        ret->baseline = args->baseline;
+    }
+
+    if (nrecords &&
+        VIR_ALLOC_N(ret->retStats.retStats_val, nrecords) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nrecords; i++) {
+        remote_domain_stats_packed_record *dst = ret->retStats.retStats_val + i;
+        virDomainStatsRecordPtr rec = retStats[i];
+        virDomainStatsRecordPtr base = NULL;
+        virDomainStatsRecordPtr next = NULL;
+        size_t len = 0;
+        int layout;
+
+        ret->retStats.retStats_len++;
+
+        if (make_nonnull_domain(&dst->dom, rec->dom) < 0)
+            goto cleanup;
+
+        if ((layout = remoteStatsPackLayout(rec, keys, &nkeysAlloc,
+                                            layouts, &nlayoutsAlloc, ret)) < 0)
+            goto cleanup;
+        dst->layout = layout;
+
+        virUUIDFormat(rec->dom->uuid, uuidstr);
+        if (prev &&
+            (base = virHashLookup(prev, uuidstr)) &&
+            !virTypedParamsSameLayout(rec->params, rec->nparams,
+                                      base->params, base->nparams))
+            base = NULL;
+
+        if (virTypedParamsPack(rec->params, rec->nparams,
+                               base ? base->params : NULL,
+                               base ? base->nparams : 0,
+                               &dst->values.values_val, &len) < 0)
+            goto cleanup;
+
+        if (len > REMOTE_DOMAIN_STATS_PACKED_MAX) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Packed domain stats size %zu exceeds max limit: %d"),
+                           len, REMOTE_DOMAIN_STATS_PACKED_MAX);
+            goto cleanup;
+        }
+        dst->values.values_len = len;
+        dst->delta = !!base;
+
+        /* Keep the values as baseline for the next sample */
+        if (VIR_ALLOC(next) < 0)
+            goto cleanup;
+        VIR_STEAL_PTR(next->params, rec->params);
+        next->nparams = rec->nparams;
+        rec->nparams = 0;
+
+        if (virHashUpdateEntry(baseline, uuidstr, next) < 0) {
+            remoteStatsBaselineFree(next, NULL);
+            goto cleanup;
+        }
+    }
+
+    virHashFree(priv->statsBaseline);
+    VIR_STEAL_PTR(priv->statsBaseline, baseline);
+    ret->sample = ++priv->statsSample;
+
+    rv = 0;
+
+ cleanup:
+    if (locked)
+        virMutexUnlock(&priv->lock);
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virDomainStatsRecordListFree(retStats);
+    virHashFree(keys);
+    virHashFree(layouts);
+    virHashFree(baseline);
+
+    return rv;
+}
+
+
+static int
+remoteDispatchConnectDomainStatsRegister(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                         virNetServerClientPtr client,
+                                         virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                         virNetMessageErrorPtr rerr,
+                                         remote_connect_domain_stats_register_args *args,
+                                         remote_connect_domain_stats_register_ret *ret)
+{
+    int callbackID;
+    int rv = -1;
+    daemonClientEventCallbackPtr callback = NULL;
+    daemonClientEventCallbackPtr ref;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+    virDomainPtr dom = NULL;
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    virMutexLock(&priv->lock);
+
+    if (args->dom &&
+        !(dom = get_nonnull_domain(priv->conn, *args->dom)))
+        goto cleanup;
+
+    /* See qemuDispatchConnectDomainMonitorEventRegister for why the
+     * incomplete callback is appended before registering.  */
+    if (VIR_ALLOC(callback) < 0)
+        goto cleanup;
+    callback->client = virObjectRef(client);
+    callback->eventID = -1;
+    callback->callbackID = -1;
+    ref = callback;
+    if (VIR_APPEND_ELEMENT(priv->statsEventCallbacks,
+                           priv->nstatsEventCallbacks,
+                           callback) < 0)
+        goto cleanup;
+
+    if ((callbackID = virConnectDomainStatsRegister(priv->conn,
+                                                    dom,
+                                                    args->stats,
+                                                    args->interval,
+                                                    remoteRelayDomainStats,
+                                                    ref,
+                                                    remoteEventCallbackFree,
+                                                    args->flags)) < 0) {
+        VIR_SHRINK_N(priv->statsEventCallbacks,
+                     priv->nstatsEventCallbacks, 1);
+        callback = ref;
+        goto cleanup;
+    }
+
+    ref->callbackID = callbackID;
+    ret->callbackID = callbackID;
+
+    rv = 0;
+
+ cleanup:
+    remoteEventCallbackFree(callback);
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virObjectUnref(dom);
+    virMutexUnlock(&priv->lock);
+    return rv;
+}
+
+
+static int
+remoteDispatchConnectDomainStatsDeregister(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                           virNetServerClientPtr client,
+                                           virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                           virNetMessageErrorPtr rerr,
+                                           remote_connect_domain_stats_deregister_args *args)
+{
+    int rv = -1;
+    size_t i;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    virMutexLock(&priv->lock);
+
+    for (i = 0; i < priv->nstatsEventCallbacks; i++) {
+        if (priv->statsEventCallbacks[i]->callbackID == args->callbackID)
+            break;
+    }
+    if (i == priv->nstatsEventCallbacks) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("domain stats callback %d not registered"),
+                       args->callbackID);
+        goto cleanup;
+    }
+
+    if (virConnectDomainStatsDeregister(priv->conn, args->callbackID) < 0)
+        goto cleanup;
+
+    VIR_DELETE_ELEMENT(priv->statsEventCallbacks, i,
+                       priv->nstatsEventCallbacks);
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virMutexUnlock(&priv->lock);
+    return rv;
+}
+
+
+static int
+remoteDispatchConnectSetEventBatching(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                      virNetServerClientPtr client,
+                                      virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                      virNetMessageErrorPtr rerr,
+                                      remote_connect_set_event_batching_args *args)
+{
+    int rv = -1;
+    unsigned int flags = args->flags;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    virMutexLock(&priv->lock);
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    virCheckFlagsGoto(0, cleanup);
+
+    if (args->window > REMOTE_EVENT_BATCH_WINDOW_MAX) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("event batching window %u ms is larger than %d ms"),
+                       args->window, REMOTE_EVENT_BATCH_WINDOW_MAX);
+        goto cleanup;
+    }
+
+    if (args->window && priv->eventBatchTimer < 0) {
+        virObjectRef(client);
+        if ((priv->eventBatchTimer = virEventAddTimeout(-1,
+                                                        remoteEventBatchTimer,
+                                                        client,
+                                                        virObjectFreeCallback)) < 0) {
+            virObjectUnref(client);
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("unable to register event batching timer"));
+            goto cleanup;
+        }
+    }
+
+    if (!args->window)
+        remoteEventBatchFlushLocked(client, priv);
+    priv->eventBatchWindow = args->window;
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virMutexUnlock(&priv->lock);
+    return rv;
+}
+
+
 static int
 remoteDispatchNodeAllocPages(virNetServerPtr server ATTRIBUTE_UNUSED,
                              virNetServerClientPtr client,
@@ -95,6 +95,11 @@ struct private_data {
     bool serverKeepAlive;       /* Does server support keepalive protocol? */
     bool serverEventFilter;     /* Does server support modern event filtering */
     bool serverCloseCallback;   /* Does server support driver close callback */
+    bool serverPackedStats;     /* Does server support packed domain stats */
+
+    /* Last packed domain stats sample, baseline for delta decoding */
+    virHashTablePtr statsBaseline;
+    unsigned long long statsSample;
 
     virObjectEventStatePtr eventState;
     virConnectCloseCallbackDataPtr closeCallback;
@@ -418,11 +423,21 @@ remoteDomainBuildEventBlockThreshold(virNetClientProgramPtr prog,
                                      virNetClientPtr client,
                                      void *evdata, void *opaque);
 
+static void
+remoteDomainBuildEventStats(virNetClientProgramPtr prog,
+                            virNetClientPtr client,
+                            void *evdata, void *opaque);
+
 static void
 remoteConnectNotifyEventConnectionClosed(virNetClientProgramPtr prog ATTRIBUTE_UNUSED,
                                          virNetClientPtr client ATTRIBUTE_UNUSED,
                                          void *evdata, void *opaque);
 
+static void
+remoteConnectBuildEventBatch(virNetClientProgramPtr prog,
+                             virNetClientPtr client,
+                             void *evdata, void *opaque);
+
 static virNetClientProgramEvent remoteEvents[] = {
     { REMOTE_PROC_DOMAIN_EVENT_LIFECYCLE,
       remoteDomainBuildEventLifecycle,
@@ -629,8 +644,54 @@ static virNetClientProgramEvent remoteEvents[] = {
       remoteDomainBuildEventBlockThreshold,
       sizeof(remote_domain_event_block_threshold_msg),
       (xdrproc_t)xdr_remote_domain_event_block_threshold_msg },
+    { REMOTE_PROC_DOMAIN_EVENT_STATS,
+      remoteDomainBuildEventStats,
+      sizeof(remote_domain_event_stats_msg),
+      (xdrproc_t)xdr_remote_domain_event_stats_msg },
+    { REMOTE_PROC_CONNECT_EVENT_BATCH,
+      remoteConnectBuildEventBatch,
+      sizeof(remote_connect_event_batch_msg),
+      (xdrproc_t)xdr_remote_connect_event_batch_msg },
 };
 
+/*
+ * Each entry of a batch is a complete event message of this program,
+ * which is dispatched as if it had been received on its own.
+ */
+static void
+remoteConnectBuildEventBatch(virNetClientProgramPtr prog,
+                             virNetClientPtr client,
+                             void *evdata, void *opaque ATTRIBUTE_UNUSED)
+{
+    remote_connect_event_batch_msg *msg = evdata;
+    size_t i;
+
+    VIR_DEBUG("Unbatching %u events", msg->events.events_len);
+
+    for (i = 0; i < msg->events.events_len; i++) {
+        remote_event_batch_entry *entry = &msg->events.events_val[i];
+        virNetMessagePtr event;
+
+        if (!(event = virNetMessageNew(false)))
+            return;
+
+        /* Steal the buffer, xdr_free() skips it afterwards */
+        event->buffer = entry->message.message_val;
+        event->bufferLength = entry->message.message_len;
+        entry->message.message_val = NULL;
+        entry->message.message_len = 0;
+
+        if (virNetMessageDecodeHeader(event) < 0 ||
+            event->header.proc == REMOTE_PROC_CONNECT_EVENT_BATCH) {
+            VIR_WARN("Dropping malformed event %zu of a batch", i);
+        } else {
+            virNetClientProgramDispatch(prog, client, event);
+        }
+
+        virNetMessageFree(event);
+    }
+}
+
 static void
 remoteConnectNotifyEventConnectionClosed(virNetClientProgramPtr prog ATTRIBUTE_UNUSED,
                                          virNetClientPtr client ATTRIBUTE_UNUSED,
@@ -787,6 +848,7 @@ doRemoteOpen(virConnectPtr conn,
     char *daemonPath = NULL;
 #endif
     char *tls_priority = NULL;
+    char *eventBatchWindow = NULL;
 
     /* We handle *ALL* URIs here. The caller has rejected any
      * URIs we don't care about */
@@ -900,6 +962,7 @@ doRemoteOpen(virConnectPtr conn,
             EXTRACT_URI_ARG_STR("known_hosts", knownHosts);
             EXTRACT_URI_ARG_STR("known_hosts_verify", knownHostsVerify);
             EXTRACT_URI_ARG_STR("tls_priority", tls_priority);
+            EXTRACT_URI_ARG_STR("event_batch_window", eventBatchWindow);
 
             EXTRACT_URI_ARG_BOOL("no_sanity", sanity);
             EXTRACT_URI_ARG_BOOL("no_verify", verify);
@@ -1251,6 +1314,34 @@ doRemoteOpen(virConnectPtr conn,
                  "by the remote side.");
     }
 
+    priv->serverPackedStats = remoteConnectSupportsFeatureUnlocked(conn,
+                                  priv, VIR_DRV_FEATURE_REMOTE_PACKED_DOMAIN_STATS);
+
+    if (eventBatchWindow) {
+        remote_connect_set_event_batching_args args = { 0, 0 };
+
+        if (virStrToLong_ui(eventBatchWindow, NULL, 10, &args.window) < 0) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("invalid event batching window '%s'"),
+                           eventBatchWindow);
+            goto failed;
+        }
+
+        if (args.window > 0) {
+            if (remoteConnectSupportsFeatureUnlocked(conn, priv,
+                                    VIR_DRV_FEATURE_REMOTE_EVENT_BATCH)) {
+                if (call(conn, priv, 0, REMOTE_PROC_CONNECT_SET_EVENT_BATCHING,
+                         (xdrproc_t) xdr_remote_connect_set_event_batching_args,
+                         (char *) &args,
+                         (xdrproc_t) xdr_void, (char *) NULL) == -1)
+                    goto failed;
+            } else {
+                VIR_INFO("Not batching events since it is not supported "
+                         "by the server");
+            }
+        }
+    }
+
     /* Successful. */
     retcode = VIR_DRV_OPEN_SUCCESS;
 
@@ -1267,6 +1358,7 @@ doRemoteOpen(virConnectPtr conn,
     VIR_FREE(port);
     VIR_FREE(pkipath);
     VIR_FREE(tls_priority);
+    VIR_FREE(eventBatchWindow);
     VIR_FREE(knownHostsVerify);
     VIR_FREE(knownHosts);
 #ifndef WIN32
@@ -1438,6 +1530,10 @@ doRemoteClose(virConnectPtr conn, struct private_data *priv)
     virObjectUnref(priv->eventState);
     priv->eventState = NULL;
 
+    virHashFree(priv->statsBaseline);
+    priv->statsBaseline = NULL;
+    priv->statsSample = 0;
+
     return ret;
 }
 
@@ -3559,6 +3655,96 @@ remoteConnectDomainQemuMonitorEventDeregister(virConnectPtr conn,
     return rv;
 }
 
+
+static int
+remoteConnectDomainStatsRegister(virConnectPtr conn,
+                                 virDomainPtr dom,
+                                 unsigned int stats,
+                                 unsigned int interval,
+                                 virConnectDomainStatsCallback callback,
+                                 void *opaque,
+                                 virFreeCallback freecb,
+                                 unsigned int flags)
+{
+    int rv = -1;
+    struct private_data *priv = conn->privateData;
+    remote_connect_domain_stats_register_args args;
+    remote_connect_domain_stats_register_ret ret;
+    int callbackID;
+    remote_nonnull_domain domain;
+
+    remoteDriverLock(priv);
+
+    /* Every subscription has its own sampling parameters, so unlike
+     * other events each client callback maps to one server callback */
+    if (virDomainStatsEventStateRegisterID(conn, priv->eventState,
+                                           dom, 0, callback,
+                                           opaque, freecb,
+                                           &callbackID) < 0)
+        goto done;
+
+    if (dom) {
+        make_nonnull_domain(&domain, dom);
+        args.dom = &domain;
+    } else {
+        args.dom = NULL;
+    }
+    args.stats = stats;
+    args.interval = interval;
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_DOMAIN_STATS_REGISTER,
+             (xdrproc_t) xdr_remote_connect_domain_stats_register_args, (char *) &args,
+             (xdrproc_t) xdr_remote_connect_domain_stats_register_ret, (char *) &ret) == -1) {
+        virObjectEventStateDeregisterID(conn, priv->eventState,
+                                        callbackID, false);
+        goto done;
+    }
+    virObjectEventStateSetRemote(conn, priv->eventState, callbackID,
+                                 ret.callbackID);
+
+    rv = callbackID;
+
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
+static int
+remoteConnectDomainStatsDeregister(virConnectPtr conn,
+                                   int callbackID)
+{
+    struct private_data *priv = conn->privateData;
+    int rv = -1;
+    remote_connect_domain_stats_deregister_args args;
+    int remoteID;
+
+    remoteDriverLock(priv);
+
+    if (virObjectEventStateEventID(conn, priv->eventState,
+                                   callbackID, &remoteID) < 0)
+        goto done;
+
+    if (virObjectEventStateDeregisterID(conn, priv->eventState,
+                                        callbackID, true) < 0)
+        goto done;
+
+    args.callbackID = remoteID;
+
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_DOMAIN_STATS_DEREGISTER,
+             (xdrproc_t) xdr_remote_connect_domain_stats_deregister_args, (char *) &args,
+             (xdrproc_t) xdr_void, (char *) NULL) == -1)
+        goto done;
+
+    rv = 0;
+
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
 /*----------------------------------------------------------------------*/
 
 static char *
@@ -5590,6 +5776,40 @@ remoteDomainBuildEventBlockThreshold(virNetClientProgramPtr prog ATTRIBUTE_UNUSE
 }
 
 
+static void
+remoteDomainBuildEventStats(virNetClientProgramPtr prog ATTRIBUTE_UNUSED,
+                            virNetClientPtr client ATTRIBUTE_UNUSED,
+                            void *evdata, void *opaque)
+{
+    virConnectPtr conn = opaque;
+    remote_domain_event_stats_msg *msg = evdata;
+    struct private_data *priv = conn->privateData;
+    virDomainPtr dom;
+    virObjectEventPtr event = NULL;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) msg->params.params_val,
+                                  msg->params.params_len,
+                                  REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX,
+                                  &params, &nparams) < 0)
+        return;
+
+    if (!(dom = get_nonnull_domain(conn, msg->dom))) {
+        virTypedParamsFree(params, nparams);
+        return;
+    }
+
+    /* The server already picked the groups and subscriptions */
+    event = virDomainStatsEventNew(dom->id, dom->name, dom->uuid,
+                                   params, nparams, NULL, NULL, 0);
+
+    virObjectUnref(dom);
+
+    virObjectEventStateQueueRemote(priv->eventState, event, msg->callbackID);
+}
+
+
 static int
 remoteStreamSend(virStreamPtr st,
                  const char *data,
@@ -7662,6 +7882,212 @@ remoteNetworkGetDHCPLeases(virNetworkPtr net,
 }
 
 
+static void
+remoteStatsBaselineFree(void *payload,
+                        const void *name ATTRIBUTE_UNUSED)
+{
+    virDomainStatsRecordPtr rec = payload;
+
+    virTypedParamsFree(rec->params, rec->nparams);
+    VIR_FREE(rec);
+}
+
+
+static virDomainStatsRecordPtr
+remoteDomainStatsUnpack(virConnectPtr conn,
+                        struct private_data *priv,
+                        remote_connect_get_all_domain_stats_packed_ret *ret,
+                        remote_domain_stats_packed_record *rec)
+{
+    virDomainStatsRecordPtr elem = NULL;
+    virDomainStatsRecordPtr base = NULL;
+    remote_domain_stats_layout *layout;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    size_t i;
+
+    if (rec->layout >= ret->layouts.layouts_len) {
+        virReportError(VIR_ERR_RPC,
+                       _("invalid domain stats layout %u"), rec->layout);
+        return NULL;
+    }
+    layout = ret->layouts.layouts_val + rec->layout;
+
+    if (VIR_ALLOC(elem) < 0)
+        return NULL;
+
+    if (!(elem->dom = get_nonnull_domain(conn, rec->dom)))
+        goto error;
+
+    if (VIR_ALLOC_N(elem->params, layout->keys.keys_len) < 0)
+        goto error;
+    elem->nparams = layout->keys.keys_len;
+
+    for (i = 0; i < layout->keys.keys_len; i++) {
+        unsigned int key = layout->keys.keys_val[i];
+
+        if (key >= ret->keys.keys_len) {
+            virReportError(VIR_ERR_RPC,
+                           _("invalid domain stats key %u"), key);
+            goto error;
+        }
+
+        if (virStrcpyStatic(elem->params[i].field,
+                            ret->keys.keys_val[key].field) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("parameter %s too big for destination"),
+                           ret->keys.keys_val[key].field);
+            goto error;
+        }
+        elem->params[i].type = ret->keys.keys_val[key].type;
+    }
+
+    if (rec->delta) {
+        virUUIDFormat(elem->dom->uuid, uuidstr);
+        if (!priv->statsBaseline ||
+            !(base = virHashLookup(priv->statsBaseline, uuidstr))) {
+            virReportError(VIR_ERR_RPC,
+                           _("missing stats baseline for domain %s"),
+                           elem->dom->name);
+            goto error;
+        }
+    }
+
+    if (virTypedParamsUnpack(rec->values.values_val, rec->values.values_len,
+                             elem->params, elem->nparams,
+                             base ? base->params : NULL,
+                             base ? base->nparams : 0) < 0)
+        goto error;
+
+    return elem;
+
+ error:
+    virObjectUnref(elem->dom);
+    virTypedParamsFree(elem->params, elem->nparams);
+    VIR_FREE(elem);
+    return NULL;
+}
+
+
+/*
+ * Fetch bulk stats in packed form: field names are sent once per reply
+ * and values are relative to the previous sample when possible. The
+ * values of each domain are remembered to serve as baseline for the
+ * next call. The server echoes the sample it computed the deltas
+ * against, so replies of concurrent calls are never decoded against
+ * the wrong baseline. Must be called with the driver lock held.
+ */
+static int
+remoteConnectGetAllDomainStatsPacked(virConnectPtr conn,
+                                     struct private_data *priv,
+                                     virDomainPtr *doms,
+                                     unsigned int ndoms,
+                                     unsigned int stats,
+                                     virDomainStatsRecordPtr **retStats,
+                                     unsigned int flags)
+{
+    int rv = -1;
+    size_t i;
+    remote_connect_get_all_domain_stats_packed_args args;
+    remote_connect_get_all_domain_stats_packed_ret ret;
+    virDomainStatsRecordPtr *tmpret = NULL;
+    virDomainStatsRecordPtr next = NULL;
+    virHashTablePtr baseline = NULL;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    memset(&args, 0, sizeof(args));
+    memset(&ret, 0, sizeof(ret));
+
+    if (ndoms) {
+        if (VIR_ALLOC_N(args.doms.doms_val, ndoms) < 0)
+            goto cleanup;
+
+        for (i = 0; i < ndoms; i++)
+            make_nonnull_domain(args.doms.doms_val + i, doms[i]);
+    }
+    args.doms.doms_len = ndoms;
+
+    args.stats = stats;
+    args.flags = flags;
+    args.baseline = priv->statsSample;
+
+ retry:
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_STATS_PACKED,
+             (xdrproc_t)xdr_remote_connect_get_all_domain_stats_packed_args, (char *)&args,
+             (xdrproc_t)xdr_remote_connect_get_all_domain_stats_packed_ret, (char *)&ret) == -1)
+        goto cleanup;
+
+    /* call() drops the driver lock, so a concurrent call may have
+     * replaced the baseline the server computed the deltas against.
+     * Ask for a full sample in that case, which never needs one. */
+    if (ret.baseline && ret.baseline != priv->statsSample) {
+        VIR_DEBUG("Stats baseline %llu was replaced by %llu, retrying",
+                  (unsigned long long)ret.baseline,
+                  (unsigned long long)priv->statsSample);
+        xdr_free((xdrproc_t)xdr_remote_connect_get_all_domain_stats_packed_ret,
+                 (char *) &ret);
+        memset(&ret, 0, sizeof(ret));
+        args.baseline = 0;
+        goto retry;
+    }
+
+    if (ret.retStats.retStats_len > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of stats entries is %d, which exceeds max limit: %d"),
+                       ret.retStats.retStats_len, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    *retStats = NULL;
+
+    if (VIR_ALLOC_N(tmpret, ret.retStats.retStats_len + 1) < 0 ||
+        !(baseline = virHashCreate(MAX(ret.retStats.retStats_len, 16),
+                                   remoteStatsBaselineFree)))
+        goto cleanup;
+
+    for (i = 0; i < ret.retStats.retStats_len; i++) {
+        if (!(tmpret[i] = remoteDomainStatsUnpack(conn, priv, &ret,
+                                                  ret.retStats.retStats_val + i)))
+            goto cleanup;
+
+        if (VIR_ALLOC(next) < 0 ||
+            virTypedParamsCopy(&next->params, tmpret[i]->params,
+                               tmpret[i]->nparams) < 0)
+            goto cleanup;
+        next->nparams = tmpret[i]->nparams;
+
+        virUUIDFormat(tmpret[i]->dom->uuid, uuidstr);
+        if (virHashUpdateEntry(baseline, uuidstr, next) < 0)
+            goto cleanup;
+        next = NULL;
+    }
+
+    virHashFree(priv->statsBaseline);
+    VIR_STEAL_PTR(priv->statsBaseline, baseline);
+    priv->statsSample = ret.sample;
+
+    *retStats = tmpret;
+    tmpret = NULL;
+    rv = ret.retStats.retStats_len;
+
+ cleanup:
+    if (rv < 0) {
+        /* The server has moved on, start over with a full sample */
+        virHashFree(priv->statsBaseline);
+        priv->statsBaseline = NULL;
+        priv->statsSample = 0;
+    }
+    if (next)
+        remoteStatsBaselineFree(next, NULL);
+    virHashFree(baseline);
+    virDomainStatsRecordListFree(tmpret);
+    VIR_FREE(args.doms.doms_val);
+    xdr_free((xdrproc_t)xdr_remote_connect_get_all_domain_stats_packed_ret,
+             (char *) &ret);
+
+    return rv;
+}
+
+
 static int
 remoteConnectGetAllDomainStats(virConnectPtr conn,
                                virDomainPtr *doms,
@@ -7678,6 +8104,14 @@ remoteConnectGetAllDomainStats(virConnectPtr conn,
     virDomainStatsRecordPtr elem = NULL;
     virDomainStatsRecordPtr *tmpret = NULL;
 
+    if (priv->serverPackedStats) {
+        remoteDriverLock(priv);
+        rv = remoteConnectGetAllDomainStatsPacked(conn, priv, doms, ndoms,
+                                                  stats, retStats, flags);
+        remoteDriverUnlock(priv);
+        return rv;
+    }
+
     memset(&args, 0, sizeof(args));
 
     if (ndoms) {
@@ -8516,7 +8950,10 @@ static virHypervisorDriver hypervisor_driver = {
     .connectCompareHypervisorCPU = remoteConnectCompareHypervisorCPU, /* 4.4.0 */
     .connectBaselineHypervisorCPU = remoteConnectBaselineHypervisorCPU, /* 4.4.0 */
     .nodeGetSEVInfo = remoteNodeGetSEVInfo, /* 4.5.0 */
-    .domainGetLaunchSecurityInfo = remoteDomainGetLaunchSecurityInfo /* 4.5.0 */
+    .domainGetLaunchSecurityInfo = remoteDomainGetLaunchSecurityInfo, /* 4.5.0 */
+    .connectDomainStatsRegister = remoteConnectDomainStatsRegister, /* 5.3.0 */
+    .connectDomainStatsDeregister = remoteConnectDomainStatsDeregister, /* 5.3.0 */
+    .domainAttachDevices = remoteDomainAttachDevices, /* 5.3.0 */
 };
 
 static virNetworkDriver network_driver = {
@@ -236,6 +236,18 @@ const REMOTE_NETWORK_DHCP_LEASES_MAX = 65536;
 /* Upper limit on count of parameters returned via bulk stats API */
 const REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX = 262144;
 
+/* Upper limit on size of packed values of a bulk stats record */
+const REMOTE_DOMAIN_STATS_PACKED_MAX = 4194304;
+
+/* Upper limit on number of events coalesced into one batch message */
+const REMOTE_EVENT_BATCH_MAX = 4096;
+
+/* Upper limit on size of a single event message within a batch */
+const REMOTE_EVENT_BATCH_MESSAGE_MAX = 1048576;
+
+/* Upper limit on the time, in milliseconds, events may be held back */
+const REMOTE_EVENT_BATCH_WINDOW_MAX = 1000;
+
 /* Upper limit of message size for tunable event. */
 const REMOTE_DOMAIN_EVENT_TUNABLE_MAX = 2048;
 
@@ -263,6 +275,9 @@ const REMOTE_NODE_SEV_INFO_MAX = 64;
 /* Upper limit on number of launch security information entries */
 const REMOTE_DOMAIN_LAUNCH_SECURITY_INFO_PARAMS_MAX = 64;
 
+/* Upper limit on number of devices attached in one call */
+const REMOTE_DOMAIN_ATTACH_DEVICES_MAX = 256;
+
 /* UUID.  VIR_UUID_BUFLEN definition comes from libvirt.h */
 typedef opaque remote_uuid[VIR_UUID_BUFLEN];
 
@@ -3573,6 +3588,79 @@ struct remote_connect_get_storage_pool_capabilities_ret {
     remote_nonnull_string capabilities;
 };
 
+struct remote_domain_stats_key {
+    remote_nonnull_string field;
+    int type;
+};
+
+struct remote_domain_stats_layout {
+    unsigned int keys<REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX>; /* index into keys of the reply */
+};
+
+struct remote_domain_stats_packed_record {
+    remote_nonnull_domain dom;
+    unsigned int layout; /* index into layouts of the reply */
+    int delta;           /* values are relative to the baseline sample */
+    opaque values<REMOTE_DOMAIN_STATS_PACKED_MAX>;
+};
+
+struct remote_connect_get_all_domain_stats_packed_args {
+    remote_nonnull_domain doms<REMOTE_DOMAIN_LIST_MAX>;
+    unsigned int stats;
+    unsigned int flags;
+    unsigned hyper baseline; /* sample held by the client, 0 for none */
+};
+
+struct remote_connect_get_all_domain_stats_packed_ret {
+    remote_domain_stats_key keys<REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX>;
+    remote_domain_stats_layout layouts<REMOTE_DOMAIN_LIST_MAX>;
+    remote_domain_stats_packed_record retStats<REMOTE_DOMAIN_LIST_MAX>;
+    unsigned hyper baseline; /* sample deltas are relative to, 0 for none */
+    unsigned hyper sample;
+};
+
+struct remote_connect_domain_stats_register_args {
+    remote_domain dom;
+    unsigned int stats;
+    unsigned int interval;
+    unsigned int flags;
+};
+
+struct remote_connect_domain_stats_register_ret {
+    int callbackID;
+};
+
+struct remote_connect_domain_stats_deregister_args {
+    int callbackID;
+};
+
+struct remote_domain_event_stats_msg {
+    int callbackID;
+    remote_nonnull_domain dom;
+    remote_typed_param params<REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX>;
+};
+
+struct remote_connect_set_event_batching_args {
+    unsigned int window; /* in milliseconds, 0 disables batching */
+    unsigned int flags;
+};
+
+/* A complete event message, including its length word and header,
+ * exactly as it would have been sent on its own */
+struct remote_event_batch_entry {
+    opaque message<REMOTE_EVENT_BATCH_MESSAGE_MAX>;
+};
+
+struct remote_connect_event_batch_msg {
+    remote_event_batch_entry events<REMOTE_EVENT_BATCH_MAX>;
+};
+
+struct remote_domain_attach_devices_args {
+    remote_nonnull_domain dom;
+    remote_nonnull_string xmls<REMOTE_DOMAIN_ATTACH_DEVICES_MAX>; /* (const char **) */
+    unsigned int flags;
+};
+
 /*----- Protocol. -----*/
 
 /* Define the program number, protocol version and procedure numbers here. */
@@ -6342,5 +6430,54 @@ enum remote_procedure {
      * @generate: both
      * @acl: connect:read
      */
-    REMOTE_PROC_CONNECT_GET_STORAGE_POOL_CAPABILITIES = 403
+    REMOTE_PROC_CONNECT_GET_STORAGE_POOL_CAPABILITIES = 403,
+
+    /**
+     * @generate: none
+     * @acl: connect:search_domains
+     * @aclfilter: domain:read
+     */
+    REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_STATS_PACKED = 404,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: connect:search_domains
+     * @aclfilter: domain:read
+     */
+    REMOTE_PROC_CONNECT_DOMAIN_STATS_REGISTER = 405,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: connect:search_domains
+     */
+    REMOTE_PROC_CONNECT_DOMAIN_STATS_DEREGISTER = 406,
+
+    /**
+     * @generate: both
+     * @acl: none
+     */
+    REMOTE_PROC_DOMAIN_EVENT_STATS = 407,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: none
+     */
+    REMOTE_PROC_CONNECT_SET_EVENT_BATCHING = 408,
+
+    /**
+     * @generate: none
+     * @acl: none
+     */
+    REMOTE_PROC_CONNECT_EVENT_BATCH = 409,
+
+    /**
+     * @generate: both
+     * @acl: domain:write
+     * @acl: domain:save:!VIR_DOMAIN_AFFECT_CONFIG|VIR_DOMAIN_AFFECT_LIVE
+     * @acl: domain:save:VIR_DOMAIN_AFFECT_CONFIG
+     */
+    REMOTE_PROC_DOMAIN_ATTACH_DEVICES = 410
 };
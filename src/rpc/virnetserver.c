@@ -839,6 +839,21 @@ void virNetServerClose(virNetServerPtr srv)
     virObjectUnlock(srv);
 }
 
+
+/*
+ * Wait for the workers to finish processing all requests that
+ * were already dispatched and stop them. Must only be called
+ * once the event loop has stopped, so that no new requests
+ * arrive.
+ */
+void virNetServerShutdownWait(virNetServerPtr srv)
+{
+    if (!srv)
+        return;
+
+    virThreadPoolDrain(srv->workers);
+}
+
 static inline size_t
 virNetServerTrackPendingAuthLocked(virNetServerPtr srv)
 {
@@ -191,6 +191,75 @@ static int virSecurityDACRestoreFileLabelInternal(virSecurityManagerPtr mgr,
                                                   const virStorageSource *src,
                                                   const char *path,
                                                   bool recall);
+/**
+ * virSecurityDACChownItemIsDuplicate:
+ * @list: transaction list
+ * @idx: index of the item to check
+ *
+ * Checks whether the last operation over the same path that
+ * precedes the item at @idx in @list is exactly the same. This is
+ * the case for instance when a backing image is shared by several
+ * disks. Since without remembering the owner chown() is
+ * idempotent, the duplicate item can be skipped then.
+ *
+ * When the owner is remembered (which is the default) nothing is
+ * skipped, because each item bumps or drops the refcount stored
+ * in XATTRs and restoring the path later relies on that.
+ *
+ * Returns: true if the item can be skipped,
+ *          false otherwise.
+ */
+static bool
+virSecurityDACChownItemIsDuplicate(virSecurityDACChownListPtr list,
+                                   size_t idx)
+{
+    virSecurityDACChownItemPtr item = list->items[idx];
+    size_t i;
+
+    if (list->lock || !item->path)
+        return false;
+
+    for (i = idx; i > 0; i--) {
+        virSecurityDACChownItemPtr prev = list->items[i - 1];
+
+        if (STRNEQ_NULLABLE(prev->path, item->path))
+            continue;
+
+        return prev->restore == item->restore &&
+            prev->uid == item->uid &&
+            prev->gid == item->gid;
+    }
+
+    return false;
+}
+
+
+static int
+virSecurityDACTransactionRunItem(size_t idx,
+                                 void *opaque)
+{
+    virSecurityDACChownListPtr list = opaque;
+    virSecurityDACChownItemPtr item = list->items[idx];
+
+    if (virSecurityDACChownItemIsDuplicate(list, idx))
+        return 1;
+
+    if (!item->restore) {
+        return virSecurityDACSetOwnership(list->manager,
+                                          item->src,
+                                          item->path,
+                                          item->uid,
+                                          item->gid,
+                                          list->lock);
+    }
+
+    return virSecurityDACRestoreFileLabelInternal(list->manager,
+                                                  item->src,
+                                                  item->path,
+                                                  list->lock);
+}
+
+
 /**
  * virSecurityDACTransactionRun:
  * @pid: process pid
@@ -199,7 +268,8 @@ static int virSecurityDACRestoreFileLabelInternal(virSecurityManagerPtr mgr,
  * This is the callback that runs in the same namespace as the domain we are
  * relabelling. For given transaction (@opaque) it relabels all the paths on
  * the list. Depending on security manager configuration it might lock paths
- * we will relabel.
+ * we will relabel. Paths on different filesystems are relabeled in
+ * parallel.
  *
  * Returns: 0 on success
  *         -1 otherwise.
@@ -212,14 +282,19 @@ virSecurityDACTransactionRun(pid_t pid ATTRIBUTE_UNUSED,
     virSecurityManagerMetadataLockStatePtr state;
     const char **paths = NULL;
     size_t npaths = 0;
+    bool *done = NULL;
     size_t i;
-    int rv = 0;
+    int rv;
     int ret = -1;
 
-    if (list->lock) {
-        if (VIR_ALLOC_N(paths, list->nItems) < 0)
-            return -1;
+    if (VIR_ALLOC_N(paths, list->nItems) < 0 ||
+        VIR_ALLOC_N(done, list->nItems) < 0)
+        goto cleanup;
+
+    if (virSecurityRelabelCacheBegin() < 0)
+        goto cleanup;
 
+    if (list->lock) {
         for (i = 0; i < list->nItems; i++) {
             const char *p = list->items[i]->path;
 
@@ -227,33 +302,23 @@ virSecurityDACTransactionRun(pid_t pid ATTRIBUTE_UNUSED,
         }
 
         if (!(state = virSecurityManagerMetadataLock(list->manager, paths, npaths)))
-            goto cleanup;
+            goto endcache;
     }
 
-    for (i = 0; i < list->nItems; i++) {
-        virSecurityDACChownItemPtr item = list->items[i];
-
-        if (!item->restore) {
-            rv = virSecurityDACSetOwnership(list->manager,
-                                            item->src,
-                                            item->path,
-                                            item->uid,
-                                            item->gid,
-                                            list->lock);
-        } else {
-            rv = virSecurityDACRestoreFileLabelInternal(list->manager,
-                                                        item->src,
-                                                        item->path,
-                                                        list->lock);
-        }
+    /* virSecurityManagerMetadataLock() sorted @paths. */
+    for (i = 0; i < list->nItems; i++)
+        paths[i] = list->items[i]->path;
 
-        if (rv < 0)
-            break;
-    }
+    rv = virSecurityRelabelPaths(paths, list->nItems,
+                                 virSecurityDACTransactionRunItem,
+                                 list, done);
 
-    for (; rv < 0 && i > 0; i--) {
+    for (i = list->nItems; rv < 0 && i > 0; i--) {
         virSecurityDACChownItemPtr item = list->items[i - 1];
 
+        if (!done[i - 1])
+            continue;
+
         if (!item->restore) {
             virSecurityDACRestoreFileLabelInternal(list->manager,
                                                    item->src,
@@ -269,10 +334,13 @@ virSecurityDACTransactionRun(pid_t pid ATTRIBUTE_UNUSED,
         virSecurityManagerMetadataUnlock(list->manager, &state);
 
     if (rv < 0)
-        goto cleanup;
+        goto endcache;
 
     ret = 0;
+ endcache:
+    virSecurityRelabelCacheEnd();
  cleanup:
+    VIR_FREE(done);
     VIR_FREE(paths);
     return ret;
 }
@@ -636,6 +704,46 @@ virSecurityDACTransactionCommit(virSecurityManagerPtr mgr ATTRIBUTE_UNUSED,
     return ret;
 }
 
+/**
+ * virSecurityDACTransactionApply:
+ * @mgr: security manager
+ * @lock: lock and unlock paths that are relabeled
+ *
+ * Performs all the chown()-s on the list in the calling process.
+ * The caller is responsible for being in the right namespace and
+ * for forking if @lock is true.
+ *
+ * Returns: 0 on success,
+ *         -1 otherwise.
+ */
+static int
+virSecurityDACTransactionApply(virSecurityManagerPtr mgr ATTRIBUTE_UNUSED,
+                               bool lock)
+{
+    virSecurityDACChownListPtr list;
+    int ret = -1;
+
+    list = virThreadLocalGet(&chownList);
+    if (!list) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("No transaction is set"));
+        goto cleanup;
+    }
+
+    if (virThreadLocalSet(&chownList, NULL) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to clear thread local variable"));
+        goto cleanup;
+    }
+
+    list->lock = lock;
+
+    ret = virSecurityDACTransactionRun(-1, list);
+ cleanup:
+    virSecurityDACChownListFree(list);
+    return ret;
+}
+
 /**
  * virSecurityDACTransactionAbort:
  * @mgr: security manager
@@ -690,7 +798,7 @@ virSecurityDACSetOwnershipInternal(const virSecurityDACData *priv,
             path = src->path;
         }
 
-        if (stat(path, &sb) < 0) {
+        if (virSecurityRelabelStat(path, &sb) < 0) {
             virReportSystemError(errno, _("unable to stat: %s"), path);
             return -1;
         }
@@ -700,7 +808,8 @@ virSecurityDACSetOwnershipInternal(const virSecurityDACData *priv,
             return 0;
         }
 
-        rc = chown(path, uid, gid);
+        if ((rc = chown(path, uid, gid)) == 0)
+            virSecurityRelabelCacheSetOwner(path, uid, gid);
     }
 
     if (rc < 0) {
@@ -754,7 +863,7 @@ virSecurityDACSetOwnership(virSecurityManagerPtr mgr,
         return 0;
 
     if (remember && path) {
-        if (stat(path, &sb) < 0) {
+        if (virSecurityRelabelStat(path, &sb) < 0) {
             virReportSystemError(errno, _("unable to stat: %s"), path);
             return -1;
         }
@@ -2328,6 +2437,7 @@ virSecurityDriver virSecurityDriverDAC = {
 
     .transactionStart                   = virSecurityDACTransactionStart,
     .transactionCommit                  = virSecurityDACTransactionCommit,
+    .transactionApply                   = virSecurityDACTransactionApply,
     .transactionAbort                   = virSecurityDACTransactionAbort,
 
     .domainSecurityVerify               = virSecurityDACVerify,
@@ -52,6 +52,8 @@ typedef int (*virSecurityDriverTransactionStart) (virSecurityManagerPtr mgr);
 typedef int (*virSecurityDriverTransactionCommit) (virSecurityManagerPtr mgr,
                                                    pid_t pid,
                                                    bool lock);
+typedef int (*virSecurityDriverTransactionApply) (virSecurityManagerPtr mgr,
+                                                  bool lock);
 typedef void (*virSecurityDriverTransactionAbort) (virSecurityManagerPtr mgr);
 
 typedef int (*virSecurityDomainSetDaemonSocketLabel)(virSecurityManagerPtr mgr,
@@ -164,6 +166,7 @@ struct _virSecurityDriver {
 
     virSecurityDriverTransactionStart transactionStart;
     virSecurityDriverTransactionCommit transactionCommit;
+    virSecurityDriverTransactionApply transactionApply;
     virSecurityDriverTransactionAbort transactionAbort;
 
     virSecurityDomainSecurityVerify domainSecurityVerify;
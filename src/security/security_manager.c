@@ -302,6 +302,34 @@ virSecurityManagerTransactionCommit(virSecurityManagerPtr mgr,
 }
 
 
+/**
+ * virSecurityManagerTransactionApply:
+ * @mgr: security manager
+ * @lock: lock and unlock paths that are relabeled
+ *
+ * Performs all the operations on the transaction list right in the
+ * calling process, without forking or entering any namespace. This
+ * is meant to be called from a child process that was forked (and
+ * possibly moved into domain's namespace) by the caller, e.g. to
+ * relabel for multiple security drivers at once. Because the state
+ * of @mgr's mutex is undefined after fork(), @mgr is not locked.
+ *
+ * The transaction is freed, just like in
+ * virSecurityManagerTransactionCommit().
+ *
+ * Returns: 0 on success,
+ *         -1 otherwise.
+ */
+int
+virSecurityManagerTransactionApply(virSecurityManagerPtr mgr,
+                                   bool lock)
+{
+    if (mgr->drv->transactionApply)
+        return mgr->drv->transactionApply(mgr, lock);
+    return 0;
+}
+
+
 /**
  * virSecurityManagerTransactionAbort:
  * @mgr: security manager
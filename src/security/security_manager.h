@@ -77,6 +77,8 @@ int virSecurityManagerTransactionStart(virSecurityManagerPtr mgr);
 int virSecurityManagerTransactionCommit(virSecurityManagerPtr mgr,
                                         pid_t pid,
                                         bool lock);
+int virSecurityManagerTransactionApply(virSecurityManagerPtr mgr,
+                                       bool lock);
 void virSecurityManagerTransactionAbort(virSecurityManagerPtr mgr);
 
 void *virSecurityManagerGetPrivateData(virSecurityManagerPtr mgr);
@@ -230,6 +230,67 @@ static int virSecuritySELinuxRestoreFileLabel(virSecurityManagerPtr mgr,
                                               bool recall);
 
 
+/**
+ * virSecuritySELinuxContextItemIsDuplicate:
+ * @list: transaction list
+ * @idx: index of the item to check
+ *
+ * Checks whether the last operation over the same path that
+ * precedes the item at @idx in @list is exactly the same. Unless
+ * the original label is remembered, such item can be skipped.
+ *
+ * Returns: true if the item can be skipped,
+ *          false otherwise.
+ */
+static bool
+virSecuritySELinuxContextItemIsDuplicate(virSecuritySELinuxContextListPtr list,
+                                         size_t idx)
+{
+    virSecuritySELinuxContextItemPtr item = list->items[idx];
+    size_t i;
+
+    if (list->lock || !item->path)
+        return false;
+
+    for (i = idx; i > 0; i--) {
+        virSecuritySELinuxContextItemPtr prev = list->items[i - 1];
+
+        if (STRNEQ_NULLABLE(prev->path, item->path))
+            continue;
+
+        return prev->restore == item->restore &&
+            prev->optional == item->optional &&
+            STREQ_NULLABLE(prev->tcon, item->tcon);
+    }
+
+    return false;
+}
+
+
+static int
+virSecuritySELinuxTransactionRunItem(size_t idx,
+                                     void *opaque)
+{
+    virSecuritySELinuxContextListPtr list = opaque;
+    virSecuritySELinuxContextItemPtr item = list->items[idx];
+
+    if (virSecuritySELinuxContextItemIsDuplicate(list, idx))
+        return 1;
+
+    if (!item->restore) {
+        return virSecuritySELinuxSetFileconHelper(list->manager,
+                                                  item->path,
+                                                  item->tcon,
+                                                  item->optional,
+                                                  list->lock);
+    }
+
+    return virSecuritySELinuxRestoreFileLabel(list->manager,
+                                              item->path,
+                                              list->lock);
+}
+
+
 /**
  * virSecuritySELinuxTransactionRun:
  * @pid: process pid
@@ -237,7 +298,7 @@ static int virSecuritySELinuxRestoreFileLabel(virSecurityManagerPtr mgr,
  *
  * This is the callback that runs in the same namespace as the domain we are
  * relabelling. For given transaction (@opaque) it relabels all the paths on
- * the list.
+ * the list. Paths on different filesystems are relabeled in parallel.
  *
  * Returns: 0 on success
  *         -1 otherwise.
@@ -250,14 +311,19 @@ virSecuritySELinuxTransactionRun(pid_t pid ATTRIBUTE_UNUSED,
     virSecurityManagerMetadataLockStatePtr state;
     const char **paths = NULL;
     size_t npaths = 0;
+    bool *done = NULL;
     size_t i;
     int rv;
     int ret = -1;
 
-    if (list->lock) {
-        if (VIR_ALLOC_N(paths, list->nItems) < 0)
-            return -1;
+    if (VIR_ALLOC_N(paths, list->nItems) < 0 ||
+        VIR_ALLOC_N(done, list->nItems) < 0)
+        goto cleanup;
 
+    if (virSecurityRelabelCacheBegin() < 0)
+        goto cleanup;
+
+    if (list->lock) {
         for (i = 0; i < list->nItems; i++) {
             const char *p = list->items[i]->path;
 
@@ -265,32 +331,23 @@ virSecuritySELinuxTransactionRun(pid_t pid ATTRIBUTE_UNUSED,
         }
 
         if (!(state = virSecurityManagerMetadataLock(list->manager, paths, npaths)))
-            goto cleanup;
+            goto endcache;
     }
 
-    rv = 0;
-    for (i = 0; i < list->nItems; i++) {
-        virSecuritySELinuxContextItemPtr item = list->items[i];
+    /* virSecurityManagerMetadataLock() sorted @paths. */
+    for (i = 0; i < list->nItems; i++)
+        paths[i] = list->items[i]->path;
 
-        if (!item->restore) {
-            rv = virSecuritySELinuxSetFileconHelper(list->manager,
-                                                    item->path,
-                                                    item->tcon,
-                                                    item->optional,
-                                                    list->lock);
-        } else {
-            rv = virSecuritySELinuxRestoreFileLabel(list->manager,
-                                                    item->path,
-                                                    list->lock);
-        }
+    rv = virSecurityRelabelPaths(paths, list->nItems,
+                                 virSecuritySELinuxTransactionRunItem,
+                                 list, done);
 
-        if (rv < 0)
-            break;
-    }
-
-    for (; rv < 0 && i > 0; i--) {
+    for (i = list->nItems; rv < 0 && i > 0; i--) {
         virSecuritySELinuxContextItemPtr item = list->items[i - 1];
 
+        if (!done[i - 1])
+            continue;
+
         if (!item->restore) {
             virSecuritySELinuxRestoreFileLabel(list->manager,
                                                item->path,
@@ -304,10 +361,13 @@ virSecuritySELinuxTransactionRun(pid_t pid ATTRIBUTE_UNUSED,
         virSecurityManagerMetadataUnlock(list->manager, &state);
 
     if (rv < 0)
-        goto cleanup;
+        goto endcache;
 
     ret = 0;
+ endcache:
+    virSecurityRelabelCacheEnd();
  cleanup:
+    VIR_FREE(done);
     VIR_FREE(paths);
     return ret;
 }
@@ -1184,6 +1244,46 @@ virSecuritySELinuxTransactionCommit(virSecurityManagerPtr mgr ATTRIBUTE_UNUSED,
     return ret;
 }
 
+/**
+ * virSecuritySELinuxTransactionApply:
+ * @mgr: security manager
+ * @lock: lock and unlock paths that are relabeled
+ *
+ * Performs all the sefilecon()-s on the list in the calling
+ * process. The caller is responsible for being in the right
+ * namespace and for forking if @lock is true.
+ *
+ * Returns: 0 on success,
+ *         -1 otherwise.
+ */
+static int
+virSecuritySELinuxTransactionApply(virSecurityManagerPtr mgr ATTRIBUTE_UNUSED,
+                                   bool lock)
+{
+    virSecuritySELinuxContextListPtr list;
+    int ret = -1;
+
+    list = virThreadLocalGet(&contextList);
+    if (!list) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("No transaction is set"));
+        return -1;
+    }
+
+    if (virThreadLocalSet(&contextList, NULL) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to clear thread local variable"));
+        goto cleanup;
+    }
+
+    list->lock = lock;
+
+    ret = virSecuritySELinuxTransactionRun(-1, list);
+ cleanup:
+    virSecuritySELinuxContextListFree(list);
+    return ret;
+}
+
 /**
  * virSecuritySELinuxTransactionAbort:
  * @mgr: security manager
@@ -1492,7 +1592,7 @@ virSecuritySELinuxRestoreFileLabel(virSecurityManagerPtr mgr,
             goto cleanup;
         }
     } else {
-        if (stat(newpath, &buf) != 0) {
+        if (virSecurityRelabelStat(newpath, &buf) != 0) {
             VIR_WARN("cannot stat %s: %s", newpath,
                      virStrerror(errno, ebuf, sizeof(ebuf)));
             goto cleanup;
@@ -3417,6 +3517,7 @@ virSecurityDriver virSecurityDriverSELinux = {
 
     .transactionStart                   = virSecuritySELinuxTransactionStart,
     .transactionCommit                  = virSecuritySELinuxTransactionCommit,
+    .transactionApply                   = virSecuritySELinuxTransactionApply,
     .transactionAbort                   = virSecuritySELinuxTransactionAbort,
 
     .domainSecurityVerify               = virSecuritySELinuxVerify,
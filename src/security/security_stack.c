@@ -21,9 +21,11 @@
 #include <config.h>
 
 #include "security_stack.h"
+#include "security_util.h"
 
 #include "virerror.h"
 #include "viralloc.h"
+#include "virprocess.h"
 
 #define VIR_FROM_THIS VIR_FROM_SECURITY
 
@@ -41,6 +43,13 @@ struct _virSecurityStackData {
     virSecurityStackItemPtr itemsHead;
 };
 
+typedef struct _virSecurityStackTransactionData virSecurityStackTransactionData;
+typedef virSecurityStackTransactionData *virSecurityStackTransactionDataPtr;
+struct _virSecurityStackTransactionData {
+    virSecurityStackDataPtr priv;
+    bool lock;
+};
+
 int
 virSecurityStackAddNested(virSecurityManagerPtr mgr,
                           virSecurityManagerPtr nested)
@@ -154,32 +163,89 @@ virSecurityStackTransactionStart(virSecurityManagerPtr mgr)
 }
 
 
-static int
-virSecurityStackTransactionCommit(virSecurityManagerPtr mgr,
-                                  pid_t pid,
-                                  bool lock)
+static void
+virSecurityStackTransactionAbort(virSecurityManagerPtr mgr)
 {
     virSecurityStackDataPtr priv = virSecurityManagerGetPrivateData(mgr);
     virSecurityStackItemPtr item = priv->itemsHead;
+
+    for (; item; item = item->next)
+        virSecurityManagerTransactionAbort(item->securityManager);
+}
+
+
+static int
+virSecurityStackTransactionRun(pid_t pid ATTRIBUTE_UNUSED,
+                               void *opaque)
+{
+    virSecurityStackTransactionDataPtr data = opaque;
+    virSecurityStackItemPtr item = data->priv->itemsHead;
     int rc = 0;
 
+    /* Let nested drivers share stat() results of the paths. */
+    if (virSecurityRelabelCacheBegin() < 0)
+        return -1;
+
     for (; item; item = item->next) {
-        if (virSecurityManagerTransactionCommit(item->securityManager, pid, lock) < 0)
+        if (virSecurityManagerTransactionApply(item->securityManager,
+                                               data->lock) < 0)
             rc = -1;
     }
 
+    virSecurityRelabelCacheEnd();
     return rc;
 }
 
 
-static void
-virSecurityStackTransactionAbort(virSecurityManagerPtr mgr)
+static int
+virSecurityStackTransactionCommit(virSecurityManagerPtr mgr,
+                                  pid_t pid,
+                                  bool lock)
 {
     virSecurityStackDataPtr priv = virSecurityManagerGetPrivateData(mgr);
+    virSecurityStackTransactionData data = { .priv = priv, .lock = lock };
     virSecurityStackItemPtr item = priv->itemsHead;
+    int rc = 0;
 
-    for (; item; item = item->next)
-        virSecurityManagerTransactionAbort(item->securityManager);
+    if (pid == -1 && !lock) {
+        if (virSecurityRelabelCacheBegin() < 0) {
+            virSecurityStackTransactionAbort(mgr);
+            return -1;
+        }
+
+        for (; item; item = item->next) {
+            if (virSecurityManagerTransactionCommit(item->securityManager, pid, lock) < 0)
+                rc = -1;
+        }
+
+        virSecurityRelabelCacheEnd();
+        return rc;
+    }
+
+    /* Fork and enter the domain's namespace only once for all nested
+     * drivers rather than letting each of them do it on its own. */
+    if (pid == -1)
+        rc = virProcessRunInFork(virSecurityStackTransactionRun, &data);
+    else
+        rc = virProcessRunInMountNamespace(pid,
+                                           virSecurityStackTransactionRun,
+                                           &data);
+
+    /* The transactions were consumed by the child. Free our copy. */
+    virSecurityStackTransactionAbort(mgr);
+
+    return rc < 0 ? -1 : 0;
+}
+
+
+static int
+virSecurityStackTransactionApply(virSecurityManagerPtr mgr,
+                                 bool lock)
+{
+    virSecurityStackDataPtr priv = virSecurityManagerGetPrivateData(mgr);
+    virSecurityStackTransactionData data = { .priv = priv, .lock = lock };
+
+    return virSecurityStackTransactionRun(-1, &data);
 }
 
 
@@ -779,6 +845,7 @@ virSecurityDriver virSecurityDriverStack = {
 
     .transactionStart                   = virSecurityStackTransactionStart,
     .transactionCommit                  = virSecurityStackTransactionCommit,
+    .transactionApply                   = virSecurityStackTransactionApply,
     .transactionAbort                   = virSecurityStackTransactionAbort,
 
     .domainSecurityVerify               = virSecurityStackVerify,
@@ -19,14 +19,20 @@
 #include <config.h>
 
 #include "viralloc.h"
+#include "viratomic.h"
 #include "virfile.h"
+#include "virhash.h"
+#include "virlog.h"
 #include "virstring.h"
 #include "virerror.h"
+#include "virthread.h"
 
 #include "security_util.h"
 
 #define VIR_FROM_THIS VIR_FROM_SECURITY
 
+VIR_LOG_INIT("security.security_util");
+
 /* There are four namespaces available on Linux (xattr(7)):
  *
  *  user - can be modified by anybody,
@@ -254,3 +260,402 @@ virSecuritySetRememberedLabel(const char *name,
     VIR_FREE(ref_name);
     return ret;
 }
+
+
+/* Relabeling is done in parallel only across different
+ * filesystems and with at most this many threads. */
+#define VIR_SECURITY_RELABEL_MAX_WORKERS 8
+
+typedef struct _virSecurityRelabelCache virSecurityRelabelCache;
+typedef virSecurityRelabelCache *virSecurityRelabelCachePtr;
+struct _virSecurityRelabelCache {
+    virMutex lock;
+    virHashTablePtr stats; /* path -> struct stat */
+    size_t refs;
+};
+
+static virThreadLocal relabelCache;
+
+static int
+virSecurityUtilOnceInit(void)
+{
+    return virThreadLocalInit(&relabelCache, NULL);
+}
+
+VIR_ONCE_GLOBAL_INIT(virSecurityUtil);
+
+
+/**
+ * virSecurityRelabelCacheBegin:
+ *
+ * Starts memoizing stat() results done through
+ * virSecurityRelabelStat() in the calling thread. Calls can be
+ * nested, in which case the inner ones share the cache of the
+ * outermost one. This way all the security drivers that relabel
+ * within one transaction stat each path only once. Each call must
+ * be paired with virSecurityRelabelCacheEnd().
+ *
+ * Returns: 0 on success,
+ *         -1 otherwise (with error reported)
+ */
+int
+virSecurityRelabelCacheBegin(void)
+{
+    virSecurityRelabelCachePtr cache;
+
+    if (virSecurityUtilInitialize() < 0)
+        return -1;
+
+    if ((cache = virThreadLocalGet(&relabelCache))) {
+        cache->refs++;
+        return 0;
+    }
+
+    if (VIR_ALLOC(cache) < 0)
+        return -1;
+
+    if (virMutexInit(&cache->lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to initialize mutex"));
+        VIR_FREE(cache);
+        return -1;
+    }
+
+    if (!(cache->stats = virHashCreate(32, virHashValueFree)))
+        goto error;
+
+    if (virThreadLocalSet(&relabelCache, cache) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to set thread local variable"));
+        goto error;
+    }
+
+    cache->refs = 1;
+    return 0;
+
+ error:
+    virHashFree(cache->stats);
+    virMutexDestroy(&cache->lock);
+    VIR_FREE(cache);
+    return -1;
+}
+
+
+/**
+ * virSecurityRelabelCacheEnd:
+ *
+ * Counterpart to virSecurityRelabelCacheBegin(). Frees the cache
+ * once the outermost caller is done with it.
+ */
+void
+virSecurityRelabelCacheEnd(void)
+{
+    virSecurityRelabelCachePtr cache = virThreadLocalGet(&relabelCache);
+
+    if (!cache || --cache->refs > 0)
+        return;
+
+    if (virThreadLocalSet(&relabelCache, NULL) < 0)
+        VIR_DEBUG("Unable to clear thread local variable");
+
+    virHashFree(cache->stats);
+    virMutexDestroy(&cache->lock);
+    VIR_FREE(cache);
+}
+
+
+/**
+ * virSecurityRelabelStat:
+ * @path: file name
+ * @sb: returned stat data
+ *
+ * Like stat(), but if there's a cache set up by
+ * virSecurityRelabelCacheBegin() the result is remembered and
+ * returned for subsequent calls over the same @path.
+ *
+ * Returns: 0 on success,
+ *         -1 otherwise (with errno set)
+ */
+int
+virSecurityRelabelStat(const char *path,
+                       struct stat *sb)
+{
+    virSecurityRelabelCachePtr cache = virThreadLocalGet(&relabelCache);
+    struct stat *cached;
+
+    if (!cache)
+        return stat(path, sb);
+
+    virMutexLock(&cache->lock);
+    if ((cached = virHashLookup(cache->stats, path))) {
+        *sb = *cached;
+        virMutexUnlock(&cache->lock);
+        return 0;
+    }
+    virMutexUnlock(&cache->lock);
+
+    if (stat(path, sb) < 0)
+        return -1;
+
+    /* Failing to remember the result is not fatal. */
+    if (VIR_ALLOC_QUIET(cached) < 0)
+        return 0;
+
+    *cached = *sb;
+    virMutexLock(&cache->lock);
+    if (virHashLookup(cache->stats, path) ||
+        virHashAddEntry(cache->stats, path, cached) < 0)
+        VIR_FREE(cached);
+    virMutexUnlock(&cache->lock);
+
+    return 0;
+}
+
+
+static int
+virSecurityRelabelCacheSetOwnerHelper(void *payload,
+                                      const void *name ATTRIBUTE_UNUSED,
+                                      void *opaque)
+{
+    struct stat *cached = payload;
+    const struct stat *sb = opaque;
+
+    if (cached->st_dev == sb->st_dev &&
+        cached->st_ino == sb->st_ino) {
+        cached->st_uid = sb->st_uid;
+        cached->st_gid = sb->st_gid;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virSecurityRelabelCacheSetOwner:
+ * @path: file name
+ * @uid: new owner
+ * @gid: new group
+ *
+ * Updates the remembered stat data of @path after it was
+ * successfully chown()-ed. Since other cached paths might refer
+ * to the same file (e.g. /dev/disk/by-id/ symlinks and their
+ * targets), all entries with the same device and inode number
+ * are updated.
+ */
+void
+virSecurityRelabelCacheSetOwner(const char *path,
+                                uid_t uid,
+                                gid_t gid)
+{
+    virSecurityRelabelCachePtr cache = virThreadLocalGet(&relabelCache);
+    struct stat sb;
+
+    if (!cache)
+        return;
+
+    if (virSecurityRelabelStat(path, &sb) < 0) {
+        /* Don't know which file @path is, so forget everything. */
+        virMutexLock(&cache->lock);
+        virHashRemoveAll(cache->stats);
+        virMutexUnlock(&cache->lock);
+        return;
+    }
+
+    sb.st_uid = uid;
+    sb.st_gid = gid;
+
+    virMutexLock(&cache->lock);
+    ignore_value(virHashForEach(cache->stats,
+                                virSecurityRelabelCacheSetOwnerHelper,
+                                &sb));
+    virMutexUnlock(&cache->lock);
+}
+
+
+typedef struct _virSecurityRelabelWorker virSecurityRelabelWorker;
+typedef virSecurityRelabelWorker *virSecurityRelabelWorkerPtr;
+struct _virSecurityRelabelWorker {
+    virThread thread;
+    bool started;
+
+    size_t id;
+    size_t nworkers;
+    const size_t *groups;
+    size_t npaths;
+
+    virSecurityRelabelFunc func;
+    void *opaque;
+    bool *done;
+    int *failed;
+
+    virSecurityRelabelCachePtr cache;
+    virErrorPtr err;
+};
+
+
+static void
+virSecurityRelabelWorkerRun(virSecurityRelabelWorkerPtr worker)
+{
+    size_t i;
+    int rc;
+
+    for (i = 0; i < worker->npaths; i++) {
+        if (worker->groups[i] % worker->nworkers != worker->id)
+            continue;
+
+        if (virAtomicIntGet(worker->failed))
+            break;
+
+        if ((rc = worker->func(i, worker->opaque)) < 0) {
+            virErrorPreserveLast(&worker->err);
+            virAtomicIntSet(worker->failed, 1);
+            break;
+        }
+
+        worker->done[i] = rc == 0;
+    }
+}
+
+
+static void
+virSecurityRelabelWorkerThread(void *opaque)
+{
+    virSecurityRelabelWorkerPtr worker = opaque;
+
+    /* Share the cache of the thread that spawned us. */
+    if (worker->cache)
+        ignore_value(virThreadLocalSet(&relabelCache, worker->cache));
+
+    virSecurityRelabelWorkerRun(worker);
+
+    if (worker->cache)
+        ignore_value(virThreadLocalSet(&relabelCache, NULL));
+}
+
+
+/**
+ * virSecurityRelabelPaths:
+ * @paths: paths to relabel
+ * @npaths: number of items in @paths array
+ * @func: callback doing the actual relabel
+ * @opaque: opaque data to @func
+ * @done: array of @npaths items
+ *
+ * Calls @func for every item of @paths. The paths are grouped
+ * by the filesystem they live on and each group is processed by
+ * a separate thread, so that slow (e.g. network) filesystems
+ * don't hold back each other. Within a group the paths are
+ * processed in the order they appear in @paths, therefore the
+ * order of operations over a single path is preserved. An item
+ * of @paths can be NULL, in which case it's put into the same
+ * group as paths that can't be stat()-ed.
+ *
+ * @func should return 0 if it relabeled the path, 1 if there was
+ * nothing to do, or -1 on error. Upon return, @done[i] is set to
+ * true if @func returned 0 for @paths[i], so that the caller can
+ * roll back on failure. Once @func fails no more paths are
+ * processed.
+ *
+ * Returns: 0 on success,
+ *         -1 otherwise (with error reported)
+ */
+int
+virSecurityRelabelPaths(const char **paths,
+                        size_t npaths,
+                        virSecurityRelabelFunc func,
+                        void *opaque,
+                        bool *done)
+{
+    VIR_AUTOFREE(size_t *) groups = NULL;
+    VIR_AUTOFREE(dev_t *) devs = NULL;
+    VIR_AUTOFREE(bool *) known = NULL;
+    VIR_AUTOFREE(virSecurityRelabelWorkerPtr) workers = NULL;
+    size_t ngroups = 0;
+    size_t nworkers;
+    size_t i;
+    size_t j;
+    bool reported = false;
+    int failed = 0;
+
+    if (npaths == 0)
+        return 0;
+
+    if (virSecurityUtilInitialize() < 0 ||
+        VIR_ALLOC_N(groups, npaths) < 0 ||
+        VIR_ALLOC_N(devs, npaths) < 0 ||
+        VIR_ALLOC_N(known, npaths) < 0)
+        return -1;
+
+    for (i = 0; i < npaths; i++) {
+        struct stat sb;
+        bool isKnown = paths[i] && virSecurityRelabelStat(paths[i], &sb) == 0;
+
+        for (j = 0; j < ngroups; j++) {
+            if (known[j] == isKnown &&
+                (!isKnown || devs[j] == sb.st_dev))
+                break;
+        }
+
+        if (j == ngroups) {
+            known[j] = isKnown;
+            if (isKnown)
+                devs[j] = sb.st_dev;
+            ngroups++;
+        }
+
+        groups[i] = j;
+    }
+
+    nworkers = MIN(ngroups, VIR_SECURITY_RELABEL_MAX_WORKERS);
+
+    if (VIR_ALLOC_N(workers, nworkers) < 0)
+        return -1;
+
+    for (i = 0; i < nworkers; i++) {
+        workers[i].id = i;
+        workers[i].nworkers = nworkers;
+        workers[i].groups = groups;
+        workers[i].npaths = npaths;
+        workers[i].func = func;
+        workers[i].opaque = opaque;
+        workers[i].done = done;
+        workers[i].failed = &failed;
+        workers[i].cache = virThreadLocalGet(&relabelCache);
+    }
+
+    /* The first worker runs in this thread. If a thread can't be
+     * spawned its share of work is done here too. */
+    for (i = 1; i < nworkers; i++) {
+        if (virThreadCreate(&workers[i].thread, true,
+                            virSecurityRelabelWorkerThread,
+                            &workers[i]) == 0)
+            workers[i].started = true;
+    }
+
+    for (i = 0; i < nworkers; i++) {
+        if (!workers[i].started)
+            virSecurityRelabelWorkerRun(&workers[i]);
+    }
+
+    for (i = 1; i < nworkers; i++) {
+        if (workers[i].started)
+            virThreadJoin(&workers[i].thread);
+    }
+
+    if (!virAtomicIntGet(&failed))
+        return 0;
+
+    for (i = 0; i < nworkers; i++) {
+        if (!workers[i].err)
+            continue;
+
+        if (!reported) {
+            virErrorRestore(&workers[i].err);
+            reported = true;
+        } else {
+            virFreeError(workers[i].err);
+        }
+    }
+
+    return -1;
+}
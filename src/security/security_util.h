@@ -19,6 +19,8 @@
 #ifndef LIBVIRT_SECURITY_UTIL_H
 # define LIBVIRT_SECURITY_UTIL_H
 
+# include <sys/stat.h>
+
 int
 virSecurityGetRememberedLabel(const char *name,
                               const char *path,
@@ -29,4 +31,29 @@ virSecuritySetRememberedLabel(const char *name,
                               const char *path,
                               const char *label);
 
+int
+virSecurityRelabelCacheBegin(void);
+
+void
+virSecurityRelabelCacheEnd(void);
+
+int
+virSecurityRelabelStat(const char *path,
+                       struct stat *sb);
+
+void
+virSecurityRelabelCacheSetOwner(const char *path,
+                                uid_t uid,
+                                gid_t gid);
+
+typedef int (*virSecurityRelabelFunc)(size_t idx,
+                                      void *opaque);
+
+int
+virSecurityRelabelPaths(const char **paths,
+                        size_t npaths,
+                        virSecurityRelabelFunc func,
+                        void *opaque,
+                        bool *done);
+
 #endif /* LIBVIRT_SECURITY_UTIL_H */
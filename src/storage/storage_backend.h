@@ -106,6 +106,9 @@ struct _virStorageBackend {
     virStorageBackendStartPool startPool;
     virStorageBackendBuildPool buildPool;
     virStorageBackendRefreshPool refreshPool; /* Must be non-NULL */
+    /* If true, refreshPool reconciles the existing volume list itself
+     * and the driver only clears it for a full refresh */
+    bool incrementalRefresh;
     virStorageBackendStopPool stopPool;
     virStorageBackendDeletePool deletePool;
 
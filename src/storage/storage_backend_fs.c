@@ -648,6 +648,7 @@ virStorageBackend virStorageBackendDirectory = {
     .buildPool = virStorageBackendFileSystemBuild,
     .checkPool = virStorageBackendFileSystemCheck,
     .refreshPool = virStorageBackendRefreshLocal,
+    .incrementalRefresh = true,
     .deletePool = virStorageBackendDeleteLocal,
     .buildVol = virStorageBackendVolBuildLocal,
     .buildVolFrom = virStorageBackendVolBuildFromLocal,
@@ -668,6 +669,7 @@ virStorageBackend virStorageBackendFileSystem = {
     .checkPool = virStorageBackendFileSystemCheck,
     .startPool = virStorageBackendFileSystemStart,
     .refreshPool = virStorageBackendRefreshLocal,
+    .incrementalRefresh = true,
     .stopPool = virStorageBackendFileSystemStop,
     .deletePool = virStorageBackendDeleteLocal,
     .buildVol = virStorageBackendVolBuildLocal,
@@ -688,6 +690,7 @@ virStorageBackend virStorageBackendNetFileSystem = {
     .startPool = virStorageBackendFileSystemStart,
     .findPoolSources = virStorageBackendFileSystemNetFindPoolSources,
     .refreshPool = virStorageBackendRefreshLocal,
+    .incrementalRefresh = true,
     .stopPool = virStorageBackendFileSystemStop,
     .deletePool = virStorageBackendDeleteLocal,
     .buildVol = virStorageBackendVolBuildLocal,
@@ -153,6 +153,7 @@ virStorageBackend virStorageBackendVstorage = {
     .stopPool = virStorageBackendVzPoolStop,
     .deletePool = virStorageBackendDeleteLocal,
     .refreshPool = virStorageBackendRefreshLocal,
+    .incrementalRefresh = true,
     .checkPool = virStorageBackendVzCheck,
     .buildVol = virStorageBackendVolBuildLocal,
     .buildVolFrom = virStorageBackendVolBuildFromLocal,
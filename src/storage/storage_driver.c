@@ -98,9 +98,12 @@ storagePoolRefreshFailCleanup(virStorageBackendPtr backend,
 static int
 storagePoolRefreshImpl(virStorageBackendPtr backend,
                        virStoragePoolObjPtr obj,
-                       const char *stateFile)
+                       const char *stateFile,
+                       unsigned int flags)
 {
-    virStoragePoolObjClearVols(obj);
+    if (!backend->incrementalRefresh ||
+        (flags & VIR_STORAGE_POOL_REFRESH_FULL))
+        virStoragePoolObjClearVols(obj);
     if (backend->refreshPool(obj) < 0) {
         storagePoolRefreshFailCleanup(backend, obj, stateFile);
         return -1;
@@ -167,7 +170,8 @@ storagePoolUpdateStateCallback(virStoragePoolObjPtr obj,
      * continue with other pools.
      */
     if (active &&
-        storagePoolRefreshImpl(backend, obj, stateFile) < 0) {
+        storagePoolRefreshImpl(backend, obj, stateFile,
+                               VIR_STORAGE_POOL_REFRESH_FULL) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Failed to restart storage pool '%s': %s"),
                        def->name, virGetLastErrorMessage());
@@ -221,7 +225,8 @@ storageDriverAutostartCallback(virStoragePoolObjPtr obj,
         stateFile = virFileBuildPath(driver->stateDir, def->name, ".xml");
         if (!stateFile ||
             virStoragePoolSaveState(stateFile, def) < 0 ||
-            storagePoolRefreshImpl(backend, obj, stateFile) < 0) {
+            storagePoolRefreshImpl(backend, obj, stateFile,
+                                   VIR_STORAGE_POOL_REFRESH_FULL) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("Failed to autostart storage pool '%s': %s"),
                            def->name, virGetLastErrorMessage());
@@ -777,7 +782,8 @@ storagePoolCreateXML(virConnectPtr conn,
 
     if (!stateFile ||
         virStoragePoolSaveState(stateFile, def) < 0 ||
-        storagePoolRefreshImpl(backend, obj, stateFile) < 0) {
+        storagePoolRefreshImpl(backend, obj, stateFile,
+                               VIR_STORAGE_POOL_REFRESH_FULL) < 0) {
         goto error;
     }
 
@@ -971,7 +977,8 @@ storagePoolCreate(virStoragePoolPtr pool,
 
     if (!stateFile ||
         virStoragePoolSaveState(stateFile, def) < 0 ||
-        storagePoolRefreshImpl(backend, obj, stateFile) < 0) {
+        storagePoolRefreshImpl(backend, obj, stateFile,
+                               VIR_STORAGE_POOL_REFRESH_FULL) < 0) {
         goto cleanup;
     }
 
@@ -1172,7 +1179,7 @@ storagePoolRefresh(virStoragePoolPtr pool,
     int ret = -1;
     virObjectEventPtr event = NULL;
 
-    virCheckFlags(0, -1);
+    virCheckFlags(VIR_STORAGE_POOL_REFRESH_FULL, -1);
 
     if (!(obj = storagePoolObjFindByUUID(pool->uuid, pool->name)))
         goto cleanup;
@@ -1198,7 +1205,7 @@ storagePoolRefresh(virStoragePoolPtr pool,
     }
 
     stateFile = virFileBuildPath(driver->stateDir, def->name, ".xml");
-    if (storagePoolRefreshImpl(backend, obj, stateFile) < 0) {
+    if (storagePoolRefreshImpl(backend, obj, stateFile, flags) < 0) {
         event = virStoragePoolEventLifecycleNew(def->name,
                                                 def->uuid,
                                                 VIR_STORAGE_POOL_EVENT_STOPPED,
@@ -1556,19 +1563,11 @@ storageVolLookupByKey(virConnectPtr conn,
 }
 
 
+/* Volumes of local storage are looked up by the sanitized path,
+ * those of network storage by the path as given */
 static bool
-storageVolLookupByPathCallback(virStoragePoolObjPtr obj,
-                               const void *opaque)
+storageVolLookupByPathIsLocal(virStoragePoolDefPtr def)
 {
-    struct storageVolLookupData *data = (struct storageVolLookupData *)opaque;
-    virStoragePoolDefPtr def;
-    VIR_AUTOFREE(char *) stable_path = NULL;
-
-    if (!virStoragePoolObjIsActive(obj))
-        return false;
-
-    def = virStoragePoolObjGetDef(obj);
-
     switch ((virStoragePoolType)def->type) {
         case VIR_STORAGE_POOL_DIR:
         case VIR_STORAGE_POOL_FS:
@@ -1580,19 +1579,43 @@ storageVolLookupByPathCallback(virStoragePoolObjPtr obj,
         case VIR_STORAGE_POOL_SCSI:
         case VIR_STORAGE_POOL_MPATH:
         case VIR_STORAGE_POOL_VSTORAGE:
-            stable_path = virStorageBackendStablePath(obj, data->cleanpath,
-                                                      false);
-            break;
+            return true;
 
         case VIR_STORAGE_POOL_GLUSTER:
         case VIR_STORAGE_POOL_RBD:
         case VIR_STORAGE_POOL_SHEEPDOG:
         case VIR_STORAGE_POOL_ZFS:
         case VIR_STORAGE_POOL_LAST:
-            ignore_value(VIR_STRDUP(stable_path, data->path));
             break;
     }
 
+    return false;
+}
+
+
+static bool
+storageVolLookupByPathCallback(virStoragePoolObjPtr obj,
+                               const void *opaque)
+{
+    struct storageVolLookupData *data = (struct storageVolLookupData *)opaque;
+    virStoragePoolDefPtr def;
+    VIR_AUTOFREE(char *) stable_path = NULL;
+
+    if (!virStoragePoolObjIsActive(obj))
+        return false;
+
+    def = virStoragePoolObjGetDef(obj);
+
+    /* Only pools of devices in a directory of stable links such as
+     * /dev/disk/by-path may know a volume under another path than the
+     * one looked up.  Any other volume was found in the index. */
+    if (!storageVolLookupByPathIsLocal(def) ||
+        def->type == VIR_STORAGE_POOL_LOGICAL ||
+        !virStorageBackendPoolPathIsStable(def->target.path))
+        return false;
+
+    stable_path = virStorageBackendStablePath(obj, data->cleanpath, false);
+
     /* Don't break the whole lookup process if it fails on
      * getting the stable path for some of the pools. */
     if (!stable_path) {
@@ -1600,12 +1623,33 @@ storageVolLookupByPathCallback(virStoragePoolObjPtr obj,
         return false;
     }
 
+    if (STREQ(stable_path, data->cleanpath))
+        return false;
+
     data->voldef = virStorageVolDefFindByPath(obj, stable_path);
 
     return !!data->voldef;
 }
 
 
+static virStoragePoolObjPtr
+storageVolLookupByPathIndexed(const char *path,
+                              bool local,
+                              virStorageVolDefPtr *voldef)
+{
+    virStoragePoolObjPtr obj;
+
+    obj = virStoragePoolObjListFindByVolPath(driver->pools, path, voldef);
+    if (obj &&
+        storageVolLookupByPathIsLocal(virStoragePoolObjGetDef(obj)) != local) {
+        virStoragePoolObjEndAPI(&obj);
+        *voldef = NULL;
+    }
+
+    return obj;
+}
+
+
 static virStorageVolPtr
 storageVolLookupByPath(virConnectPtr conn,
                        const char *path)
@@ -1619,9 +1663,16 @@ storageVolLookupByPath(virConnectPtr conn,
     if (!(data.cleanpath = virFileSanitizePath(path)))
         return NULL;
 
-    if ((obj = virStoragePoolObjListSearch(driver->pools,
-                                           storageVolLookupByPathCallback,
-                                           &data)) && data.voldef) {
+    /* Most volumes are found right away in the index of volume paths,
+     * only stable device links require looking into the pools */
+    if (!(obj = storageVolLookupByPathIndexed(data.cleanpath, true,
+                                              &data.voldef)) &&
+        !(obj = storageVolLookupByPathIndexed(path, false, &data.voldef)))
+        obj = virStoragePoolObjListSearch(driver->pools,
+                                          storageVolLookupByPathCallback,
+                                          &data);
+
+    if (obj && data.voldef) {
         def = virStoragePoolObjGetDef(obj);
 
         if (virStorageVolLookupByPathEnsureACL(conn, def, data.voldef) == 0) {
@@ -1629,8 +1680,8 @@ storageVolLookupByPath(virConnectPtr conn,
                                    data.voldef->name, data.voldef->key,
                                    NULL, NULL);
         }
-        virStoragePoolObjEndAPI(&obj);
     }
+    virStoragePoolObjEndAPI(&obj);
 
     if (!vol) {
         if (STREQ(path, data.cleanpath)) {
@@ -2288,7 +2339,7 @@ virStorageVolPoolRefreshThread(void *opaque)
     if (!(backend = virStorageBackendForType(def->type)))
         goto cleanup;
 
-    if (storagePoolRefreshImpl(backend, obj, NULL) < 0)
+    if (storagePoolRefreshImpl(backend, obj, NULL, 0) < 0)
         VIR_DEBUG("Failed to refresh storage pool");
 
     event = virStoragePoolEventRefreshNew(def->name, def->uuid);
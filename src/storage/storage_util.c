@@ -77,6 +77,7 @@
 #include "virstring.h"
 #include "virxml.h"
 #include "virfdstream.h"
+#include "virthreadpool.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -3513,9 +3514,215 @@ virStorageBackendRefreshVolTargetUpdate(virStorageVolDefPtr vol)
 }
 
 
+/*
+ * Check whether @vol, found by a previous refresh, still describes the
+ * file on disk. Only plain files are considered: their modification and
+ * change times are bumped by any write, truncation, ownership or mode
+ * change, so matching timestamps and size mean the probed header data
+ * is still accurate. Directories, ploop images and device nodes are
+ * always re-probed.
+ */
+static bool
+virStorageBackendRefreshLocalVolUnchanged(virStorageVolDefPtr vol)
+{
+    struct stat sb;
+    struct timespec mtim;
+    struct timespec ctim;
+
+    if (vol->type != VIR_STORAGE_VOL_FILE ||
+        !vol->target.timestamps)
+        return false;
+
+    if (stat(vol->target.path, &sb) < 0 ||
+        !S_ISREG(sb.st_mode))
+        return false;
+
+    mtim = get_stat_mtime(&sb);
+    ctim = get_stat_ctime(&sb);
+
+    return mtim.tv_sec == vol->target.timestamps->mtime.tv_sec &&
+        mtim.tv_nsec == vol->target.timestamps->mtime.tv_nsec &&
+        ctim.tv_sec == vol->target.timestamps->ctime.tv_sec &&
+        ctim.tv_nsec == vol->target.timestamps->ctime.tv_nsec &&
+        (unsigned long long) sb.st_size == vol->target.physical;
+}
+
+
+struct virStorageBackendRefreshLocalStaleData {
+    virHashTablePtr seen;
+    char **names;
+    size_t nnames;
+};
+
+
+static int
+virStorageBackendRefreshLocalFindStale(virStorageVolDefPtr voldef,
+                                       const void *opaque)
+{
+    struct virStorageBackendRefreshLocalStaleData *data = (void *) opaque;
+    char *name;
+
+    if (virHashLookup(data->seen, voldef->name))
+        return 0;
+
+    if (VIR_STRDUP(name, voldef->name) < 0 ||
+        VIR_APPEND_ELEMENT(data->names, data->nnames, name) < 0) {
+        VIR_FREE(name);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Drop volumes cached by a previous refresh whose files are no longer
+ * present in the pool directory.
+ */
+static int
+virStorageBackendRefreshLocalPrune(virStoragePoolObjPtr pool,
+                                   virHashTablePtr seen)
+{
+    struct virStorageBackendRefreshLocalStaleData data = { .seen = seen };
+    virStorageVolDefPtr voldef;
+    size_t i;
+    int ret = -1;
+
+    if (virStoragePoolObjForEachVolume(pool,
+                                       virStorageBackendRefreshLocalFindStale,
+                                       &data) < 0)
+        goto cleanup;
+
+    for (i = 0; i < data.nnames; i++) {
+        if ((voldef = virStorageVolDefFindByName(pool, data.names[i])))
+            virStoragePoolObjRemoveVol(pool, voldef);
+    }
+
+    ret = 0;
+ cleanup:
+    virStringListFreeCount(data.names, data.nnames);
+    return ret;
+}
+
+
+/* Probing a volume is dominated by I/O latency on network backed
+ * directories, so it's fanned out to a few threads once there are
+ * enough volumes to make that worthwhile. */
+#define VIR_STORAGE_BACKEND_PROBE_WORKERS 16
+#define VIR_STORAGE_BACKEND_PROBE_PARALLEL_MIN 32
+
+typedef struct _virStorageBackendProbeJob virStorageBackendProbeJob;
+typedef virStorageBackendProbeJob *virStorageBackendProbeJobPtr;
+struct _virStorageBackendProbeJob {
+    virStorageVolDefPtr vol;
+    int rc;
+    virErrorPtr err;
+};
+
+typedef struct _virStorageBackendProbeState virStorageBackendProbeState;
+typedef virStorageBackendProbeState *virStorageBackendProbeStatePtr;
+struct _virStorageBackendProbeState {
+    virMutex lock;
+    virCond cond;
+    size_t pending;
+};
+
+
+static void
+virStorageBackendProbeWorker(void *jobdata,
+                             void *opaque)
+{
+    virStorageBackendProbeJobPtr job = jobdata;
+    virStorageBackendProbeStatePtr state = opaque;
+
+    /* Errors are thread local, keep them for the thread merging results */
+    if ((job->rc = virStorageBackendRefreshVolTargetUpdate(job->vol)) == -1)
+        job->err = virSaveLastError();
+    virResetLastError();
+
+    virMutexLock(&state->lock);
+    if (--state->pending == 0)
+        virCondSignal(&state->cond);
+    virMutexUnlock(&state->lock);
+}
+
+
+/*
+ * Probe all volumes in @jobs, using a bounded pool of worker threads for
+ * large batches. The outcome of each probe is stored in the job itself;
+ * the caller merges the results into the pool afterwards. Returns 0 once
+ * all jobs finished, -1 if the jobs could not be dispatched.
+ */
+static int
+virStorageBackendProbeVols(virStorageBackendProbeJobPtr jobs,
+                           size_t njobs)
+{
+    virStorageBackendProbeState state = { .pending = 0 };
+    virThreadPoolPtr workers = NULL;
+    size_t nworkers = MIN(njobs, VIR_STORAGE_BACKEND_PROBE_WORKERS);
+    size_t i;
+    int ret = -1;
+
+    if (virMutexInit(&state.lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to initialize mutex"));
+        return -1;
+    }
+
+    if (virCondInit(&state.cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to initialize condition variable"));
+        virMutexDestroy(&state.lock);
+        return -1;
+    }
+
+    if (njobs < VIR_STORAGE_BACKEND_PROBE_PARALLEL_MIN) {
+        state.pending = njobs;
+        for (i = 0; i < njobs; i++)
+            virStorageBackendProbeWorker(&jobs[i], &state);
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (!(workers = virThreadPoolNew(nworkers, nworkers, 0,
+                                     virStorageBackendProbeWorker,
+                                     &state)))
+        goto cleanup;
+
+    VIR_DEBUG("probing %zu volumes using %zu workers", njobs, nworkers);
+
+    virMutexLock(&state.lock);
+    for (i = 0; i < njobs; i++) {
+        state.pending++;
+        if (virThreadPoolSendJob(workers, 0, &jobs[i]) < 0) {
+            state.pending--;
+            break;
+        }
+    }
+
+    while (state.pending > 0)
+        ignore_value(virCondWait(&state.cond, &state.lock));
+    virMutexUnlock(&state.lock);
+
+    if (i == njobs)
+        ret = 0;
+
+ cleanup:
+    virThreadPoolFree(workers);
+    virCondDestroy(&state.cond);
+    virMutexDestroy(&state.lock);
+    return ret;
+}
+
+
 /**
  * Iterate over the pool's directory and enumerate all disk images
  * within it. This is non-recursive.
+ *
+ * Volumes already present in the pool's volume list are kept as they
+ * are as long as their files did not change, so that a refresh of a
+ * large pool only needs to probe added or modified images. Callers
+ * wanting a full rescan clear the volume list beforehand.
  */
 int
 virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
@@ -3530,12 +3737,22 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
     VIR_AUTOPTR(virStorageVolDef) vol = NULL;
     VIR_AUTOCLOSE fd = -1;
     VIR_AUTOUNREF(virStorageSourcePtr) target = NULL;
+    virStorageVolDefPtr oldvol;
+    virHashTablePtr seen = NULL;
+    virStorageBackendProbeJobPtr jobs = NULL;
+    size_t njobs = 0;
+    size_t reused = 0;
+    size_t i;
+
+    if (virStoragePoolObjGetVolumesCount(pool) > 0 &&
+        !(seen = virHashCreate(128, NULL)))
+        goto cleanup;
 
     if (virDirOpen(&dir, def->target.path) < 0)
         goto cleanup;
 
     while ((direrr = virDirRead(dir, &ent, def->target.path)) > 0) {
-        int err;
+        virStorageBackendProbeJob job = { .rc = 0 };
 
         if (virStringHasControlChars(ent->d_name)) {
             VIR_WARN("Ignoring file '%s' with control characters under '%s'",
@@ -3543,6 +3760,19 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
             continue;
         }
 
+        if (seen) {
+            if (virHashAddEntry(seen, ent->d_name, (void *) 1) < 0)
+                goto cleanup;
+
+            if ((oldvol = virStorageVolDefFindByName(pool, ent->d_name))) {
+                if (virStorageBackendRefreshLocalVolUnchanged(oldvol)) {
+                    reused++;
+                    continue;
+                }
+                virStoragePoolObjRemoveVol(pool, oldvol);
+            }
+        }
+
         if (VIR_ALLOC(vol) < 0)
             goto cleanup;
 
@@ -3557,25 +3787,44 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
         if (VIR_STRDUP(vol->key, vol->target.path) < 0)
             goto cleanup;
 
-        if ((err = virStorageBackendRefreshVolTargetUpdate(vol)) < 0) {
-            if (err == -2) {
-                /* Silently ignore non-regular files,
-                 * eg 'lost+found', dangling symbolic link */
-                virStorageVolDefFree(vol);
-                vol = NULL;
-                continue;
-            }
+        VIR_STEAL_PTR(job.vol, vol);
+        if (VIR_APPEND_ELEMENT(jobs, njobs, job) < 0) {
+            virStorageVolDefFree(job.vol);
             goto cleanup;
         }
-
-        if (virStoragePoolObjAddVol(pool, vol) < 0)
-            goto cleanup;
-        vol = NULL;
     }
     if (direrr < 0)
         goto cleanup;
     VIR_DIR_CLOSE(dir);
 
+    if (virStorageBackendProbeVols(jobs, njobs) < 0)
+        goto cleanup;
+
+    /* Merge the results in directory order while holding the pool lock */
+    for (i = 0; i < njobs; i++) {
+        if (jobs[i].rc == -2) {
+            /* Silently ignore non-regular files,
+             * eg 'lost+found', dangling symbolic link */
+            continue;
+        }
+
+        if (jobs[i].rc < 0) {
+            virSetError(jobs[i].err);
+            goto cleanup;
+        }
+
+        if (virStoragePoolObjAddVol(pool, jobs[i].vol) < 0)
+            goto cleanup;
+        jobs[i].vol = NULL;
+    }
+
+    if (seen &&
+        virStorageBackendRefreshLocalPrune(pool, seen) < 0)
+        goto cleanup;
+
+    VIR_DEBUG("pool '%s': probed %zu volumes, reused %zu unchanged",
+              def->name, njobs, reused);
+
     if (!(target = virStorageSourceNew()))
         goto cleanup;
 
@@ -3620,6 +3869,12 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
     ret = 0;
  cleanup:
     VIR_DIR_CLOSE(dir);
+    virHashFree(seen);
+    for (i = 0; i < njobs; i++) {
+        virStorageVolDefFree(jobs[i].vol);
+        virFreeError(jobs[i].err);
+    }
+    VIR_FREE(jobs);
     return ret;
 }
 
@@ -4962,19 +4962,6 @@ testStorageVolLookupByKey(virConnectPtr conn,
 }
 
 
-static bool
-testStorageVolLookupByPathCallback(virStoragePoolObjPtr obj,
-                                   const void *opaque)
-{
-    struct storageVolLookupData *data = (struct storageVolLookupData *)opaque;
-
-    if (virStoragePoolObjIsActive(obj))
-        data->voldef = virStorageVolDefFindByPath(obj, data->path);
-
-    return !!data->voldef;
-}
-
-
 static virStorageVolPtr
 testStorageVolLookupByPath(virConnectPtr conn,
                            const char *path)
@@ -4982,17 +4969,15 @@ testStorageVolLookupByPath(virConnectPtr conn,
     testDriverPtr privconn = conn->privateData;
     virStoragePoolObjPtr obj;
     virStoragePoolDefPtr def;
-    struct storageVolLookupData data = {
-        .path = path, .voldef = NULL };
+    virStorageVolDefPtr voldef;
     virStorageVolPtr vol = NULL;
 
     virObjectLock(privconn);
-    if ((obj = virStoragePoolObjListSearch(privconn->pools,
-                                           testStorageVolLookupByPathCallback,
-                                           &data)) && data.voldef) {
+    if ((obj = virStoragePoolObjListFindByVolPath(privconn->pools, path,
+                                                  &voldef))) {
         def = virStoragePoolObjGetDef(obj);
         vol = virGetStorageVol(conn, def->name,
-                               data.voldef->name, data.voldef->key,
+                               voldef->name, voldef->key,
                                NULL, NULL);
         virStoragePoolObjEndAPI(&obj);
     }
@@ -5810,6 +5795,99 @@ static int testConnectListAllDomains(virConnectPtr conn,
                                   NULL, flags);
 }
 
+static int
+testConnectGetAllDomainStats(virConnectPtr conn,
+                             virDomainPtr *doms,
+                             unsigned int ndoms,
+                             unsigned int stats,
+                             virDomainStatsRecordPtr **retStats,
+                             unsigned int flags)
+{
+    testDriverPtr privconn = conn->privateData;
+    virDomainObjPtr *vms = NULL;
+    size_t nvms = 0;
+    virDomainStatsRecordPtr *tmpstats = NULL;
+    virDomainStatsRecordPtr tmp = NULL;
+    int nstats = 0;
+    size_t i;
+    int ret = -1;
+    unsigned int lflags = flags & (VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
+                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
+                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE);
+
+    virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
+                  VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
+                  VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS, -1);
+
+    /* Only the state group is supported */
+    if (stats & ~VIR_DOMAIN_STATS_STATE) {
+        if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS) {
+            virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
+                           _("Stats types bits 0x%x are not supported by this daemon"),
+                           stats & ~VIR_DOMAIN_STATS_STATE);
+            return -1;
+        }
+        stats &= VIR_DOMAIN_STATS_STATE;
+    }
+
+    if (!stats)
+        stats = VIR_DOMAIN_STATS_STATE;
+
+    if (ndoms) {
+        if (virDomainObjListConvert(privconn->domains, conn, doms, ndoms,
+                                    &vms, &nvms, NULL, lflags, true) < 0)
+            return -1;
+    } else {
+        if (virDomainObjListCollect(privconn->domains, conn, &vms, &nvms,
+                                    NULL, lflags) < 0)
+            return -1;
+    }
+
+    if (VIR_ALLOC_N(tmpstats, nvms + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nvms; i++) {
+        virDomainObjPtr vm = vms[i];
+        int maxparams = 0;
+
+        if (VIR_ALLOC(tmp) < 0)
+            goto cleanup;
+
+        virObjectLock(vm);
+
+        if (virTypedParamsAddInt(&tmp->params, &tmp->nparams, &maxparams,
+                                 "state.state", vm->state.state) < 0 ||
+            virTypedParamsAddInt(&tmp->params, &tmp->nparams, &maxparams,
+                                 "state.reason", vm->state.reason) < 0 ||
+            !(tmp->dom = virGetDomain(conn, vm->def->name,
+                                      vm->def->uuid, vm->def->id))) {
+            virObjectUnlock(vm);
+            goto cleanup;
+        }
+
+        virObjectUnlock(vm);
+
+        tmpstats[nstats++] = tmp;
+        tmp = NULL;
+    }
+
+    *retStats = tmpstats;
+    tmpstats = NULL;
+    ret = nstats;
+
+ cleanup:
+    if (tmp) {
+        virTypedParamsFree(tmp->params, tmp->nparams);
+        VIR_FREE(tmp);
+    }
+    virDomainStatsRecordListFree(tmpstats);
+    virObjectListFreeCount(vms, nvms);
+    return ret;
+}
+
 static int
 testNodeGetCPUMap(virConnectPtr conn ATTRIBUTE_UNUSED,
                   unsigned char **cpumap,
@@ -6769,6 +6847,7 @@ static virHypervisorDriver testHypervisorDriver = {
     .connectListDomains = testConnectListDomains, /* 0.1.1 */
     .connectNumOfDomains = testConnectNumOfDomains, /* 0.1.1 */
     .connectListAllDomains = testConnectListAllDomains, /* 0.9.13 */
+    .connectGetAllDomainStats = testConnectGetAllDomainStats, /* 5.3.0 */
     .domainCreateXML = testDomainCreateXML, /* 0.1.4 */
     .domainLookupByID = testDomainLookupByID, /* 0.1.1 */
     .domainLookupByUUID = testDomainLookupByUUID, /* 0.1.1 */
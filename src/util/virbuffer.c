@@ -121,7 +121,7 @@ virBufferGetIndent(const virBuffer *buf, bool dynamic)
 static int
 virBufferGrow(virBufferPtr buf, unsigned int len)
 {
-    int size;
+    size_t size;
 
     if (buf->error)
         return -1;
@@ -129,7 +129,12 @@ virBufferGrow(virBufferPtr buf, unsigned int len)
     if ((len + buf->use) < buf->size)
         return 0;
 
+    /* Grow at least geometrically, so that building a large document
+     * from many small pieces does not reallocate and copy everything
+     * written so far every thousand bytes. */
     size = buf->use + len + 1000;
+    if (size < buf->size * 2)
+        size = buf->size * 2;
 
     if (VIR_REALLOC_N_QUIET(buf->content, size) < 0) {
         virBufferSetError(buf, errno);
@@ -175,6 +180,25 @@ virBufferAdd(virBufferPtr buf, const char *str, int len)
     buf->content[buf->use] = '\0';
 }
 
+/**
+ * virBufferAddRaw:
+ * @buf: the buffer to append to
+ * @str: the string
+ * @len: the number of bytes to add
+ *
+ * Add a string range to a buffer without applying auto indentation.
+ */
+static void
+virBufferAddRaw(virBufferPtr buf, const char *str, size_t len)
+{
+    if (len == 0 || virBufferGrow(buf, len + 1) < 0)
+        return;
+
+    memcpy(&buf->content[buf->use], str, len);
+    buf->use += len;
+    buf->content[buf->use] = '\0';
+}
+
 /**
  * virBufferAddBuffer:
  * @buf: the buffer to append to
@@ -425,6 +449,96 @@ virBufferVasprintf(virBufferPtr buf, const char *format, va_list argptr)
 VIR_WARNINGS_NO_WLOGICALOP_STRCHR
 
 
+static const char virBufferXMLForbiddenChars[] = {
+    0x01,   0x02,   0x03,   0x04,   0x05,   0x06,   0x07,   0x08,
+    /*\t*/  /*\n*/  0x0B,   0x0C,   /*\r*/  0x0E,   0x0F,   0x10,
+    0x11,   0x12,   0x13,   0x14,   0x15,   0x16,   0x17,   0x18,
+    0x19,   '"',    '&',    '\'',   '<',    '>',
+    '\0'
+};
+
+/**
+ * virBufferXMLEntity:
+ * @c: a character from virBufferXMLForbiddenChars
+ *
+ * Returns the XML replacement for @c, or an empty string for control
+ * characters which are silently dropped.
+ */
+static const char *
+virBufferXMLEntity(char c)
+{
+    switch (c) {
+    case '<':
+        return "&lt;";
+    case '>':
+        return "&gt;";
+    case '&':
+        return "&amp;";
+    case '"':
+        return "&quot;";
+    case '\'':
+        return "&apos;";
+    }
+
+    return "";
+}
+
+/**
+ * virBufferAddEscapedXML:
+ * @buf: the buffer to append to
+ * @str: the string to escape
+ *
+ * Append @str escaped for use in XML, writing straight into the buffer.
+ * Auto indentation is NOT applied.
+ *
+ * Note that character over 0x80 are likely to give problem with UTF-8
+ * XML, but since our string don't have an encoding it's hard to handle
+ * properly we have to assume it's UTF-8 too.
+ */
+static void
+virBufferAddEscapedXML(virBufferPtr buf, const char *str)
+{
+    const char *cur;
+    const char *entity;
+    size_t len = 0;
+    size_t n;
+    char *out;
+
+    /* size the escaped string first so that it is only written once */
+    for (cur = str; *cur; cur++) {
+        n = strcspn(cur, virBufferXMLForbiddenChars);
+        len += n;
+        cur += n;
+        if (!*cur)
+            break;
+        len += strlen(virBufferXMLEntity(*cur));
+    }
+
+    if (len > UINT_MAX - 1) {
+        virBufferSetError(buf, ENOMEM);
+        return;
+    }
+
+    if (len == 0 || virBufferGrow(buf, len + 1) < 0)
+        return;
+
+    out = &buf->content[buf->use];
+    for (cur = str; *cur; cur++) {
+        n = strcspn(cur, virBufferXMLForbiddenChars);
+        memcpy(out, cur, n);
+        out += n;
+        cur += n;
+        if (!*cur)
+            break;
+        entity = virBufferXMLEntity(*cur);
+        n = strlen(entity);
+        memcpy(out, entity, n);
+        out += n;
+    }
+    *out = '\0';
+    buf->use = out - buf->content;
+}
+
 /**
  * virBufferEscapeString:
  * @buf: the buffer to append to
@@ -439,17 +553,8 @@ VIR_WARNINGS_NO_WLOGICALOP_STRCHR
 void
 virBufferEscapeString(virBufferPtr buf, const char *format, const char *str)
 {
-    int len;
-    VIR_AUTOFREE(char *) escaped = NULL;
-    char *out;
-    const char *cur;
-    const char forbidden_characters[] = {
-        0x01,   0x02,   0x03,   0x04,   0x05,   0x06,   0x07,   0x08,
-        /*\t*/  /*\n*/  0x0B,   0x0C,   /*\r*/  0x0E,   0x0F,   0x10,
-        0x11,   0x12,   0x13,   0x14,   0x15,   0x16,   0x17,   0x18,
-        0x19,   '"',    '&',    '\'',   '<',    '>',
-        '\0'
-    };
+    virBuffer escaped = VIR_BUFFER_INITIALIZER;
+    const char *directive;
 
     if ((format == NULL) || (buf == NULL) || (str == NULL))
         return;
@@ -457,67 +562,33 @@ virBufferEscapeString(virBufferPtr buf, const char *format, const char *str)
     if (buf->error)
         return;
 
-    len = strlen(str);
-    if (strcspn(str, forbidden_characters) == len) {
-        virBufferAsprintf(buf, format, str);
+    /* Nearly every caller passes a plain "prefix%ssuffix" format, which
+     * can be copied around the escaped string without going through
+     * printf at all. */
+    if ((directive = strchr(format, '%')) &&
+        directive[1] == 's' &&
+        !strchr(directive + 2, '%')) {
+        virBufferAdd(buf, format, directive - format);
+        virBufferAddEscapedXML(buf, str);
+        virBufferAddRaw(buf, directive + 2, strlen(directive + 2));
         return;
     }
 
-    if (xalloc_oversized(6, len) ||
-        VIR_ALLOC_N_QUIET(escaped, 6 * len + 1) < 0) {
-        virBufferSetError(buf, errno);
+    if (strcspn(str, virBufferXMLForbiddenChars) == strlen(str)) {
+        virBufferAsprintf(buf, format, str);
         return;
     }
 
-    cur = str;
-    out = escaped;
-    while (*cur != 0) {
-        if (*cur == '<') {
-            *out++ = '&';
-            *out++ = 'l';
-            *out++ = 't';
-            *out++ = ';';
-        } else if (*cur == '>') {
-            *out++ = '&';
-            *out++ = 'g';
-            *out++ = 't';
-            *out++ = ';';
-        } else if (*cur == '&') {
-            *out++ = '&';
-            *out++ = 'a';
-            *out++ = 'm';
-            *out++ = 'p';
-            *out++ = ';';
-        } else if (*cur == '"') {
-            *out++ = '&';
-            *out++ = 'q';
-            *out++ = 'u';
-            *out++ = 'o';
-            *out++ = 't';
-            *out++ = ';';
-        } else if (*cur == '\'') {
-            *out++ = '&';
-            *out++ = 'a';
-            *out++ = 'p';
-            *out++ = 'o';
-            *out++ = 's';
-            *out++ = ';';
-        } else if (!strchr(forbidden_characters, *cur)) {
-            /*
-             * default case, just copy !
-             * Note that character over 0x80 are likely to give problem
-             * with UTF-8 XML, but since our string don't have an encoding
-             * it's hard to handle properly we have to assume it's UTF-8 too
-             */
-            *out++ = *cur;
-        } else {
-            /* silently ignore control characters */
-        }
-        cur++;
+    virBufferAddEscapedXML(&escaped, str);
+    if (virBufferError(&escaped)) {
+        virBufferSetError(buf, virBufferError(&escaped));
+        goto cleanup;
     }
-    *out = 0;
 
-    virBufferAsprintf(buf, format, escaped);
+    virBufferAsprintf(buf, format, virBufferCurrentContent(&escaped));
+
+ cleanup:
+    virBufferFreeAndReset(&escaped);
 }
 
 /**
@@ -64,6 +64,7 @@ struct _virFDStreamMsg {
     union {
         struct {
             char *buf;
+            size_t size; /* allocated size of @buf */
             size_t len;
             size_t offset;
         } data;
@@ -111,6 +112,15 @@ struct virFDStreamData {
     bool threadAbort;
     bool threadDoRead;
     virFDStreamMsgPtr msg;
+    size_t nmsgs;
+
+    /* consumed data messages kept for reuse */
+    virFDStreamMsgPtr spare;
+    size_t nspare;
+    size_t bufsize; /* size of data message buffers */
+
+    /* transfer statistics, see virFDStreamGetStats */
+    virFDStreamStats stats;
 };
 
 static virClassPtr virFDStreamDataClass;
@@ -125,6 +135,7 @@ virFDStreamDataDispose(void *obj)
     VIR_DEBUG("obj=%p", fdst);
     virFreeError(fdst->threadErr);
     virFDStreamMsgQueueFree(&fdst->msg);
+    virFDStreamMsgQueueFree(&fdst->spare);
 }
 
 static int virFDStreamDataOnceInit(void)
@@ -151,6 +162,7 @@ virFDStreamMsgQueuePush(virFDStreamDataPtr fdst,
         tmp = &(*tmp)->next;
 
     *tmp = msg;
+    fdst->nmsgs++;
     virCondSignal(&fdst->threadCond);
 
     if (safewrite(fd, &c, sizeof(c)) != sizeof(c)) {
@@ -175,6 +187,7 @@ virFDStreamMsgQueuePop(virFDStreamDataPtr fdst,
     if (tmp) {
         fdst->msg = tmp->next;
         tmp->next = NULL;
+        fdst->nmsgs--;
     }
 
     virCondSignal(&fdst->threadCond);
@@ -224,6 +237,79 @@ virFDStreamMsgQueueFree(virFDStreamMsgPtr *queue)
 }
 
 
+/**
+ * virFDStreamMsgNewData:
+ * @fdst: stream data (locked)
+ * @size: number of bytes the message must be able to hold
+ *
+ * Returns a data message with a buffer of at least @size bytes,
+ * recycling a previously consumed one if possible, or NULL on error.
+ * New buffers are as big as the largest one requested on the stream
+ * so far, so that a short read or write doesn't produce a buffer
+ * that can't be reused for the following full sized chunks.
+ */
+static virFDStreamMsgPtr
+virFDStreamMsgNewData(virFDStreamDataPtr fdst,
+                      size_t size)
+{
+    virFDStreamMsgPtr msg = NULL;
+
+    if (size > fdst->bufsize) {
+        /* Spare buffers are too small from now on */
+        virFDStreamMsgQueueFree(&fdst->spare);
+        fdst->nspare = 0;
+        fdst->bufsize = size;
+    }
+
+    if ((msg = fdst->spare)) {
+        fdst->spare = msg->next;
+        msg->next = NULL;
+        fdst->nspare--;
+        return msg;
+    }
+
+    if (VIR_ALLOC(msg) < 0 ||
+        VIR_ALLOC_N(msg->stream.data.buf, fdst->bufsize) < 0) {
+        VIR_FREE(msg);
+        return NULL;
+    }
+
+    msg->type = VIR_FDSTREAM_MSG_TYPE_DATA;
+    msg->stream.data.size = fdst->bufsize;
+    fdst->stats.nbufs++;
+    return msg;
+}
+
+
+/**
+ * virFDStreamMsgRelease:
+ * @fdst: stream data (locked)
+ * @msg: consumed message
+ *
+ * Frees @msg or keeps it for reuse by virFDStreamMsgNewData.
+ */
+static void
+virFDStreamMsgRelease(virFDStreamDataPtr fdst,
+                      virFDStreamMsgPtr msg)
+{
+    if (!msg)
+        return;
+
+    if (msg->type != VIR_FDSTREAM_MSG_TYPE_DATA ||
+        msg->stream.data.size < fdst->bufsize ||
+        fdst->nspare >= VIR_FDSTREAM_QUEUE_MAX) {
+        virFDStreamMsgFree(msg);
+        return;
+    }
+
+    msg->stream.data.len = 0;
+    msg->stream.data.offset = 0;
+    msg->next = fdst->spare;
+    fdst->spare = msg;
+    fdst->nspare++;
+}
+
+
 static int virFDStreamRemoveCallback(virStreamPtr stream)
 {
     virFDStreamDataPtr fdst = stream->privateData;
@@ -431,7 +517,6 @@ virFDStreamThreadDoRead(virFDStreamDataPtr fdst,
     virFDStreamMsgPtr msg = NULL;
     int inData = 0;
     long long sectionLen = 0;
-    char *buf = NULL;
     ssize_t got;
 
     if (sparse && *dataLen == 0) {
@@ -450,10 +535,10 @@ virFDStreamThreadDoRead(virFDStreamDataPtr fdst,
         buflen > length - total)
         buflen = length - total;
 
-    if (VIR_ALLOC(msg) < 0)
-        goto error;
-
     if (sparse && *dataLen == 0) {
+        if (VIR_ALLOC(msg) < 0)
+            goto error;
+
         msg->type = VIR_FDSTREAM_MSG_TYPE_HOLE;
         msg->stream.hole.len = sectionLen;
         got = sectionLen;
@@ -472,20 +557,23 @@ virFDStreamThreadDoRead(virFDStreamDataPtr fdst,
             buflen > *dataLen)
             buflen = *dataLen;
 
-        if (VIR_ALLOC_N(buf, buflen) < 0)
+        if (!(msg = virFDStreamMsgNewData(fdst, buflen)))
             goto error;
 
-        if ((got = saferead(fdin, buf, buflen)) < 0) {
+        /* Nobody else can see @msg yet, so let the reader consume
+         * queued chunks while we wait for the disk. */
+        virObjectUnlock(fdst);
+        got = saferead(fdin, msg->stream.data.buf, buflen);
+        virObjectLock(fdst);
+
+        if (got < 0) {
             virReportSystemError(errno,
                                  _("Unable to read %s"),
                                  fdinname);
             goto error;
         }
 
-        msg->type = VIR_FDSTREAM_MSG_TYPE_DATA;
-        msg->stream.data.buf = buf;
         msg->stream.data.len = got;
-        buf = NULL;
         if (sparse)
             *dataLen -= got;
     }
@@ -496,7 +584,6 @@ virFDStreamThreadDoRead(virFDStreamDataPtr fdst,
     return got;
 
  error:
-    VIR_FREE(buf);
     virFDStreamMsgFree(msg);
     return -1;
 }
@@ -517,9 +604,13 @@ virFDStreamThreadDoWrite(virFDStreamDataPtr fdst,
 
     switch (msg->type) {
     case VIR_FDSTREAM_MSG_TYPE_DATA:
+        /* The writer only ever appends to the queue, so the head
+         * message stays ours while the lock is dropped. */
+        virObjectUnlock(fdst);
         got = safewrite(fdout,
                         msg->stream.data.buf + msg->stream.data.offset,
                         msg->stream.data.len - msg->stream.data.offset);
+        virObjectLock(fdst);
         if (got < 0) {
             virReportSystemError(errno,
                                  _("Unable to write %s"),
@@ -561,7 +652,7 @@ virFDStreamThreadDoWrite(virFDStreamDataPtr fdst,
 
     if (pop) {
         virFDStreamMsgQueuePop(fdst, fdin, fdinname);
-        virFDStreamMsgFree(msg);
+        virFDStreamMsgRelease(fdst, msg);
     }
 
     return got;
@@ -581,9 +672,13 @@ virFDStreamThread(void *opaque)
     char *fdoutname = data->fdoutname;
     virFDStreamDataPtr fdst = st->privateData;
     bool doRead = fdst->threadDoRead;
-    size_t buflen = 256 * 1024;
+    size_t buflen = VIR_FDSTREAM_CHUNK_SIZE;
     size_t total = 0;
     size_t dataLen = 0;
+    unsigned long long start = 0;
+    unsigned long long now = 0;
+
+    ignore_value(virTimeMillisNow(&start));
 
     virObjectRef(fdst);
     virObjectLock(fdst);
@@ -591,7 +686,11 @@ virFDStreamThread(void *opaque)
     while (1) {
         ssize_t got;
 
-        while (doRead == (fdst->msg != NULL) &&
+        /* Reading, keep up to VIR_FDSTREAM_QUEUE_MAX chunks queued.
+         * Writing, wait for something to write. */
+        while ((doRead ?
+                fdst->nmsgs >= VIR_FDSTREAM_QUEUE_MAX :
+                fdst->msg == NULL) &&
                !fdst->threadQuit) {
             if (virCondWait(&fdst->threadCond, &fdst->parent.lock)) {
                 virReportSystemError(errno, "%s",
@@ -628,11 +727,20 @@ virFDStreamThread(void *opaque)
             break;
 
         total += got;
+        fdst->stats.bytes = total;
+        if (virTimeMillisNow(&now) == 0)
+            fdst->stats.duration = now - start;
     }
 
  cleanup:
     fdst->threadQuit = true;
+    if (virTimeMillisNow(&now) == 0)
+        fdst->stats.duration = now - start;
+    now = fdst->stats.duration;
     virObjectUnlock(fdst);
+    VIR_DEBUG("%s %zu bytes of %s in %llu ms",
+              doRead ? "read" : "wrote", total,
+              doRead ? fdinname : fdoutname, now);
     if (!virObjectUnref(fdst))
         st->privateData = NULL;
     VIR_FORCE_CLOSE(fdin);
@@ -718,8 +826,17 @@ virFDStreamCloseInt(virStreamPtr st, bool streamAbort)
         fdst->abortCallbackDispatching = false;
     }
 
-    if (virFDStreamJoinWorker(fdst, streamAbort) < 0)
-        ret = -1;
+    if (fdst->thread) {
+        if (virFDStreamJoinWorker(fdst, streamAbort) < 0)
+            ret = -1;
+
+        VIR_INFO("stream=%p transferred %llu bytes in %llu ms (%llu KiB/s) "
+                 "using %zu buffers",
+                 st, fdst->stats.bytes, fdst->stats.duration,
+                 fdst->stats.duration ?
+                 fdst->stats.bytes * 1000 / fdst->stats.duration / 1024 : 0,
+                 fdst->stats.nbufs);
+    }
 
     /* mutex locked */
     if ((ret = VIR_CLOSE(fdst->fd)) < 0)
@@ -792,8 +909,6 @@ static int virFDStreamWrite(virStreamPtr st, const char *bytes, size_t nbytes)
     }
 
     if (fdst->thread) {
-        char *buf;
-
         if (fdst->threadQuit || fdst->threadErr) {
 
             /* virStreamSend will virResetLastError possibly set
@@ -805,13 +920,10 @@ static int virFDStreamWrite(virStreamPtr st, const char *bytes, size_t nbytes)
             goto cleanup;
         }
 
-        if (VIR_ALLOC(msg) < 0 ||
-            VIR_ALLOC_N(buf, nbytes) < 0)
+        if (!(msg = virFDStreamMsgNewData(fdst, nbytes)))
             goto cleanup;
 
-        memcpy(buf, bytes, nbytes);
-        msg->type = VIR_FDSTREAM_MSG_TYPE_DATA;
-        msg->stream.data.buf = buf;
+        memcpy(msg->stream.data.buf, bytes, nbytes);
         msg->stream.data.len = nbytes;
 
         virFDStreamMsgQueuePush(fdst, msg, fdst->fd, "pipe");
@@ -923,7 +1035,7 @@ static int virFDStreamRead(virStreamPtr st, char *bytes, size_t nbytes)
         msg->stream.data.offset += nbytes;
         if (msg->stream.data.offset == msg->stream.data.len) {
             virFDStreamMsgQueuePop(fdst, fdst->fd, "pipe");
-            virFDStreamMsgFree(msg);
+            virFDStreamMsgRelease(fdst, msg);
         }
 
         ret = nbytes;
@@ -1292,6 +1404,14 @@ virFDStreamOpenFileInternal(virStreamPtr st,
             goto error;
         }
 
+#if HAVE_POSIX_FADVISE
+        /* Just a hint to get the kernel to read ahead more aggressively
+         * for the chunks the helper thread reads, failure is harmless. */
+        if (S_ISREG(sb.st_mode))
+            ignore_value(posix_fadvise(fd, offset, length,
+                                       POSIX_FADV_SEQUENTIAL));
+#endif
+
         if (VIR_ALLOC(threadData) < 0)
             goto error;
 
@@ -1448,3 +1568,33 @@ int virFDStreamSetInternalCloseCb(virStreamPtr st,
     virObjectUnlock(fdst);
     return 0;
 }
+
+
+/**
+ * virFDStreamGetStats:
+ * @st: stream opened by one of the virFDStreamOpen* functions
+ * @stats: filled with the statistics
+ *
+ * Gets the transfer statistics of the I/O thread of @st. Streams without
+ * a thread report no transferred bytes.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virFDStreamGetStats(virStreamPtr st,
+                    virFDStreamStatsPtr stats)
+{
+    virFDStreamDataPtr fdst = st->privateData;
+
+    if (!fdst) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("stream is not open"));
+        return -1;
+    }
+
+    virObjectLock(fdst);
+    *stats = fdst->stats;
+    stats->nspare = fdst->nspare;
+    virObjectUnlock(fdst);
+    return 0;
+}
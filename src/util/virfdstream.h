@@ -24,12 +24,27 @@
 
 # include "internal.h"
 
+/* Size of the chunks the I/O helper thread reads from the file, and
+ * the number of chunks it may queue up ahead of the reader. Consumed
+ * chunk buffers are kept around (up to the same limit) for reuse. */
+# define VIR_FDSTREAM_CHUNK_SIZE (1024 * 1024)
+# define VIR_FDSTREAM_QUEUE_MAX 4
+
 /* internal callback, the generic one is used up by daemon stream driver */
 /* the close callback is called with fdstream private data locked */
 typedef void (*virFDStreamInternalCloseCb)(virStreamPtr st, void *opaque);
 
 typedef void (*virFDStreamInternalCloseCbFreeOpaque)(void *opaque);
 
+typedef struct _virFDStreamStats virFDStreamStats;
+typedef virFDStreamStats *virFDStreamStatsPtr;
+struct _virFDStreamStats {
+    unsigned long long bytes; /* bytes moved by the I/O thread */
+    unsigned long long duration; /* ms the I/O thread spent moving them */
+    size_t nbufs; /* data buffers allocated */
+    size_t nspare; /* consumed buffers kept for reuse */
+};
+
 
 int virFDStreamOpen(virStreamPtr st,
                     int fd);
@@ -65,4 +80,7 @@ int virFDStreamSetInternalCloseCb(virStreamPtr st,
                                   virFDStreamInternalCloseCb cb,
                                   void *opaque,
                                   virFDStreamInternalCloseCbFreeOpaque fcb);
+
+int virFDStreamGetStats(virStreamPtr st,
+                        virFDStreamStatsPtr stats);
 #endif /* LIBVIRT_VIRFDSTREAM_H */
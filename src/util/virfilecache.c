@@ -34,6 +34,7 @@
 #include "virlog.h"
 #include "virobject.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -49,6 +50,11 @@ struct _virFileCache {
 
     virHashTablePtr table;
 
+    /* names for which data is being loaded or created right now, with
+     * @pendingCond broadcasted whenever one of them is done */
+    virHashTablePtr pending;
+    virCond pendingCond;
+
     char *dir;
     char *suffix;
 
@@ -78,6 +84,8 @@ virFileCacheDispose(void *obj)
     VIR_FREE(cache->suffix);
 
     virHashFree(cache->table);
+    virHashFree(cache->pending);
+    virCondDestroy(&cache->pendingCond);
 
     virFileCachePrivFree(cache);
 }
@@ -133,6 +141,7 @@ virFileCacheLoad(virFileCachePtr cache,
     VIR_AUTOFREE(char *) file = NULL;
     int ret = -1;
     void *loadData = NULL;
+    bool valid;
 
     *data = NULL;
 
@@ -159,7 +168,13 @@ virFileCacheLoad(virFileCachePtr cache,
         goto cleanup;
     }
 
-    if (!cache->handlers.isValid(loadData, cache->priv)) {
+    /* @cache is not locked while loading data, but the handlers only
+     * expect to be called without the lock for creating the data. */
+    virObjectLock(cache);
+    valid = cache->handlers.isValid(loadData, cache->priv);
+    virObjectUnlock(cache);
+
+    if (!valid) {
         VIR_DEBUG("Outdated cached capabilities '%s' for '%s'", file, name);
         unlink(file);
         ret = 0;
@@ -239,12 +254,21 @@ virFileCacheNew(const char *dir,
     if (virFileCacheInitialize() < 0)
         return NULL;
 
-    if (!(cache = virObjectNew(virFileCacheClass)))
+    if (!(cache = virObjectLockableNew(virFileCacheClass)))
         return NULL;
 
     if (!(cache->table = virHashCreate(10, virObjectFreeHashData)))
         goto cleanup;
 
+    if (!(cache->pending = virHashCreate(10, NULL)))
+        goto cleanup;
+
+    if (virCondInit(&cache->pendingCond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        goto cleanup;
+    }
+
     if (VIR_STRDUP(cache->dir, dir) < 0)
         goto cleanup;
 
@@ -261,11 +285,16 @@ virFileCacheNew(const char *dir,
 }
 
 
+/* Called with @cache locked. The lock is dropped while new data is being
+ * loaded or created so that only lookups of the same @name have to wait
+ * for it. */
 static void
 virFileCacheValidate(virFileCachePtr cache,
                      const char *name,
                      void **data)
 {
+    void *newData;
+
     if (*data && !cache->handlers.isValid(*data, cache->priv)) {
         VIR_DEBUG("Cached data '%p' no longer valid for '%s'",
                   *data, NULLSTR(name));
@@ -274,16 +303,43 @@ virFileCacheValidate(virFileCachePtr cache,
         *data = NULL;
     }
 
-    if (!*data && name) {
-        VIR_DEBUG("Creating data for '%s'", name);
-        *data = virFileCacheNewData(cache, name);
-        if (*data) {
-            VIR_DEBUG("Caching data '%p' for '%s'", *data, name);
-            if (virHashAddEntry(cache->table, name, *data) < 0) {
-                virObjectUnref(*data);
-                *data = NULL;
+    if (*data || !name)
+        return;
+
+    if (virHashLookup(cache->pending, name)) {
+        VIR_DEBUG("Waiting for data for '%s'", name);
+        while (virHashLookup(cache->pending, name)) {
+            if (virCondWait(&cache->pendingCond, &cache->parent.lock) < 0) {
+                virReportSystemError(errno, "%s",
+                                     _("failed to wait on condition"));
+                return;
             }
         }
+
+        /* NULL if creating the data failed, the error was reported by
+         * the thread which tried to create it */
+        *data = virHashLookup(cache->table, name);
+        return;
+    }
+
+    if (virHashAddEntry(cache->pending, name, cache) < 0)
+        return;
+
+    VIR_DEBUG("Creating data for '%s'", name);
+    virObjectUnlock(cache);
+    newData = virFileCacheNewData(cache, name);
+    virObjectLock(cache);
+
+    virHashRemoveEntry(cache->pending, name);
+    virCondBroadcast(&cache->pendingCond);
+
+    if (newData) {
+        VIR_DEBUG("Caching data '%p' for '%s'", newData, name);
+        if (virHashAddEntry(cache->table, name, newData) < 0) {
+            virObjectUnref(newData);
+            return;
+        }
+        *data = newData;
     }
 }
 
@@ -340,6 +396,17 @@ virFileCacheLookupByFunc(virFileCachePtr cache,
     virObjectLock(cache);
 
     data = virHashSearch(cache->table, iter, iterData, (void **)&name);
+
+    /* The data we are looking for might be still being created */
+    while (!data && virHashSize(cache->pending) > 0) {
+        if (virCondWait(&cache->pendingCond, &cache->parent.lock) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("failed to wait on condition"));
+            break;
+        }
+        data = virHashSearch(cache->table, iter, iterData, (void **)&name);
+    }
+
     virFileCacheValidate(cache, name, &data);
 
     virObjectRef(data);
@@ -349,6 +416,78 @@ virFileCacheLookupByFunc(virFileCachePtr cache,
 }
 
 
+struct virFileCachePrefetchData {
+    virFileCachePtr cache;
+    char *name;
+};
+
+
+static void
+virFileCachePrefetchThread(void *opaque)
+{
+    struct virFileCachePrefetchData *prefetch = opaque;
+    void *data;
+
+    if (!(data = virFileCacheLookup(prefetch->cache, prefetch->name))) {
+        VIR_DEBUG("Failed to prefetch data for '%s': %s",
+                  prefetch->name, virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+    virObjectUnref(data);
+    virObjectUnref(prefetch->cache);
+    VIR_FREE(prefetch->name);
+    VIR_FREE(prefetch);
+}
+
+
+/**
+ * virFileCachePrefetch:
+ * @cache: existing cache object
+ * @name: name of the data to prefetch
+ * @thread: where to store the thread or NULL
+ *
+ * Starts loading or creating data for @name in a background thread. Lookups
+ * of @name done in the meantime wait for the thread to finish, lookups of
+ * other names are not blocked by it.
+ *
+ * If @thread is not NULL the thread is joinable and the caller must join it
+ * using virThreadJoin(), otherwise it is detached.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virFileCachePrefetch(virFileCachePtr cache,
+                     const char *name,
+                     virThreadPtr thread)
+{
+    struct virFileCachePrefetchData *prefetch = NULL;
+    virThread tmp;
+
+    if (VIR_ALLOC(prefetch) < 0 ||
+        VIR_STRDUP(prefetch->name, name) < 0)
+        goto error;
+
+    prefetch->cache = virObjectRef(cache);
+
+    if (virThreadCreate(thread ? thread : &tmp, !!thread,
+                        virFileCachePrefetchThread, prefetch) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create prefetch thread"));
+        virObjectUnref(cache);
+        goto error;
+    }
+
+    return 0;
+
+ error:
+    if (prefetch)
+        VIR_FREE(prefetch->name);
+    VIR_FREE(prefetch);
+    return -1;
+}
+
+
 /**
  * virFileCacheGetPriv:
  * @cache: existing cache object
@@ -26,6 +26,7 @@
 
 # include "virobject.h"
 # include "virhash.h"
+# include "virthread.h"
 
 typedef struct _virFileCache virFileCache;
 typedef virFileCache *virFileCachePtr;
@@ -122,6 +123,11 @@ virFileCacheLookupByFunc(virFileCachePtr cache,
                          virHashSearcher iter,
                          const void *iterData);
 
+int
+virFileCachePrefetch(virFileCachePtr cache,
+                     const char *name,
+                     virThreadPtr thread);
+
 void *
 virFileCacheGetPriv(virFileCachePtr cache);
 
@@ -28,8 +28,10 @@
 #include "virutil.h"
 #include "virfile.h"
 #include "virhash.h"
+#include "virhashcode.h"
 #include "virthread.h"
 #include "virstring.h"
+#include "intprops.h"
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -40,10 +42,17 @@
 VIR_LOG_INIT("util.lockspace");
 
 #define VIR_LOCKSPACE_TABLE_SIZE 10
+#define VIR_LOCKSPACE_SHARDS 16
 
 typedef struct _virLockSpaceResource virLockSpaceResource;
 typedef virLockSpaceResource *virLockSpaceResourcePtr;
 
+typedef struct _virLockSpaceOwner virLockSpaceOwner;
+typedef virLockSpaceOwner *virLockSpaceOwnerPtr;
+
+typedef struct _virLockSpaceShard virLockSpaceShard;
+typedef virLockSpaceShard *virLockSpaceShardPtr;
+
 struct _virLockSpaceResource {
     char *name;
     char *path;
@@ -54,11 +63,29 @@ struct _virLockSpaceResource {
     pid_t *owners;
 };
 
-struct _virLockSpace {
-    char *dir;
+/* Resources held by one owner within a shard. A resource is listed
+ * once for each time the owner appears in its owners array. */
+struct _virLockSpaceOwner {
+    size_t nresources;
+    virLockSpaceResourcePtr *resources;
+};
+
+/* Resources are spread over shards by the hash of their name so that
+ * requests for unrelated resources do not contend on a single lock.
+ * Each shard also indexes its resources by owner, so releasing
+ * everything an owner holds does not walk every resource. */
+struct _virLockSpaceShard {
     virMutex lock;
 
     virHashTablePtr resources;
+    virHashTablePtr owners; /* owner pid => virLockSpaceOwnerPtr */
+};
+
+struct _virLockSpace {
+    char *dir;
+
+    size_t nshards; /* number of initialized shards */
+    virLockSpaceShard shards[VIR_LOCKSPACE_SHARDS];
 };
 
 
@@ -239,6 +266,115 @@ static void virLockSpaceResourceDataFree(void *opaque, const void *name ATTRIBUT
 }
 
 
+static void virLockSpaceOwnerDataFree(void *opaque, const void *name ATTRIBUTE_UNUSED)
+{
+    virLockSpaceOwnerPtr entry = opaque;
+
+    if (!entry)
+        return;
+
+    VIR_FREE(entry->resources);
+    VIR_FREE(entry);
+}
+
+
+static int
+virLockSpaceInitShards(virLockSpacePtr lockspace)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_LOCKSPACE_SHARDS; i++) {
+        virLockSpaceShardPtr shard = &lockspace->shards[i];
+
+        if (virMutexInit(&shard->lock) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Unable to initialize lockspace mutex"));
+            return -1;
+        }
+        lockspace->nshards++;
+
+        if (!(shard->resources = virHashCreate(VIR_LOCKSPACE_TABLE_SIZE,
+                                               virLockSpaceResourceDataFree)) ||
+            !(shard->owners = virHashCreate(VIR_LOCKSPACE_TABLE_SIZE,
+                                            virLockSpaceOwnerDataFree)))
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static virLockSpaceShardPtr
+virLockSpaceGetShard(virLockSpacePtr lockspace,
+                     const char *resname)
+{
+    uint32_t code = virHashCodeGen(resname, strlen(resname), 0);
+
+    return &lockspace->shards[code % VIR_LOCKSPACE_SHARDS];
+}
+
+
+static void
+virLockSpaceOwnerKey(pid_t owner,
+                     char *key,
+                     size_t keylen)
+{
+    snprintf(key, keylen, "%lld", (long long)owner);
+}
+
+
+/* Record @res as held by @owner in the owner index of @shard. */
+static int
+virLockSpaceOwnerAddResource(virLockSpaceShardPtr shard,
+                             pid_t owner,
+                             virLockSpaceResourcePtr res)
+{
+    char key[INT_BUFSIZE_BOUND(long long)];
+    virLockSpaceOwnerPtr entry;
+
+    virLockSpaceOwnerKey(owner, key, sizeof(key));
+
+    if (!(entry = virHashLookup(shard->owners, key))) {
+        if (VIR_ALLOC(entry) < 0)
+            return -1;
+
+        if (virHashAddEntry(shard->owners, key, entry) < 0) {
+            VIR_FREE(entry);
+            return -1;
+        }
+    }
+
+    return VIR_APPEND_ELEMENT(entry->resources, entry->nresources, res);
+}
+
+
+/* Drop one record of @res held by @owner from the owner index of @shard. */
+static void
+virLockSpaceOwnerRemoveResource(virLockSpaceShardPtr shard,
+                                pid_t owner,
+                                virLockSpaceResourcePtr res)
+{
+    char key[INT_BUFSIZE_BOUND(long long)];
+    virLockSpaceOwnerPtr entry;
+    size_t i;
+
+    virLockSpaceOwnerKey(owner, key, sizeof(key));
+
+    if (!(entry = virHashLookup(shard->owners, key)))
+        return;
+
+    for (i = 0; i < entry->nresources; i++) {
+        if (entry->resources[i] == res) {
+            VIR_DELETE_ELEMENT(entry->resources, i, entry->nresources);
+            break;
+        }
+    }
+
+    if (entry->nresources == 0)
+        ignore_value(virHashRemoveEntry(shard->owners, key));
+}
+
+
 virLockSpacePtr virLockSpaceNew(const char *directory)
 {
     virLockSpacePtr lockspace;
@@ -248,18 +384,10 @@ virLockSpacePtr virLockSpaceNew(const char *directory)
     if (VIR_ALLOC(lockspace) < 0)
         return NULL;
 
-    if (virMutexInit(&lockspace->lock) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Unable to initialize lockspace mutex"));
-        VIR_FREE(lockspace);
-        return NULL;
-    }
-
-    if (VIR_STRDUP(lockspace->dir, directory) < 0)
+    if (virLockSpaceInitShards(lockspace) < 0)
         goto error;
 
-    if (!(lockspace->resources = virHashCreate(VIR_LOCKSPACE_TABLE_SIZE,
-                                               virLockSpaceResourceDataFree)))
+    if (VIR_STRDUP(lockspace->dir, directory) < 0)
         goto error;
 
     if (directory) {
@@ -300,15 +428,7 @@ virLockSpacePtr virLockSpaceNewPostExecRestart(virJSONValuePtr object)
     if (VIR_ALLOC(lockspace) < 0)
         return NULL;
 
-    if (virMutexInit(&lockspace->lock) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Unable to initialize lockspace mutex"));
-        VIR_FREE(lockspace);
-        return NULL;
-    }
-
-    if (!(lockspace->resources = virHashCreate(VIR_LOCKSPACE_TABLE_SIZE,
-                                               virLockSpaceResourceDataFree)))
+    if (virLockSpaceInitShards(lockspace) < 0)
         goto error;
 
     if (virJSONValueObjectHasKey(object, "directory")) {
@@ -332,6 +452,7 @@ virLockSpacePtr virLockSpaceNewPostExecRestart(virJSONValuePtr object)
     for (i = 0; i < virJSONValueArraySize(resources); i++) {
         virJSONValuePtr child = virJSONValueArrayGet(resources, i);
         virLockSpaceResourcePtr res;
+        virLockSpaceShardPtr shard;
         const char *tmp;
         virJSONValuePtr owners;
         size_t j;
@@ -403,7 +524,7 @@ virLockSpacePtr virLockSpaceNewPostExecRestart(virJSONValuePtr object)
         }
 
         m = virJSONValueArraySize(owners);
-        if (VIR_ALLOC_N(res->owners, res->nOwners) < 0) {
+        if (VIR_ALLOC_N(res->owners, m) < 0) {
             virLockSpaceResourceFree(res);
             goto error;
         }
@@ -423,10 +544,16 @@ virLockSpacePtr virLockSpaceNewPostExecRestart(virJSONValuePtr object)
             res->owners[j] = (pid_t)owner;
         }
 
-        if (virHashAddEntry(lockspace->resources, res->name, res) < 0) {
+        shard = virLockSpaceGetShard(lockspace, res->name);
+        if (virHashAddEntry(shard->resources, res->name, res) < 0) {
             virLockSpaceResourceFree(res);
             goto error;
         }
+
+        for (j = 0; j < res->nOwners; j++) {
+            if (virLockSpaceOwnerAddResource(shard, res->owners[j], res) < 0)
+                goto error;
+        }
     }
 
     return lockspace;
@@ -437,17 +564,68 @@ virLockSpacePtr virLockSpaceNewPostExecRestart(virJSONValuePtr object)
 }
 
 
+static int
+virLockSpaceResourcePreExecRestart(virLockSpaceResourcePtr res,
+                                   virJSONValuePtr resources)
+{
+    virJSONValuePtr child = virJSONValueNewObject();
+    virJSONValuePtr owners = NULL;
+    size_t i;
+
+    if (!child)
+        return -1;
+
+    if (virJSONValueArrayAppend(resources, child) < 0) {
+        virJSONValueFree(child);
+        return -1;
+    }
+
+    if (virJSONValueObjectAppendString(child, "name", res->name) < 0 ||
+        virJSONValueObjectAppendString(child, "path", res->path) < 0 ||
+        virJSONValueObjectAppendNumberInt(child, "fd", res->fd) < 0 ||
+        virJSONValueObjectAppendBoolean(child, "lockHeld", res->lockHeld) < 0 ||
+        virJSONValueObjectAppendNumberUint(child, "flags", res->flags) < 0)
+        return -1;
+
+    if (virSetInherit(res->fd, true) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Cannot disable close-on-exec flag"));
+        return -1;
+    }
+
+    if (!(owners = virJSONValueNewArray()))
+        return -1;
+
+    if (virJSONValueObjectAppend(child, "owners", owners) < 0) {
+        virJSONValueFree(owners);
+        return -1;
+    }
+
+    for (i = 0; i < res->nOwners; i++) {
+        virJSONValuePtr owner = virJSONValueNewNumberUlong(res->owners[i]);
+        if (!owner)
+            return -1;
+
+        if (virJSONValueArrayAppend(owners, owner) < 0) {
+            virJSONValueFree(owner);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
 virJSONValuePtr virLockSpacePreExecRestart(virLockSpacePtr lockspace)
 {
     virJSONValuePtr object = virJSONValueNewObject();
     virJSONValuePtr resources;
     virHashKeyValuePairPtr pairs = NULL, tmp;
+    size_t i;
 
     if (!object)
         return NULL;
 
-    virMutexLock(&lockspace->lock);
-
     if (lockspace->dir &&
         virJSONValueObjectAppendString(object, "directory", lockspace->dir) < 0)
         goto error;
@@ -460,76 +638,47 @@ virJSONValuePtr virLockSpacePreExecRestart(virLockSpacePtr lockspace)
         goto error;
     }
 
-    tmp = pairs = virHashGetItems(lockspace->resources, NULL);
-    while (tmp && tmp->value) {
-        virLockSpaceResourcePtr res = (virLockSpaceResourcePtr)tmp->value;
-        virJSONValuePtr child = virJSONValueNewObject();
-        virJSONValuePtr owners = NULL;
-        size_t i;
+    for (i = 0; i < VIR_LOCKSPACE_SHARDS; i++) {
+        virLockSpaceShardPtr shard = &lockspace->shards[i];
+        int rc = 0;
 
-        if (!child)
-            goto error;
+        virMutexLock(&shard->lock);
 
-        if (virJSONValueArrayAppend(resources, child) < 0) {
-            virJSONValueFree(child);
-            goto error;
+        tmp = pairs = virHashGetItems(shard->resources, NULL);
+        while (rc == 0 && tmp && tmp->value) {
+            rc = virLockSpaceResourcePreExecRestart((virLockSpaceResourcePtr)tmp->value,
+                                                    resources);
+            tmp++;
         }
+        VIR_FREE(pairs);
 
-        if (virJSONValueObjectAppendString(child, "name", res->name) < 0 ||
-            virJSONValueObjectAppendString(child, "path", res->path) < 0 ||
-            virJSONValueObjectAppendNumberInt(child, "fd", res->fd) < 0 ||
-            virJSONValueObjectAppendBoolean(child, "lockHeld", res->lockHeld) < 0 ||
-            virJSONValueObjectAppendNumberUint(child, "flags", res->flags) < 0)
-            goto error;
-
-        if (virSetInherit(res->fd, true) < 0) {
-            virReportSystemError(errno, "%s",
-                                 _("Cannot disable close-on-exec flag"));
-            goto error;
-        }
+        virMutexUnlock(&shard->lock);
 
-        if (!(owners = virJSONValueNewArray()))
+        if (rc < 0)
             goto error;
-
-        if (virJSONValueObjectAppend(child, "owners", owners) < 0) {
-            virJSONValueFree(owners);
-            goto error;
-        }
-
-        for (i = 0; i < res->nOwners; i++) {
-            virJSONValuePtr owner = virJSONValueNewNumberUlong(res->owners[i]);
-            if (!owner)
-                goto error;
-
-            if (virJSONValueArrayAppend(owners, owner) < 0) {
-                virJSONValueFree(owner);
-                goto error;
-            }
-        }
-
-        tmp++;
     }
-    VIR_FREE(pairs);
 
-    virMutexUnlock(&lockspace->lock);
     return object;
 
  error:
-    VIR_FREE(pairs);
     virJSONValueFree(object);
-    virMutexUnlock(&lockspace->lock);
     return NULL;
 }
 
 
 void virLockSpaceFree(virLockSpacePtr lockspace)
 {
+    size_t i;
+
     if (!lockspace)
         return;
 
-    virHashFree(lockspace->resources);
+    for (i = 0; i < lockspace->nshards; i++) {
+        virHashFree(lockspace->shards[i].owners);
+        virHashFree(lockspace->shards[i].resources);
+        virMutexDestroy(&lockspace->shards[i].lock);
+    }
     VIR_FREE(lockspace->dir);
-    virMutexDestroy(&lockspace->lock);
     VIR_FREE(lockspace);
 }
 
@@ -545,12 +694,13 @@ int virLockSpaceCreateResource(virLockSpacePtr lockspace,
 {
     int ret = -1;
     char *respath = NULL;
+    virLockSpaceShardPtr shard = virLockSpaceGetShard(lockspace, resname);
 
     VIR_DEBUG("lockspace=%p resname=%s", lockspace, resname);
 
-    virMutexLock(&lockspace->lock);
+    virMutexLock(&shard->lock);
 
-    if (virHashLookup(lockspace->resources, resname) != NULL) {
+    if (virHashLookup(shard->resources, resname) != NULL) {
         virReportError(VIR_ERR_RESOURCE_BUSY,
                        _("Lockspace resource '%s' is locked"),
                        resname);
@@ -566,7 +716,7 @@ int virLockSpaceCreateResource(virLockSpacePtr lockspace,
     ret = 0;
 
  cleanup:
-    virMutexUnlock(&lockspace->lock);
+    virMutexUnlock(&shard->lock);
     VIR_FREE(respath);
     return ret;
 }
@@ -577,12 +727,13 @@ int virLockSpaceDeleteResource(virLockSpacePtr lockspace,
 {
     int ret = -1;
     char *respath = NULL;
+    virLockSpaceShardPtr shard = virLockSpaceGetShard(lockspace, resname);
 
     VIR_DEBUG("lockspace=%p resname=%s", lockspace, resname);
 
-    virMutexLock(&lockspace->lock);
+    virMutexLock(&shard->lock);
 
-    if (virHashLookup(lockspace->resources, resname) != NULL) {
+    if (virHashLookup(shard->resources, resname) != NULL) {
         virReportError(VIR_ERR_RESOURCE_BUSY,
                        _("Lockspace resource '%s' is locked"),
                        resname);
@@ -603,7 +754,7 @@ int virLockSpaceDeleteResource(virLockSpacePtr lockspace,
     ret = 0;
 
  cleanup:
-    virMutexUnlock(&lockspace->lock);
+    virMutexUnlock(&shard->lock);
     VIR_FREE(respath);
     return ret;
 }
@@ -616,6 +767,7 @@ int virLockSpaceAcquireResource(virLockSpacePtr lockspace,
 {
     int ret = -1;
     virLockSpaceResourcePtr res;
+    virLockSpaceShardPtr shard;
 
     VIR_DEBUG("lockspace=%p resname=%s flags=0x%x owner=%lld",
               lockspace, resname, flags, (unsigned long long)owner);
@@ -623,9 +775,11 @@ int virLockSpaceAcquireResource(virLockSpacePtr lockspace,
     virCheckFlags(VIR_LOCK_SPACE_ACQUIRE_SHARED |
                   VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE, -1);
 
-    virMutexLock(&lockspace->lock);
+    shard = virLockSpaceGetShard(lockspace, resname);
+
+    virMutexLock(&shard->lock);
 
-    if ((res = virHashLookup(lockspace->resources, resname))) {
+    if ((res = virHashLookup(shard->resources, resname))) {
         if ((res->flags & VIR_LOCK_SPACE_ACQUIRE_SHARED) &&
             (flags & VIR_LOCK_SPACE_ACQUIRE_SHARED)) {
 
@@ -633,6 +787,11 @@ int virLockSpaceAcquireResource(virLockSpacePtr lockspace,
                 goto cleanup;
             res->owners[res->nOwners-1] = owner;
 
+            if (virLockSpaceOwnerAddResource(shard, owner, res) < 0) {
+                VIR_DELETE_ELEMENT(res->owners, res->nOwners - 1, res->nOwners);
+                goto cleanup;
+            }
+
             goto done;
         }
         virReportError(VIR_ERR_RESOURCE_BUSY,
@@ -644,16 +803,21 @@ int virLockSpaceAcquireResource(virLockSpacePtr lockspace,
     if (!(res = virLockSpaceResourceNew(lockspace, resname, flags, owner)))
         goto cleanup;
 
-    if (virHashAddEntry(lockspace->resources, resname, res) < 0) {
+    if (virHashAddEntry(shard->resources, resname, res) < 0) {
         virLockSpaceResourceFree(res);
         goto cleanup;
     }
 
+    if (virLockSpaceOwnerAddResource(shard, owner, res) < 0) {
+        ignore_value(virHashRemoveEntry(shard->resources, resname));
+        goto cleanup;
+    }
+
  done:
     ret = 0;
 
  cleanup:
-    virMutexUnlock(&lockspace->lock);
+    virMutexUnlock(&shard->lock);
     return ret;
 }
 
@@ -664,14 +828,17 @@ int virLockSpaceReleaseResource(virLockSpacePtr lockspace,
 {
     int ret = -1;
     virLockSpaceResourcePtr res;
+    virLockSpaceShardPtr shard;
     size_t i;
 
     VIR_DEBUG("lockspace=%p resname=%s owner=%lld",
               lockspace, resname, (unsigned long long)owner);
 
-    virMutexLock(&lockspace->lock);
+    shard = virLockSpaceGetShard(lockspace, resname);
+
+    virMutexLock(&shard->lock);
 
-    if (!(res = virHashLookup(lockspace->resources, resname))) {
+    if (!(res = virHashLookup(shard->resources, resname))) {
         virReportError(VIR_ERR_RESOURCE_BUSY,
                        _("Lockspace resource '%s' is not locked"),
                        resname);
@@ -691,81 +858,73 @@ int virLockSpaceReleaseResource(virLockSpacePtr lockspace,
     }
 
     VIR_DELETE_ELEMENT(res->owners, i, res->nOwners);
+    virLockSpaceOwnerRemoveResource(shard, owner, res);
 
     if ((res->nOwners == 0) &&
-        virHashRemoveEntry(lockspace->resources, resname) < 0)
+        virHashRemoveEntry(shard->resources, resname) < 0)
         goto cleanup;
 
     ret = 0;
 
  cleanup:
-    virMutexUnlock(&lockspace->lock);
+    virMutexUnlock(&shard->lock);
     return ret;
 }
 
 
-struct virLockSpaceRemoveData {
-    pid_t owner;
-    size_t count;
-};
-
-
-static int
-virLockSpaceRemoveResourcesForOwner(const void *payload,
-                                    const void *name ATTRIBUTE_UNUSED,
-                                    const void *opaque)
+int virLockSpaceReleaseResourcesForOwner(virLockSpacePtr lockspace,
+                                         pid_t owner)
 {
-    virLockSpaceResourcePtr res = (virLockSpaceResourcePtr)payload;
-    struct virLockSpaceRemoveData *data = (struct virLockSpaceRemoveData *)opaque;
+    char key[INT_BUFSIZE_BOUND(long long)];
+    size_t count = 0;
     size_t i;
+    size_t j;
+    size_t k;
 
-    VIR_DEBUG("res %s owner %lld", res->name, (unsigned long long)data->owner);
+    VIR_DEBUG("lockspace=%p owner=%lld", lockspace, (unsigned long long)owner);
 
-    for (i = 0; i < res->nOwners; i++) {
-        if (res->owners[i] == data->owner)
-            break;
-    }
+    virLockSpaceOwnerKey(owner, key, sizeof(key));
 
-    if (i == res->nOwners)
-        return 0;
+    for (i = 0; i < VIR_LOCKSPACE_SHARDS; i++) {
+        virLockSpaceShardPtr shard = &lockspace->shards[i];
+        virLockSpaceOwnerPtr entry;
 
-    data->count++;
+        virMutexLock(&shard->lock);
 
-    VIR_DELETE_ELEMENT(res->owners, i, res->nOwners);
+        if (!(entry = virHashSteal(shard->owners, key))) {
+            virMutexUnlock(&shard->lock);
+            continue;
+        }
 
-    if (res->nOwners) {
-        VIR_DEBUG("Other shared owners remain");
-        return 0;
-    }
+        for (j = 0; j < entry->nresources; j++) {
+            virLockSpaceResourcePtr res = entry->resources[j];
 
-    VIR_DEBUG("No more owners, remove it");
-    return 1;
-}
+            VIR_DEBUG("res %s owner %lld", res->name, (unsigned long long)owner);
 
+            for (k = 0; k < res->nOwners; k++) {
+                if (res->owners[k] == owner)
+                    break;
+            }
 
-int virLockSpaceReleaseResourcesForOwner(virLockSpacePtr lockspace,
-                                         pid_t owner)
-{
-    int ret = 0;
-    struct virLockSpaceRemoveData data = {
-        owner, 0
-    };
+            if (k == res->nOwners)
+                continue;
 
-    VIR_DEBUG("lockspace=%p owner=%lld", lockspace, (unsigned long long)owner);
+            count++;
 
-    virMutexLock(&lockspace->lock);
+            VIR_DELETE_ELEMENT(res->owners, k, res->nOwners);
 
-    if (virHashRemoveSet(lockspace->resources,
-                         virLockSpaceRemoveResourcesForOwner,
-                         &data) < 0)
-        goto error;
+            if (res->nOwners) {
+                VIR_DEBUG("Other shared owners remain");
+                continue;
+            }
 
-    ret = data.count;
+            VIR_DEBUG("No more owners, remove it");
+            ignore_value(virHashRemoveEntry(shard->resources, res->name));
+        }
 
-    virMutexUnlock(&lockspace->lock);
-    return ret;
+        virMutexUnlock(&shard->lock);
+        virLockSpaceOwnerDataFree(entry, NULL);
+    }
 
- error:
-    virMutexUnlock(&lockspace->lock);
-    return -1;
+    return count;
 }
@@ -24,6 +24,9 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifdef WITH_ZLIB
+# include <zlib.h>
+#endif
 
 #include "virrotatingfile.h"
 #include "viralloc.h"
@@ -31,6 +34,7 @@
 #include "virstring.h"
 #include "virfile.h"
 #include "virlog.h"
+#include "virthread.h"
 
 VIR_LOG_INIT("util.rotatingfile");
 
@@ -38,6 +42,8 @@ VIR_LOG_INIT("util.rotatingfile");
 
 #define VIR_MAX_MAX_BACKUP 32
 
+#define VIR_ROTATING_FILE_COMPRESS_BUFSIZE (64 * 1024)
+
 typedef struct virRotatingFileWriterEntry virRotatingFileWriterEntry;
 typedef virRotatingFileWriterEntry *virRotatingFileWriterEntryPtr;
 
@@ -57,6 +63,8 @@ struct virRotatingFileWriter {
     size_t maxbackup;
     mode_t mode;
     size_t maxlen;
+
+    bool compress;
 };
 
 
@@ -64,6 +72,9 @@ struct virRotatingFileReaderEntry {
     char *path;
     int fd;
     off_t inode;
+#ifdef WITH_ZLIB
+    gzFile gz; /* Set when reading a compressed backup */
+#endif
 };
 
 struct virRotatingFileReader {
@@ -72,6 +83,32 @@ struct virRotatingFileReader {
     size_t current;
 };
 
+/* Serializes renaming backups against the compressor threads,
+ * which look backups up by inode and replace them by their
+ * compressed version */
+static virMutex virRotatingFileCompressLock;
+static virCond virRotatingFileCompressCond;
+static size_t virRotatingFileCompressJobs;
+
+static int virRotatingFileOnceInit(void)
+{
+    if (virMutexInit(&virRotatingFileCompressLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize mutex"));
+        return -1;
+    }
+
+    if (virCondInit(&virRotatingFileCompressCond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize condition variable"));
+        return -1;
+    }
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virRotatingFile);
+
 
 static void
 virRotatingFileWriterEntryFree(virRotatingFileWriterEntryPtr entry)
@@ -90,6 +127,13 @@ virRotatingFileReaderEntryFree(virRotatingFileReaderEntryPtr entry)
     if (!entry)
         return;
 
+#ifdef WITH_ZLIB
+    if (entry->gz) {
+        /* This closes entry->fd too */
+        gzclose(entry->gz);
+        entry->fd = -1;
+    }
+#endif
     VIR_FREE(entry->path);
     VIR_FORCE_CLOSE(entry->fd);
     VIR_FREE(entry);
@@ -108,7 +152,11 @@ virRotatingFileWriterEntryNew(const char *path,
     if (VIR_ALLOC(entry) < 0)
         return NULL;
 
-    if ((entry->fd = open(path, O_CREAT|O_APPEND|O_WRONLY|O_CLOEXEC, mode)) < 0) {
+    /* We are the only writer and track the offset ourselves, so
+     * O_APPEND is not required. Leaving it off allows data to be
+     * spliced directly into the file (see
+     * virRotatingFileWriterAppendFD) */
+    if ((entry->fd = open(path, O_CREAT|O_WRONLY|O_CLOEXEC, mode)) < 0) {
         virReportSystemError(errno,
                              _("Unable to open file: %s"), path);
         goto error;
@@ -140,6 +188,150 @@ virRotatingFileWriterEntryNew(const char *path,
 }
 
 
+#ifdef WITH_ZLIB
+/*
+ * Compressed backups carry the inode the data had while it was
+ * being written in the gzip header comment, so that positions
+ * handed out by virRotatingFileWriterGetINode remain usable
+ */
+static int
+virRotatingFileReadCompressedINode(int fd,
+                                   off_t *inode)
+{
+    unsigned char in[512];
+    unsigned char out[1];
+    char comment[64] = "";
+    unsigned long long val;
+    gz_header head;
+    z_stream strm;
+    ssize_t got;
+    int ret = -1;
+
+    if ((got = saferead(fd, in, sizeof(in))) < 0)
+        return -1;
+
+    memset(&strm, 0, sizeof(strm));
+    memset(&head, 0, sizeof(head));
+    head.comment = (Bytef *)comment;
+    head.comm_max = sizeof(comment) - 1;
+
+    if (inflateInit2(&strm, 15 + 16) != Z_OK)
+        return -1;
+
+    if (inflateGetHeader(&strm, &head) != Z_OK)
+        goto cleanup;
+
+    strm.next_in = in;
+    strm.avail_in = got;
+    strm.next_out = out;
+    strm.avail_out = sizeof(out);
+
+    /* Z_BLOCK makes inflate return as soon as the header is parsed */
+    inflate(&strm, Z_BLOCK);
+
+    if (head.done != 1 ||
+        !STRPREFIX(comment, "inode=") ||
+        virStrToLong_ull(comment + strlen("inode="), NULL, 10, &val) < 0)
+        goto cleanup;
+
+    *inode = val;
+    ret = 0;
+
+ cleanup:
+    inflateEnd(&strm);
+    return ret;
+}
+
+
+static int
+virRotatingFileReaderEntryOpenCompressed(virRotatingFileReaderEntryPtr entry,
+                                         const char *path)
+{
+    char *gzpath = NULL;
+    struct stat sb;
+    int fd = -1;
+    int ret = -1;
+
+    if (virAsprintf(&gzpath, "%s.gz", path) < 0)
+        return -1;
+
+    if ((fd = open(gzpath, O_RDONLY|O_CLOEXEC)) < 0) {
+        if (errno == ENOENT) {
+            ret = 0;
+        } else {
+            virReportSystemError(errno,
+                                 _("Unable to open file: %s"), gzpath);
+        }
+        goto cleanup;
+    }
+
+    if (virRotatingFileReadCompressedINode(fd, &entry->inode) < 0) {
+        if (fstat(fd, &sb) < 0) {
+            virReportSystemError(errno,
+                                 _("Unable to determine current file inode: %s"),
+                                 gzpath);
+            goto cleanup;
+        }
+        entry->inode = sb.st_ino;
+    }
+
+    if (lseek(fd, 0, SEEK_SET) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to seek in file: %s"), gzpath);
+        goto cleanup;
+    }
+
+    if (!(entry->gz = gzdopen(fd, "rb"))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unable to open compressed file: %s"), gzpath);
+        goto cleanup;
+    }
+
+    entry->fd = fd;
+    fd = -1;
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(gzpath);
+    return ret;
+}
+#endif /* WITH_ZLIB */
+
+
+static off_t
+virRotatingFileReaderEntrySeek(virRotatingFileReaderEntryPtr entry,
+                               off_t offset)
+{
+#ifdef WITH_ZLIB
+    if (entry->gz) {
+        z_off_t ret = gzseek(entry->gz, offset, SEEK_SET);
+        if (ret < 0)
+            errno = EIO;
+        return ret;
+    }
+#endif
+    return lseek(entry->fd, offset, SEEK_SET);
+}
+
+
+static ssize_t
+virRotatingFileReaderEntryRead(virRotatingFileReaderEntryPtr entry,
+                               char *buf,
+                               size_t len)
+{
+#ifdef WITH_ZLIB
+    if (entry->gz) {
+        int got = gzread(entry->gz, buf, MIN(len, INT_MAX));
+        if (got < 0)
+            errno = EIO;
+        return got;
+    }
+#endif
+    return saferead(entry->fd, buf, len);
+}
+
+
 static virRotatingFileReaderEntryPtr
 virRotatingFileReaderEntryNew(const char *path)
 {
@@ -157,9 +349,14 @@ virRotatingFileReaderEntryNew(const char *path)
                                  _("Unable to open file: %s"), path);
             goto error;
         }
+
+#ifdef WITH_ZLIB
+        if (virRotatingFileReaderEntryOpenCompressed(entry, path) < 0)
+            goto error;
+#endif
     }
 
-    if (entry->fd != -1) {
+    if (entry->fd != -1 && !entry->inode) {
         if (fstat(entry->fd, &sb) < 0) {
             virReportSystemError(errno,
                                  _("Unable to determine current file inode: %s"),
@@ -185,6 +382,8 @@ static int
 virRotatingFileWriterDelete(virRotatingFileWriterPtr file)
 {
     size_t i;
+    char *oldpath = NULL;
+    char *oldgzpath = NULL;
 
     if (unlink(file->basepath) < 0 &&
         errno != ENOENT) {
@@ -194,23 +393,38 @@ virRotatingFileWriterDelete(virRotatingFileWriterPtr file)
         return -1;
     }
 
+    virMutexLock(&virRotatingFileCompressLock);
     for (i = 0; i < file->maxbackup; i++) {
-        char *oldpath;
-        if (virAsprintf(&oldpath, "%s.%zu", file->basepath, i) < 0)
-            return -1;
+        if (virAsprintf(&oldpath, "%s.%zu", file->basepath, i) < 0 ||
+            virAsprintf(&oldgzpath, "%s.gz", oldpath) < 0)
+            goto error;
 
         if (unlink(oldpath) < 0 &&
             errno != ENOENT) {
             virReportSystemError(errno,
                                  _("Unable to delete file %s"),
                                  oldpath);
-            VIR_FREE(oldpath);
-            return -1;
+            goto error;
+        }
+        if (unlink(oldgzpath) < 0 &&
+            errno != ENOENT) {
+            virReportSystemError(errno,
+                                 _("Unable to delete file %s"),
+                                 oldgzpath);
+            goto error;
         }
         VIR_FREE(oldpath);
+        VIR_FREE(oldgzpath);
     }
 
+    virMutexUnlock(&virRotatingFileCompressLock);
     return 0;
+
+ error:
+    virMutexUnlock(&virRotatingFileCompressLock);
+    VIR_FREE(oldpath);
+    VIR_FREE(oldgzpath);
+    return -1;
 }
 
 
@@ -240,6 +454,9 @@ virRotatingFileWriterNew(const char *path,
 {
     virRotatingFileWriterPtr file;
 
+    if (virRotatingFileInitialize() < 0)
+        return NULL;
+
     if (VIR_ALLOC(file) < 0)
         goto error;
 
@@ -366,15 +583,409 @@ virRotatingFileWriterGetOffset(virRotatingFileWriterPtr file)
 }
 
 
+/**
+ * virRotatingFileWriterSetCompress:
+ * @file: the file context
+ * @compress: whether to compress backup files
+ *
+ * Control whether backup files get gzip compressed after
+ * rollover. Compression happens in a background thread so
+ * that writers are not held up, and compressed backups are
+ * read back transparently by virRotatingFileReader.
+ *
+ * Returns 0 on success, -1 if compression is not supported
+ */
+int
+virRotatingFileWriterSetCompress(virRotatingFileWriterPtr file,
+                                 bool compress)
+{
+#ifndef WITH_ZLIB
+    if (compress) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("compression of rotated files is not supported "
+                         "by this build"));
+        return -1;
+    }
+#endif
+
+    file->compress = compress;
+    return 0;
+}
+
+
+#ifdef WITH_ZLIB
+typedef struct virRotatingFileCompressJob virRotatingFileCompressJob;
+typedef virRotatingFileCompressJob *virRotatingFileCompressJobPtr;
+
+struct virRotatingFileCompressJob {
+    char *basepath;
+    size_t maxbackup;
+    off_t inode;
+    mode_t mode;
+};
+
+
+/*
+ * Find the backup of @basepath which has @inode. Rollover keeps
+ * renaming backups while they are being compressed, so the caller
+ * must hold virRotatingFileCompressLock.
+ *
+ * Returns the path of the uncompressed backup, or NULL if it has
+ * been compressed, rotated out or deleted in the meantime
+ */
+static char *
+virRotatingFileCompressFind(const char *basepath,
+                            size_t maxbackup,
+                            off_t inode)
+{
+    size_t i;
+
+    for (i = 0; i < maxbackup; i++) {
+        char *path;
+        struct stat sb;
+
+        if (virAsprintf(&path, "%s.%zu", basepath, i) < 0)
+            return NULL;
+
+        if (stat(path, &sb) == 0 && sb.st_ino == inode)
+            return path;
+
+        VIR_FREE(path);
+    }
+
+    return NULL;
+}
+
+
+static int
+virRotatingFileCompress(virRotatingFileCompressJobPtr job)
+{
+    char *path = NULL;
+    char *gzpath = NULL;
+    char *tmppath = NULL;
+    char comment[64];
+    unsigned char *inbuf = NULL;
+    unsigned char *outbuf = NULL;
+    int srcfd = -1;
+    int dstfd = -1;
+    gz_header head;
+    z_stream strm;
+    bool deflating = false;
+    bool locked = false;
+    int flush;
+    int ret = -1;
+
+    /* Named after the inode, so that it can't clash with the
+     * temporary file of any other backup */
+    if (virAsprintf(&tmppath, "%s.%llu.gz.tmp", job->basepath,
+                    (unsigned long long)job->inode) < 0 ||
+        VIR_ALLOC_N(inbuf, VIR_ROTATING_FILE_COMPRESS_BUFSIZE) < 0 ||
+        VIR_ALLOC_N(outbuf, VIR_ROTATING_FILE_COMPRESS_BUFSIZE) < 0)
+        goto cleanup;
+
+    virMutexLock(&virRotatingFileCompressLock);
+    if ((path = virRotatingFileCompressFind(job->basepath, job->maxbackup,
+                                            job->inode)) &&
+        (srcfd = open(path, O_RDONLY|O_CLOEXEC)) < 0)
+        virReportSystemError(errno,
+                             _("Unable to open file: %s"), path);
+    virMutexUnlock(&virRotatingFileCompressLock);
+
+    if (!path) {
+        VIR_DEBUG("Backup of %s with inode %llu is gone",
+                  job->basepath, (unsigned long long)job->inode);
+        ret = 0;
+        goto cleanup;
+    }
+    if (srcfd < 0)
+        goto cleanup;
+
+    VIR_DEBUG("Compressing %s", path);
+
+    if ((dstfd = open(tmppath, O_CREAT|O_TRUNC|O_WRONLY|O_CLOEXEC,
+                      job->mode)) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to open file: %s"), tmppath);
+        goto cleanup;
+    }
+
+    memset(&strm, 0, sizeof(strm));
+    memset(&head, 0, sizeof(head));
+    snprintf(comment, sizeof(comment), "inode=%llu",
+             (unsigned long long)job->inode);
+    head.comment = (Bytef *)comment;
+
+    if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                     15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to initialize compression"));
+        goto cleanup;
+    }
+    deflating = true;
+
+    if (deflateSetHeader(&strm, &head) != Z_OK) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to set compression header"));
+        goto cleanup;
+    }
+
+    do {
+        ssize_t got;
+
+        if ((got = saferead(srcfd, inbuf,
+                            VIR_ROTATING_FILE_COMPRESS_BUFSIZE)) < 0) {
+            virReportSystemError(errno,
+                                 _("Unable to read from file %s"), path);
+            goto cleanup;
+        }
+
+        flush = got == 0 ? Z_FINISH : Z_NO_FLUSH;
+        strm.next_in = inbuf;
+        strm.avail_in = got;
+
+        do {
+            size_t have;
+
+            strm.next_out = outbuf;
+            strm.avail_out = VIR_ROTATING_FILE_COMPRESS_BUFSIZE;
+            deflate(&strm, flush);
+
+            have = VIR_ROTATING_FILE_COMPRESS_BUFSIZE - strm.avail_out;
+            if (safewrite(dstfd, outbuf, have) != have) {
+                virReportSystemError(errno,
+                                     _("Unable to write to file %s"),
+                                     tmppath);
+                goto cleanup;
+            }
+        } while (strm.avail_out == 0);
+    } while (flush != Z_FINISH);
+
+    if (VIR_CLOSE(dstfd) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to close file %s"), tmppath);
+        goto cleanup;
+    }
+
+    /* The backup has most likely been renamed by a rollover
+     * while it was being compressed, so look it up again */
+    virMutexLock(&virRotatingFileCompressLock);
+    locked = true;
+
+    VIR_FREE(path);
+    if (!(path = virRotatingFileCompressFind(job->basepath, job->maxbackup,
+                                             job->inode))) {
+        VIR_DEBUG("Backup of %s with inode %llu is gone",
+                  job->basepath, (unsigned long long)job->inode);
+        unlink(tmppath);
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (virAsprintf(&gzpath, "%s.gz", path) < 0) {
+        unlink(tmppath);
+        goto cleanup;
+    }
+
+    /* Readers prefer the uncompressed file if both exist, so
+     * it is safe to remove it only after the rename */
+    if (rename(tmppath, gzpath) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to rename %s to %s"),
+                             tmppath, gzpath);
+        unlink(tmppath);
+        goto cleanup;
+    }
+
+    if (unlink(path) < 0 && errno != ENOENT) {
+        virReportSystemError(errno,
+                             _("Unable to remove %s"), path);
+        goto cleanup;
+    }
+
+    VIR_DEBUG("Compressed %s", path);
+
+    ret = 0;
+
+ cleanup:
+    if (locked)
+        virMutexUnlock(&virRotatingFileCompressLock);
+    if (deflating)
+        deflateEnd(&strm);
+    if (dstfd != -1) {
+        VIR_FORCE_CLOSE(dstfd);
+        unlink(tmppath);
+    }
+    VIR_FORCE_CLOSE(srcfd);
+    VIR_FREE(inbuf);
+    VIR_FREE(outbuf);
+    VIR_FREE(tmppath);
+    VIR_FREE(gzpath);
+    VIR_FREE(path);
+    return ret;
+}
+
+
+static void
+virRotatingFileWriterCompressThread(void *opaque)
+{
+    virRotatingFileCompressJobPtr job = opaque;
+
+    if (virRotatingFileCompress(job) < 0)
+        VIR_WARN("Unable to compress backup of %s: %s",
+                 job->basepath, virGetLastErrorMessage());
+
+    VIR_FREE(job->basepath);
+    VIR_FREE(job);
+
+    virMutexLock(&virRotatingFileCompressLock);
+    if (--virRotatingFileCompressJobs == 0)
+        virCondBroadcast(&virRotatingFileCompressCond);
+    virMutexUnlock(&virRotatingFileCompressLock);
+}
+
+
+/*
+ * Compress the most recent backup, which still has the inode
+ * of the current entry, in a detached thread. Nothing ever
+ * waits for it, as the backup is tracked by its inode rather
+ * than its name. Failure only means the backup stays
+ * uncompressed, so it is not reported.
+ */
+static void
+virRotatingFileWriterCompressStart(virRotatingFileWriterPtr file)
+{
+    virRotatingFileCompressJobPtr job;
+    virThread thread;
+
+    if (VIR_ALLOC(job) < 0 ||
+        VIR_STRDUP(job->basepath, file->basepath) < 0)
+        goto error;
+
+    job->maxbackup = file->maxbackup;
+    job->inode = file->entry->inode;
+    job->mode = file->mode;
+
+    virMutexLock(&virRotatingFileCompressLock);
+    virRotatingFileCompressJobs++;
+    virMutexUnlock(&virRotatingFileCompressLock);
+
+    if (virThreadCreate(&thread, false,
+                        virRotatingFileWriterCompressThread, job) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create compression thread"));
+        virMutexLock(&virRotatingFileCompressLock);
+        if (--virRotatingFileCompressJobs == 0)
+            virCondBroadcast(&virRotatingFileCompressCond);
+        virMutexUnlock(&virRotatingFileCompressLock);
+        goto error;
+    }
+
+    return;
+
+ error:
+    VIR_WARN("Unable to compress %s.0: %s",
+             file->basepath, virGetLastErrorMessage());
+    if (job)
+        VIR_FREE(job->basepath);
+    VIR_FREE(job);
+}
+#endif /* WITH_ZLIB */
+
+
+/**
+ * virRotatingFileWriterCompressWait:
+ *
+ * Wait until all backups that are queued for compression
+ * have been compressed. Writers never wait for compression
+ * themselves, this is meant for a daemon that is about to
+ * exit or re-exec itself.
+ */
+void
+virRotatingFileWriterCompressWait(void)
+{
+    if (virRotatingFileInitialize() < 0)
+        return;
+
+    virMutexLock(&virRotatingFileCompressLock);
+    while (virRotatingFileCompressJobs > 0) {
+        if (virCondWait(&virRotatingFileCompressCond,
+                        &virRotatingFileCompressLock) < 0) {
+            VIR_WARN("Unable to wait for compression of backups");
+            break;
+        }
+    }
+    virMutexUnlock(&virRotatingFileCompressLock);
+}
+
+
+/*
+ * Move a backup file, which may or may not have been
+ * compressed, out of the way of a newer one
+ */
+static int
+virRotatingFileWriterRename(const char *thispath,
+                            const char *nextpath)
+{
+    char *thisgzpath = NULL;
+    char *nextgzpath = NULL;
+    const char *from;
+    const char *to;
+    const char *stale;
+    int ret = -1;
+
+    if (virAsprintf(&thisgzpath, "%s.gz", thispath) < 0 ||
+        virAsprintf(&nextgzpath, "%s.gz", nextpath) < 0)
+        goto cleanup;
+
+    if (access(thispath, F_OK) == 0) {
+        from = thispath;
+        to = nextpath;
+        stale = nextgzpath;
+    } else if (access(thisgzpath, F_OK) == 0) {
+        from = thisgzpath;
+        to = nextgzpath;
+        stale = nextpath;
+    } else {
+        ret = 0;
+        goto cleanup;
+    }
+
+    VIR_DEBUG("Rollover %s -> %s", from, to);
+
+    if (rename(from, to) < 0 &&
+        errno != ENOENT) {
+        virReportSystemError(errno,
+                             _("Unable to rename %s to %s"),
+                             from, to);
+        goto cleanup;
+    }
+
+    if (unlink(stale) < 0 &&
+        errno != ENOENT) {
+        virReportSystemError(errno,
+                             _("Unable to remove %s"), stale);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(thisgzpath);
+    VIR_FREE(nextgzpath);
+    return ret;
+}
+
+
 static int
 virRotatingFileWriterRollover(virRotatingFileWriterPtr file)
 {
     size_t i;
     char *nextpath = NULL;
     char *thispath = NULL;
+    bool locked = false;
     int ret = -1;
 
     VIR_DEBUG("Rollover %s", file->basepath);
+
     if (file->maxbackup == 0) {
         if (unlink(file->basepath) < 0 &&
             errno != ENOENT) {
@@ -387,6 +998,11 @@ virRotatingFileWriterRollover(virRotatingFileWriterPtr file)
         if (virAsprintf(&nextpath, "%s.%zu", file->basepath, file->maxbackup - 1) < 0)
             return -1;
 
+        /* Backups may be in the middle of being compressed, the
+         * compressor finds them again by inode once it is done */
+        virMutexLock(&virRotatingFileCompressLock);
+        locked = true;
+
         for (i = file->maxbackup; i > 0; i--) {
             if (i == 1) {
                 if (VIR_STRDUP(thispath, file->basepath) < 0)
@@ -395,25 +1011,29 @@ virRotatingFileWriterRollover(virRotatingFileWriterPtr file)
                 if (virAsprintf(&thispath, "%s.%zu", file->basepath, i - 2) < 0)
                     goto cleanup;
             }
-            VIR_DEBUG("Rollover %s -> %s", thispath, nextpath);
 
-            if (rename(thispath, nextpath) < 0 &&
-                errno != ENOENT) {
-                virReportSystemError(errno,
-                                     _("Unable to rename %s to %s"),
-                                     thispath, nextpath);
+            if (virRotatingFileWriterRename(thispath, nextpath) < 0)
                 goto cleanup;
-            }
 
             VIR_FREE(nextpath);
             VIR_STEAL_PTR(nextpath, thispath);
         }
+
+        virMutexUnlock(&virRotatingFileCompressLock);
+        locked = false;
+
+#ifdef WITH_ZLIB
+        if (file->compress)
+            virRotatingFileWriterCompressStart(file);
+#endif
     }
 
     VIR_DEBUG("Rollover done %s", file->basepath);
 
     ret = 0;
  cleanup:
+    if (locked)
+        virMutexUnlock(&virRotatingFileCompressLock);
     VIR_FREE(nextpath);
     VIR_FREE(thispath);
     return ret;
@@ -502,6 +1122,71 @@ virRotatingFileWriterAppend(virRotatingFileWriterPtr file,
 }
 
 
+/**
+ * virRotatingFileWriterAppendFD:
+ * @file: the file context
+ * @fd: the pipe to read data from
+ * @len: the maximum number of bytes to transfer
+ *
+ * Move up to @len bytes from the pipe @fd straight into the
+ * file using splice(), avoiding a copy through userspace.
+ *
+ * This is only possible if the data is guaranteed to fit
+ * in the current file, since the rollover logic needs to
+ * inspect the data to avoid splitting lines. The caller
+ * should fall back to read() and virRotatingFileWriterAppend()
+ * when -2 is returned.
+ *
+ * Returns the number of bytes written, 0 on EOF, -2 if the
+ * data must be transferred with virRotatingFileWriterAppend
+ * instead, or -1 on error
+ */
+#ifdef HAVE_SPLICE
+ssize_t
+virRotatingFileWriterAppendFD(virRotatingFileWriterPtr file,
+                              int fd,
+                              size_t len)
+{
+    ssize_t got;
+
+    if (len == 0 ||
+        file->entry->pos + len > file->maxlen)
+        return -2;
+
+ retry:
+    got = splice(fd, NULL, file->entry->fd, NULL, len,
+                 SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (got < 0) {
+        if (errno == EINTR)
+            goto retry;
+
+        /* The filesystem may not support splice, or there may
+         * be nothing to read. Let the caller deal with it */
+        if (errno == EINVAL || errno == ENOSYS || errno == EAGAIN)
+            return -2;
+
+        virReportSystemError(errno,
+                             _("Unable to write to file %s"),
+                             file->basepath);
+        return -1;
+    }
+
+    file->entry->pos += got;
+    file->entry->len += got;
+
+    return got;
+}
+#else /* !HAVE_SPLICE */
+ssize_t
+virRotatingFileWriterAppendFD(virRotatingFileWriterPtr file ATTRIBUTE_UNUSED,
+                              int fd ATTRIBUTE_UNUSED,
+                              size_t len ATTRIBUTE_UNUSED)
+{
+    return -2;
+}
+#endif /* !HAVE_SPLICE */
+
+
 /**
  * virRotatingFileReaderSeek
  * @file: the file context
@@ -528,7 +1213,7 @@ virRotatingFileReaderSeek(virRotatingFileReaderPtr file,
             entry->fd == -1)
             continue;
 
-        ret = lseek(entry->fd, offset, SEEK_SET);
+        ret = virRotatingFileReaderEntrySeek(entry, offset);
         if (ret == (off_t)-1) {
             virReportSystemError(errno,
                                  _("Unable to seek to inode %llu offset %llu"),
@@ -541,7 +1226,7 @@ virRotatingFileReaderSeek(virRotatingFileReaderPtr file,
     }
 
     file->current = 0;
-    ret = lseek(file->entries[0]->fd, offset, SEEK_SET);
+    ret = virRotatingFileReaderEntrySeek(file->entries[0], offset);
     if (ret == (off_t)-1) {
         virReportSystemError(errno,
                              _("Unable to seek to inode %llu offset %llu"),
@@ -584,7 +1269,7 @@ virRotatingFileReaderConsume(virRotatingFileReaderPtr file,
             continue;
         }
 
-        got = saferead(entry->fd, buf + ret, len);
+        got = virRotatingFileReaderEntryRead(entry, buf + ret, len);
         if (got < 0) {
             virReportSystemError(errno,
                                  _("Unable to read from file %s"),
@@ -44,9 +44,16 @@ const char *virRotatingFileWriterGetPath(virRotatingFileWriterPtr file);
 ino_t virRotatingFileWriterGetINode(virRotatingFileWriterPtr file);
 off_t virRotatingFileWriterGetOffset(virRotatingFileWriterPtr file);
 
+int virRotatingFileWriterSetCompress(virRotatingFileWriterPtr file,
+                                     bool compress);
+void virRotatingFileWriterCompressWait(void);
+
 ssize_t virRotatingFileWriterAppend(virRotatingFileWriterPtr file,
                                     const char *buf,
                                     size_t len);
+ssize_t virRotatingFileWriterAppendFD(virRotatingFileWriterPtr file,
+                                      int fd,
+                                      size_t len);
 
 int virRotatingFileReaderSeek(virRotatingFileReaderPtr file,
                               ino_t inode,
@@ -52,6 +52,7 @@ struct _virThreadPoolJobList {
 
 struct _virThreadPool {
     bool quit;
+    bool drain; /* run queued jobs before quitting */
 
     virThreadPoolJobFunc jobFunc;
     const char *jobFuncName;
@@ -129,7 +130,10 @@ static void virThreadPoolWorker(void *opaque)
                 goto out;
         }
 
-        if (pool->quit)
+        if (pool->quit &&
+            !(pool->drain &&
+              ((!priority && pool->jobList.head) ||
+               (priority && pool->jobList.firstPrio))))
             break;
 
         if (priority) {
@@ -277,7 +281,8 @@ void virThreadPoolFree(virThreadPoolPtr pool)
     pool->quit = true;
     if (pool->nWorkers > 0)
         virCondBroadcast(&pool->cond);
-    if (pool->nPrioWorkers > 0) {
+    /* The priority workers may be gone already if the pool was drained */
+    if (pool->nPrioWorkers > 0 || pool->prioWorkers) {
         priority = true;
         virCondBroadcast(&pool->prioCond);
     }
@@ -303,6 +308,27 @@ void virThreadPoolFree(virThreadPoolPtr pool)
 }
 
 
+/*
+ * Run all queued jobs to completion and stop the workers. No further
+ * jobs are accepted afterwards, the caller must make sure that none
+ * are submitted while this is in progress.
+ */
+void virThreadPoolDrain(virThreadPoolPtr pool)
+{
+    virMutexLock(&pool->mutex);
+    pool->quit = true;
+    pool->drain = true;
+    if (pool->nWorkers > 0)
+        virCondBroadcast(&pool->cond);
+    if (pool->nPrioWorkers > 0)
+        virCondBroadcast(&pool->prioCond);
+
+    while (pool->nWorkers > 0 || pool->nPrioWorkers > 0)
+        ignore_value(virCondWait(&pool->quit_cond, &pool->mutex));
+    virMutexUnlock(&pool->mutex);
+}
+
+
 size_t virThreadPoolGetMinWorkers(virThreadPoolPtr pool)
 {
     size_t ret;
@@ -1567,3 +1567,347 @@ virTypedParamsSerialize(virTypedParameterPtr params,
     virTypedParamsRemoteFree(params_val, nparams);
     return rv;
 }
+
+
+/**
+ * virTypedParamsSameLayout:
+ * @a: first array of typed parameters
+ * @na: number of parameters in @a
+ * @b: second array of typed parameters
+ * @nb: number of parameters in @b
+ *
+ * Checks whether @a and @b contain the same fields with the same types in
+ * the same order, i.e. whether values of one can be packed relative to the
+ * other by virTypedParamsPack.
+ *
+ * Returns true if the layouts match, false otherwise.
+ */
+bool
+virTypedParamsSameLayout(virTypedParameterPtr a,
+                         int na,
+                         virTypedParameterPtr b,
+                         int nb)
+{
+    size_t i;
+
+    if (na != nb)
+        return false;
+
+    for (i = 0; i < na; i++) {
+        if (a[i].type != b[i].type ||
+            STRNEQ(a[i].field, b[i].field))
+            return false;
+    }
+
+    return true;
+}
+
+
+typedef struct _virTypedParamsPackBuf virTypedParamsPackBuf;
+struct _virTypedParamsPackBuf {
+    char *data;
+    size_t len;
+    size_t alloc;
+};
+
+
+static int
+virTypedParamsPackBytes(virTypedParamsPackBuf *buf,
+                        const void *data,
+                        size_t len)
+{
+    if (!len)
+        return 0;
+
+    if (VIR_RESIZE_N(buf->data, buf->alloc, buf->len, len) < 0)
+        return -1;
+
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    return 0;
+}
+
+
+/* Unsigned LEB128 encoding, small values take a single byte */
+static int
+virTypedParamsPackVarint(virTypedParamsPackBuf *buf,
+                         unsigned long long val)
+{
+    unsigned char bytes[10];
+    size_t n = 0;
+
+    do {
+        bytes[n] = val & 0x7f;
+        val >>= 7;
+        if (val)
+            bytes[n] |= 0x80;
+        n++;
+    } while (val);
+
+    return virTypedParamsPackBytes(buf, bytes, n);
+}
+
+
+/* Map signed differences to unsigned ones so that small negative
+ * values stay small as well */
+static unsigned long long
+virTypedParamsZigZag(unsigned long long diff)
+{
+    return (diff << 1) ^ (0 - (diff >> 63));
+}
+
+
+static unsigned long long
+virTypedParamsUnZigZag(unsigned long long val)
+{
+    return (val >> 1) ^ (0 - (val & 1));
+}
+
+
+static unsigned long long
+virTypedParamsPackNumber(virTypedParameterPtr param)
+{
+    unsigned long long val = 0;
+
+    switch ((virTypedParameterType) param->type) {
+    case VIR_TYPED_PARAM_INT:
+        val = (long long) param->value.i;
+        break;
+    case VIR_TYPED_PARAM_UINT:
+        val = param->value.ui;
+        break;
+    case VIR_TYPED_PARAM_LLONG:
+        val = param->value.l;
+        break;
+    case VIR_TYPED_PARAM_ULLONG:
+        val = param->value.ul;
+        break;
+    case VIR_TYPED_PARAM_DOUBLE:
+        verify(sizeof(val) == sizeof(param->value.d));
+        memcpy(&val, &param->value.d, sizeof(val));
+        break;
+    case VIR_TYPED_PARAM_BOOLEAN:
+        val = !!param->value.b;
+        break;
+    case VIR_TYPED_PARAM_STRING:
+    case VIR_TYPED_PARAM_LAST:
+        break;
+    }
+
+    return val;
+}
+
+
+/**
+ * virTypedParamsPack:
+ * @params: array of typed parameters to pack
+ * @nparams: number of parameters in @params
+ * @base: optional array of parameters @params are packed relative to
+ * @nbase: number of parameters in @base
+ * @buf: pointer filled with the packed values
+ * @buflen: pointer filled with the length of @buf
+ *
+ * Packs the values of @params into a compact byte stream. Field names and
+ * types are not included, the receiving side is supposed to know them from
+ * elsewhere. Numbers are stored as variable length integers, so typical
+ * statistics values take only a few bytes each.
+ *
+ * If @base is provided, it has to have the same layout as @params (see
+ * virTypedParamsSameLayout) and numeric values are stored as differences
+ * to the values in @base: counters which barely changed since @base was
+ * sampled are then packed into a single byte. Strings and booleans are
+ * always stored in full.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virTypedParamsPack(virTypedParameterPtr params,
+                   int nparams,
+                   virTypedParameterPtr base,
+                   int nbase,
+                   char **buf,
+                   size_t *buflen)
+{
+    virTypedParamsPackBuf packed = { NULL, 0, 0 };
+    size_t i;
+
+    if (base && !virTypedParamsSameLayout(params, nparams, base, nbase)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot pack parameters relative to a different layout"));
+        goto error;
+    }
+
+    for (i = 0; i < nparams; i++) {
+        virTypedParameterPtr param = params + i;
+        unsigned long long val;
+        unsigned long long prev = 0;
+        size_t len;
+
+        switch ((virTypedParameterType) param->type) {
+        case VIR_TYPED_PARAM_INT:
+        case VIR_TYPED_PARAM_UINT:
+        case VIR_TYPED_PARAM_LLONG:
+        case VIR_TYPED_PARAM_ULLONG:
+            val = virTypedParamsPackNumber(param);
+            if (base)
+                prev = virTypedParamsPackNumber(base + i);
+            if (virTypedParamsPackVarint(&packed,
+                                         virTypedParamsZigZag(val - prev)) < 0)
+                goto error;
+            break;
+
+        case VIR_TYPED_PARAM_DOUBLE:
+            /* Unchanged doubles are packed into a single zero byte */
+            val = virTypedParamsPackNumber(param);
+            if (base)
+                prev = virTypedParamsPackNumber(base + i);
+            if (virTypedParamsPackVarint(&packed, val ^ prev) < 0)
+                goto error;
+            break;
+
+        case VIR_TYPED_PARAM_BOOLEAN:
+            if (virTypedParamsPackVarint(&packed,
+                                         virTypedParamsPackNumber(param)) < 0)
+                goto error;
+            break;
+
+        case VIR_TYPED_PARAM_STRING:
+            len = param->value.s ? strlen(param->value.s) : 0;
+            if (virTypedParamsPackVarint(&packed, len) < 0 ||
+                virTypedParamsPackBytes(&packed, param->value.s, len) < 0)
+                goto error;
+            break;
+
+        case VIR_TYPED_PARAM_LAST:
+        default:
+            virReportError(VIR_ERR_RPC, _("unknown parameter type: %d"),
+                           param->type);
+            goto error;
+        }
+    }
+
+    *buf = packed.data;
+    *buflen = packed.len;
+    return 0;
+
+ error:
+    VIR_FREE(packed.data);
+    return -1;
+}
+
+
+static int
+virTypedParamsUnpackVarint(const unsigned char *buf,
+                           size_t buflen,
+                           size_t *pos,
+                           unsigned long long *val)
+{
+    unsigned int shift = 0;
+
+    *val = 0;
+    while (*pos < buflen && shift < 64) {
+        unsigned char byte = buf[(*pos)++];
+
+        *val |= (unsigned long long) (byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return 0;
+        shift += 7;
+    }
+
+    virReportError(VIR_ERR_RPC, "%s", _("malformed packed parameter value"));
+    return -1;
+}
+
+
+/**
+ * virTypedParamsUnpack:
+ * @buf: packed values as produced by virTypedParamsPack
+ * @buflen: length of @buf
+ * @params: array of parameters with field names and types already filled in
+ * @nparams: number of parameters in @params
+ * @base: array of parameters @buf was packed relative to, or NULL
+ * @nbase: number of parameters in @base
+ *
+ * Fills in the values of @params from @buf. This is the reverse operation
+ * of virTypedParamsPack, the caller must provide the same @base which was
+ * used for packing. On failure, string values which were already filled in
+ * are left in @params and need to be freed by the caller.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virTypedParamsUnpack(const char *buf,
+                     size_t buflen,
+                     virTypedParameterPtr params,
+                     int nparams,
+                     virTypedParameterPtr base,
+                     int nbase)
+{
+    const unsigned char *data = (const unsigned char *) buf;
+    size_t pos = 0;
+    size_t i;
+
+    if (base && !virTypedParamsSameLayout(params, nparams, base, nbase)) {
+        virReportError(VIR_ERR_RPC, "%s",
+                       _("packed parameters do not match their baseline"));
+        return -1;
+    }
+
+    for (i = 0; i < nparams; i++) {
+        virTypedParameterPtr param = params + i;
+        unsigned long long val;
+        unsigned long long prev = 0;
+
+        if (virTypedParamsUnpackVarint(data, buflen, &pos, &val) < 0)
+            return -1;
+
+        if (base && param->type != VIR_TYPED_PARAM_BOOLEAN &&
+            param->type != VIR_TYPED_PARAM_STRING)
+            prev = virTypedParamsPackNumber(base + i);
+
+        switch ((virTypedParameterType) param->type) {
+        case VIR_TYPED_PARAM_INT:
+            param->value.i = virTypedParamsUnZigZag(val) + prev;
+            break;
+        case VIR_TYPED_PARAM_UINT:
+            param->value.ui = virTypedParamsUnZigZag(val) + prev;
+            break;
+        case VIR_TYPED_PARAM_LLONG:
+            param->value.l = virTypedParamsUnZigZag(val) + prev;
+            break;
+        case VIR_TYPED_PARAM_ULLONG:
+            param->value.ul = virTypedParamsUnZigZag(val) + prev;
+            break;
+        case VIR_TYPED_PARAM_DOUBLE:
+            val ^= prev;
+            memcpy(&param->value.d, &val, sizeof(val));
+            break;
+        case VIR_TYPED_PARAM_BOOLEAN:
+            param->value.b = !!val;
+            break;
+        case VIR_TYPED_PARAM_STRING:
+            if (val > buflen - pos) {
+                virReportError(VIR_ERR_RPC, "%s",
+                               _("malformed packed parameter value"));
+                return -1;
+            }
+            if (VIR_STRNDUP(param->value.s, buf + pos, val) < 0)
+                return -1;
+            pos += val;
+            break;
+        case VIR_TYPED_PARAM_LAST:
+        default:
+            virReportError(VIR_ERR_RPC, _("unknown parameter type: %d"),
+                           param->type);
+            return -1;
+        }
+    }
+
+    if (pos != buflen) {
+        virReportError(VIR_ERR_RPC, "%s",
+                       _("trailing data after packed parameters"));
+        return -1;
+    }
+
+    return 0;
+}
@@ -118,6 +118,25 @@ int virTypedParamsSerialize(virTypedParameterPtr params,
                             unsigned int *remote_params_len,
                             unsigned int flags);
 
+bool virTypedParamsSameLayout(virTypedParameterPtr a,
+                              int na,
+                              virTypedParameterPtr b,
+                              int nb);
+
+int virTypedParamsPack(virTypedParameterPtr params,
+                       int nparams,
+                       virTypedParameterPtr base,
+                       int nbase,
+                       char **buf,
+                       size_t *buflen);
+
+int virTypedParamsUnpack(const char *buf,
+                         size_t buflen,
+                         virTypedParameterPtr params,
+                         int nparams,
+                         virTypedParameterPtr base,
+                         int nbase);
+
 VIR_ENUM_DECL(virTypedParameter);
 
 # define VIR_TYPED_PARAMS_DEBUG(params, nparams) \
@@ -31,6 +31,9 @@
 #include "viralloc.h"
 #include "virfile.h"
 #include "virstring.h"
+#include "virhash.h"
+#include "virthread.h"
+#include "virobject.h"
 
 #define VIR_FROM_THIS VIR_FROM_XML
 
@@ -44,6 +47,71 @@ struct virParserData {
 };
 
 
+/* Compiled XPath expressions, keyed by the expression text. The same
+ * handful of expressions are evaluated over and over while parsing
+ * configuration, so compile each of them only once per process. Entries
+ * are never removed, so a looked up expression can be evaluated without
+ * holding the lock. To keep dynamically built expressions from growing
+ * the table without bound, once it is full any new expression is
+ * compiled for a single use only. */
+#define VIR_XPATH_CACHE_MAX 2048
+
+static virMutex virXPathCacheLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr virXPathCache;
+
+
+static void
+virXPathCacheDataFree(void *payload,
+                      const void *name ATTRIBUTE_UNUSED)
+{
+    xmlXPathFreeCompExpr(payload);
+}
+
+
+/**
+ * virXPathEval:
+ * @xpath: the XPath string to evaluate
+ * @ctxt: an XPath context
+ *
+ * Drop-in replacement for xmlXPathEval() which reuses the compiled form
+ * of @xpath from earlier calls.
+ *
+ * Returns the resulting XPath object or NULL if the evaluation failed.
+ */
+static xmlXPathObjectPtr
+virXPathEval(const char *xpath,
+             xmlXPathContextPtr ctxt)
+{
+    xmlXPathCompExprPtr comp = NULL;
+    xmlXPathCompExprPtr tmp = NULL;
+    xmlXPathObjectPtr obj;
+
+    virMutexLock(&virXPathCacheLock);
+
+    if (!virXPathCache)
+        virXPathCache = virHashCreate(64, virXPathCacheDataFree);
+
+    if (virXPathCache)
+        comp = virHashLookup(virXPathCache, xpath);
+
+    if (!comp && (comp = xmlXPathCompile(BAD_CAST xpath))) {
+        if (!virXPathCache ||
+            virHashSize(virXPathCache) >= VIR_XPATH_CACHE_MAX ||
+            virHashAddEntry(virXPathCache, xpath, comp) < 0)
+            tmp = comp;
+    }
+
+    virMutexUnlock(&virXPathCacheLock);
+
+    if (!comp)
+        return NULL;
+
+    obj = xmlXPathCompiledEval(comp, ctxt);
+    xmlXPathFreeCompExpr(tmp);
+    return obj;
+}
+
+
 /**
  * virXPathString:
  * @xpath: the XPath string to evaluate
@@ -68,7 +136,7 @@ virXPathString(const char *xpath,
         return NULL;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_STRING) ||
         (obj->stringval == NULL) || (obj->stringval[0] == 0)) {
@@ -145,7 +213,7 @@ virXPathNumber(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_NUMBER) ||
         (isnan(obj->floatval))) {
@@ -174,7 +242,7 @@ virXPathLongBase(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -279,7 +347,7 @@ virXPathULongBase(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -395,7 +463,7 @@ virXPathULongLong(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -441,7 +509,7 @@ virXPathLongLong(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -567,7 +635,7 @@ virXPathBoolean(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_BOOLEAN) ||
         (obj->boolval < 0) || (obj->boolval > 1)) {
@@ -604,7 +672,7 @@ virXPathNode(const char *xpath,
         return NULL;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_NODESET) ||
         (obj->nodesetval == NULL) || (obj->nodesetval->nodeNr <= 0) ||
@@ -648,7 +716,7 @@ virXPathNodeSet(const char *xpath,
         *list = NULL;
 
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if (obj == NULL)
         return 0;
@@ -1238,38 +1306,54 @@ static void ignoreRNGError(void *ctx ATTRIBUTE_UNUSED,
 {}
 
 
-virXMLValidatorPtr
-virXMLValidatorInit(const char *schemafile)
+static xmlRelaxNGPtr
+virXMLRelaxNGParse(const char *schemafile)
 {
-    virXMLValidatorPtr validator = NULL;
-
-    if (VIR_ALLOC(validator) < 0)
-        return NULL;
-
-    if (VIR_STRDUP(validator->schemafile, schemafile) < 0)
-        goto error;
+    xmlRelaxNGParserCtxtPtr rngParser = NULL;
+    xmlRelaxNGPtr rng = NULL;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
 
-    if (!(validator->rngParser =
-          xmlRelaxNGNewParserCtxt(validator->schemafile))) {
+    if (!(rngParser = xmlRelaxNGNewParserCtxt(schemafile))) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Unable to create RNG parser for %s"),
-                       validator->schemafile);
-        goto error;
+                       schemafile);
+        goto cleanup;
     }
 
-    xmlRelaxNGSetParserErrors(validator->rngParser,
+    xmlRelaxNGSetParserErrors(rngParser,
                               catchRNGError,
                               ignoreRNGError,
-                              &validator->buf);
+                              &buf);
 
-    if (!(validator->rng = xmlRelaxNGParse(validator->rngParser))) {
+    if (!(rng = xmlRelaxNGParse(rngParser))) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Unable to parse RNG %s: %s"),
-                       validator->schemafile,
-                       virBufferCurrentContent(&validator->buf));
-        goto error;
+                       schemafile,
+                       virBufferCurrentContent(&buf));
+        goto cleanup;
     }
 
+ cleanup:
+    xmlRelaxNGFreeParserCtxt(rngParser);
+    virBufferFreeAndReset(&buf);
+    return rng;
+}
+
+
+virXMLValidatorPtr
+virXMLValidatorInit(const char *schemafile)
+{
+    virXMLValidatorPtr validator = NULL;
+
+    if (VIR_ALLOC(validator) < 0)
+        return NULL;
+
+    if (VIR_STRDUP(validator->schemafile, schemafile) < 0)
+        goto error;
+
+    if (!(validator->rng = virXMLRelaxNGParse(validator->schemafile)))
+        goto error;
+
     if (!(validator->rngValid = xmlRelaxNGNewValidCtxt(validator->rng))) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Unable to create RNG validation context %s"),
@@ -1310,22 +1394,149 @@ virXMLValidatorValidate(virXMLValidatorPtr validator,
 }
 
 
+/* Parsed schemas shared by all callers of virXMLValidateAgainstSchema(),
+ * keyed by the schema file name. The parsed grammar is read-only once
+ * built, so it is safe to validate against it from several threads at
+ * once as long as each of them uses its own validation context. A schema
+ * is parsed again once its file is seen to have been modified or
+ * replaced; callers still holding the old one keep a reference to it. */
+typedef struct _virXMLSchema virXMLSchema;
+typedef virXMLSchema *virXMLSchemaPtr;
+struct _virXMLSchema {
+    virObject parent;
+
+    xmlRelaxNGPtr rng;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+};
+
+static virClassPtr virXMLSchemaClass;
+static virHashTablePtr virXMLSchemaCache;
+static virMutex virXMLSchemaLock = VIR_MUTEX_INITIALIZER;
+
+static void
+virXMLSchemaDispose(void *obj)
+{
+    virXMLSchemaPtr schema = obj;
+
+    xmlRelaxNGFree(schema->rng);
+}
+
+
+static int
+virXMLSchemaOnceInit(void)
+{
+    if (!VIR_CLASS_NEW(virXMLSchema, virClassForObject()))
+        return -1;
+
+    if (!(virXMLSchemaCache = virHashCreate(8, virObjectFreeHashData)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virXMLSchema);
+
+
+/**
+ * virXMLSchemaGet:
+ * @schemafile: path to the RelaxNG schema
+ *
+ * Look up the parsed @schemafile, parsing it first if it was not seen
+ * yet or if the file changed since it was last parsed.
+ *
+ * Returns a new reference to the schema or NULL on error.
+ */
+static virXMLSchemaPtr
+virXMLSchemaGet(const char *schemafile)
+{
+    virXMLSchemaPtr schema = NULL;
+    struct stat sb;
+
+    if (virXMLSchemaInitialize() < 0)
+        return NULL;
+
+    if (stat(schemafile, &sb) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to access RNG %s"),
+                             schemafile);
+        return NULL;
+    }
+
+    virMutexLock(&virXMLSchemaLock);
+
+    if ((schema = virHashLookup(virXMLSchemaCache, schemafile)) &&
+        schema->dev == sb.st_dev &&
+        schema->ino == sb.st_ino &&
+        schema->size == sb.st_size &&
+        schema->mtime == sb.st_mtime) {
+        virObjectRef(schema);
+        goto cleanup;
+    }
+
+    if (!(schema = virObjectNew(virXMLSchemaClass)))
+        goto cleanup;
+
+    schema->dev = sb.st_dev;
+    schema->ino = sb.st_ino;
+    schema->size = sb.st_size;
+    schema->mtime = sb.st_mtime;
+
+    if (!(schema->rng = virXMLRelaxNGParse(schemafile)) ||
+        virHashUpdateEntry(virXMLSchemaCache, schemafile, schema) < 0) {
+        virObjectUnref(schema);
+        schema = NULL;
+        goto cleanup;
+    }
+
+    /* one reference is owned by the cache, the other by the caller */
+    virObjectRef(schema);
+
+ cleanup:
+    virMutexUnlock(&virXMLSchemaLock);
+    return schema;
+}
+
+
 int
 virXMLValidateAgainstSchema(const char *schemafile,
                             xmlDocPtr doc)
 {
-    virXMLValidatorPtr validator = NULL;
+    virXMLSchemaPtr schema = NULL;
+    xmlRelaxNGValidCtxtPtr rngValid = NULL;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
     int ret = -1;
 
-    if (!(validator = virXMLValidatorInit(schemafile)))
+    if (!(schema = virXMLSchemaGet(schemafile)))
         return -1;
 
-    if (virXMLValidatorValidate(validator, doc) < 0)
+    if (!(rngValid = xmlRelaxNGNewValidCtxt(schema->rng))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unable to create RNG validation context %s"),
+                       schemafile);
         goto cleanup;
+    }
+
+    xmlRelaxNGSetValidErrors(rngValid,
+                             catchRNGError,
+                             ignoreRNGError,
+                             &buf);
+
+    if (xmlRelaxNGValidateDoc(rngValid, doc) != 0) {
+        virReportError(VIR_ERR_XML_INVALID_SCHEMA,
+                       _("Unable to validate doc against %s\n%s"),
+                       schemafile,
+                       virBufferCurrentContent(&buf));
+        goto cleanup;
+    }
 
     ret = 0;
  cleanup:
-    virXMLValidatorFree(validator);
+    xmlRelaxNGFreeValidCtxt(rngValid);
+    virBufferFreeAndReset(&buf);
+    virObjectUnref(schema);
     return ret;
 }
 
@@ -1338,7 +1549,6 @@ virXMLValidatorFree(virXMLValidatorPtr validator)
 
     VIR_FREE(validator->schemafile);
     virBufferFreeAndReset(&validator->buf);
-    xmlRelaxNGFreeParserCtxt(validator->rngParser);
     xmlRelaxNGFreeValidCtxt(validator->rngValid);
     xmlRelaxNGFree(validator->rng);
     VIR_FREE(validator);
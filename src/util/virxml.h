@@ -192,7 +192,6 @@ int virXMLCheckIllegalChars(const char *nodeName,
                             const char *illegal);
 
 struct _virXMLValidator {
-    xmlRelaxNGParserCtxtPtr rngParser;
     xmlRelaxNGPtr rng;
     xmlRelaxNGValidCtxtPtr rngValid;
     virBuffer buf;
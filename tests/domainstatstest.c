@@ -0,0 +1,247 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library;  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#include "virerror.h"
+#include "viralloc.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/* Number of domains the test driver has, including the default one */
+#define NDOMAINS 7
+
+struct testChunkData {
+    virConnectPtr conn;
+    unsigned int chunk;
+    bool vanish; /* destroy the last listed transient domain once the
+                    first record is received */
+    bool abort; /* fail the callback on the second record */
+
+    char **names; /* names in the order they are listed */
+    size_t nnames;
+    size_t victim; /* index of the domain to destroy in @names */
+    size_t nrecords; /* number of records received so far */
+    size_t pos; /* position in @names of the next expected record */
+    bool fail;
+};
+
+
+static int
+testChunkCallback(virConnectPtr conn,
+                  virDomainStatsRecordPtr record,
+                  void *opaque)
+{
+    struct testChunkData *data = opaque;
+    const char *name = virDomainGetName(record->dom);
+    int state;
+
+    if (data->abort && data->nrecords == 1)
+        return -1;
+
+    /* The destroyed domain might be skipped */
+    if (data->vanish && data->pos == data->victim &&
+        data->pos < data->nnames &&
+        STRNEQ(name, data->names[data->pos]))
+        data->pos++;
+
+    if (data->pos >= data->nnames ||
+        STRNEQ(name, data->names[data->pos])) {
+        fprintf(stderr, "unexpected record %zu: %s\n", data->nrecords, name);
+        data->fail = true;
+    }
+    data->pos++;
+
+    if (virTypedParamsGetInt(record->params, record->nparams,
+                             "state.state", &state) != 1 ||
+        state != VIR_DOMAIN_RUNNING) {
+        fprintf(stderr, "missing or wrong state of %s\n", name);
+        data->fail = true;
+    }
+
+    if (data->vanish && data->nrecords == 0) {
+        virDomainPtr dom;
+
+        if (!(dom = virDomainLookupByName(conn, data->names[data->victim])) ||
+            virDomainDestroy(dom) < 0)
+            data->fail = true;
+        virObjectUnref(dom);
+    }
+
+    data->nrecords++;
+    return 0;
+}
+
+
+static int
+testCreateDomains(virConnectPtr conn)
+{
+    virDomainPtr dom;
+    char *xml = NULL;
+    size_t i;
+
+    for (i = 1; i < NDOMAINS; i++) {
+        if (virAsprintf(&xml,
+                        "<domain type='test'>"
+                        "  <name>stats%zu</name>"
+                        "  <memory>8192</memory>"
+                        "  <os>"
+                        "    <type>hvm</type>"
+                        "  </os>"
+                        "</domain>", i) < 0)
+            return -1;
+
+        /* Domains destroyed by previous test cases are created again */
+        if ((dom = virDomainCreateXML(conn, xml, 0)))
+            virObjectUnref(dom);
+        virResetLastError();
+        VIR_FREE(xml);
+    }
+
+    return 0;
+}
+
+
+static int
+testChunk(const void *opaque)
+{
+    struct testChunkData data = *(const struct testChunkData *) opaque;
+    virDomainPtr *doms = NULL;
+    int ndoms = 0;
+    size_t expected;
+    int rc;
+    size_t i;
+    int ret = -1;
+
+    if (testCreateDomains(data.conn) < 0)
+        return -1;
+
+    if ((ndoms = virConnectListAllDomains(data.conn, &doms, 0)) < 0)
+        return -1;
+
+    if (ndoms != NDOMAINS) {
+        fprintf(stderr, "expected %d domains, got %d\n", NDOMAINS, ndoms);
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(data.names, ndoms) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ndoms; i++) {
+        if (VIR_STRDUP(data.names[i], virDomainGetName(doms[i])) < 0)
+            goto cleanup;
+        data.nnames++;
+
+        /* The default domain is persistent, destroying it would not
+         * make it go away. */
+        if (STRNEQ(data.names[i], "test"))
+            data.victim = i;
+    }
+
+    rc = virConnectGetAllDomainStatsChunked(data.conn, VIR_DOMAIN_STATS_STATE,
+                                            data.chunk, testChunkCallback,
+                                            &data, 0);
+
+    if (data.abort) {
+        if (rc >= 0 || data.nrecords != 1) {
+            fprintf(stderr, "aborting the callback didn't stop the query\n");
+            goto cleanup;
+        }
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (rc < 0)
+        goto cleanup;
+
+    /* Records of a chunk are collected when the chunk is requested,
+     * therefore the domain destroyed while processing the first chunk
+     * is reported only if it was in that chunk too. */
+    expected = ndoms;
+    if (data.vanish && data.chunk != 0 && data.victim >= data.chunk)
+        expected--;
+
+    if (rc != data.nrecords || data.nrecords != expected) {
+        fprintf(stderr, "expected %zu records, got %zu (returned %d)\n",
+                expected, data.nrecords, rc);
+        goto cleanup;
+    }
+
+    if (data.fail)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    for (i = 0; i < data.nnames; i++)
+        VIR_FREE(data.names[i]);
+    VIR_FREE(data.names);
+    for (i = 0; i < ndoms; i++)
+        virObjectUnref(doms[i]);
+    VIR_FREE(doms);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    virConnectPtr conn;
+    int ret = EXIT_SUCCESS;
+
+    if (!(conn = virConnectOpen("test:///default")))
+        return EXIT_FAILURE;
+
+    virTestQuiesceLibvirtErrors(false);
+
+#define DO_TEST_FULL(name, c, v, a) \
+    do { \
+        struct testChunkData data = { \
+            .conn = conn, .chunk = c, .vanish = v, .abort = a, \
+        }; \
+        if (virTestRun(name, testChunk, &data) < 0) \
+            ret = EXIT_FAILURE; \
+    } while (0)
+
+#define DO_TEST(c) \
+    DO_TEST_FULL("chunk " #c, c, false, false)
+#define DO_TEST_VANISH(c) \
+    DO_TEST_FULL("chunk " #c " vanish", c, true, false)
+
+    DO_TEST(0);
+    DO_TEST(1);
+    DO_TEST(2);
+    DO_TEST(3);
+    DO_TEST(6);
+    DO_TEST(7);
+    DO_TEST(8);
+
+    DO_TEST_VANISH(0);
+    DO_TEST_VANISH(1);
+    DO_TEST_VANISH(3);
+    DO_TEST_VANISH(6);
+    DO_TEST_VANISH(7);
+
+    DO_TEST_FULL("abort", 2, false, true);
+
+    virConnectClose(conn);
+
+    return ret;
+}
+
+VIR_TEST_MAIN(mymain)
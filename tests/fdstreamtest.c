@@ -313,6 +313,196 @@ static int testFDStreamWriteNonblock(const void *data)
     return testFDStreamWriteCommon(data, false);
 }
 
+static int
+testFDStreamBuffersRead(const void *opaque)
+{
+    const char *scratchdir = opaque;
+    size_t size = VIR_FDSTREAM_CHUNK_SIZE * 10 + 100;
+    size_t total = 0;
+    virFDStreamStats stats;
+    virConnectPtr conn = NULL;
+    virStreamPtr st = NULL;
+    char *file = NULL;
+    char *buf = NULL;
+    int fd = -1;
+    int ret = -1;
+
+    if (!(conn = virConnectOpen("test:///default")))
+        goto cleanup;
+
+    if (virAsprintf(&file, "%s/buffers-read.data", scratchdir) < 0 ||
+        VIR_ALLOC_N(buf, VIR_FDSTREAM_CHUNK_SIZE) < 0)
+        goto cleanup;
+
+    if ((fd = open(file, O_CREAT|O_WRONLY|O_EXCL, 0600)) < 0 ||
+        ftruncate(fd, size) < 0 ||
+        VIR_CLOSE(fd) < 0)
+        goto cleanup;
+
+    /* Only non-blocking streams of regular files use the I/O thread */
+    if (!(st = virStreamNew(conn, VIR_STREAM_NONBLOCK)) ||
+        virFDStreamOpenFile(st, file, 0, 0, O_RDONLY) < 0)
+        goto cleanup;
+
+    while (1) {
+        int got = st->driver->streamRecv(st, buf, VIR_FDSTREAM_CHUNK_SIZE);
+
+        if (got == -2) {
+            usleep(1000);
+            continue;
+        }
+        if (got < 0) {
+            virFilePrintf(stderr, "Failed to read stream: %s\n",
+                          virGetLastErrorMessage());
+            goto cleanup;
+        }
+        if (got == 0)
+            break;
+        total += got;
+    }
+
+    if (virFDStreamGetStats(st, &stats) < 0)
+        goto cleanup;
+
+    if (total != size || stats.bytes != size) {
+        virFilePrintf(stderr, "Expected %zu bytes, read %zu, thread %llu\n",
+                      size, total, stats.bytes);
+        goto cleanup;
+    }
+
+    /* The thread never queues more than VIR_FDSTREAM_QUEUE_MAX chunks
+     * and allocates only when no consumed one is left for reuse. */
+    if (stats.nbufs > VIR_FDSTREAM_QUEUE_MAX ||
+        stats.nspare > VIR_FDSTREAM_QUEUE_MAX) {
+        virFilePrintf(stderr, "Too many buffers: allocated %zu, spare %zu\n",
+                      stats.nbufs, stats.nspare);
+        goto cleanup;
+    }
+
+    if (st->driver->streamFinish(st) != 0) {
+        virFilePrintf(stderr, "Failed to finish stream: %s\n",
+                      virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    if (st)
+        virStreamFree(st);
+    VIR_FORCE_CLOSE(fd);
+    if (file != NULL)
+        unlink(file);
+    if (conn)
+        virConnectClose(conn);
+    VIR_FREE(file);
+    VIR_FREE(buf);
+    return ret;
+}
+
+
+/* Sends @len bytes of @buf and waits for the I/O thread to write them,
+ * so that the message is back in the spare list when this returns. */
+static int
+testFDStreamSendDrain(virStreamPtr st,
+                      const char *buf,
+                      size_t len,
+                      unsigned long long *sent)
+{
+    virFDStreamStats stats;
+    size_t retries = 5000;
+    int got;
+
+    while ((got = st->driver->streamSend(st, buf, len)) == -2)
+        usleep(1000);
+
+    if (got < 0 || (size_t) got != len) {
+        virFilePrintf(stderr, "Failed to write stream: %s\n",
+                      virGetLastErrorMessage());
+        return -1;
+    }
+    *sent += len;
+
+    while (retries--) {
+        if (virFDStreamGetStats(st, &stats) < 0)
+            return -1;
+        if (stats.bytes == *sent)
+            return 0;
+        usleep(1000);
+    }
+
+    virFilePrintf(stderr, "Thread wrote %llu bytes out of %llu\n",
+                  stats.bytes, *sent);
+    return -1;
+}
+
+
+static int
+testFDStreamBuffersWrite(const void *opaque)
+{
+    const char *scratchdir = opaque;
+    const size_t sizes[] = { 100, 4096, 1000 };
+    unsigned long long sent = 0;
+    virFDStreamStats stats;
+    virConnectPtr conn = NULL;
+    virStreamPtr st = NULL;
+    char *file = NULL;
+    char *buf = NULL;
+    struct stat sb;
+    size_t i;
+    int ret = -1;
+
+    if (!(conn = virConnectOpen("test:///default")))
+        goto cleanup;
+
+    if (virAsprintf(&file, "%s/buffers-write.data", scratchdir) < 0 ||
+        VIR_ALLOC_N(buf, 4096) < 0)
+        goto cleanup;
+
+    if (!(st = virStreamNew(conn, VIR_STREAM_NONBLOCK)) ||
+        virFDStreamCreateFile(st, file, 0, 0, O_WRONLY, 0600) < 0)
+        goto cleanup;
+
+    /* A short write first, the following bigger one must not leave
+     * its buffer behind in the spare list. */
+    for (i = 0; i < 20; i++) {
+        if (testFDStreamSendDrain(st, buf, sizes[i % ARRAY_CARDINALITY(sizes)],
+                                  &sent) < 0)
+            goto cleanup;
+    }
+
+    if (virFDStreamGetStats(st, &stats) < 0)
+        goto cleanup;
+
+    if (stats.nbufs != 2 || stats.nspare != 1) {
+        virFilePrintf(stderr, "Expected 2 buffers allocated and 1 spare, "
+                      "got %zu and %zu\n", stats.nbufs, stats.nspare);
+        goto cleanup;
+    }
+
+    if (st->driver->streamFinish(st) != 0) {
+        virFilePrintf(stderr, "Failed to finish stream: %s\n",
+                      virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    if (stat(file, &sb) < 0 || (unsigned long long) sb.st_size != sent) {
+        virFilePrintf(stderr, "Expected %llu bytes in %s\n", sent, file);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    if (st)
+        virStreamFree(st);
+    if (file != NULL)
+        unlink(file);
+    if (conn)
+        virConnectClose(conn);
+    VIR_FREE(file);
+    VIR_FREE(buf);
+    return ret;
+}
+
 #define SCRATCHDIRTEMPLATE abs_builddir "/fdstreamdir-XXXXXX"
 
 static int
@@ -334,6 +524,10 @@ mymain(void)
         ret = -1;
     if (virTestRun("Stream write non-blocking ", testFDStreamWriteNonblock, scratchdir) < 0)
         ret = -1;
+    if (virTestRun("Stream read buffers ", testFDStreamBuffersRead, scratchdir) < 0)
+        ret = -1;
+    if (virTestRun("Stream write buffers ", testFDStreamBuffersWrite, scratchdir) < 0)
+        ret = -1;
 
     if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
         virFileDeleteTree(scratchdir);
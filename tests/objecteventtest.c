@@ -21,8 +21,14 @@
 
 #include "testutils.h"
 
+#include "datatypes.h"
 #include "virerror.h"
 #include "virxml.h"
+#include "virtime.h"
+#include "virstring.h"
+#include "virtypedparam.h"
+#include "domain_event.h"
+#include "object_event.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -92,6 +98,12 @@ lifecycleEventCounter_reset(lifecycleEventCounter *counter)
     counter->deletedEvents = 0;
 }
 
+typedef struct {
+    int calls;
+    int stateParams;
+    int balloonParams;
+} statsEventCounter;
+
 typedef struct {
     virConnectPtr conn;
     virNetworkPtr net;
@@ -823,6 +835,281 @@ testNodeDeviceCreateXML(const void *data)
     return ret;
 }
 
+static void
+domainStatsCb(virConnectPtr conn ATTRIBUTE_UNUSED,
+              virDomainPtr dom ATTRIBUTE_UNUSED,
+              virTypedParameterPtr params,
+              int nparams,
+              void *opaque)
+{
+    statsEventCounter *counter = opaque;
+    size_t i;
+
+    counter->calls++;
+    for (i = 0; i < nparams; i++) {
+        if (STRPREFIX(params[i].field, "state."))
+            counter->stateParams++;
+        else if (STRPREFIX(params[i].field, "balloon."))
+            counter->balloonParams++;
+    }
+}
+
+static virObjectEventPtr
+testDomainStatsEventNew(const int *due, size_t ndue)
+{
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    int maxparams = 0;
+    unsigned int *groups = NULL;
+    unsigned char uuid[VIR_UUID_BUFLEN];
+
+    if (virUUIDParse("77a6fc12-07b5-9415-8abb-a803613f2a40", uuid) < 0 ||
+        virTypedParamsAddInt(&params, &nparams, &maxparams,
+                             "state.state", VIR_DOMAIN_RUNNING) < 0 ||
+        virTypedParamsAddInt(&params, &nparams, &maxparams,
+                             "state.reason", 0) < 0 ||
+        virTypedParamsAddULLong(&params, &nparams, &maxparams,
+                                "balloon.current", 1024) < 0 ||
+        VIR_ALLOC_N(groups, nparams) < 0) {
+        virTypedParamsFree(params, nparams);
+        return NULL;
+    }
+
+    groups[0] = groups[1] = VIR_DOMAIN_STATS_STATE;
+    groups[2] = VIR_DOMAIN_STATS_BALLOON;
+
+    return virDomainStatsEventNew(1, "test-domain", uuid, params, nparams,
+                                  groups, due, ndue);
+}
+
+static int
+testDomainStatsEvent(const void *data)
+{
+    const objecteventTest *test = data;
+    virObjectEventStatePtr state;
+    statsEventCounter stateCounter = { 0 };
+    statsEventCounter allCounter = { 0 };
+    int stateID = -1;
+    int allID = -1;
+    int due[2];
+    virObjectEventPtr event;
+    int ret = -1;
+
+    if (!(state = virObjectEventStateNew()))
+        return -1;
+
+    if (virDomainStatsEventStateRegisterID(test->conn, state, NULL,
+                                           VIR_DOMAIN_STATS_STATE,
+                                           domainStatsCb, &stateCounter,
+                                           NULL, &stateID) < 0 ||
+        virDomainStatsEventStateRegisterID(test->conn, state, NULL, 0,
+                                           domainStatsCb, &allCounter,
+                                           NULL, &allID) < 0)
+        goto cleanup;
+
+    /* A sample taken for both subscriptions feeds each with its own
+     * groups only */
+    due[0] = stateID;
+    due[1] = allID;
+    if (!(event = testDomainStatsEventNew(due, 2)))
+        goto cleanup;
+    virObjectEventStateQueue(state, event);
+    if (virEventRunDefaultImpl() < 0)
+        goto cleanup;
+
+    if (stateCounter.calls != 1 || stateCounter.stateParams != 2 ||
+        stateCounter.balloonParams != 0 ||
+        allCounter.calls != 1 || allCounter.stateParams != 2 ||
+        allCounter.balloonParams != 1)
+        goto cleanup;
+
+    /* A sample taken for one subscription must not reach the other */
+    if (!(event = testDomainStatsEventNew(&allID, 1)))
+        goto cleanup;
+    virObjectEventStateQueue(state, event);
+    if (virEventRunDefaultImpl() < 0)
+        goto cleanup;
+
+    if (stateCounter.calls != 1 || allCounter.calls != 2)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    if (stateID >= 0)
+        virObjectEventStateDeregisterID(test->conn, state, stateID, true);
+    if (allID >= 0)
+        virObjectEventStateDeregisterID(test->conn, state, allID, true);
+    virObjectUnref(state);
+    return ret;
+}
+
+#define TEST_DISPATCH_DOMAINS 10000
+#define TEST_DISPATCH_EVENTS 1000
+
+typedef struct {
+    size_t *seq;
+    size_t calls;
+    size_t last;
+} dispatchCounter;
+
+static int
+domainDispatchCb(virConnectPtr conn ATTRIBUTE_UNUSED,
+                 virDomainPtr dom ATTRIBUTE_UNUSED,
+                 int event ATTRIBUTE_UNUSED,
+                 int detail ATTRIBUTE_UNUSED,
+                 void *opaque)
+{
+    dispatchCounter *counter = opaque;
+
+    counter->calls++;
+    counter->last = ++(*counter->seq);
+    return 0;
+}
+
+static virObjectEventPtr
+testDomainDispatchEventNew(virDomainPtr dom)
+{
+    return virDomainEventLifecycleNew(-1, dom->name, dom->uuid,
+                                      VIR_DOMAIN_EVENT_STARTED,
+                                      VIR_DOMAIN_EVENT_STARTED_BOOTED);
+}
+
+/* Every domain gets its own lifecycle callback, so dispatching an event
+ * must only reach the callback of that domain and the global ones, in
+ * the order they were registered.  The number of events can be raised
+ * through VIR_TEST_EVENT_DISPATCH_EVENTS and the time taken is printed
+ * with VIR_TEST_DEBUG=1 to benchmark dispatching. */
+static int
+testDomainEventDispatch(const void *data)
+{
+    const objecteventTest *test = data;
+    const char *env = getenv("VIR_TEST_EVENT_DISPATCH_EVENTS");
+    size_t nevents = TEST_DISPATCH_EVENTS;
+    size_t ndoms = TEST_DISPATCH_DOMAINS;
+    virConnectDomainEventGenericCallback cb;
+    virObjectEventStatePtr state;
+    virDomainPtr *doms = NULL;
+    dispatchCounter *counters = NULL;
+    int *ids = NULL;
+    dispatchCounter global = { 0 };
+    dispatchCounter late = { 0 };
+    int globalID = -1;
+    int lateID = -1;
+    size_t seq = 0;
+    unsigned long long then;
+    unsigned long long now;
+    size_t i;
+    int ret = -1;
+
+    if (env && virStrToLong_ulp(env, NULL, 10, &nevents) < 0)
+        return -1;
+
+    if (!(state = virObjectEventStateNew()))
+        return -1;
+
+    if (VIR_ALLOC_N(doms, ndoms) < 0 ||
+        VIR_ALLOC_N(counters, ndoms) < 0 ||
+        VIR_ALLOC_N(ids, ndoms) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ndoms; i++)
+        ids[i] = -1;
+
+    for (i = 0; i < ndoms; i++) {
+        unsigned char uuid[VIR_UUID_BUFLEN] = { 0 };
+        char name[32];
+
+        memcpy(uuid, &i, sizeof(i));
+        snprintf(name, sizeof(name), "dispatch%zu", i);
+        counters[i].seq = &seq;
+        if (!(doms[i] = virGetDomain(test->conn, name, uuid, -1)))
+            goto cleanup;
+    }
+
+    global.seq = &seq;
+    late.seq = &seq;
+    cb = VIR_DOMAIN_EVENT_CALLBACK(domainDispatchCb);
+
+    if (virDomainEventStateRegisterID(test->conn, state, doms[0],
+                                      VIR_DOMAIN_EVENT_ID_LIFECYCLE, cb,
+                                      &counters[0], NULL, &ids[0]) < 0 ||
+        virDomainEventStateRegisterID(test->conn, state, NULL,
+                                      VIR_DOMAIN_EVENT_ID_LIFECYCLE, cb,
+                                      &global, NULL, &globalID) < 0 ||
+        virDomainEventStateRegisterID(test->conn, state, doms[0],
+                                      VIR_DOMAIN_EVENT_ID_LIFECYCLE, cb,
+                                      &late, NULL, &lateID) < 0)
+        goto cleanup;
+
+    for (i = 1; i < ndoms; i++) {
+        if (virDomainEventStateRegisterID(test->conn, state, doms[i],
+                                          VIR_DOMAIN_EVENT_ID_LIFECYCLE, cb,
+                                          &counters[i], NULL, &ids[i]) < 0)
+            goto cleanup;
+    }
+
+    /* Global and per-domain callbacks keep their registration order */
+    virObjectEventStateQueue(state, testDomainDispatchEventNew(doms[0]));
+    if (virEventRunDefaultImpl() < 0)
+        goto cleanup;
+
+    if (counters[0].calls != 1 || global.calls != 1 || late.calls != 1 ||
+        counters[1].calls != 0 ||
+        !(counters[0].last < global.last && global.last < late.last)) {
+        fprintf(stderr, "unexpected dispatch of the first event\n");
+        goto cleanup;
+    }
+
+    for (i = 0; i < nevents; i++)
+        virObjectEventStateQueue(state,
+                                 testDomainDispatchEventNew(doms[i % ndoms]));
+
+    if (virTimeMillisNow(&then) < 0 ||
+        virEventRunDefaultImpl() < 0 ||
+        virTimeMillisNow(&now) < 0)
+        goto cleanup;
+
+    VIR_TEST_DEBUG("dispatch of %zu events to %zu callbacks: %llu ms",
+                   nevents, ndoms + 2, now - then);
+
+    if (global.calls != nevents + 1) {
+        fprintf(stderr, "global callback got %zu events, expected %zu\n",
+                global.calls, nevents + 1);
+        goto cleanup;
+    }
+
+    for (i = 0; i < ndoms; i++) {
+        size_t expected = nevents / ndoms + (i < nevents % ndoms);
+
+        if (i == 0)
+            expected++;
+        if (counters[i].calls != expected) {
+            fprintf(stderr, "domain %zu got %zu events, expected %zu\n",
+                    i, counters[i].calls, expected);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (globalID >= 0)
+        virObjectEventStateDeregisterID(test->conn, state, globalID, true);
+    if (lateID >= 0)
+        virObjectEventStateDeregisterID(test->conn, state, lateID, true);
+    for (i = 0; ids && i < ndoms; i++) {
+        if (ids[i] >= 0)
+            virObjectEventStateDeregisterID(test->conn, state, ids[i], true);
+        virObjectUnref(doms[i]);
+    }
+    VIR_FREE(doms);
+    VIR_FREE(counters);
+    VIR_FREE(ids);
+    virObjectUnref(state);
+    return ret;
+}
+
 static void
 timeout(int id ATTRIBUTE_UNUSED, void *opaque ATTRIBUTE_UNUSED)
 {
@@ -862,6 +1149,10 @@ mymain(void)
         ret = EXIT_FAILURE;
     if (virTestRun("Domain start stop events", testDomainStartStopEvent, &test) < 0)
         ret = EXIT_FAILURE;
+    if (virTestRun("Domain stats subscriptions", testDomainStatsEvent, &test) < 0)
+        ret = EXIT_FAILURE;
+    if (virTestRun("Domain event dispatch", testDomainEventDispatch, &test) < 0)
+        ret = EXIT_FAILURE;
 
     /* Network event tests */
     /* Tests requiring the test network not to be set up*/
@@ -0,0 +1,41 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "internal.h"
+
+/* stat() on the path in this variable fails as if the file was removed,
+ * without the file actually changing and generating any inotify events */
+#define ENVVAR "QEMU_CAPS_CACHE_HIDE"
+
+#define VIR_MOCK_STAT_HOOK \
+    do { \
+        const char *hide = getenv(ENVVAR); \
+\
+        if (hide && STREQ(path, hide)) { \
+            errno = ENOENT; \
+            return -1; \
+        } \
+    } while (0)
+
+#include "virmockstathelpers.c"
+
+static int
+virMockStatRedirect(const char *path ATTRIBUTE_UNUSED, char **newpath ATTRIBUTE_UNUSED)
+{
+    return 0;
+}
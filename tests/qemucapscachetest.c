@@ -0,0 +1,183 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#if HAVE_SYS_INOTIFY_H
+
+# include <sys/inotify.h>
+# include <sys/stat.h>
+# include <sys/time.h>
+
+# include "qemu/qemu_capabilities.h"
+# include "vircrypto.h"
+# include "virfile.h"
+# include "virstring.h"
+# include "virutil.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+# define ENVVAR "QEMU_CAPS_CACHE_HIDE"
+
+
+static int
+testQemuCapsCacheWrite(const char *dir,
+                       const char *binary,
+                       virArch arch)
+{
+    VIR_AUTOFREE(char *) hash = NULL;
+    VIR_AUTOFREE(char *) capsDir = NULL;
+    VIR_AUTOFREE(char *) file = NULL;
+    VIR_AUTOFREE(char *) xml = NULL;
+    struct stat sb;
+
+    if (stat(binary, &sb) < 0)
+        return -1;
+
+    if (virCryptoHashString(VIR_CRYPTO_HASH_SHA256, binary, &hash) < 0 ||
+        virAsprintf(&capsDir, "%s/capabilities", dir) < 0 ||
+        virAsprintf(&file, "%s/%s.xml", capsDir, hash) < 0 ||
+        virAsprintf(&xml,
+                    "<qemuCaps>\n"
+                    "  <qemuctime>%lld</qemuctime>\n"
+                    "  <selfctime>%lld</selfctime>\n"
+                    "  <selfvers>%lu</selfvers>\n"
+                    "  <version>4000000</version>\n"
+                    "  <kvmVersion>0</kvmVersion>\n"
+                    "  <microcodeVersion>0</microcodeVersion>\n"
+                    "  <arch>%s</arch>\n"
+                    "</qemuCaps>\n",
+                    (long long) sb.st_ctime,
+                    (long long) virGetSelfLastChanged(),
+                    (unsigned long) LIBVIR_VERSION_NUMBER,
+                    virArchToString(arch)) < 0)
+        return -1;
+
+    if (virFileMakePath(capsDir) < 0 ||
+        virFileWriteStr(file, xml, 0600) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+testQemuCapsCacheValidate(const void *opaque)
+{
+    const char *dir = opaque;
+    VIR_AUTOFREE(char *) binary = NULL;
+    virFileCachePtr cache = NULL;
+    virQEMUCapsPtr first = NULL;
+    virQEMUCapsPtr caps = NULL;
+    /* KVM related checks are skipped for non-native guests, the test
+     * doesn't depend on the host then */
+    virArch arch = virArchFromHost() == VIR_ARCH_AARCH64 ?
+                   VIR_ARCH_S390X : VIR_ARCH_AARCH64;
+    int ret = -1;
+
+    if (virAsprintf(&binary, "%s/qemu-system-%s",
+                    dir, virArchToString(arch)) < 0)
+        goto cleanup;
+
+    if (virFileTouch(binary, 0700) < 0 ||
+        testQemuCapsCacheWrite(dir, binary, arch) < 0)
+        goto cleanup;
+
+    if (!(cache = virQEMUCapsCacheNew(dir, dir, -1, -1, 0)))
+        goto cleanup;
+
+    /* The first lookup fully validates the cached capabilities */
+    if (!(first = virQEMUCapsCacheLookup(cache, binary))) {
+        fprintf(stderr, "Cached capabilities were not used\n");
+        goto cleanup;
+    }
+
+    /* Nothing changed, the binary is not even looked at now */
+    if (setenv(ENVVAR, binary, 1) < 0)
+        goto cleanup;
+
+    caps = virQEMUCapsCacheLookup(cache, binary);
+    if (caps != first) {
+        fprintf(stderr, "Capabilities were validated again\n");
+        goto cleanup;
+    }
+    virObjectUnref(caps);
+    caps = NULL;
+
+    /* Touching the binary must trigger a full validation, which fails
+     * since the binary seems to be gone */
+    if (utimes(binary, NULL) < 0)
+        goto cleanup;
+
+    if ((caps = virQEMUCapsCacheLookup(cache, binary))) {
+        fprintf(stderr, "Outdated capabilities were used\n");
+        goto cleanup;
+    }
+    virResetLastError();
+
+    ret = 0;
+
+ cleanup:
+    unsetenv(ENVVAR);
+    virObjectUnref(caps);
+    virObjectUnref(first);
+    virObjectUnref(cache);
+    return ret;
+}
+
+
+# define TEMPLATE abs_builddir "/qemucapscachedata-XXXXXX"
+
+static int
+mymain(void)
+{
+    char dir[] = TEMPLATE;
+    int ret = 0;
+    int fd;
+
+    /* Without inotify every lookup does a full validation */
+    if ((fd = inotify_init1(IN_CLOEXEC)) < 0)
+        return EXIT_AM_SKIP;
+    VIR_FORCE_CLOSE(fd);
+
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "Cannot create temporary directory\n");
+        return EXIT_FAILURE;
+    }
+
+    if (virTestRun("Validate cached capabilities",
+                   testQemuCapsCacheValidate, dir) < 0)
+        ret = -1;
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(dir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN_PRELOAD(mymain, abs_builddir "/.libs/qemucapscachemock.so")
+
+#else /* !HAVE_SYS_INOTIFY_H */
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* !HAVE_SYS_INOTIFY_H */
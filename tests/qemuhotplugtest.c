@@ -21,15 +21,20 @@
 
 #include "qemu/qemu_alias.h"
 #include "qemu/qemu_conf.h"
+#define LIBVIRT_QEMU_DRIVERPRIV_H_ALLOW
+#include "qemu/qemu_driverpriv.h"
 #include "qemu/qemu_hotplug.h"
 #define LIBVIRT_QEMU_HOTPLUGPRIV_H_ALLOW
 #include "qemu/qemu_hotplugpriv.h"
+#define LIBVIRT_QEMU_PROCESSPRIV_H_ALLOW
+#include "qemu/qemu_processpriv.h"
 #include "qemumonitortestutils.h"
 #include "testutils.h"
 #include "testutilsqemu.h"
 #include "virerror.h"
 #include "virstring.h"
 #include "virthread.h"
+#include "virthreadpool.h"
 #include "virfile.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -39,6 +44,7 @@ static virQEMUDriver driver;
 enum {
     ATTACH,
     DETACH,
+    DETACH_ASYNC,
     UPDATE
 };
 
@@ -53,6 +59,7 @@ struct qemuHotplugTestData {
     bool keep;
     virDomainObjPtr vm;
     bool deviceDeletedEvent;
+    const char *deviceDeletedAlias;
 };
 
 static int
@@ -185,6 +192,27 @@ testQemuHotplugUpdate(virDomainObjPtr vm,
     return ret;
 }
 
+/* Deliver DEVICE_DELETED for @alias the way the monitor does and wait
+ * for the event handler to finish removing the device */
+static int
+testQemuHotplugDeviceDeleted(virDomainObjPtr vm,
+                             const char *alias)
+{
+    if (!(driver.workerPool = virThreadPoolNew(0, 1, 0,
+                                               qemuProcessEventHandler,
+                                               &driver)))
+        return -1;
+
+    virObjectUnlock(vm);
+    qemuProcessHandleDeviceDeleted(NULL, vm, alias, &driver);
+    virThreadPoolDrain(driver.workerPool);
+    virObjectLock(vm);
+
+    virThreadPoolFree(driver.workerPool);
+    driver.workerPool = NULL;
+    return 0;
+}
+
 static int
 testQemuHotplugCheckResult(virDomainObjPtr vm,
                            const char *expected,
@@ -251,7 +279,8 @@ testQemuHotplug(const void *data)
         virTestLoadFile(device_filename, &device_xml) < 0)
         goto cleanup;
 
-    if (test->action == ATTACH &&
+    if ((test->action == ATTACH ||
+         (test->action == DETACH_ASYNC && test->deviceDeletedAlias)) &&
         virTestLoadFile(result_filename, &result_xml) < 0)
         goto cleanup;
 
@@ -324,6 +353,21 @@ testQemuHotplug(const void *data)
                                              domain_filename, fail);
         break;
 
+    case DETACH_ASYNC:
+        ret = testQemuHotplugDetach(vm, dev, true);
+        if (ret == 0 && test->deviceDeletedAlias) {
+            /* The device must stay until QEMU reports it is gone */
+            ret = testQemuHotplugCheckResult(vm, result_xml,
+                                             result_filename, false);
+            if (ret == 0)
+                ret = testQemuHotplugDeviceDeleted(vm,
+                                                   test->deviceDeletedAlias);
+        }
+        if (ret == 0 || fail)
+            ret = testQemuHotplugCheckResult(vm, domain_xml,
+                                             domain_filename, fail);
+        break;
+
     case UPDATE:
         ret = testQemuHotplugUpdate(vm, dev);
     }
@@ -351,6 +395,145 @@ testQemuHotplug(const void *data)
 }
 
 
+struct testQemuHotplugAttachMultiData {
+    const char *domain_filename;
+    bool fail;
+    const char *const *mon;
+};
+
+/* Attach a watchdog and an ivshmem device in one go, as
+ * virDomainAttachDevices does. If the second device fails, the
+ * watchdog must stay attached to the running domain and be
+ * recorded in its status, while the persistent definition is
+ * left alone. */
+static int
+testQemuHotplugAttachMulti(const void *opaque)
+{
+    const struct testQemuHotplugAttachMultiData *test = opaque;
+    const char *devices[] = { "watchdog", "ivshmem-plain" };
+    char *xmls[ARRAY_CARDINALITY(devices)] = { NULL };
+    char *domain_filename = NULL;
+    char *domain_xml = NULL;
+    char *status_file = NULL;
+    char *config_file = NULL;
+    virDomainObjPtr vm = NULL;
+    virDomainDefPtr persistentDef;
+    qemuMonitorTestPtr test_mon = NULL;
+    qemuDomainObjPrivatePtr priv = NULL;
+    const char *const *tmp;
+    size_t i;
+    int rc;
+    int ret = -1;
+
+    if (virAsprintf(&domain_filename, "%s/qemuhotplugtestdomains/qemuhotplug-%s.xml",
+                    abs_srcdir, test->domain_filename) < 0 ||
+        virTestLoadFile(domain_filename, &domain_xml) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ARRAY_CARDINALITY(devices); i++) {
+        char *device_filename = NULL;
+
+        if (virAsprintf(&device_filename,
+                        "%s/qemuhotplugtestdevices/qemuhotplug-%s.xml",
+                        abs_srcdir, devices[i]) < 0)
+            goto cleanup;
+
+        rc = virTestLoadFile(device_filename, &xmls[i]);
+        VIR_FREE(device_filename);
+        if (rc < 0)
+            goto cleanup;
+    }
+
+    if (qemuHotplugCreateObjects(driver.xmlopt, &vm, domain_xml) < 0)
+        goto cleanup;
+    vm->persistent = 1;
+
+    if (!(status_file = virDomainConfigFile(driver.config->stateDir,
+                                            vm->def->name)) ||
+        !(config_file = virDomainConfigFile(driver.config->configDir,
+                                            vm->def->name)))
+        goto cleanup;
+
+    if (!(test_mon = qemuMonitorTestNew(true, driver.xmlopt, vm, &driver,
+                                        NULL, NULL)))
+        goto cleanup;
+
+    tmp = test->mon;
+    while (tmp && *tmp) {
+        const char *command_name;
+        const char *response;
+
+        if (!(command_name = *tmp++) ||
+            !(response = *tmp++))
+            break;
+        if (qemuMonitorTestAddItem(test_mon, command_name, response) < 0)
+            goto cleanup;
+    }
+
+    priv = vm->privateData;
+    priv->mon = qemuMonitorTestGetMonitor(test_mon);
+    priv->monJSON = true;
+    virObjectUnlock(priv->mon);
+
+    rc = qemuDomainAttachDeviceLiveAndConfig(vm, &driver,
+                                             (const char **) xmls,
+                                             ARRAY_CARDINALITY(xmls),
+                                             VIR_DOMAIN_AFFECT_LIVE |
+                                             VIR_DOMAIN_AFFECT_CONFIG);
+    if ((rc < 0) != test->fail) {
+        VIR_TEST_VERBOSE("attaching devices %s\n",
+                         rc < 0 ? "failed unexpectedly" : "should have failed");
+        goto cleanup;
+    }
+
+    /* The first device is in use by the guest either way */
+    if (!vm->def->watchdog) {
+        VIR_TEST_VERBOSE("watchdog is missing from the live definition\n");
+        goto cleanup;
+    }
+    if (vm->def->nshmems != (test->fail ? 0 : 1)) {
+        VIR_TEST_VERBOSE("unexpected number of shmem devices %zu in the "
+                         "live definition\n", vm->def->nshmems);
+        goto cleanup;
+    }
+    if (!virFileExists(status_file)) {
+        VIR_TEST_VERBOSE("status of the domain was not saved\n");
+        goto cleanup;
+    }
+
+    persistentDef = vm->newDef ? vm->newDef : vm->def;
+    if (!!persistentDef->watchdog != !test->fail ||
+        persistentDef->nshmems != (test->fail ? 0 : 1)) {
+        VIR_TEST_VERBOSE("unexpected devices in the persistent definition\n");
+        goto cleanup;
+    }
+    if (virFileExists(config_file) == test->fail) {
+        VIR_TEST_VERBOSE("configuration of the domain %s\n",
+                         test->fail ? "must not be saved" : "was not saved");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (status_file)
+        unlink(status_file);
+    if (config_file)
+        unlink(config_file);
+    for (i = 0; i < ARRAY_CARDINALITY(xmls); i++)
+        VIR_FREE(xmls[i]);
+    VIR_FREE(domain_filename);
+    VIR_FREE(domain_xml);
+    VIR_FREE(status_file);
+    VIR_FREE(config_file);
+    if (priv)
+        priv->mon = NULL;
+    virObjectUnref(vm);
+    qemuMonitorTestFree(test_mon);
+    return ret;
+}
+
+
 struct testQemuHotplugCpuData {
     char *file_xml_dom;
     char *file_xml_res_live;
@@ -633,6 +816,13 @@ mymain(void)
 #define DO_TEST_DETACH(file, dev, fial, kep, ...) \
     DO_TEST(file, DETACH, dev, fial, kep, __VA_ARGS__)
 
+#define DO_TEST_DETACH_ASYNC(file, dev, alias, fial, kep, ...) \
+    do { \
+        data.deviceDeletedAlias = alias; \
+        DO_TEST(file, DETACH_ASYNC, dev, fial, kep, __VA_ARGS__); \
+        data.deviceDeletedAlias = NULL; \
+    } while (0)
+
 #define DO_TEST_UPDATE(file, dev, fial, kep, ...) \
     DO_TEST(file, UPDATE, dev, fial, kep, __VA_ARGS__)
 
@@ -653,6 +843,22 @@ mymain(void)
     "    }" \
     "}\r\n"
 
+#define QMP_ERROR \
+    "{" \
+    "    \"error\": {" \
+    "        \"class\": \"GenericError\"," \
+    "        \"desc\": \"Device initialization failed\"" \
+    "    }" \
+    "}"
+
+#define QMP_DEVICE_NOT_FOUND(dev) \
+    "{" \
+    "    \"error\": {" \
+    "        \"class\": \"DeviceNotFound\"," \
+    "        \"desc\": \"Device '" dev "' not found\"" \
+    "    }" \
+    "}"
+
     DO_TEST_UPDATE("graphics-spice", "graphics-spice-nochange", false, false, NULL);
     DO_TEST_UPDATE("graphics-spice-timeout", "graphics-spice-timeout-nochange", false, false,
                    "set_password", QMP_OK, "expire_password", QMP_OK);
@@ -682,6 +888,22 @@ mymain(void)
                    "device_del", QMP_DEVICE_DELETED("virtio-disk4") QMP_OK,
                    "human-monitor-command", HMP(""));
 
+    /* Asynchronous detach, as done by virDomainDetachDeviceAlias, leaves
+     * the device in place until DEVICE_DELETED arrives, unless QEMU
+     * doesn't know the device anymore */
+    DO_TEST_ATTACH("base-live", "disk-virtio", false, true,
+                   "human-monitor-command", HMP("OK\\r\\n"),
+                   "device_add", QMP_OK);
+    DO_TEST_DETACH_ASYNC("base-live", "disk-virtio", "virtio-disk4", false, false,
+                         "device_del", QMP_OK,
+                         "human-monitor-command", HMP(""));
+    DO_TEST_ATTACH("base-live", "disk-virtio", false, true,
+                   "human-monitor-command", HMP("OK\\r\\n"),
+                   "device_add", QMP_OK);
+    DO_TEST_DETACH_ASYNC("base-live", "disk-virtio", NULL, false, false,
+                         "device_del", QMP_DEVICE_NOT_FOUND("virtio-disk4"),
+                         "human-monitor-command", HMP(""));
+
     DO_TEST_ATTACH("base-live", "disk-usb", false, true,
                    "human-monitor-command", HMP("OK\\r\\n"),
                    "device_add", QMP_OK);
@@ -790,6 +1012,29 @@ mymain(void)
     DO_TEST_DETACH("base-live", "watchdog-user-alias-full", false, false,
                    "device_del", QMP_DEVICE_DELETED("ua-UserWatchdog") QMP_OK);
 
+#define DO_TEST_ATTACH_MULTI(name, file, fial, ...) \
+    do { \
+        const char *my_mon[] = { __VA_ARGS__, NULL}; \
+        struct testQemuHotplugAttachMultiData multidata = { \
+            .domain_filename = file, .fail = fial, .mon = my_mon, \
+        }; \
+        if (virTestRun(file " ATTACH_MULTI " name, \
+                       testQemuHotplugAttachMulti, &multidata) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_ATTACH_MULTI("watchdog+ivshmem-plain", "base-live", false,
+                         "watchdog-set-action", QMP_OK,
+                         "device_add", QMP_OK,
+                         "object-add", QMP_OK,
+                         "device_add", QMP_OK);
+    DO_TEST_ATTACH_MULTI("watchdog+ivshmem-plain-fail", "base-live", true,
+                         "watchdog-set-action", QMP_OK,
+                         "device_add", QMP_OK,
+                         "object-add", QMP_OK,
+                         "device_add", QMP_ERROR,
+                         "object-del", QMP_OK);
+
     DO_TEST_ATTACH("base-live", "guestfwd", false, true,
                    "chardev-add", QMP_OK,
                    "netdev_add", QMP_OK);
@@ -27,6 +27,7 @@
 #include "virmock.h"
 #include "virfile.h"
 #include "virthread.h"
+#include "virprocess.h"
 #include "virhash.h"
 #include "virstring.h"
 #include "viralloc.h"
@@ -40,16 +41,15 @@
  * work as expected. Therefore there is a lot we have to mock
  * (chown, stat, XATTR APIs, etc.). Since the test won't run as
  * root chown() would fail, therefore we have to keep everything
- * in memory. By default, all files are owned by 1:2.
+ * in memory. By default, all files are owned by 1:2. Each top
+ * level directory is a separate filesystem and paths starting
+ * with ALIAS_PREFIX are symlinks to the path that follows the
+ * prefix.
  * By the way, since there are some cases where real stat needs
  * to be called, the mocked functions are effective only if
  * $ENVVAR is set.
  */
 
-#define DEFAULT_UID 1
-#define DEFAULT_GID 2
-
-
 static int (*real_chown)(const char *path, uid_t uid, gid_t gid);
 static int (*real_open)(const char *path, int flags, ...);
 static int (*real_close)(int fd);
@@ -71,6 +71,23 @@ virHashTablePtr xattr_paths = NULL;
 virHashTablePtr chown_paths = NULL;
 
 
+/* Path that chown() fails on. */
+char *fail_path = NULL;
+
+
+/* Threads that chown()-ed paths and filesystems they did so on.
+ * Relabeling of each filesystem is expected to be done by one
+ * thread and each thread is expected to relabel one filesystem
+ * (there are not that many filesystems in tests). */
+struct chownThread {
+    dev_t dev;
+    unsigned long long thread;
+};
+struct chownThread chown_threads[32];
+size_t nchown_threads = 0;
+bool chown_threads_fail = false;
+
+
 static void
 init_hash(void)
 {
@@ -110,13 +127,43 @@ init_syms(void)
 }
 
 
+static const char *
+resolve_path(const char *path)
+{
+    if (STRPREFIX(path, ALIAS_PREFIX "/"))
+        return path + strlen(ALIAS_PREFIX);
+
+    return path;
+}
+
+
+static unsigned long long
+hash_path(const char *path,
+          size_t len)
+{
+    unsigned long long ret = 1;
+
+    while (len--)
+        ret = ret * 31 + *path++;
+
+    return ret;
+}
+
+
+static dev_t
+get_dev(const char *path)
+{
+    return hash_path(path, strcspn(path + 1, "/") + 1);
+}
+
+
 static char *
 get_key(const char *path,
         const char *name)
 {
     char *ret;
 
-    if (virAsprintf(&ret, "%s:%s", path, name) < 0) {
+    if (virAsprintf(&ret, "%s:%s", resolve_path(path), name) < 0) {
         fprintf(stderr, "Unable to create hash table key\n");
         abort();
     }
@@ -209,6 +256,7 @@ int virFileRemoveXAttr(const char *path,
 #define VIR_MOCK_STAT_HOOK \
     do { \
         if (getenv(ENVVAR)) { \
+            const char *file = resolve_path(path); \
             uint32_t *val; \
 \
             virMutexLock(&m); \
@@ -218,15 +266,16 @@ int virFileRemoveXAttr(const char *path,
 \
             sb->st_mode = S_IFREG | 0666; \
             sb->st_size = 123456; \
-            sb->st_ino = 1; \
+            sb->st_dev = get_dev(file); \
+            sb->st_ino = hash_path(file, strlen(file)); \
 \
-            if (!(val = virHashLookup(chown_paths, path))) { \
+            if (!(val = virHashLookup(chown_paths, file))) { \
                 /* New path. Set the defaults */ \
                 sb->st_uid = DEFAULT_UID; \
                 sb->st_gid = DEFAULT_GID; \
             } else { \
                 /* Known path. Set values passed to chown() earlier */ \
-                sb->st_uid = *val % 16; \
+                sb->st_uid = *val & 0xffff; \
                 sb->st_gid = *val >> 16; \
             } \
 \
@@ -236,6 +285,35 @@ int virFileRemoveXAttr(const char *path,
         } \
     } while (0)
 
+static void
+record_thread(const char *path)
+{
+    dev_t dev = get_dev(path);
+    unsigned long long thread = virThreadSelfID();
+    size_t i;
+
+    for (i = 0; i < nchown_threads; i++) {
+        if (chown_threads[i].dev == dev &&
+            chown_threads[i].thread == thread)
+            return;
+
+        if (chown_threads[i].dev == dev ||
+            chown_threads[i].thread == thread) {
+            fprintf(stderr,
+                    "Path %s relabeled by unexpected thread\n", path);
+            chown_threads_fail = true;
+            return;
+        }
+    }
+
+    if (nchown_threads < ARRAY_CARDINALITY(chown_threads)) {
+        chown_threads[nchown_threads].dev = dev;
+        chown_threads[nchown_threads].thread = thread;
+        nchown_threads++;
+    }
+}
+
+
 static int
 mock_chown(const char *path,
            uid_t uid,
@@ -244,6 +322,8 @@ mock_chown(const char *path,
     uint32_t *val = NULL;
     int ret = -1;
 
+    path = resolve_path(path);
+
     if (gid >> 16 || uid >> 16) {
         fprintf(stderr, "Attempt to set too high UID or GID: %lld %lld",
                (unsigned long long) uid, (unsigned long long) gid);
@@ -258,6 +338,13 @@ mock_chown(const char *path,
     virMutexLock(&m);
     init_hash();
 
+    if (STREQ_NULLABLE(path, fail_path)) {
+        errno = EIO;
+        goto cleanup;
+    }
+
+    record_thread(path);
+
     if (virHashUpdateEntry(chown_paths, path, val) < 0)
         goto cleanup;
     val = NULL;
@@ -335,6 +422,17 @@ close(int fd)
 }
 
 
+/* There's no point in relabeling in a child process as the test
+ * doesn't run as root. And effects of mocked functions wouldn't
+ * be visible to the test then. */
+int
+virProcessRunInFork(virProcessForkCallback cb,
+                    void *opaque)
+{
+    return cb(-1, opaque);
+}
+
+
 int virFileLock(int fd ATTRIBUTE_UNUSED,
                 bool shared ATTRIBUTE_UNUSED,
                 off_t start ATTRIBUTE_UNUSED,
@@ -366,7 +464,7 @@ checkOwner(void *payload,
         fprintf(stderr,
                 "Path %s wasn't restored back to its original owner\n",
                 (const char *) name);
-        *chown_fail = false;
+        *chown_fail = true;
     }
 
     return 0;
@@ -382,7 +480,7 @@ printXATTR(void *payload,
 
     /* The fact that we are in this function means that there are
      * some XATTRs left behind. This is enough to claim an error. */
-    *xattr_fail = false;
+    *xattr_fail = true;
 
     /* Hash table key consists of "$path:$xattr_name", xattr
      * value is then the value stored in the hash table. */
@@ -416,3 +514,43 @@ int checkPaths(void)
     virMutexUnlock(&m);
     return ret;
 }
+
+
+int checkThreads(void)
+{
+    int ret = 0;
+
+    virMutexLock(&m);
+
+    if (chown_threads_fail)
+        ret = -1;
+
+    chown_threads_fail = false;
+    nchown_threads = 0;
+
+    virMutexUnlock(&m);
+    return ret;
+}
+
+
+void resetPaths(void)
+{
+    virMutexLock(&m);
+    init_hash();
+
+    virHashRemoveAll(chown_paths);
+    virHashRemoveAll(xattr_paths);
+    chown_threads_fail = false;
+    nchown_threads = 0;
+
+    virMutexUnlock(&m);
+}
+
+
+void setChownFail(const char *path)
+{
+    virMutexLock(&m);
+    VIR_FREE(fail_path);
+    ignore_value(VIR_STRDUP_QUIET(fail_path, path));
+    virMutexUnlock(&m);
+}
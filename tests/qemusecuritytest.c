@@ -25,14 +25,18 @@
 #include "conf/domain_conf.h"
 #include "qemu/qemu_domain.h"
 #include "qemu/qemu_security.h"
+#include "viratomic.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
 struct testData {
     virQEMUDriverPtr driver;
     const char *file; /* file name to load VM def XML from; qemuxml2argvdata/ */
+    const char *fail; /* path chown() fails on */
 };
 
+static int chownCalls;
+
 
 static int
 prepareObjects(virQEMUDriverPtr driver,
@@ -115,6 +119,53 @@ testDomain(const void *opaque)
     if (qemuSecuritySetAllLabel(data->driver, vm, NULL) < 0)
         goto cleanup;
 
+    if (checkThreads() < 0)
+        goto cleanup;
+
+    qemuSecurityRestoreAllLabel(data->driver, vm, false);
+
+    if (checkThreads() < 0 ||
+        checkPaths() < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    unsetenv(ENVVAR);
+    virObjectUnref(vm);
+    virObjectUnref(securityManager);
+    return ret;
+}
+
+
+static int
+testDomainAlias(const void *opaque)
+{
+    const struct testData *data = opaque;
+    virDomainObjPtr vm = NULL;
+    char *alias = NULL;
+    int ret = -1;
+
+    if (prepareObjects(data->driver, data->file, &vm) < 0)
+        return -1;
+
+    /* Make the second disk refer to the same file as the first
+     * one, but via a symlink. */
+    if (vm->def->ndisks < 2) {
+        fprintf(stderr, "Domain has too few disks\n");
+        goto cleanup;
+    }
+
+    if (virAsprintf(&alias, "%s%s", ALIAS_PREFIX,
+                    virDomainDiskGetSource(vm->def->disks[0])) < 0 ||
+        virDomainDiskSetSource(vm->def->disks[1], alias) < 0)
+        goto cleanup;
+
+    if (setenv(ENVVAR, "1", 0) < 0)
+        goto cleanup;
+
+    if (qemuSecuritySetAllLabel(data->driver, vm, NULL) < 0)
+        goto cleanup;
+
     qemuSecurityRestoreAllLabel(data->driver, vm, false);
 
     if (checkPaths() < 0)
@@ -123,6 +174,152 @@ testDomain(const void *opaque)
     ret = 0;
  cleanup:
     unsetenv(ENVVAR);
+    resetPaths();
+    virObjectUnref(vm);
+    VIR_FREE(alias);
+    return ret;
+}
+
+
+static int
+testDomainRollback(const void *opaque)
+{
+    const struct testData *data = opaque;
+    virDomainObjPtr vm = NULL;
+    qemuDomainObjPrivatePtr priv;
+    bool failed = false;
+    size_t i;
+    int ret = -1;
+
+    if (prepareObjects(data->driver, data->file, &vm) < 0)
+        return -1;
+
+    /* Without remembering the owner the restore is chown() to
+     * root:root. This way we can tell which paths were rolled
+     * back. */
+    priv = vm->privateData;
+    priv->rememberOwner = false;
+
+    if (setenv(ENVVAR, "1", 0) < 0)
+        goto cleanup;
+
+    setChownFail(data->fail);
+
+    if (qemuSecuritySetAllLabel(data->driver, vm, NULL) == 0) {
+        fprintf(stderr, "Relabeling succeeded unexpectedly\n");
+        goto cleanup;
+    }
+
+    /* All the disks live on the same filesystem and are thus
+     * relabeled in order. The ones preceding the failed one must
+     * be restored, the rest must be left untouched. */
+    for (i = 0; i < vm->def->ndisks; i++) {
+        const char *path = virDomainDiskGetSource(vm->def->disks[i]);
+        uid_t uid = 0;
+        gid_t gid = 0;
+        struct stat sb;
+
+        if (STREQ(path, data->fail))
+            failed = true;
+
+        if (failed) {
+            uid = DEFAULT_UID;
+            gid = DEFAULT_GID;
+        }
+
+        if (stat(path, &sb) < 0)
+            goto cleanup;
+
+        if (sb.st_uid != uid || sb.st_gid != gid) {
+            fprintf(stderr, "Path %s owned by %u:%u, expected %u:%u\n",
+                    path, (unsigned int) sb.st_uid, (unsigned int) sb.st_gid,
+                    (unsigned int) uid, (unsigned int) gid);
+            goto cleanup;
+        }
+    }
+
+    if (!failed) {
+        fprintf(stderr, "Domain has no disk %s\n", data->fail);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    unsetenv(ENVVAR);
+    setChownFail(NULL);
+    resetPaths();
+    virObjectUnref(vm);
+    return ret;
+}
+
+
+static int
+testChownCallback(const virStorageSource *src,
+                  uid_t uid,
+                  gid_t gid)
+{
+    virAtomicIntInc(&chownCalls);
+
+    if (chown(src->path, uid, gid) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+testDomainDuplicate(const void *opaque)
+{
+    const struct testData *data = opaque;
+    virSecurityManagerPtr origManager = data->driver->securityManager;
+    virSecurityManagerPtr securityManager = NULL;
+    virDomainObjPtr vm = NULL;
+    qemuDomainObjPrivatePtr priv;
+    size_t i;
+    int ret = -1;
+
+    if (prepareObjects(data->driver, data->file, &vm) < 0)
+        return -1;
+
+    /* Duplicate items are skipped only if the owner is not
+     * remembered. */
+    priv = vm->privateData;
+    priv->rememberOwner = false;
+
+    /* Unlike chown() the callback is called for each item that
+     * is not skipped. */
+    if (!(securityManager = virSecurityManagerNewDAC("test", 1000, 1000,
+                                                     VIR_SECURITY_MANAGER_PRIVILEGED |
+                                                     VIR_SECURITY_MANAGER_DYNAMIC_OWNERSHIP,
+                                                     testChownCallback)))
+        goto cleanup;
+
+    for (i = 1; i < vm->def->ndisks; i++) {
+        if (virDomainDiskSetSource(vm->def->disks[i],
+                                   virDomainDiskGetSource(vm->def->disks[0])) < 0)
+            goto cleanup;
+    }
+
+    if (setenv(ENVVAR, "1", 0) < 0)
+        goto cleanup;
+
+    data->driver->securityManager = securityManager;
+    virAtomicIntSet(&chownCalls, 0);
+
+    if (qemuSecuritySetAllLabel(data->driver, vm, NULL) < 0)
+        goto cleanup;
+
+    if (virAtomicIntGet(&chownCalls) != 1) {
+        fprintf(stderr, "Expected 1 chown, got %d\n",
+                virAtomicIntGet(&chownCalls));
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    data->driver->securityManager = origManager;
+    unsetenv(ENVVAR);
+    resetPaths();
     virObjectUnref(vm);
     virObjectUnref(securityManager);
     return ret;
@@ -163,6 +360,19 @@ mymain(void)
     DO_TEST_DOMAIN("aarch64-virtio-pci-manual-addresses");
     DO_TEST_DOMAIN("acpi-table");
 
+#define DO_TEST_DOMAIN_FULL(name, func, f, fl) \
+    do { \
+        struct testData data = {.driver = &driver, .file = f, .fail = fl}; \
+        if (virTestRun(name, func, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_DOMAIN_FULL("alias", testDomainAlias, "disk-virtio", NULL);
+    DO_TEST_DOMAIN_FULL("rollback", testDomainRollback, "pci-bridge-many-disks",
+                        "/var/lib/libvirt/images/disk-a-c.img");
+    DO_TEST_DOMAIN_FULL("duplicate", testDomainDuplicate, "pci-bridge-many-disks",
+                        NULL);
+
  cleanup:
     qemuTestDriverFree(&driver);
     return ret;
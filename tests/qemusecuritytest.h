@@ -21,6 +21,14 @@
 
 # define ENVVAR "LIBVIRT_QEMU_SECURITY_TEST"
 
+# define DEFAULT_UID 1
+# define DEFAULT_GID 2
+
+# define ALIAS_PREFIX "/alias"
+
 extern int checkPaths(void);
+extern int checkThreads(void);
+extern void resetPaths(void);
+extern void setChownFail(const char *path);
 
 #endif /* LIBVIRT_QEMUSECURITYTEST_H */
@@ -13,7 +13,9 @@
 # include "qemu/qemu_domain_address.h"
 # include "qemu/qemu_domain.h"
 # include "testutilsqemu.h"
+# include "virbuffer.h"
 # include "virstring.h"
+# include "virtime.h"
 
 # define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -48,6 +50,305 @@ testXML2XMLInactive(const void *opaque)
 }
 
 
+struct testCopyCounts {
+    size_t native; /* inputs copied natively */
+    size_t xml; /* inputs virDomainDefCopyNative can't handle */
+    size_t unparsable; /* inputs not valid on their own */
+};
+
+struct testCopyData {
+    char *infile;
+    struct testCopyCounts *counts;
+};
+
+
+/* Copying the inactive definition natively must give the same XML as
+ * copying it through XML does.  Setting VIR_TEST_DOMAIN_COPY_ITERATIONS
+ * times that many copies done either way, and that many parses of the
+ * formatted XML alone, printed with VIR_TEST_DEBUG=1. */
+static int
+testXML2XMLCopy(const void *opaque)
+{
+    const struct testCopyData *data = opaque;
+    const char *env = getenv("VIR_TEST_DOMAIN_COPY_ITERATIONS");
+    unsigned int formatFlags[] = {
+        VIR_DOMAIN_DEF_FORMAT_SECURE,
+        VIR_DOMAIN_DEF_FORMAT_SECURE | VIR_DOMAIN_DEF_FORMAT_INACTIVE,
+    };
+    unsigned long iterations = 0;
+    unsigned long long then;
+    unsigned long long native;
+    unsigned long long xml;
+    unsigned long long now;
+    virDomainDefPtr def = NULL;
+    virDomainDefPtr copy = NULL;
+    virDomainDefPtr xmlCopy = NULL;
+    virDomainDefPtr tmp = NULL;
+    char *expected = NULL;
+    char *actual = NULL;
+    size_t i;
+    int rc;
+    int ret = -1;
+
+    if (env && virStrToLong_ul(env, NULL, 10, &iterations) < 0)
+        return -1;
+
+    if (!(def = virDomainDefParseFile(data->infile, driver.caps, driver.xmlopt,
+                                      NULL, VIR_DOMAIN_DEF_PARSE_INACTIVE))) {
+        VIR_TEST_DEBUG("'%s' can't be parsed: %s",
+                       data->infile, virGetLastErrorMessage());
+        virResetLastError();
+        data->counts->unparsable++;
+        return EXIT_AM_SKIP;
+    }
+
+    if ((rc = virDomainDefCopyNative(def, driver.caps, driver.xmlopt,
+                                     &copy)) < 0)
+        goto cleanup;
+
+    if (rc == 0) {
+        VIR_TEST_DEBUG("'%s' can only be copied through XML", data->infile);
+        data->counts->xml++;
+        ret = EXIT_AM_SKIP;
+        goto cleanup;
+    }
+
+    if (!(xmlCopy = virDomainDefCopyXML(def, driver.caps, driver.xmlopt,
+                                        NULL, false)))
+        goto cleanup;
+
+    for (i = 0; i < ARRAY_CARDINALITY(formatFlags); i++) {
+        if (!(expected = virDomainDefFormat(xmlCopy, driver.caps,
+                                            formatFlags[i])) ||
+            !(actual = virDomainDefFormat(copy, driver.caps, formatFlags[i])))
+            goto cleanup;
+
+        if (STRNEQ(expected, actual)) {
+            virTestDifference(stderr, expected, actual);
+            goto cleanup;
+        }
+
+        VIR_FREE(expected);
+        VIR_FREE(actual);
+    }
+
+    data->counts->native++;
+
+    if (iterations) {
+        if (virTimeMillisNow(&then) < 0)
+            goto cleanup;
+
+        for (i = 0; i < iterations; i++) {
+            if (virDomainDefCopyNative(def, driver.caps, driver.xmlopt,
+                                       &tmp) < 0)
+                goto cleanup;
+            virDomainDefFree(tmp);
+            tmp = NULL;
+        }
+
+        if (virTimeMillisNow(&now) < 0)
+            goto cleanup;
+        native = now - then;
+        then = now;
+
+        for (i = 0; i < iterations; i++) {
+            if (!(tmp = virDomainDefCopyXML(def, driver.caps, driver.xmlopt,
+                                            NULL, false)))
+                goto cleanup;
+            virDomainDefFree(tmp);
+            tmp = NULL;
+        }
+
+        if (virTimeMillisNow(&now) < 0)
+            goto cleanup;
+        xml = now - then;
+
+        if (!(expected = virDomainDefFormat(def, driver.caps,
+                                            VIR_DOMAIN_DEF_FORMAT_SECURE)))
+            goto cleanup;
+
+        if (virTimeMillisNow(&then) < 0)
+            goto cleanup;
+
+        for (i = 0; i < iterations; i++) {
+            if (!(tmp = virDomainDefParseString(expected, driver.caps,
+                                                driver.xmlopt, NULL,
+                                                VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                                                VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE)))
+                goto cleanup;
+            virDomainDefFree(tmp);
+            tmp = NULL;
+        }
+
+        if (virTimeMillisNow(&now) < 0)
+            goto cleanup;
+
+        VIR_TEST_DEBUG("%lu copies: native %llu ms, through XML %llu ms "
+                       "(parsing alone %llu ms)",
+                       iterations, native, xml, now - then);
+    }
+
+    ret = 0;
+
+ cleanup:
+    virDomainDefFree(def);
+    virDomainDefFree(copy);
+    virDomainDefFree(xmlCopy);
+    virDomainDefFree(tmp);
+    VIR_FREE(expected);
+    VIR_FREE(actual);
+    return ret;
+}
+
+
+/* Runs testXML2XMLCopy on every input of qemuxml2argvtest. Inputs which
+ * are rejected by virDomainDefCopyNativeSupported() or don't parse with
+ * the capabilities of this test are skipped and counted. */
+static int
+testXML2XMLCopyAll(void)
+{
+    const char *dirname = abs_srcdir "/qemuxml2argvdata";
+    struct testCopyCounts counts = { 0 };
+    struct testCopyData data = { NULL, &counts };
+    struct dirent *ent;
+    DIR *dir = NULL;
+    char *title = NULL;
+    int rc;
+    int ret = 0;
+
+    if (virDirOpen(&dir, dirname) < 0)
+        return -1;
+
+    while ((rc = virDirRead(dir, &ent, dirname)) > 0) {
+        if (!virStringHasSuffix(ent->d_name, ".xml"))
+            continue;
+
+        if (virAsprintf(&data.infile, "%s/%s", dirname, ent->d_name) < 0 ||
+            virAsprintf(&title, "QEMU XML-2-XML-copy %s", ent->d_name) < 0) {
+            ret = -1;
+            break;
+        }
+
+        if (virTestRun(title, testXML2XMLCopy, &data) < 0)
+            ret = -1;
+
+        VIR_FREE(data.infile);
+        VIR_FREE(title);
+    }
+
+    if (rc < 0)
+        ret = -1;
+
+    VIR_TEST_VERBOSE("%zu inputs copied natively, %zu only through XML, "
+                     "%zu not parsable\n",
+                     counts.native, counts.xml, counts.unparsable);
+
+    VIR_FREE(data.infile);
+    VIR_FREE(title);
+    VIR_DIR_CLOSE(dir);
+    return ret;
+}
+
+
+/* Auto-assign PCI addresses to a guest with many network interfaces and
+ * check that every one of them got its own address.  With pc the devices
+ * go on pci-root and pci-bridges, with q35 each of them needs its own
+ * pcie-root-port.  Setting VIR_TEST_PCI_ADDRESS_DEVICES changes the
+ * number of interfaces from the default of 500; the time taken is printed
+ * with VIR_TEST_DEBUG=1.  As pcie-root only has room for a little over
+ * 200 root ports, even with 8 of them sharing each slot, q35 is capped
+ * there. */
+static int
+testPCIAddressScaling(const void *opaque)
+{
+    const char *machine = opaque;
+    const char *env = getenv("VIR_TEST_PCI_ADDRESS_DEVICES");
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    unsigned long ndevices = 500;
+    unsigned long long then;
+    unsigned long long now;
+    virDomainDefPtr def = NULL;
+    char *xml = NULL;
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    if (env && virStrToLong_ul(env, NULL, 10, &ndevices) < 0)
+        return -1;
+
+    if (STREQ(machine, "q35") && ndevices > 200) {
+        if (env)
+            fprintf(stderr, "q35 has room for 200 interfaces, "
+                    "testing with 200 instead of %lu\n", ndevices);
+        ndevices = 200;
+    }
+
+    virBufferAddLit(&buf, "<domain type='qemu'>\n");
+    virBufferAddLit(&buf, "  <name>pci-scaling</name>\n");
+    virBufferAddLit(&buf, "  <uuid>c7a5fdbd-edaf-9455-926a-d65c16db1809</uuid>\n");
+    virBufferAddLit(&buf, "  <memory unit='KiB'>219100</memory>\n");
+    virBufferAddLit(&buf, "  <vcpu placement='static'>1</vcpu>\n");
+    virBufferAsprintf(&buf, "  <os><type arch='x86_64' machine='%s'>hvm</type></os>\n",
+                      machine);
+    virBufferAddLit(&buf, "  <devices>\n");
+    virBufferAddLit(&buf, "    <emulator>/usr/bin/qemu-system-x86_64</emulator>\n");
+    for (i = 0; i < ndevices; i++) {
+        virBufferAddLit(&buf, "    <interface type='user'>\n");
+        virBufferAsprintf(&buf, "      <mac address='52:54:00:%02zx:%02zx:%02zx'/>\n",
+                          (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff);
+        virBufferAddLit(&buf, "      <model type='virtio'/>\n");
+        virBufferAddLit(&buf, "    </interface>\n");
+    }
+    virBufferAddLit(&buf, "  </devices>\n");
+    virBufferAddLit(&buf, "</domain>\n");
+
+    if (!(xml = virBufferContentAndReset(&buf)))
+        goto cleanup;
+
+    if (virTimeMillisNow(&then) < 0)
+        goto cleanup;
+
+    if (!(def = virDomainDefParseString(xml, driver.caps, driver.xmlopt, NULL,
+                                        VIR_DOMAIN_DEF_PARSE_INACTIVE)))
+        goto cleanup;
+
+    if (virTimeMillisNow(&now) < 0)
+        goto cleanup;
+
+    if (def->nnets != ndevices)
+        goto cleanup;
+
+    for (i = 0; i < def->nnets; i++) {
+        virDomainDeviceInfoPtr info = &def->nets[i]->info;
+
+        if (info->type != VIR_DOMAIN_DEVICE_ADDRESS_TYPE_PCI) {
+            VIR_TEST_DEBUG("interface %zu has no PCI address", i);
+            goto cleanup;
+        }
+
+        for (j = 0; j < i; j++) {
+            if (virPCIDeviceAddressEqual(&info->addr.pci,
+                                         &def->nets[j]->info.addr.pci)) {
+                VIR_TEST_DEBUG("interfaces %zu and %zu share a PCI address",
+                               j, i);
+                goto cleanup;
+            }
+        }
+    }
+
+    VIR_TEST_DEBUG("%s: %lu devices, %zu controllers, assigned in %llu ms",
+                   machine, ndevices, def->ncontrollers, now - then);
+
+    ret = 0;
+
+ cleanup:
+    virBufferFreeAndReset(&buf);
+    virDomainDefFree(def);
+    VIR_FREE(xml);
+    return ret;
+}
+
+
 static int
 testCompareStatusXMLToXMLFiles(const void *opaque)
 {
@@ -1293,6 +1594,27 @@ mymain(void)
     DO_TEST("riscv64-virt-pci",
             QEMU_CAPS_OBJECT_GPEX);
 
+    if (testQemuInfoSetArgs(&info, capslatest,
+                            ARG_QEMU_CAPS,
+                            QEMU_CAPS_DEVICE_PCI_BRIDGE,
+                            QEMU_CAPS_DEVICE_DMI_TO_PCI_BRIDGE,
+                            QEMU_CAPS_DEVICE_PCIE_ROOT_PORT,
+                            QEMU_CAPS_DEVICE_VIRTIO_NET,
+                            QEMU_CAPS_VIRTIO_PCI_DISABLE_LEGACY,
+                            QEMU_CAPS_LAST,
+                            ARG_END) < 0 ||
+        qemuTestCapsCacheInsert(driver.qemuCapsCache, info.qemuCaps) < 0) {
+        VIR_TEST_DEBUG("Failed to generate PCI address scaling test data");
+        return -1;
+    }
+    if (virTestRun("QEMU PCI address scaling pc",
+                   testPCIAddressScaling, "pc") < 0)
+        ret = -1;
+    if (virTestRun("QEMU PCI address scaling q35",
+                   testPCIAddressScaling, "q35") < 0)
+        ret = -1;
+    testQemuInfoClear(&info);
+
     DO_TEST("virtio-transitional",
             QEMU_CAPS_DEVICE_VIDEO_PRIMARY,
             QEMU_CAPS_DEVICE_PCIE_PCI_BRIDGE,
@@ -1312,6 +1634,18 @@ mymain(void)
             QEMU_CAPS_VIRTIO_INPUT_HOST,
             QEMU_CAPS_VIRTIO_SCSI);
 
+    if (testQemuInfoSetArgs(&info, capslatest,
+                            ARG_CAPS_ARCH, "x86_64",
+                            ARG_CAPS_VER, "latest",
+                            ARG_END) < 0 ||
+        qemuTestCapsCacheInsert(driver.qemuCapsCache, info.qemuCaps) < 0) {
+        VIR_TEST_DEBUG("Failed to generate copy test data");
+        return -1;
+    }
+    if (testXML2XMLCopyAll() < 0)
+        ret = -1;
+    testQemuInfoClear(&info);
+
     if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
         virFileDeleteTree(fakerootdir);
 
@@ -6,6 +6,7 @@
 #include "virbuffer.h"
 #include "viralloc.h"
 #include "virstring.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -374,6 +375,45 @@ testBufEscapeStr(const void *opaque ATTRIBUTE_UNUSED)
 }
 
 
+struct testBufEscapeFormatData {
+    const char *format;
+    const char *data;
+    const char *expect;
+};
+
+static int
+testBufEscapeFormat(const void *opaque)
+{
+    const struct testBufEscapeFormatData *data = opaque;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *actual;
+    int ret = -1;
+
+    virBufferAddLit(&buf, "<c>\n");
+    virBufferAdjustIndent(&buf, 2);
+    virBufferEscapeString(&buf, data->format, data->data);
+    virBufferAdjustIndent(&buf, -2);
+    virBufferAddLit(&buf, "</c>");
+
+    if (!(actual = virBufferContentAndReset(&buf))) {
+        VIR_TEST_DEBUG("testBufEscapeFormat: buf is empty");
+        goto cleanup;
+    }
+
+    if (STRNEQ_NULLABLE(actual, data->expect)) {
+        VIR_TEST_DEBUG("testBufEscapeFormat: Strings don't match:\n");
+        virTestDifference(stderr, data->expect, actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(actual);
+    return ret;
+}
+
+
 static int
 testBufEscapeRegex(const void *opaque)
 {
@@ -442,6 +482,74 @@ testBufferAutoclean(const void *opaque ATTRIBUTE_UNUSED)
 }
 
 
+#define TEST_FORMAT_ELEMENTS 1000
+
+/* Builds a document out of the kind of appends domain XML formatting
+ * does and checks its size.  The number of elements can be raised
+ * through VIR_TEST_BUFFER_FORMAT_ELEMENTS and the time taken is printed
+ * with VIR_TEST_DEBUG=1 to benchmark formatting. */
+static int
+testBufFormat(const void *opaque ATTRIBUTE_UNUSED)
+{
+    const char *env = getenv("VIR_TEST_BUFFER_FORMAT_ELEMENTS");
+    const char elem[] = "  <disk type='file' device='disk'>\n"
+                        "    <source file='/var/lib/images/a&amp;b.img'/>\n"
+                        "    <target dev='vda' bus='virtio'/>\n"
+                        "    <address type='pci' bus='0x00' slot='0x05'/>\n"
+                        "  </disk>\n";
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t nelems = TEST_FORMAT_ELEMENTS;
+    unsigned long long then;
+    unsigned long long now;
+    size_t i;
+    int ret = -1;
+
+    if (env && virStrToLong_ulp(env, NULL, 10, &nelems) < 0)
+        return -1;
+
+    if (virTimeMillisNow(&then) < 0)
+        return -1;
+
+    virBufferAddLit(&buf, "<devices>\n");
+    virBufferAdjustIndent(&buf, 2);
+    for (i = 0; i < nelems; i++) {
+        virBufferAsprintf(&buf, "<disk type='%s' device='%s'>\n",
+                          "file", "disk");
+        virBufferAdjustIndent(&buf, 2);
+        virBufferEscapeString(&buf, "<source file='%s'/>\n",
+                              "/var/lib/images/a&b.img");
+        virBufferEscapeString(&buf, "<target dev='%s'", "vda");
+        virBufferEscapeString(&buf, " bus='%s'/>\n", "virtio");
+        virBufferAsprintf(&buf, "<address type='pci' bus='0x%02x' "
+                          "slot='0x%02x'/>\n", 0, 5);
+        virBufferAdjustIndent(&buf, -2);
+        virBufferAddLit(&buf, "</disk>\n");
+    }
+    virBufferAdjustIndent(&buf, -2);
+    virBufferAddLit(&buf, "</devices>\n");
+
+    if (virTimeMillisNow(&now) < 0)
+        goto cleanup;
+
+    if (virBufferCheckError(&buf) < 0)
+        goto cleanup;
+
+    if (virBufferUse(&buf) != strlen("<devices>\n</devices>\n") +
+                              nelems * (sizeof(elem) - 1)) {
+        VIR_TEST_DEBUG("unexpected length %zu", virBufferUse(&buf));
+        goto cleanup;
+    }
+
+    VIR_TEST_DEBUG("%zu elements formatted in %llu ms", nelems, now - then);
+
+    ret = 0;
+
+ cleanup:
+    virBufferFreeAndReset(&buf);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -462,6 +570,7 @@ mymain(void)
     DO_TEST("AddBuffer", testBufAddBuffer, 0);
     DO_TEST("set indent", testBufSetIndent, 0);
     DO_TEST("autoclean", testBufferAutoclean, 0);
+    DO_TEST("format", testBufFormat, 0);
 
 #define DO_TEST_ADD_STR(DATA, EXPECT) \
     do { \
@@ -491,6 +600,20 @@ mymain(void)
     DO_TEST_ESCAPE("\x01\x01\x02\x03\x05\x08",
                    "<c>\n  <el></el>\n</c>");
 
+#define DO_TEST_ESCAPE_FORMAT(format, data, expect) \
+    do { \
+        struct testBufEscapeFormatData info = { format, data, expect }; \
+        if (virTestRun("Buf: EscapeFormat", testBufEscapeFormat, &info) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_ESCAPE_FORMAT("%s", "a<b\n", "<c>\n  a&lt;b\n</c>");
+    DO_TEST_ESCAPE_FORMAT("<a>%s</a>\n", "x\ny", "<c>\n  <a>x\ny</a>\n</c>");
+    DO_TEST_ESCAPE_FORMAT("<a b='%s'/>\n", "\x01", "<c>\n  <a b=''/>\n</c>");
+    DO_TEST_ESCAPE_FORMAT("<a>100%%%s</a>\n", "'",
+                          "<c>\n  <a>100%&apos;</a>\n</c>");
+    DO_TEST_ESCAPE_FORMAT("<a>%s%%</a>\n", "&", "<c>\n  <a>&amp;%</a>\n</c>");
+
 #define DO_TEST_ESCAPE_REGEX(data, expect) \
     do { \
         struct testBufAddStrData info = { data, expect }; \
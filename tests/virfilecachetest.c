@@ -23,6 +23,7 @@
 
 #include "virfile.h"
 #include "virfilecache.h"
+#include "virthread.h"
 
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -86,6 +87,15 @@ struct _testFileCachePriv {
     bool dataSaved;
     const char *newData;
     const char *expectData;
+
+    /* Creating data for @blockName waits until @release is set */
+    virMutex lock;
+    virCond cond;
+    const char *blockName;
+    bool blocked;
+    bool release;
+    size_t blockCalls;
+    unsigned long long blockThread;
 };
 typedef struct _testFileCachePriv testFileCachePriv;
 typedef testFileCachePriv *testFileCachePrivPtr;
@@ -103,11 +113,22 @@ testFileCacheIsValid(void *data,
 
 
 static void *
-testFileCacheNewData(const char *name ATTRIBUTE_UNUSED,
+testFileCacheNewData(const char *name,
                      void *priv)
 {
     testFileCachePrivPtr testPriv = priv;
 
+    virMutexLock(&testPriv->lock);
+    if (STREQ_NULLABLE(name, testPriv->blockName)) {
+        testPriv->blockCalls++;
+        testPriv->blockThread = virThreadSelfID();
+        testPriv->blocked = true;
+        virCondBroadcast(&testPriv->cond);
+        while (!testPriv->release)
+            ignore_value(virCondWait(&testPriv->cond, &testPriv->lock));
+    }
+    virMutexUnlock(&testPriv->lock);
+
     return testFileCacheObjNew(testPriv->newData);
 }
 
@@ -157,6 +178,7 @@ struct _testFileCacheData {
     const char *newData;
     const char *expectData;
     bool expectSave;
+    bool prefetch;
 };
 typedef struct _testFileCacheData testFileCacheData;
 typedef testFileCacheData *testFileCacheDataPtr;
@@ -169,11 +191,54 @@ testFileCache(const void *opaque)
     const testFileCacheData *data = opaque;
     testFileCacheObjPtr obj = NULL;
     testFileCachePrivPtr testPriv = virFileCacheGetPriv(data->cache);
+    virThread thread;
 
     testPriv->dataSaved = false;
     testPriv->newData = data->newData;
     testPriv->expectData = data->expectData;
 
+    if (data->prefetch) {
+        testFileCacheObjPtr other;
+
+        testPriv->blockName = data->name;
+        testPriv->blocked = false;
+        testPriv->release = false;
+        testPriv->blockCalls = 0;
+
+        if (virFileCachePrefetch(data->cache, data->name, &thread) < 0) {
+            fprintf(stderr, "Prefetching data failed.\n");
+            goto cleanup;
+        }
+
+        /* Wait for the thread to start creating the data */
+        virMutexLock(&testPriv->lock);
+        while (!testPriv->blocked)
+            ignore_value(virCondWait(&testPriv->cond, &testPriv->lock));
+        virMutexUnlock(&testPriv->lock);
+
+        /* Data of other names can be created meanwhile */
+        other = virFileCacheLookup(data->cache, "cachePrefetchOther");
+        virObjectUnref(other);
+
+        virMutexLock(&testPriv->lock);
+        testPriv->release = true;
+        virCondBroadcast(&testPriv->cond);
+        virMutexUnlock(&testPriv->lock);
+
+        virThreadJoin(&thread);
+
+        if (!other) {
+            fprintf(stderr, "Lookup blocked by prefetch failed.\n");
+            goto cleanup;
+        }
+
+        if (testPriv->blockCalls != 1 ||
+            testPriv->blockThread == virThreadSelfID()) {
+            fprintf(stderr, "Data was not created by the prefetch thread.\n");
+            goto cleanup;
+        }
+    }
+
     if (!(obj = virFileCacheLookup(data->cache, data->name))) {
         fprintf(stderr, "Getting cached data failed.\n");
         goto cleanup;
@@ -185,6 +250,11 @@ testFileCache(const void *opaque)
         goto cleanup;
     }
 
+    if (data->prefetch && testPriv->blockCalls != 1) {
+        fprintf(stderr, "Prefetched data was created again.\n");
+        goto cleanup;
+    }
+
     if (data->expectSave != testPriv->dataSaved) {
         fprintf(stderr, "Expect data to be saved '%s', data saved '%s'.\n",
                 data->expectSave ? "yes" : "no",
@@ -195,6 +265,7 @@ testFileCache(const void *opaque)
     ret = 0;
 
  cleanup:
+    testPriv->blockName = NULL;
     virObjectUnref(obj);
     return ret;
 }
@@ -207,28 +278,38 @@ mymain(void)
     testFileCachePriv testPriv = {0};
     virFileCachePtr cache = NULL;
 
+    if (virMutexInit(&testPriv.lock) < 0 ||
+        virCondInit(&testPriv.cond) < 0)
+        return EXIT_FAILURE;
+
     if (!(cache = virFileCacheNew(abs_srcdir "/virfilecachedata",
                                   "cache", &testFileCacheHandlers)))
         return EXIT_FAILURE;
 
     virFileCacheSetPriv(cache, &testPriv);
 
-#define TEST_RUN(name, newData, expectData, expectSave) \
+#define TEST_RUN_FULL(name, newData, expectData, expectSave, prefetch) \
     do { \
         testFileCacheData data = { \
-            cache, name, newData, expectData, expectSave \
+            cache, name, newData, expectData, expectSave, prefetch \
         }; \
         if (virTestRun(name, testFileCache, &data) < 0) \
             ret = -1; \
     } while (0)
 
+#define TEST_RUN(name, newData, expectData, expectSave) \
+    TEST_RUN_FULL(name, newData, expectData, expectSave, false)
+
     /* The cache file name is created using:
      * '$ echo -n $TEST_NAME | sha256sum' */
     TEST_RUN("cacheValid", NULL, "aaa\n", false);
     TEST_RUN("cacheInvalid", "bbb\n", "bbb\n", true);
     TEST_RUN("cacheMissing", "ccc\n", "ccc\n", true);
+    TEST_RUN_FULL("cachePrefetch", "ddd\n", "ddd\n", true, true);
 
     virObjectUnref(cache);
+    virCondDestroy(&testPriv.cond);
+    virMutexDestroy(&testPriv.lock);
 
     return ret != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -0,0 +1,432 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <unistd.h>
+
+#include "testutils.h"
+#include "virerror.h"
+#include "viralloc.h"
+#include "viratomic.h"
+#include "virevent.h"
+#include "virfile.h"
+#include "virstring.h"
+#include "virthread.h"
+#include "rpc/virnetserver.h"
+#include "locking/lock_manager.h"
+#include "lock_protocol.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define NDISKS 3
+
+/* What the fake virtlockd has seen so far. Requests are dispatched
+ * in the event loop thread, hence the atomics. */
+static int nclients;
+static int ncalls[VIR_LOCK_SPACE_PROTOCOL_PROC_RELEASE_RESOURCES + 1];
+static int nbatched; /* resources received in batched calls */
+static int batch; /* whether the batched procedures are known */
+
+static int quit;
+
+
+static void *
+testLockdClientNew(virNetServerClientPtr client ATTRIBUTE_UNUSED,
+                   void *opaque ATTRIBUTE_UNUSED)
+{
+    virAtomicIntInc(&nclients);
+    return &nclients;
+}
+
+
+static void
+testLockdClientFree(void *opaque ATTRIBUTE_UNUSED)
+{
+}
+
+
+static int
+testLockdDispatch(virNetServerPtr server ATTRIBUTE_UNUSED,
+                  virNetServerClientPtr client ATTRIBUTE_UNUSED,
+                  virNetMessagePtr msg,
+                  virNetMessageErrorPtr rerr ATTRIBUTE_UNUSED,
+                  void *args ATTRIBUTE_UNUSED,
+                  void *ret ATTRIBUTE_UNUSED)
+{
+    virAtomicIntInc(&ncalls[msg->header.proc]);
+    return 0;
+}
+
+
+static int
+testLockdDispatchBatch(virNetServerPtr server ATTRIBUTE_UNUSED,
+                       virNetServerClientPtr client ATTRIBUTE_UNUSED,
+                       virNetMessagePtr msg,
+                       virNetMessageErrorPtr rerr,
+                       void *args,
+                       void *ret ATTRIBUTE_UNUSED)
+{
+    unsigned int *nresources = args;
+
+    virAtomicIntInc(&ncalls[msg->header.proc]);
+
+    /* Reply the way virtlockd without the procedure does */
+    if (!virAtomicIntGet(&batch)) {
+        virReportError(VIR_ERR_RPC,
+                       _("unknown procedure: %d"),
+                       msg->header.proc);
+        virNetMessageSaveError(rerr);
+        return -1;
+    }
+
+    virAtomicIntAdd(&nbatched, *nresources);
+    return 0;
+}
+
+
+/* Both batched procedures start with the array of resources,
+ * its length is all the test needs */
+static bool_t
+testLockdDecodeBatch(XDR *xdrs, unsigned int *nresources)
+{
+    return xdr_u_int(xdrs, nresources);
+}
+
+
+#define TEST_PROC(proc, handler, filter, len) \
+    [VIR_LOCK_SPACE_PROTOCOL_PROC_ ## proc] = { \
+        .func = handler, \
+        .arg_len = len, \
+        .arg_filter = (xdrproc_t)filter, \
+        .ret_filter = (xdrproc_t)xdr_void, \
+    }
+
+static virNetServerProgramProc testLockdProcs[] = {
+    TEST_PROC(REGISTER, testLockdDispatch, xdr_void, 0),
+    TEST_PROC(RESTRICT, testLockdDispatch, xdr_void, 0),
+    TEST_PROC(ACQUIRE_RESOURCE, testLockdDispatch, xdr_void, 0),
+    TEST_PROC(RELEASE_RESOURCE, testLockdDispatch, xdr_void, 0),
+    TEST_PROC(ACQUIRE_RESOURCES, testLockdDispatchBatch,
+              testLockdDecodeBatch, sizeof(unsigned int)),
+    TEST_PROC(RELEASE_RESOURCES, testLockdDispatchBatch,
+              testLockdDecodeBatch, sizeof(unsigned int)),
+};
+
+
+static virNetServerPtr
+testLockdServerNew(const char *sockpath)
+{
+    virNetServerPtr srv = NULL;
+    virNetServerServicePtr svc = NULL;
+    virNetServerProgramPtr prog = NULL;
+
+    /* Without workers the requests are processed in the event loop
+     * thread, so they are accounted for once the reply arrives */
+    if (!(srv = virNetServerNew("virtlockd", 1, 0, 0, 0, 10, 10, -1, 0,
+                                NULL,
+                                testLockdClientNew,
+                                NULL,
+                                testLockdClientFree,
+                                NULL)))
+        goto error;
+
+    if (!(svc = virNetServerServiceNewUNIX(sockpath, 0700, 0, 0,
+                                           NULL, false, 5, 5)) ||
+        virNetServerAddService(srv, svc, NULL) < 0)
+        goto error;
+
+    if (!(prog = virNetServerProgramNew(VIR_LOCK_SPACE_PROTOCOL_PROGRAM,
+                                        VIR_LOCK_SPACE_PROTOCOL_PROGRAM_VERSION,
+                                        testLockdProcs,
+                                        ARRAY_CARDINALITY(testLockdProcs))) ||
+        virNetServerAddProgram(srv, prog) < 0)
+        goto error;
+
+    virNetServerUpdateServices(srv, true);
+
+    virObjectUnref(prog);
+    virObjectUnref(svc);
+    return srv;
+
+ error:
+    virObjectUnref(prog);
+    virObjectUnref(svc);
+    virNetServerClose(srv);
+    virObjectUnref(srv);
+    return NULL;
+}
+
+
+static virLockManagerPtr
+testLockdManagerNew(virLockManagerPluginPtr plugin)
+{
+    virLockManagerPtr lock;
+    virLockManagerParam params[] = {
+        { .type = VIR_LOCK_MANAGER_PARAM_TYPE_UUID,
+          .key = "uuid",
+          .value = { .uuid = "\x34\xc6\x5c\x1e\x96\x4e\x41\x2c"
+                             "\x8b\x5a\x4e\x22\x8d\xaa\x3b\x0f" },
+        },
+        { .type = VIR_LOCK_MANAGER_PARAM_TYPE_STRING,
+          .key = "name",
+          .value = { .str = "test" },
+        },
+        { .type = VIR_LOCK_MANAGER_PARAM_TYPE_UINT,
+          .key = "id",
+          .value = { .iv = 1 },
+        },
+        { .type = VIR_LOCK_MANAGER_PARAM_TYPE_UINT,
+          .key = "pid",
+          .value = { .iv = getpid() },
+        },
+    };
+    size_t i;
+
+    if (!(lock = virLockManagerNew(virLockManagerPluginGetDriver(plugin),
+                                   VIR_LOCK_MANAGER_OBJECT_TYPE_DOMAIN,
+                                   ARRAY_CARDINALITY(params),
+                                   params,
+                                   0)))
+        return NULL;
+
+    for (i = 0; i < NDISKS; i++) {
+        char *path = NULL;
+        int rc;
+
+        if (virAsprintf(&path, "/var/lib/libvirt/images/disk%zu.img", i) < 0) {
+            virLockManagerFree(lock);
+            return NULL;
+        }
+
+        rc = virLockManagerAddResource(lock,
+                                       VIR_LOCK_MANAGER_RESOURCE_TYPE_DISK,
+                                       path, 0, NULL, 0);
+        VIR_FREE(path);
+        if (rc < 0) {
+            virLockManagerFree(lock);
+            return NULL;
+        }
+    }
+
+    return lock;
+}
+
+
+struct testLockdData {
+    const char *dir;
+    bool batch; /* whether virtlockd knows the batched procedures */
+    unsigned int flags; /* for the acquire calls */
+    bool fd; /* whether to take over the connection on acquire */
+
+    /* expected outcome of two acquire and release rounds */
+    int nclients;
+    int nbatched;
+    int ncalls[VIR_LOCK_SPACE_PROTOCOL_PROC_RELEASE_RESOURCES + 1];
+};
+
+
+static int
+testLockd(const void *opaque)
+{
+    const struct testLockdData *data = opaque;
+    virNetServerPtr srv = NULL;
+    virLockManagerPluginPtr plugin = NULL;
+    virLockManagerPtr lock = NULL;
+    char *sockpath = NULL;
+    size_t i;
+    int ret = -1;
+
+    virAtomicIntSet(&nclients, 0);
+    virAtomicIntSet(&nbatched, 0);
+    for (i = 0; i < ARRAY_CARDINALITY(ncalls); i++)
+        virAtomicIntSet(&ncalls[i], 0);
+    virAtomicIntSet(&batch, data->batch);
+
+    if (virAsprintf(&sockpath, "%s/libvirt/virtlockd-sock", data->dir) < 0)
+        goto cleanup;
+
+    if (!(srv = testLockdServerNew(sockpath)))
+        goto cleanup;
+
+    /* There is no qemu-lockd.conf in there, so disks get direct
+     * leases and no lockspaces are set up */
+    if (!(plugin = virLockManagerPluginNew("lockd", "qemu", data->dir, 0)))
+        goto cleanup;
+
+    for (i = 0; i < 2; i++) {
+        int fd = -1;
+
+        if (!(lock = testLockdManagerNew(plugin)))
+            goto cleanup;
+
+        if (virLockManagerAcquire(lock, NULL, data->flags,
+                                  VIR_DOMAIN_LOCK_FAILURE_DEFAULT,
+                                  data->fd ? &fd : NULL) < 0)
+            goto cleanup;
+        VIR_FORCE_CLOSE(fd);
+
+        if (virLockManagerRelease(lock, NULL, 0) < 0)
+            goto cleanup;
+
+        virLockManagerFree(lock);
+        lock = NULL;
+    }
+
+    if (virAtomicIntGet(&nclients) != data->nclients) {
+        fprintf(stderr, "expected %d connections, got %d\n",
+                data->nclients, virAtomicIntGet(&nclients));
+        goto cleanup;
+    }
+
+    if (virAtomicIntGet(&nbatched) != data->nbatched) {
+        fprintf(stderr, "expected %d batched resources, got %d\n",
+                data->nbatched, virAtomicIntGet(&nbatched));
+        goto cleanup;
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(ncalls); i++) {
+        if (virAtomicIntGet(&ncalls[i]) != data->ncalls[i]) {
+            fprintf(stderr, "expected %d calls of procedure %zu, got %d\n",
+                    data->ncalls[i], i, virAtomicIntGet(&ncalls[i]));
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virLockManagerFree(lock);
+    if (plugin)
+        virLockManagerPluginUnref(plugin);
+    virNetServerClose(srv);
+    virObjectUnref(srv);
+    VIR_FREE(sockpath);
+    return ret;
+}
+
+
+static void
+testLockdEventLoop(void *opaque ATTRIBUTE_UNUSED)
+{
+    while (!virAtomicIntGet(&quit)) {
+        if (virEventRunDefaultImpl() < 0)
+            break;
+    }
+}
+
+
+static void
+testLockdQuit(int timer ATTRIBUTE_UNUSED,
+              void *opaque ATTRIBUTE_UNUSED)
+{
+    virAtomicIntSet(&quit, 1);
+}
+
+
+#define TEMPLATE abs_builddir "/virlockddata-XXXXXX"
+
+static int
+mymain(void)
+{
+    char dir[] = TEMPLATE;
+    char *rundir = NULL;
+    virThread thread;
+    int timer;
+    int ret = 0;
+
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "Cannot create temporary directory\n");
+        return EXIT_FAILURE;
+    }
+
+    /* The plugin finds the socket in the runtime directory and would
+     * spawn virtlockd from VIRTLOCKD_PATH if nothing listened there */
+    if (virAsprintf(&rundir, "%s/libvirt", dir) < 0 ||
+        virFileMakePath(rundir) < 0 ||
+        setenv("XDG_RUNTIME_DIR", dir, 1) < 0 ||
+        setenv("VIRTLOCKD_PATH", "/bin/false", 1) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    virEventRegisterDefaultImpl();
+    if (virThreadCreate(&thread, true, testLockdEventLoop, NULL) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+#define DO_TEST(name, ...) \
+    do { \
+        struct testLockdData data = { \
+            .dir = dir, __VA_ARGS__ \
+        }; \
+        if (virTestRun(name, testLockd, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+#define P(proc) VIR_LOCK_SPACE_PROTOCOL_PROC_ ## proc
+
+    /* One connection serves all calls, and each acquire and release
+     * is a single call however many disks there are */
+    DO_TEST("batched", .batch = true,
+            .nclients = 1, .nbatched = 4 * NDISKS,
+            .ncalls = { [P(REGISTER)] = 4,
+                        [P(ACQUIRE_RESOURCES)] = 2,
+                        [P(RELEASE_RESOURCES)] = 2 });
+
+    /* Connections handed over to the domain are never reused, the
+     * releases share one of their own */
+    DO_TEST("batched fd", .batch = true, .fd = true,
+            .nclients = 3, .nbatched = 4 * NDISKS,
+            .ncalls = { [P(REGISTER)] = 4,
+                        [P(ACQUIRE_RESOURCES)] = 2,
+                        [P(RELEASE_RESOURCES)] = 2 });
+
+    /* Neither are restricted ones */
+    DO_TEST("batched restrict", .batch = true,
+            .flags = VIR_LOCK_MANAGER_ACQUIRE_RESTRICT,
+            .nclients = 3, .nbatched = 4 * NDISKS,
+            .ncalls = { [P(REGISTER)] = 4,
+                        [P(RESTRICT)] = 2,
+                        [P(ACQUIRE_RESOURCES)] = 2,
+                        [P(RELEASE_RESOURCES)] = 2 });
+
+    /* After the first batched call fails, everything is done one
+     * resource at a time on the very same connection */
+    DO_TEST("fallback", .batch = false,
+            .nclients = 1, .nbatched = 0,
+            .ncalls = { [P(REGISTER)] = 4,
+                        [P(ACQUIRE_RESOURCE)] = 2 * NDISKS,
+                        [P(RELEASE_RESOURCE)] = 2 * NDISKS,
+                        [P(ACQUIRE_RESOURCES)] = 1 });
+
+#undef P
+
+    timer = virEventAddTimeout(0, testLockdQuit, NULL, NULL);
+    virThreadJoin(&thread);
+    if (timer >= 0)
+        virEventRemoveTimeout(timer);
+
+ cleanup:
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(dir);
+    VIR_FREE(rundir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN_PRELOAD(mymain, abs_builddir "/.libs/virlockdmock.so")
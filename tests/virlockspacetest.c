@@ -27,6 +27,9 @@
 #include "viralloc.h"
 #include "virfile.h"
 #include "virlog.h"
+#include "virstring.h"
+#include "virthread.h"
+#include "virtime.h"
 
 #include "virlockspace.h"
 
@@ -336,6 +339,138 @@ static int testLockSpaceResourceLockPath(const void *args ATTRIBUTE_UNUSED)
 }
 
 
+#define LOCKSPACE_STRESS_OWNERS 8
+#define LOCKSPACE_STRESS_RESOURCES 50
+
+struct testLockSpaceStressData {
+    virLockSpacePtr lockspace;
+    pid_t owner;
+    size_t nresources;
+    int ret;
+};
+
+
+static void
+testLockSpaceStressThread(void *opaque)
+{
+    struct testLockSpaceStressData *data = opaque;
+    size_t i;
+
+    for (i = 0; i < data->nresources; i++) {
+        char name[64];
+
+        snprintf(name, sizeof(name), "owner%lld-res%zu",
+                 (long long)data->owner, i);
+
+        if (virLockSpaceAcquireResource(data->lockspace, name, data->owner,
+                                        VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE) < 0)
+            return;
+    }
+
+    if (virLockSpaceAcquireResource(data->lockspace, "shared", data->owner,
+                                    VIR_LOCK_SPACE_ACQUIRE_SHARED |
+                                    VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE) < 0)
+        return;
+
+    data->ret = 0;
+}
+
+
+/* Several owners acquire their own resources plus one shared resource
+ * concurrently, then each owner goes away.  Releasing an owner must
+ * drop exactly what it held.  The number of resources per owner can be
+ * raised through VIR_TEST_LOCKSPACE_RESOURCES and the time taken is
+ * printed with VIR_TEST_DEBUG=1 to benchmark the lockspace. */
+static int testLockSpaceResourceOwners(const void *args ATTRIBUTE_UNUSED)
+{
+    const char *env = getenv("VIR_TEST_LOCKSPACE_RESOURCES");
+    struct testLockSpaceStressData data[LOCKSPACE_STRESS_OWNERS];
+    virThread threads[LOCKSPACE_STRESS_OWNERS];
+    size_t nresources = LOCKSPACE_STRESS_RESOURCES;
+    virLockSpacePtr lockspace;
+    unsigned long long then;
+    unsigned long long acquired;
+    unsigned long long now;
+    size_t nthreads = 0;
+    size_t i;
+    int ret = -1;
+
+    if (env && virStrToLong_ulp(env, NULL, 10, &nresources) < 0)
+        return -1;
+
+    rmdir(LOCKSPACE_DIR);
+
+    if (!(lockspace = virLockSpaceNew(LOCKSPACE_DIR)))
+        goto cleanup;
+
+    if (virTimeMillisNow(&then) < 0)
+        goto cleanup;
+
+    for (i = 0; i < LOCKSPACE_STRESS_OWNERS; i++) {
+        data[i].lockspace = lockspace;
+        data[i].owner = 1000 + i;
+        data[i].nresources = nresources;
+        data[i].ret = -1;
+
+        if (virThreadCreate(&threads[i], true,
+                            testLockSpaceStressThread, &data[i]) < 0)
+            goto join;
+        nthreads++;
+    }
+
+ join:
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    if (nthreads != LOCKSPACE_STRESS_OWNERS)
+        goto cleanup;
+
+    for (i = 0; i < LOCKSPACE_STRESS_OWNERS; i++) {
+        if (data[i].ret < 0)
+            goto cleanup;
+    }
+
+    if (virTimeMillisNow(&acquired) < 0)
+        goto cleanup;
+
+    /* Another owner must not get an exclusive lock on anything held */
+    if (virLockSpaceAcquireResource(lockspace, "owner1000-res0", 1,
+                                    VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE) == 0)
+        goto cleanup;
+
+    for (i = 0; i < LOCKSPACE_STRESS_OWNERS; i++) {
+        int rc = virLockSpaceReleaseResourcesForOwner(lockspace, data[i].owner);
+
+        if (rc != nresources + 1) {
+            VIR_TEST_DEBUG("owner %lld released %d resources, expected %zu",
+                           (long long)data[i].owner, rc, nresources + 1);
+            goto cleanup;
+        }
+    }
+
+    if (virTimeMillisNow(&now) < 0)
+        goto cleanup;
+
+    if (virLockSpaceReleaseResourcesForOwner(lockspace, data[0].owner) != 0)
+        goto cleanup;
+
+    /* Releasing the last owner of the auto-created files deletes them */
+    if (virFileExists(LOCKSPACE_DIR "/shared") ||
+        virFileExists(LOCKSPACE_DIR "/owner1000-res0"))
+        goto cleanup;
+
+    VIR_TEST_DEBUG("%d owners x %zu resources: acquire %llu ms, release %llu ms",
+                   LOCKSPACE_STRESS_OWNERS, nresources + 1,
+                   acquired - then, now - acquired);
+
+    ret = 0;
+
+ cleanup:
+    virLockSpaceFree(lockspace);
+    rmdir(LOCKSPACE_DIR);
+    return ret;
+}
+
 
 static int
 mymain(void)
@@ -365,6 +500,9 @@ mymain(void)
     if (virTestRun("Lockspace res full path", testLockSpaceResourceLockPath, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Lockspace res owners", testLockSpaceResourceOwners, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -0,0 +1,418 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virevent.h"
+#include "logging/log_handler.c"
+
+#define LOGFILE "guest.log"
+
+/* As long as the last refill is in the future no tokens are
+ * added, which makes the tests independent of the clock. */
+#define FROZEN_TIME ULLONG_MAX
+
+
+static void
+testLogHandlerInhibitor(bool inhibit ATTRIBUTE_UNUSED,
+                        void *opaque ATTRIBUTE_UNUSED)
+{
+}
+
+
+struct testRefillData {
+    size_t rate;
+    size_t burst;
+    unsigned long long tokens;
+    unsigned long long refill;
+    unsigned long long now;
+    unsigned long long expectTokens;
+    unsigned long long expectRefill;
+};
+
+static int
+testLogHandlerRefill(const void *opaque)
+{
+    const struct testRefillData *data = opaque;
+    virLogHandlerPtr handler;
+    virLogHandlerDomainLimit limit;
+    int ret = -1;
+
+    if (!(handler = virLogHandlerNew(false, 128 * 1024, 3, false,
+                                     data->rate, data->burst, false,
+                                     testLogHandlerInhibitor, NULL)))
+        return -1;
+
+    memset(&limit, 0, sizeof(limit));
+    limit.tokens = data->tokens;
+    limit.refill = data->refill;
+
+    virLogHandlerDomainLimitRefill(handler, &limit, data->now);
+
+    if (limit.tokens != data->expectTokens) {
+        fprintf(stderr, "Expected %llu tokens, got %llu\n",
+                data->expectTokens, limit.tokens);
+        goto cleanup;
+    }
+
+    if (limit.refill != data->expectRefill) {
+        fprintf(stderr, "Expected refill at %llu, got %llu\n",
+                data->expectRefill, limit.refill);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(handler);
+    return ret;
+}
+
+
+struct testThrottleData {
+    char *dir;
+    bool drop;
+};
+
+typedef struct _testLogHandlerCtxt testLogHandlerCtxt;
+struct _testLogHandlerCtxt {
+    virLogHandlerPtr handler;
+    virLogHandlerLogFilePtr file;
+    char *path;
+    int fd;
+};
+
+
+static void
+testLogHandlerCtxtFree(testLogHandlerCtxt *ctxt)
+{
+    VIR_FORCE_CLOSE(ctxt->fd);
+    virObjectUnref(ctxt->handler);
+    if (ctxt->path)
+        unlink(ctxt->path);
+    VIR_FREE(ctxt->path);
+}
+
+
+static int
+testLogHandlerCtxtInit(testLogHandlerCtxt *ctxt,
+                       const struct testThrottleData *data)
+{
+    unsigned char uuid[VIR_UUID_BUFLEN] = { 0 };
+    ino_t inode;
+    off_t offset;
+
+    memset(ctxt, 0, sizeof(*ctxt));
+    ctxt->fd = -1;
+
+    if (virAsprintf(&ctxt->path, "%s/%s", data->dir, LOGFILE) < 0)
+        return -1;
+
+    if (!(ctxt->handler = virLogHandlerNew(false, 128 * 1024, 3, false,
+                                           1000, 1000, data->drop,
+                                           testLogHandlerInhibitor, NULL)))
+        return -1;
+
+    if ((ctxt->fd = virLogHandlerDomainOpenLogFile(ctxt->handler, "qemu",
+                                                   uuid, "test",
+                                                   ctxt->path, true,
+                                                   &inode, &offset)) < 0)
+        return -1;
+
+    ctxt->file = virLogHandlerGetLogFileFromPath(ctxt->handler, ctxt->path);
+    if (!ctxt->file || !ctxt->file->limit) {
+        fprintf(stderr, "Log file is not rate limited\n");
+        return -1;
+    }
+
+    ctxt->file->limit->refill = FROZEN_TIME;
+    return 0;
+}
+
+
+static int
+testLogHandlerWrite(testLogHandlerCtxt *ctxt,
+                    char c,
+                    size_t len)
+{
+    char buf[4096];
+
+    if (len > sizeof(buf))
+        return -1;
+
+    memset(buf, c, len);
+    if (safewrite(ctxt->fd, buf, len) != len) {
+        fprintf(stderr, "Unable to write to log pipe\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+testLogHandlerEvent(testLogHandlerCtxt *ctxt)
+{
+    virLogHandlerDomainLogFileEvent(ctxt->file->watch, ctxt->file->pipefd,
+                                    VIR_EVENT_HANDLE_READABLE,
+                                    ctxt->handler);
+}
+
+
+static int
+testLogHandlerCheckStats(testLogHandlerCtxt *ctxt,
+                         unsigned long long bytes,
+                         unsigned long long dropped,
+                         unsigned long long throttled)
+{
+    virLogHandlerLogFileStats stats;
+
+    if (virLogHandlerDomainGetLogFileStats(ctxt->handler, ctxt->path,
+                                           0, &stats) < 0)
+        return -1;
+
+    if (stats.bytes != bytes ||
+        stats.dropped != dropped ||
+        stats.throttled != throttled) {
+        fprintf(stderr,
+                "Expected bytes=%llu dropped=%llu throttled=%llu, "
+                "got bytes=%llu dropped=%llu throttled=%llu\n",
+                bytes, dropped, throttled,
+                stats.bytes, stats.dropped, stats.throttled);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testLogHandlerCheckOffset(testLogHandlerCtxt *ctxt,
+                          off_t expect)
+{
+    ino_t inode;
+    off_t offset;
+
+    if (virLogHandlerDomainGetLogFilePosition(ctxt->handler, ctxt->path,
+                                              0, &inode, &offset) < 0)
+        return -1;
+
+    if (offset != expect) {
+        fprintf(stderr, "Expected log file offset %llu, got %llu\n",
+                (unsigned long long)expect, (unsigned long long)offset);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testLogHandlerThrottleDrop(const void *opaque)
+{
+    const struct testThrottleData *data = opaque;
+    testLogHandlerCtxt ctxt;
+    VIR_AUTOFREE(char *) content = NULL;
+    VIR_AUTOFREE(char *) expect = NULL;
+    int ret = -1;
+
+    if (testLogHandlerCtxtInit(&ctxt, data) < 0)
+        goto cleanup;
+
+    /* The whole burst is written, the rest is dropped */
+    if (testLogHandlerWrite(&ctxt, 'a', 3000) < 0)
+        goto cleanup;
+
+    testLogHandlerEvent(&ctxt);
+    if (testLogHandlerCheckStats(&ctxt, 1000, 0, 0) < 0)
+        goto cleanup;
+
+    testLogHandlerEvent(&ctxt);
+    if (testLogHandlerCheckStats(&ctxt, 1000, 2000, 0) < 0)
+        goto cleanup;
+
+    /* Once there are tokens again, a summary precedes new data */
+    ctxt.file->limit->tokens = 100;
+    if (testLogHandlerWrite(&ctxt, 'b', 10) < 0)
+        goto cleanup;
+
+    testLogHandlerEvent(&ctxt);
+    if (testLogHandlerCheckStats(&ctxt, 1010, 2000, 0) < 0)
+        goto cleanup;
+
+    if (ctxt.file->limit->dropped != 0 ||
+        ctxt.file->limit->tokens != 90) {
+        fprintf(stderr, "Unexpected state of token bucket\n");
+        goto cleanup;
+    }
+
+    if (virFileReadAll(ctxt.path, 10 * 1024, &content) < 0)
+        goto cleanup;
+
+    if (virAsprintf(&expect,
+                    "%1000s\nvirtlogd: 2000 bytes of output dropped "
+                    "due to rate limit\n%10s", "", "") < 0)
+        goto cleanup;
+    memset(expect, 'a', 1000);
+    memset(expect + strlen(expect) - 10, 'b', 10);
+
+    if (STRNEQ(content, expect)) {
+        virTestDifference(stderr, expect, content);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    testLogHandlerCtxtFree(&ctxt);
+    return ret;
+}
+
+
+static int
+testLogHandlerThrottlePause(const void *opaque)
+{
+    const struct testThrottleData *data = opaque;
+    testLogHandlerCtxt ctxt;
+    int ret = -1;
+
+    if (testLogHandlerCtxtInit(&ctxt, data) < 0)
+        goto cleanup;
+
+    if (testLogHandlerWrite(&ctxt, 'a', 3000) < 0)
+        goto cleanup;
+
+    testLogHandlerEvent(&ctxt);
+    if (testLogHandlerCheckStats(&ctxt, 1000, 0, 0) < 0)
+        goto cleanup;
+
+    /* Out of tokens, reading from the pipe is paused */
+    testLogHandlerEvent(&ctxt);
+    if (testLogHandlerCheckStats(&ctxt, 1000, 0, 1) < 0)
+        goto cleanup;
+
+    if (!ctxt.file->paused) {
+        fprintf(stderr, "Log file should be paused\n");
+        goto cleanup;
+    }
+
+    /* Neither further events nor draining may write anything */
+    testLogHandlerEvent(&ctxt);
+    if (testLogHandlerCheckOffset(&ctxt, 1000) < 0 ||
+        testLogHandlerCheckStats(&ctxt, 1000, 0, 1) < 0)
+        goto cleanup;
+
+    /* The timer resumes the file once tokens are available */
+    ctxt.file->limit->tokens = 1000;
+    virLogHandlerDomainLimitTimer(ctxt.file->limit->timer, ctxt.handler);
+    if (ctxt.file->paused) {
+        fprintf(stderr, "Log file should be resumed\n");
+        goto cleanup;
+    }
+
+    testLogHandlerEvent(&ctxt);
+    if (testLogHandlerCheckStats(&ctxt, 2000, 0, 1) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    testLogHandlerCtxtFree(&ctxt);
+    return ret;
+}
+
+
+static int
+testLogHandlerDrain(const void *opaque)
+{
+    const struct testThrottleData *data = opaque;
+    testLogHandlerCtxt ctxt;
+    int ret = -1;
+
+    if (testLogHandlerCtxtInit(&ctxt, data) < 0)
+        goto cleanup;
+
+    ctxt.file->limit->tokens = 500;
+    if (testLogHandlerWrite(&ctxt, 'a', 3000) < 0)
+        goto cleanup;
+
+    /* Draining on position query is subject to the limit too */
+    if (testLogHandlerCheckOffset(&ctxt, 500) < 0 ||
+        testLogHandlerCheckStats(&ctxt, 500, 0, 0) < 0)
+        goto cleanup;
+
+    if (ctxt.file->limit->tokens != 0) {
+        fprintf(stderr, "Drained data was not charged to the bucket\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    testLogHandlerCtxtFree(&ctxt);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    char dir[] = "virloghandlertest-XXXXXX";
+    struct testThrottleData data = { .dir = dir };
+
+    if (virEventRegisterDefaultImpl() < 0)
+        return EXIT_FAILURE;
+
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "Cannot create temporary directory\n");
+        return EXIT_FAILURE;
+    }
+
+#define DO_TEST_REFILL(name, rate, burst, tokens, refill, now, \
+                       expectTokens, expectRefill) \
+    do { \
+        struct testRefillData refillData = { \
+            rate, burst, tokens, refill, now, expectTokens, expectRefill \
+        }; \
+        if (virTestRun("Refill " name, testLogHandlerRefill, \
+                       &refillData) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_REFILL("half second", 1000, 4000, 0, 1000, 1500, 500, 1500);
+    DO_TEST_REFILL("no time passed", 1000, 4000, 10, 1000, 1000, 10, 1000);
+    DO_TEST_REFILL("clock going back", 1000, 4000, 10, 1000, 900, 10, 1000);
+    DO_TEST_REFILL("burst cap", 1000, 4000, 3900, 1000, 1500, 4000, 1500);
+    DO_TEST_REFILL("long idle", 1000, 4000, 100, 1000, 100000, 4000, 100000);
+    DO_TEST_REFILL("partial token", 1, 10, 0, 1000, 1500, 0, 1000);
+    DO_TEST_REFILL("whole token", 1, 10, 0, 1000, 2000, 1, 2000);
+
+    data.drop = true;
+    if (virTestRun("Throttle drop", testLogHandlerThrottleDrop, &data) < 0)
+        ret = -1;
+
+    data.drop = false;
+    if (virTestRun("Throttle pause", testLogHandlerThrottlePause, &data) < 0)
+        ret = -1;
+
+    if (virTestRun("Drain", testLogHandlerDrain, &data) < 0)
+        ret = -1;
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(dir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
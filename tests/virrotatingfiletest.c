@@ -22,6 +22,7 @@
 #include <fcntl.h>
 
 #include "virrotatingfile.h"
+#include "virfile.h"
 #include "virlog.h"
 #include "testutils.h"
 
@@ -247,6 +248,81 @@ static int testRotatingFileWriterAppend(const void *data ATTRIBUTE_UNUSED)
 }
 
 
+static int testRotatingFileWriterAppendFD(const void *data ATTRIBUTE_UNUSED)
+{
+    virRotatingFileWriterPtr file;
+    int ret = -1;
+    int pipefd[2] = { -1, -1 };
+    char buf[512];
+    ssize_t got;
+
+    if (testRotatingFileInitFiles(256,
+                                  (off_t)-1,
+                                  (off_t)-1) < 0)
+        return -1;
+
+    file = virRotatingFileWriterNew(FILENAME,
+                                    1024,
+                                    2,
+                                    false,
+                                    0700);
+    if (!file)
+        goto cleanup;
+
+    if (pipe(pipefd) < 0)
+        goto cleanup;
+
+    memset(buf, 0x5e, sizeof(buf));
+
+    if (safewrite(pipefd[1], buf, sizeof(buf)) != sizeof(buf))
+        goto cleanup;
+
+    got = virRotatingFileWriterAppendFD(file, pipefd[0], sizeof(buf));
+    if (got == -2) {
+        /* splice not usable here, emulate what callers do */
+        if (saferead(pipefd[0], buf, sizeof(buf)) != sizeof(buf))
+            goto cleanup;
+        got = virRotatingFileWriterAppend(file, buf, sizeof(buf));
+    }
+
+    if (got != sizeof(buf)) {
+        fprintf(stderr, "Expected %zu bytes written not %zd\n",
+                sizeof(buf), got);
+        goto cleanup;
+    }
+
+    if (testRotatingFileWriterAssertFileSizes(768,
+                                              (off_t)-1,
+                                              (off_t)-1) < 0)
+        goto cleanup;
+
+    /* Data which could trigger a rollover must not be spliced */
+    if (safewrite(pipefd[1], buf, sizeof(buf)) != sizeof(buf))
+        goto cleanup;
+
+    if ((got = virRotatingFileWriterAppendFD(file, pipefd[0],
+                                             sizeof(buf))) != -2) {
+        fprintf(stderr, "Expected splice to be refused, got %zd\n", got);
+        goto cleanup;
+    }
+
+    if (testRotatingFileWriterAssertFileSizes(768,
+                                              (off_t)-1,
+                                              (off_t)-1) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FORCE_CLOSE(pipefd[0]);
+    VIR_FORCE_CLOSE(pipefd[1]);
+    virRotatingFileWriterFree(file);
+    unlink(FILENAME);
+    unlink(FILENAME0);
+    unlink(FILENAME1);
+    return ret;
+}
+
+
 static int testRotatingFileWriterTruncate(const void *data ATTRIBUTE_UNUSED)
 {
     virRotatingFileWriterPtr file;
@@ -470,6 +546,94 @@ static int testRotatingFileWriterRolloverMany(const void *data ATTRIBUTE_UNUSED)
 }
 
 
+#ifdef WITH_ZLIB
+static int testRotatingFileWriterRolloverCompress(const void *data ATTRIBUTE_UNUSED)
+{
+    virRotatingFileWriterPtr file;
+    virRotatingFileReaderPtr reader = NULL;
+    int ret = -1;
+    char buf[512];
+    char rbuf[4096];
+    ino_t inode;
+    ssize_t got;
+    size_t i;
+
+    if (testRotatingFileInitFiles((off_t)-1,
+                                  (off_t)-1,
+                                  (off_t)-1) < 0)
+        return -1;
+
+    file = virRotatingFileWriterNew(FILENAME,
+                                    1024,
+                                    2,
+                                    false,
+                                    0700);
+    if (!file)
+        goto cleanup;
+
+    if (virRotatingFileWriterSetCompress(file, true) < 0)
+        goto cleanup;
+
+    inode = virRotatingFileWriterGetINode(file);
+
+    memset(buf, 0x5e, sizeof(buf));
+
+    for (i = 0; i < 5; i++)
+        virRotatingFileWriterAppend(file, buf, sizeof(buf));
+
+    virRotatingFileWriterFree(file);
+    file = NULL;
+
+    virRotatingFileWriterCompressWait();
+
+    if (testRotatingFileWriterAssertFileSizes(512,
+                                              (off_t)-1,
+                                              (off_t)-1) < 0)
+        goto cleanup;
+
+    if (access(FILENAME0 ".gz", F_OK) < 0 ||
+        access(FILENAME1 ".gz", F_OK) < 0) {
+        fprintf(stderr, "Compressed backups are missing\n");
+        goto cleanup;
+    }
+
+    if (!(reader = virRotatingFileReaderNew(FILENAME, 2)))
+        goto cleanup;
+
+    /* The oldest backup must still be found by its original inode */
+    if (virRotatingFileReaderSeek(reader, inode, 512) < 0)
+        goto cleanup;
+
+    if ((got = virRotatingFileReaderConsume(reader, rbuf, sizeof(rbuf))) < 0)
+        goto cleanup;
+
+    if (got != 2048) {
+        fprintf(stderr, "Expected 2048 bytes not %zd\n", got);
+        goto cleanup;
+    }
+
+    for (i = 0; i < got; i++) {
+        if (rbuf[i] != 0x5e) {
+            fprintf(stderr, "Unexpected byte 0x%x at %zu\n",
+                    rbuf[i] & 0xff, i);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    virRotatingFileReaderFree(reader);
+    virRotatingFileWriterFree(file);
+    unlink(FILENAME);
+    unlink(FILENAME0);
+    unlink(FILENAME1);
+    unlink(FILENAME0 ".gz");
+    unlink(FILENAME1 ".gz");
+    return ret;
+}
+#endif /* WITH_ZLIB */
+
+
 static int testRotatingFileWriterRolloverLineBreak(const void *data ATTRIBUTE_UNUSED)
 {
     virRotatingFileWriterPtr file;
@@ -702,6 +866,9 @@ mymain(void)
     if (virTestRun("Rotating file write append", testRotatingFileWriterAppend, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Rotating file write append from pipe", testRotatingFileWriterAppendFD, NULL) < 0)
+        ret = -1;
+
     if (virTestRun("Rotating file write truncate", testRotatingFileWriterTruncate, NULL) < 0)
         ret = -1;
 
@@ -717,6 +884,11 @@ mymain(void)
     if (virTestRun("Rotating file write rollover many", testRotatingFileWriterRolloverMany, NULL) < 0)
         ret = -1;
 
+#ifdef WITH_ZLIB
+    if (virTestRun("Rotating file write rollover compressed", testRotatingFileWriterRolloverCompress, NULL) < 0)
+        ret = -1;
+#endif
+
     if (virTestRun("Rotating file write rollover line break", testRotatingFileWriterRolloverLineBreak, NULL) < 0)
         ret = -1;
 
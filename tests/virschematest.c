@@ -162,6 +162,40 @@ testSchemaGrammar(const void *opaque)
 }
 
 
+/* Validating through the shared schema cache must keep reporting both
+ * valid and invalid documents correctly once the schema is cached. */
+static int
+testSchemaCached(const void *opaque ATTRIBUTE_UNUSED)
+{
+    const char *schema = abs_top_srcdir "/docs/schemas/domain.rng";
+    xmlDocPtr valid = NULL;
+    xmlDocPtr invalid = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (!(valid = virXMLParseFile(abs_srcdir "/qemuxml2argvdata/minimal.xml")) ||
+        !(invalid = virXMLParseString("<domain type='bogus'/>", NULL)))
+        goto cleanup;
+
+    for (i = 0; i < 3; i++) {
+        if (virXMLValidateAgainstSchema(schema, valid) < 0)
+            goto cleanup;
+
+        if (virXMLValidateAgainstSchema(schema, invalid) == 0) {
+            VIR_TEST_DEBUG("invalid document passed validation");
+            goto cleanup;
+        }
+        virResetLastError();
+    }
+
+    ret = 0;
+ cleanup:
+    xmlFreeDoc(valid);
+    xmlFreeDoc(invalid);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -239,6 +273,9 @@ mymain(void)
 
     DO_TEST_FILE("../news.rng", "../docs/news.xml");
 
+    if (virTestRun("cached schema validation", testSchemaCached, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -17,11 +17,14 @@
 #include <config.h>
 
 
+#include <fcntl.h>
+
 #include "testutils.h"
 #include "virerror.h"
 #include "virfile.h"
 #include "virlog.h"
 #include "virstring.h"
+#include "virtime.h"
 
 #include "storage/storage_util.h"
 
@@ -70,9 +73,366 @@ testGlusterExtractPoolSources(const void *opaque)
 }
 
 
+#define TEST_REFRESH_VOLS 64
+#define TEST_REFRESH_MIB (1024ULL * 1024ULL)
+
+/* Write a minimal qcow2 v2 header of @capacity, padded to @len bytes */
+static int
+testRefreshWriteQcow2(const char *path,
+                      unsigned long long capacity,
+                      size_t len)
+{
+    unsigned char hdr[1024] = { 'Q', 'F', 'I', 0xfb };
+    size_t i;
+    VIR_AUTOCLOSE fd = -1;
+
+    hdr[7] = 2;   /* version */
+    hdr[23] = 16; /* cluster_bits */
+    for (i = 0; i < 8; i++)
+        hdr[24 + i] = capacity >> (56 - 8 * i);
+
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0 ||
+        safewrite(fd, hdr, MIN(len, sizeof(hdr))) < 0) {
+        virReportSystemError(errno, "cannot write '%s'", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testRefreshCheckVol(virStoragePoolObjPtr obj,
+                    const char *name,
+                    unsigned long long capacity)
+{
+    virStorageVolDefPtr vol;
+
+    if (!(vol = virStorageVolDefFindByName(obj, name))) {
+        VIR_TEST_VERBOSE("\nvolume '%s' missing\n", name);
+        return -1;
+    }
+
+    if (vol->target.format != VIR_STORAGE_FILE_QCOW2 ||
+        vol->target.capacity != capacity) {
+        VIR_TEST_VERBOSE("\nvolume '%s': format %d capacity %llu, "
+                         "expected qcow2 capacity %llu\n",
+                         name, vol->target.format,
+                         vol->target.capacity, capacity);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testRefreshLocal(const void *opaque)
+{
+    const char *scratchdir = opaque;
+    const char *env = getenv("VIR_TEST_STORAGE_REFRESH_VOLS");
+    size_t nvols = TEST_REFRESH_VOLS;
+    virStoragePoolObjPtr obj = NULL;
+    virStoragePoolDefPtr def = NULL;
+    unsigned long long then;
+    unsigned long long now;
+    size_t i;
+    int ret = -1;
+    VIR_AUTOFREE(char *) dir = NULL;
+    VIR_AUTOFREE(char *) xml = NULL;
+    VIR_AUTOFREE(char *) path = NULL;
+
+    /* Allows benchmarking refresh with a large synthetic pool */
+    if (env && virStrToLong_ulp(env, NULL, 10, &nvols) < 0)
+        return -1;
+
+    if (virAsprintf(&dir, "%s/refresh", scratchdir) < 0 ||
+        virFileMakePath(dir) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nvols; i++) {
+        VIR_FREE(path);
+        if (virAsprintf(&path, "%s/vol%zu.qcow2", dir, i) < 0 ||
+            testRefreshWriteQcow2(path, (i + 1) * TEST_REFRESH_MIB, 512) < 0)
+            goto cleanup;
+    }
+
+    if (virAsprintf(&xml,
+                    "<pool type='dir'><name>refresh</name>"
+                    "<target><path>%s</path></target></pool>", dir) < 0 ||
+        !(def = virStoragePoolDefParseString(xml)) ||
+        !(obj = virStoragePoolObjNew()))
+        goto cleanup;
+    virStoragePoolObjSetDef(obj, def);
+    def = NULL;
+
+    if (virTimeMillisNow(&then) < 0 ||
+        virStorageBackendRefreshLocal(obj) < 0 ||
+        virTimeMillisNow(&now) < 0)
+        goto cleanup;
+
+    VIR_TEST_DEBUG("full refresh of %zu volumes: %llu ms", nvols, now - then);
+
+    if (virStoragePoolObjGetVolumesCount(obj) != nvols ||
+        testRefreshCheckVol(obj, "vol0.qcow2", TEST_REFRESH_MIB) < 0 ||
+        testRefreshCheckVol(obj, "vol1.qcow2", 2 * TEST_REFRESH_MIB) < 0)
+        goto cleanup;
+
+    /* Modify one image, remove another and add a new one */
+    VIR_FREE(path);
+    if (virAsprintf(&path, "%s/vol0.qcow2", dir) < 0 ||
+        testRefreshWriteQcow2(path, 42 * TEST_REFRESH_MIB, 1024) < 0)
+        goto cleanup;
+
+    VIR_FREE(path);
+    if (virAsprintf(&path, "%s/vol1.qcow2", dir) < 0)
+        goto cleanup;
+    if (unlink(path) < 0) {
+        virReportSystemError(errno, "cannot unlink '%s'", path);
+        goto cleanup;
+    }
+
+    VIR_FREE(path);
+    if (virAsprintf(&path, "%s/new.qcow2", dir) < 0 ||
+        testRefreshWriteQcow2(path, 7 * TEST_REFRESH_MIB, 512) < 0)
+        goto cleanup;
+
+    if (virTimeMillisNow(&then) < 0 ||
+        virStorageBackendRefreshLocal(obj) < 0 ||
+        virTimeMillisNow(&now) < 0)
+        goto cleanup;
+
+    VIR_TEST_DEBUG("incremental refresh of %zu volumes: %llu ms",
+                   nvols, now - then);
+
+    if (virStoragePoolObjGetVolumesCount(obj) != nvols ||
+        virStorageVolDefFindByName(obj, "vol1.qcow2") ||
+        testRefreshCheckVol(obj, "vol0.qcow2", 42 * TEST_REFRESH_MIB) < 0 ||
+        testRefreshCheckVol(obj, "new.qcow2", 7 * TEST_REFRESH_MIB) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virStoragePoolDefFree(def);
+    virStoragePoolObjEndAPI(&obj);
+    return ret;
+}
+
+
+static virStorageVolDefPtr
+testVolPathIndexNewVol(const char *name,
+                       const char *path)
+{
+    virStorageVolDefPtr vol = NULL;
+
+    if (VIR_ALLOC(vol) < 0 ||
+        VIR_STRDUP(vol->name, name) < 0 ||
+        VIR_STRDUP(vol->key, path) < 0 ||
+        VIR_STRDUP(vol->target.path, path) < 0) {
+        virStorageVolDefFree(vol);
+        return NULL;
+    }
+
+    return vol;
+}
+
+
+static int
+testVolPathIndexCheck(virStoragePoolObjListPtr pools,
+                      const char *path,
+                      const char *poolname,
+                      const char *volname)
+{
+    virStoragePoolObjPtr obj;
+    virStorageVolDefPtr voldef;
+    int ret = -1;
+
+    obj = virStoragePoolObjListFindByVolPath(pools, path, &voldef);
+
+    if (!poolname) {
+        if (obj) {
+            VIR_TEST_DEBUG("unexpectedly found '%s' in pool '%s'",
+                           path, virStoragePoolObjGetDef(obj)->name);
+            goto cleanup;
+        }
+    } else if (!obj ||
+               STRNEQ(virStoragePoolObjGetDef(obj)->name, poolname) ||
+               STRNEQ(voldef->name, volname)) {
+        VIR_TEST_DEBUG("expected to find '%s' as '%s' in pool '%s'",
+                       path, volname, poolname);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virStoragePoolObjEndAPI(&obj);
+    return ret;
+}
+
+
+static int
+testVolPathIndex(const void *opaque ATTRIBUTE_UNUSED)
+{
+    const char *poolxml[] = {
+        "<pool type='dir'><name>first</name>"
+        "<uuid>8cd3c8c8-3a31-4c5b-9a9b-5d4d2c5e0a01</uuid>"
+        "<target><path>/pool/first</path></target></pool>",
+        "<pool type='dir'><name>second</name>"
+        "<uuid>8cd3c8c8-3a31-4c5b-9a9b-5d4d2c5e0a02</uuid>"
+        "<target><path>/pool/second</path></target></pool>",
+    };
+    const char *dupxml =
+        "<pool type='dir'><name>dup</name>"
+        "<uuid>8cd3c8c8-3a31-4c5b-9a9b-5d4d2c5e0a03</uuid>"
+        "<target><path>/pool/second</path></target></pool>";
+    const char *volname[] = { "a.img", "b.img" };
+    const char *volpath[] = { "/pool/first/a.img", "/pool/second/b.img" };
+    virStoragePoolObjListPtr pools;
+    virStoragePoolObjPtr obj = NULL;
+    virStoragePoolDefPtr def = NULL;
+    virStorageVolDefPtr vol = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (!(pools = virStoragePoolObjListNew()))
+        return -1;
+
+    for (i = 0; i < ARRAY_CARDINALITY(poolxml); i++) {
+        if (!(def = virStoragePoolDefParseString(poolxml[i])) ||
+            !(obj = virStoragePoolObjAssignDef(pools, def, false)))
+            goto cleanup;
+        def = NULL;
+        virStoragePoolObjSetActive(obj, true);
+
+        if (!(vol = testVolPathIndexNewVol(volname[i], volpath[i])) ||
+            virStoragePoolObjAddVol(obj, vol) < 0)
+            goto cleanup;
+        vol = NULL;
+        virStoragePoolObjEndAPI(&obj);
+    }
+
+    if (testVolPathIndexCheck(pools, "/pool/first/a.img",
+                              "first", "a.img") < 0 ||
+        testVolPathIndexCheck(pools, "/pool/second/b.img",
+                              "second", "b.img") < 0 ||
+        testVolPathIndexCheck(pools, "/pool/first/b.img", NULL, NULL) < 0)
+        goto cleanup;
+
+    /* Volumes of inactive pools are not found */
+    if (!(obj = virStoragePoolObjFindByName(pools, "first")))
+        goto cleanup;
+    virStoragePoolObjSetActive(obj, false);
+    virStoragePoolObjEndAPI(&obj);
+
+    if (testVolPathIndexCheck(pools, "/pool/first/a.img", NULL, NULL) < 0)
+        goto cleanup;
+
+    /* Removed volumes are dropped from the index */
+    if (!(obj = virStoragePoolObjFindByName(pools, "second")) ||
+        !(vol = virStorageVolDefFindByName(obj, "b.img")))
+        goto cleanup;
+    virStoragePoolObjRemoveVol(obj, vol);
+    vol = NULL;
+    virStoragePoolObjEndAPI(&obj);
+
+    if (testVolPathIndexCheck(pools, "/pool/second/b.img", NULL, NULL) < 0)
+        goto cleanup;
+
+    /* As are the volumes of a pool refreshed from scratch */
+    if (!(obj = virStoragePoolObjFindByName(pools, "first")))
+        goto cleanup;
+    virStoragePoolObjSetActive(obj, true);
+    virStoragePoolObjClearVols(obj);
+    if (!(vol = testVolPathIndexNewVol("c.img", "/pool/first/c.img")) ||
+        virStoragePoolObjAddVol(obj, vol) < 0)
+        goto cleanup;
+    vol = NULL;
+    virStoragePoolObjEndAPI(&obj);
+
+    if (testVolPathIndexCheck(pools, "/pool/first/a.img", NULL, NULL) < 0 ||
+        testVolPathIndexCheck(pools, "/pool/first/c.img",
+                              "first", "c.img") < 0)
+        goto cleanup;
+
+    /* And the volumes of a pool removed from the list */
+    if (!(obj = virStoragePoolObjFindByName(pools, "first")))
+        goto cleanup;
+    virStoragePoolObjRemove(pools, obj);
+    virStoragePoolObjEndAPI(&obj);
+
+    if (testVolPathIndexCheck(pools, "/pool/first/c.img", NULL, NULL) < 0)
+        goto cleanup;
+
+    /* A path exposed by two pools stays findable through the other
+     * pool when one of them drops it */
+    if (!(def = virStoragePoolDefParseString(dupxml)) ||
+        !(obj = virStoragePoolObjAssignDef(pools, def, false)))
+        goto cleanup;
+    def = NULL;
+    virStoragePoolObjSetActive(obj, true);
+    if (!(vol = testVolPathIndexNewVol("d.img", "/pool/second/b.img")) ||
+        virStoragePoolObjAddVol(obj, vol) < 0)
+        goto cleanup;
+    vol = NULL;
+    virStoragePoolObjEndAPI(&obj);
+
+    if (!(obj = virStoragePoolObjFindByName(pools, "second")))
+        goto cleanup;
+    if (!(vol = testVolPathIndexNewVol("b.img", "/pool/second/b.img")) ||
+        virStoragePoolObjAddVol(obj, vol) < 0)
+        goto cleanup;
+    vol = NULL;
+    virStoragePoolObjEndAPI(&obj);
+
+    if (testVolPathIndexCheck(pools, "/pool/second/b.img",
+                              "dup", "d.img") < 0)
+        goto cleanup;
+
+    if (!(obj = virStoragePoolObjFindByName(pools, "dup")))
+        goto cleanup;
+    virStoragePoolObjClearVols(obj);
+    virStoragePoolObjEndAPI(&obj);
+
+    if (testVolPathIndexCheck(pools, "/pool/second/b.img",
+                              "second", "b.img") < 0)
+        goto cleanup;
+
+    if (!(obj = virStoragePoolObjFindByName(pools, "dup")))
+        goto cleanup;
+    if (!(vol = testVolPathIndexNewVol("d.img", "/pool/second/b.img")) ||
+        virStoragePoolObjAddVol(obj, vol) < 0)
+        goto cleanup;
+    vol = NULL;
+    virStoragePoolObjEndAPI(&obj);
+
+    if (!(obj = virStoragePoolObjFindByName(pools, "second")))
+        goto cleanup;
+    virStoragePoolObjRemove(pools, obj);
+    virStoragePoolObjEndAPI(&obj);
+
+    if (testVolPathIndexCheck(pools, "/pool/second/b.img",
+                              "dup", "d.img") < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virStorageVolDefFree(vol);
+    virStoragePoolDefFree(def);
+    virStoragePoolObjEndAPI(&obj);
+    virObjectUnref(pools);
+    return ret;
+}
+
+
+#define SCRATCHDIRTEMPLATE abs_builddir "/virstorageutildir-XXXXXX"
+
 static int
 mymain(void)
 {
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
     int ret = 0;
 
 #define DO_TEST_GLUSTER_EXTRACT_POOL_SOURCES_FULL(testname, sffx, pooltype) \
@@ -104,6 +464,20 @@ mymain(void)
 #undef DO_TEST_GLUSTER_EXTRACT_POOL_SOURCES_NETFS
 #undef DO_TEST_GLUSTER_EXTRACT_POOL_SOURCES_FULL
 
+    if (!mkdtemp(scratchdir)) {
+        virFilePrintf(stderr, "Cannot create virstorageutildir");
+        abort();
+    }
+
+    if (virTestRun("refresh-local", testRefreshLocal, scratchdir) < 0)
+        ret = -1;
+
+    if (virTestRun("vol-path-index", testVolPathIndex, NULL) < 0)
+        ret = -1;
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -24,6 +24,7 @@
 #include <virtypedparam.h>
 
 #include "testutils.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -200,6 +201,468 @@ testTypedParamsGetStringList(const void *opaque ATTRIBUTE_UNUSED)
     return rv;
 }
 
+static bool
+testTypedParamsEqual(virTypedParameterPtr a,
+                     virTypedParameterPtr b,
+                     int nparams)
+{
+    size_t i;
+
+    if (!virTypedParamsSameLayout(a, nparams, b, nparams))
+        return false;
+
+    for (i = 0; i < nparams; i++) {
+        if (a[i].type == VIR_TYPED_PARAM_STRING) {
+            if (STRNEQ_NULLABLE(a[i].value.s, b[i].value.s))
+                return false;
+        } else if (memcmp(&a[i].value, &b[i].value, sizeof(a[i].value))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static int
+testTypedParamsUnpackCopy(const char *buf,
+                          size_t len,
+                          virTypedParameterPtr layout,
+                          int nparams,
+                          virTypedParameterPtr base,
+                          virTypedParameterPtr *unpacked)
+{
+    size_t i;
+
+    if (VIR_ALLOC_N(*unpacked, nparams) < 0)
+        return -1;
+
+    for (i = 0; i < nparams; i++) {
+        ignore_value(virStrcpyStatic((*unpacked)[i].field, layout[i].field));
+        (*unpacked)[i].type = layout[i].type;
+    }
+
+    return virTypedParamsUnpack(buf, len, *unpacked, nparams,
+                                base, base ? nparams : 0);
+}
+
+
+static int
+testTypedParamsPack(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virTypedParameter base[] = {
+        { .field = "int", .type = VIR_TYPED_PARAM_INT, .value.i = -5 },
+        { .field = "uint", .type = VIR_TYPED_PARAM_UINT, .value.ui = 4000000000U },
+        { .field = "llong", .type = VIR_TYPED_PARAM_LLONG, .value.l = 1LL << 40 },
+        { .field = "ullong", .type = VIR_TYPED_PARAM_ULLONG, .value.ul = ULLONG_MAX },
+        { .field = "double", .type = VIR_TYPED_PARAM_DOUBLE, .value.d = 3.25 },
+        { .field = "bool", .type = VIR_TYPED_PARAM_BOOLEAN, .value.b = 1 },
+        { .field = "string", .type = VIR_TYPED_PARAM_STRING, .value.s = (char *) "vda" },
+    };
+    virTypedParameter next[] = {
+        { .field = "int", .type = VIR_TYPED_PARAM_INT, .value.i = 7 },
+        { .field = "uint", .type = VIR_TYPED_PARAM_UINT, .value.ui = 3 },
+        { .field = "llong", .type = VIR_TYPED_PARAM_LLONG, .value.l = -(1LL << 40) },
+        { .field = "ullong", .type = VIR_TYPED_PARAM_ULLONG, .value.ul = 1 },
+        { .field = "double", .type = VIR_TYPED_PARAM_DOUBLE, .value.d = -0.5 },
+        { .field = "bool", .type = VIR_TYPED_PARAM_BOOLEAN, .value.b = 0 },
+        { .field = "string", .type = VIR_TYPED_PARAM_STRING, .value.s = (char *) "" },
+    };
+    int nparams = ARRAY_CARDINALITY(base);
+    virTypedParameterPtr unpacked = NULL;
+    char *buf = NULL;
+    size_t len;
+    int rv = -1;
+
+    /* plain packing */
+    if (virTypedParamsPack(base, nparams, NULL, 0, &buf, &len) < 0 ||
+        testTypedParamsUnpackCopy(buf, len, base, nparams, NULL, &unpacked) < 0)
+        goto cleanup;
+
+    if (!testTypedParamsEqual(base, unpacked, nparams)) {
+        VIR_TEST_VERBOSE("\nplain unpacked values differ\n");
+        goto cleanup;
+    }
+
+    virTypedParamsFree(unpacked, nparams);
+    unpacked = NULL;
+    VIR_FREE(buf);
+
+    /* delta packing, including wraparound and negative differences */
+    if (virTypedParamsPack(next, nparams, base, nparams, &buf, &len) < 0 ||
+        testTypedParamsUnpackCopy(buf, len, next, nparams, base, &unpacked) < 0)
+        goto cleanup;
+
+    if (!testTypedParamsEqual(next, unpacked, nparams)) {
+        VIR_TEST_VERBOSE("\ndelta unpacked values differ\n");
+        goto cleanup;
+    }
+
+    virTypedParamsFree(unpacked, nparams);
+    unpacked = NULL;
+    VIR_FREE(buf);
+
+    /* unchanged values take a single byte each, strings are kept whole */
+    if (virTypedParamsPack(base, nparams, base, nparams, &buf, &len) < 0)
+        goto cleanup;
+
+    if (len != nparams + strlen("vda")) {
+        VIR_TEST_VERBOSE("\nunexpected length %zu of unchanged values\n", len);
+        goto cleanup;
+    }
+
+    /* truncated data must be refused */
+    if (testTypedParamsUnpackCopy(buf, len - 1, base, nparams,
+                                  base, &unpacked) == 0) {
+        VIR_TEST_VERBOSE("\ntruncated values were accepted\n");
+        goto cleanup;
+    }
+
+    rv = 0;
+
+ cleanup:
+    virTypedParamsFree(unpacked, nparams);
+    VIR_FREE(buf);
+    return rv;
+}
+
+
+/*
+ * Two bulk stats calls sent with the same baseline can have their
+ * replies processed in either order by the client. The first one
+ * handled by the server is delta encoded against the shared
+ * baseline, the second one is a full sample. Handling the full
+ * sample first replaces the baseline held by the client, so the
+ * delta reply must only ever be decoded against the baseline the
+ * server echoes back.
+ */
+static int
+testTypedParamsPackInterleaved(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virTypedParameter sample1[] = {
+        { .field = "rd.bytes", .type = VIR_TYPED_PARAM_ULLONG, .value.ul = 1000 },
+        { .field = "wr.bytes", .type = VIR_TYPED_PARAM_ULLONG, .value.ul = 2000 },
+    };
+    virTypedParameter sample2[] = {
+        { .field = "rd.bytes", .type = VIR_TYPED_PARAM_ULLONG, .value.ul = 1100 },
+        { .field = "wr.bytes", .type = VIR_TYPED_PARAM_ULLONG, .value.ul = 2200 },
+    };
+    virTypedParameter sample3[] = {
+        { .field = "rd.bytes", .type = VIR_TYPED_PARAM_ULLONG, .value.ul = 1300 },
+        { .field = "wr.bytes", .type = VIR_TYPED_PARAM_ULLONG, .value.ul = 2600 },
+    };
+    int nparams = ARRAY_CARDINALITY(sample1);
+    virTypedParameterPtr held = sample1;
+    unsigned long long heldSample = 1;
+    unsigned long long replyBaseline;
+    virTypedParameterPtr unpacked = NULL;
+    char *delta = NULL;
+    char *full = NULL;
+    size_t deltalen;
+    size_t fulllen;
+    int rv = -1;
+
+    /* Both calls are sent with baseline 1. The server answers the
+     * first one relative to it and the second one in full, since
+     * its own baseline has already moved on to sample 2. */
+    if (virTypedParamsPack(sample2, nparams, sample1, nparams,
+                           &delta, &deltalen) < 0 ||
+        virTypedParamsPack(sample3, nparams, NULL, 0,
+                           &full, &fulllen) < 0)
+        goto cleanup;
+    replyBaseline = 1;
+
+    /* The full sample is processed first and becomes the baseline */
+    if (testTypedParamsUnpackCopy(full, fulllen, sample3, nparams,
+                                  NULL, &unpacked) < 0)
+        goto cleanup;
+
+    if (!testTypedParamsEqual(sample3, unpacked, nparams)) {
+        VIR_TEST_VERBOSE("\nfull sample differs\n");
+        goto cleanup;
+    }
+    virTypedParamsFree(unpacked, nparams);
+    unpacked = NULL;
+    held = sample3;
+    heldSample = 3;
+
+    /* Decoding the delta against what the client now holds is
+     * silently wrong, which is why the baseline is echoed */
+    if (testTypedParamsUnpackCopy(delta, deltalen, sample2, nparams,
+                                  held, &unpacked) < 0)
+        goto cleanup;
+
+    if (testTypedParamsEqual(sample2, unpacked, nparams)) {
+        VIR_TEST_VERBOSE("\ndelta decoded against the wrong baseline\n");
+        goto cleanup;
+    }
+    virTypedParamsFree(unpacked, nparams);
+    unpacked = NULL;
+
+    if (replyBaseline == heldSample) {
+        VIR_TEST_VERBOSE("\nreplaced baseline was not detected\n");
+        goto cleanup;
+    }
+
+    /* Against the baseline it was encoded from it is correct */
+    if (testTypedParamsUnpackCopy(delta, deltalen, sample2, nparams,
+                                  sample1, &unpacked) < 0)
+        goto cleanup;
+
+    if (!testTypedParamsEqual(sample2, unpacked, nparams)) {
+        VIR_TEST_VERBOSE("\ndelta sample differs\n");
+        goto cleanup;
+    }
+
+    rv = 0;
+
+ cleanup:
+    virTypedParamsFree(unpacked, nparams);
+    VIR_FREE(delta);
+    VIR_FREE(full);
+    return rv;
+}
+
+
+#define TEST_PACK_DOMAINS 500
+#define TEST_PACK_ROUNDS 10
+
+/* Fill in a sample of bulk stats resembling what the qemu driver
+ * reports for a domain with 4 vCPUs, 2 interfaces and 4 disks */
+static int
+testTypedParamsPackSample(size_t dom,
+                          unsigned long long tick,
+                          virTypedParameterPtr *params,
+                          int *nparams)
+{
+    static const char *netfields[] = {
+        "rx.bytes", "rx.pkts", "rx.errs", "rx.drop",
+        "tx.bytes", "tx.pkts", "tx.errs", "tx.drop",
+    };
+    static const char *blockfields[] = {
+        "rd.reqs", "rd.bytes", "rd.times", "wr.reqs", "wr.bytes",
+        "wr.times", "fl.reqs", "fl.times", "allocation", "capacity",
+        "physical",
+    };
+    int maxparams = 0;
+    char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+    char value[64];
+    unsigned long long base = dom * 1000000ULL;
+    size_t i;
+    size_t j;
+
+    *params = NULL;
+    *nparams = 0;
+
+#define ADD_ULLONG(val) \
+    if (virTypedParamsAddULLong(params, nparams, &maxparams, field, val) < 0) \
+        return -1
+
+    if (virTypedParamsAddInt(params, nparams, &maxparams, "state.state", 1) < 0 ||
+        virTypedParamsAddInt(params, nparams, &maxparams, "state.reason", 1) < 0 ||
+        virTypedParamsAddULLong(params, nparams, &maxparams, "cpu.time",
+                                base + tick * 997) < 0 ||
+        virTypedParamsAddULLong(params, nparams, &maxparams, "cpu.user",
+                                base + tick * 311) < 0 ||
+        virTypedParamsAddULLong(params, nparams, &maxparams, "cpu.system",
+                                base + tick * 113) < 0 ||
+        virTypedParamsAddULLong(params, nparams, &maxparams, "balloon.current",
+                                4194304) < 0 ||
+        virTypedParamsAddULLong(params, nparams, &maxparams, "balloon.maximum",
+                                4194304) < 0 ||
+        virTypedParamsAddUInt(params, nparams, &maxparams, "vcpu.current", 4) < 0 ||
+        virTypedParamsAddUInt(params, nparams, &maxparams, "vcpu.maximum", 4) < 0)
+        return -1;
+
+    for (i = 0; i < 4; i++) {
+        snprintf(field, sizeof(field), "vcpu.%zu.state", i);
+        if (virTypedParamsAddInt(params, nparams, &maxparams, field, 1) < 0)
+            return -1;
+        snprintf(field, sizeof(field), "vcpu.%zu.time", i);
+        ADD_ULLONG(base + tick * (i + 211));
+        snprintf(field, sizeof(field), "vcpu.%zu.wait", i);
+        ADD_ULLONG(tick * i);
+    }
+
+    if (virTypedParamsAddUInt(params, nparams, &maxparams, "net.count", 2) < 0)
+        return -1;
+    for (i = 0; i < 2; i++) {
+        snprintf(field, sizeof(field), "net.%zu.name", i);
+        snprintf(value, sizeof(value), "vnet%zu", dom * 2 + i);
+        if (virTypedParamsAddString(params, nparams, &maxparams,
+                                    field, value) < 0)
+            return -1;
+        for (j = 0; j < ARRAY_CARDINALITY(netfields); j++) {
+            snprintf(field, sizeof(field), "net.%zu.%s", i, netfields[j]);
+            ADD_ULLONG(base + tick * (j * 31 + i));
+        }
+    }
+
+    if (virTypedParamsAddUInt(params, nparams, &maxparams, "block.count", 4) < 0)
+        return -1;
+    for (i = 0; i < 4; i++) {
+        snprintf(field, sizeof(field), "block.%zu.name", i);
+        snprintf(value, sizeof(value), "vd%c", (char) ('a' + i));
+        if (virTypedParamsAddString(params, nparams, &maxparams,
+                                    field, value) < 0)
+            return -1;
+        snprintf(field, sizeof(field), "block.%zu.path", i);
+        snprintf(value, sizeof(value),
+                 "/var/lib/libvirt/images/dom%zu-disk%zu.qcow2", dom, i);
+        if (virTypedParamsAddString(params, nparams, &maxparams,
+                                    field, value) < 0)
+            return -1;
+        for (j = 0; j < ARRAY_CARDINALITY(blockfields); j++) {
+            snprintf(field, sizeof(field), "block.%zu.%s", i, blockfields[j]);
+            ADD_ULLONG(base + tick * (j * 17 + i));
+        }
+    }
+
+#undef ADD_ULLONG
+
+    return 0;
+}
+
+
+/* Bytes a string takes in XDR encoding */
+#define TEST_XDR_STRING(str) (4 + VIR_ROUND_UP(strlen(str), 4))
+
+static size_t
+testTypedParamsLegacySize(virTypedParameterPtr params,
+                          int nparams)
+{
+    size_t size = 4;
+    size_t i;
+
+    for (i = 0; i < nparams; i++) {
+        size += TEST_XDR_STRING(params[i].field) + 4;
+        switch ((virTypedParameterType) params[i].type) {
+        case VIR_TYPED_PARAM_INT:
+        case VIR_TYPED_PARAM_UINT:
+        case VIR_TYPED_PARAM_BOOLEAN:
+            size += 4;
+            break;
+        case VIR_TYPED_PARAM_LLONG:
+        case VIR_TYPED_PARAM_ULLONG:
+        case VIR_TYPED_PARAM_DOUBLE:
+            size += 8;
+            break;
+        case VIR_TYPED_PARAM_STRING:
+            size += TEST_XDR_STRING(params[i].value.s);
+            break;
+        case VIR_TYPED_PARAM_LAST:
+            break;
+        }
+    }
+
+    return size;
+}
+
+
+/*
+ * Compares the size and encoding cost of bulk stats of a large host
+ * sent as typed parameters and in packed form. The numbers are only
+ * printed with VIR_TEST_DEBUG=1, the test itself just checks that the
+ * packed form is considerably smaller.
+ */
+static int
+testTypedParamsPackBench(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virTypedParameterPtr prev[TEST_PACK_DOMAINS] = { NULL };
+    virTypedParameterPtr cur[TEST_PACK_DOMAINS] = { NULL };
+    int nparams[TEST_PACK_DOMAINS] = { 0 };
+    size_t legacy = 0;
+    size_t packed = 0;
+    size_t delta = 0;
+    unsigned long long start;
+    unsigned long long legacyMs;
+    unsigned long long packedMs;
+    size_t i;
+    size_t round;
+    int rv = -1;
+
+    for (i = 0; i < TEST_PACK_DOMAINS; i++) {
+        if (testTypedParamsPackSample(i, 1000, &prev[i], &nparams[i]) < 0 ||
+            testTypedParamsPackSample(i, 1002, &cur[i], &nparams[i]) < 0)
+            goto cleanup;
+    }
+
+    /* All domains share one layout, so the dictionary is sent once */
+    packed = 4 + 4 * nparams[0];
+    for (i = 0; i < nparams[0]; i++)
+        packed += TEST_XDR_STRING(cur[0][i].field) + 4;
+    delta = packed;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+    for (round = 0; round < TEST_PACK_ROUNDS; round++) {
+        for (i = 0; i < TEST_PACK_DOMAINS; i++) {
+            virTypedParameterRemotePtr remote = NULL;
+            unsigned int nremote = 0;
+
+            if (virTypedParamsSerialize(cur[i], nparams[i], &remote, &nremote,
+                                        VIR_TYPED_PARAM_STRING_OKAY) < 0)
+                goto cleanup;
+            virTypedParamsRemoteFree(remote, nremote);
+            if (round == 0)
+                legacy += testTypedParamsLegacySize(cur[i], nparams[i]);
+        }
+    }
+    if (virTimeMillisNow(&legacyMs) < 0)
+        goto cleanup;
+    legacyMs -= start;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+    for (round = 0; round < TEST_PACK_ROUNDS; round++) {
+        for (i = 0; i < TEST_PACK_DOMAINS; i++) {
+            char *buf = NULL;
+            size_t len;
+
+            if (virTypedParamsPack(cur[i], nparams[i], prev[i], nparams[i],
+                                   &buf, &len) < 0)
+                goto cleanup;
+            VIR_FREE(buf);
+            if (round == 0)
+                delta += 12 + VIR_ROUND_UP(len, 4);
+
+            if (round == 0) {
+                if (virTypedParamsPack(cur[i], nparams[i], NULL, 0,
+                                       &buf, &len) < 0)
+                    goto cleanup;
+                VIR_FREE(buf);
+                packed += 12 + VIR_ROUND_UP(len, 4);
+            }
+        }
+    }
+    if (virTimeMillisNow(&packedMs) < 0)
+        goto cleanup;
+    packedMs -= start;
+
+    VIR_TEST_DEBUG("\n%d domains x %d params: typed params %zu bytes "
+                   "(%llu ms for %d samples), packed %zu bytes, "
+                   "packed delta %zu bytes (%llu ms for %d samples)",
+                   TEST_PACK_DOMAINS, nparams[0], legacy,
+                   legacyMs, TEST_PACK_ROUNDS, packed, delta,
+                   packedMs, TEST_PACK_ROUNDS);
+
+    if (packed * 2 > legacy || delta >= packed) {
+        VIR_TEST_VERBOSE("\npacked encoding is not smaller: %zu/%zu/%zu\n",
+                         legacy, packed, delta);
+        goto cleanup;
+    }
+
+    rv = 0;
+
+ cleanup:
+    for (i = 0; i < TEST_PACK_DOMAINS; i++) {
+        virTypedParamsFree(prev[i], nparams[i]);
+        virTypedParamsFree(cur[i], nparams[i]);
+    }
+    return rv;
+}
+
+
 static int
 testTypedParamsValidator(void)
 {
@@ -301,6 +764,15 @@ mymain(void)
     if (virTestRun("Add string list", testTypedParamsAddStringList, NULL) < 0)
         rv = -1;
 
+    if (virTestRun("Pack", testTypedParamsPack, NULL) < 0)
+        rv = -1;
+
+    if (virTestRun("Pack interleaved", testTypedParamsPackInterleaved, NULL) < 0)
+        rv = -1;
+
+    if (virTestRun("Pack benchmark", testTypedParamsPackBench, NULL) < 0)
+        rv = -1;
+
     if (rv < 0)
         return EXIT_FAILURE;
     return EXIT_SUCCESS;
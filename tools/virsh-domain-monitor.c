@@ -2127,6 +2127,10 @@ static const vshCmdOptDef opts_domstats[] = {
      .type = VSH_OT_BOOL,
      .help = N_("report only stats that are accessible instantly"),
     },
+    {.name = "chunk",
+     .type = VSH_OT_INT,
+     .help = N_("gather stats of at most this many domains at once"),
+    },
     VIRSH_COMMON_OPT_DOMAIN_OT_ARGV(N_("list of domains to get stats for"), 0),
     {.name = NULL}
 };
@@ -2156,6 +2160,29 @@ virshDomainStatsPrintRecord(vshControl *ctl ATTRIBUTE_UNUSED,
     return true;
 }
 
+struct virshDomainStatsPrintData {
+    vshControl *ctl;
+    bool raw;
+    bool first;
+};
+
+static int
+virshDomainStatsPrintChunked(virConnectPtr conn ATTRIBUTE_UNUSED,
+                             virDomainStatsRecordPtr record,
+                             void *opaque)
+{
+    struct virshDomainStatsPrintData *data = opaque;
+
+    if (!data->first)
+        vshPrint(data->ctl, "\n");
+    data->first = false;
+
+    if (!virshDomainStatsPrintRecord(data->ctl, record, data->raw))
+        return -1;
+
+    return 0;
+}
+
 static bool
 cmdDomstats(vshControl *ctl, const vshCmd *cmd)
 {
@@ -2168,9 +2195,16 @@ cmdDomstats(vshControl *ctl, const vshCmd *cmd)
     bool raw = vshCommandOptBool(cmd, "raw");
     int flags = 0;
     const vshCmdOpt *opt = NULL;
+    unsigned int chunk = 0;
+    int rv;
     bool ret = false;
     virshControlPtr priv = ctl->privData;
 
+    VSH_EXCLUSIVE_OPTIONS("chunk", "domain");
+
+    if ((rv = vshCommandOptUInt(ctl, cmd, "chunk", &chunk)) < 0)
+        return false;
+
     if (vshCommandOptBool(cmd, "state"))
         stats |= VIR_DOMAIN_STATS_STATE;
 
@@ -2248,6 +2282,16 @@ cmdDomstats(vshControl *ctl, const vshCmd *cmd)
                                   &records,
                                   flags) < 0)
             goto cleanup;
+    } else if (rv > 0) {
+        struct virshDomainStatsPrintData data = { ctl, raw, true };
+
+        if (virConnectGetAllDomainStatsChunked(priv->conn, stats, chunk,
+                                               virshDomainStatsPrintChunked,
+                                               &data, flags) < 0)
+            goto cleanup;
+
+        ret = true;
+        goto cleanup;
     } else {
        if ((virConnectGetAllDomainStats(priv->conn,
                                         stats,
@@ -214,6 +214,93 @@ cmdAttachDevice(vshControl *ctl, const vshCmd *cmd)
     return ret;
 }
 
+/*
+ * "attach-devices" command
+ */
+static const vshCmdInfo info_attach_devices[] = {
+    {.name = "help",
+     .data = N_("attach several devices from XML files")
+    },
+    {.name = "desc",
+     .data = N_("Attach the devices from one or more XML <file>s at once.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_attach_devices[] = {
+    VIRSH_COMMON_OPT_DOMAIN_FULL(0),
+    VIRSH_COMMON_OPT_DOMAIN_PERSISTENT,
+    VIRSH_COMMON_OPT_DOMAIN_CONFIG,
+    VIRSH_COMMON_OPT_DOMAIN_LIVE,
+    VIRSH_COMMON_OPT_DOMAIN_CURRENT,
+    {.name = "file",
+     .type = VSH_OT_ARGV,
+     .flags = VSH_OFLAG_REQ,
+     .help = N_("XML files")
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdAttachDevices(vshControl *ctl, const vshCmd *cmd)
+{
+    virDomainPtr dom;
+    const vshCmdOpt *opt = NULL;
+    char **buffers = NULL;
+    size_t nbuffers = 0;
+    bool ret = false;
+    unsigned int flags = VIR_DOMAIN_AFFECT_CURRENT;
+    bool current = vshCommandOptBool(cmd, "current");
+    bool config = vshCommandOptBool(cmd, "config");
+    bool live = vshCommandOptBool(cmd, "live");
+    bool persistent = vshCommandOptBool(cmd, "persistent");
+
+    VSH_EXCLUSIVE_OPTIONS_VAR(persistent, current);
+
+    VSH_EXCLUSIVE_OPTIONS_VAR(current, live);
+    VSH_EXCLUSIVE_OPTIONS_VAR(current, config);
+
+    if (config || persistent)
+        flags |= VIR_DOMAIN_AFFECT_CONFIG;
+    if (live)
+        flags |= VIR_DOMAIN_AFFECT_LIVE;
+
+    if (!(dom = virshCommandOptDomain(ctl, cmd, NULL)))
+        return false;
+
+    if (persistent &&
+        virDomainIsActive(dom) == 1)
+        flags |= VIR_DOMAIN_AFFECT_LIVE;
+
+    while ((opt = vshCommandOptArgv(ctl, cmd, opt))) {
+        char *buffer;
+
+        if (virFileReadAll(opt->data, VSH_MAX_XML_FILE, &buffer) < 0) {
+            vshReportError(ctl);
+            goto cleanup;
+        }
+
+        if (VIR_APPEND_ELEMENT(buffers, nbuffers, buffer) < 0) {
+            VIR_FREE(buffer);
+            goto cleanup;
+        }
+    }
+
+    if (virDomainAttachDevices(dom, (const char **)buffers, nbuffers,
+                               flags) < 0) {
+        vshError(ctl, "%s", _("Failed to attach devices"));
+        goto cleanup;
+    }
+
+    vshPrintExtra(ctl, "%s", _("Devices attached successfully\n"));
+    ret = true;
+
+ cleanup:
+    virStringListFreeCount(buffers, nbuffers);
+    virshDomainFree(dom);
+    return ret;
+}
+
 /*
  * "attach-disk" command
  */
@@ -14032,6 +14119,12 @@ const vshCmdDef domManagementCmds[] = {
      .info = info_attach_device,
      .flags = 0
     },
+    {.name = "attach-devices",
+     .handler = cmdAttachDevices,
+     .opts = opts_attach_devices,
+     .info = info_attach_devices,
+     .flags = 0
+    },
     {.name = "attach-disk",
      .handler = cmdAttachDisk,
      .opts = opts_attach_disk,
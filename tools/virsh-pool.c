@@ -738,6 +738,10 @@ static const vshCmdInfo info_pool_refresh[] = {
 static const vshCmdOptDef opts_pool_refresh[] = {
     VIRSH_COMMON_OPT_POOL_FULL(VIR_CONNECT_LIST_STORAGE_POOLS_ACTIVE),
 
+    {.name = "full",
+     .type = VSH_OT_BOOL,
+     .help = N_("re-probe all volumes instead of only changed ones")
+    },
     {.name = NULL}
 };
 
@@ -747,11 +751,15 @@ cmdPoolRefresh(vshControl *ctl, const vshCmd *cmd)
     virStoragePoolPtr pool;
     bool ret = true;
     const char *name;
+    unsigned int flags = 0;
+
+    if (vshCommandOptBool(cmd, "full"))
+        flags |= VIR_STORAGE_POOL_REFRESH_FULL;
 
     if (!(pool = virshCommandOptPool(ctl, cmd, "pool", &name)))
         return false;
 
-    if (virStoragePoolRefresh(pool, 0) == 0) {
+    if (virStoragePoolRefresh(pool, flags) == 0) {
         vshPrintExtra(ctl, _("Pool %s refreshed\n"), name);
     } else {
         vshError(ctl, _("Failed to refresh pool %s"), name);